@@ -67,11 +67,84 @@ SURVIVE_IMPORT extern survive_timecode SurviveSensorActivations_default_toleranc
 // DANGER: This structure may be redefined.  Note that it is logically split into 64-bit chunks
 // for optimization on 32- and 64-bit systems.
 
+typedef enum SurviveLatencyStage {
+	SURVIVE_LATENCY_USB = 0,		   // Driver handling of a received packet
+	SURVIVE_LATENCY_LIGHTCAP_DECODE, // Decoding lightcap elements out of a packet
+	SURVIVE_LATENCY_DISAMBIGUATE,	   // Disambiguating one lightcap element
+	SURVIVE_LATENCY_ANGLE,		   // Converting a light event into an angle
+	SURVIVE_LATENCY_POSER,		   // Running the poser on one angle or imu event
+	SURVIVE_LATENCY_POSE_DELIVERY,   // Handing a solved pose to the pose callback
+	SURVIVE_LATENCY_STAGE_COUNT
+} SurviveLatencyStage;
+
+#define SURVIVE_LATENCY_BUCKETS 32
+
+typedef struct SurviveLatencyHistogram {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	// Bucket i counts samples in [2^i, 2^(i+1)) nanoseconds; bucket 0 also takes 0 and the last takes everything
+	// longer.
+	uint64_t buckets[SURVIVE_LATENCY_BUCKETS];
+} SurviveLatencyHistogram;
+
+// Running totals kept for every object. Each field only ever increases; rates come from differencing two snapshots
+// taken with survive_object_counters, which copies everything after 'time' as 64 bit words, so new fields have to be
+// 64 bits wide too.
+typedef struct SurviveObjectCounters {
+	double time; // OGGetAbsoluteTime() when the snapshot was taken
+
+	uint64_t packets;				// Packets received from the device, or lines replayed for it
+	uint64_t lightcaps;				// Lightcap elements handed to the disambiguator
+	uint64_t invalid_lightcaps;		// Light data dropped as malformed or out of range
+	uint64_t disambiguator_resets;  // Times the disambiguator lost its state and had to find it again
+	uint64_t angles;				// Angle measurements handed to the poser
+	uint64_t angles_rejected;		// Angles dropped by 'visibility-filter' as coming from a sensor facing away
+	uint64_t imu;					// IMU samples
+	uint64_t poses;					// Poses reported
+	uint64_t buttons;				// Button and axis events queued for delivery
+	uint64_t buttons_dropped;		// Button and axis events lost because the button queue was full
+	uint64_t connections;			// Times the device was attached, including the first
+	uint64_t disconnections;		// Times the device was unplugged
+
+	// From the posers built on poser_general_optimizer
+	uint64_t solver_runs;
+	uint64_t solver_failures; // Solves rejected for exceeding 'max-error'
+	uint64_t solver_seed_runs;
+	uint64_t solver_measurement_failures; // Solves skipped for lack of measurements
+	uint64_t solver_iterations;			  // Optimizer iterations, summed over all of MPFIT's solves
+	double solver_error_total;			  // Sum of the error of all solves
+
+	// From 'epnp-ransac'
+	uint64_t epnp_inliers;
+	uint64_t epnp_outliers; // Measurements left out of a solve for disagreeing with the consensus pose
+
+	// From 'shed-lag'
+	uint64_t shed_starts; // Times the object fell far enough behind to start shedding load
+	uint64_t shed_solves; // Light solves skipped while shedding
+	uint64_t shed_imu;	// IMU samples kept from the poser while shedding
+} SurviveObjectCounters;
+
+// How far an object's events trail its own clock, and what is being dropped to catch up; see 'shed-lag'
+typedef struct SurviveLoadShedding {
+	bool started;
+	survive_timecode last_timecode;
+	double data_time;  // Seconds of device time since the first event
+	double min_offset; // Smallest wall clock minus data time seen, allowed to creep up to follow clock drift
+	double lag;		   // Seconds the latest event trails the fastest one seen
+
+	bool shedding;
+	bool noncritical;  // Matched by 'shed-objects'; skips every solve while shedding
+	double last_solve; // data_time of the last light solve let through while shedding
+	uint32_t imu_seen;
+} SurviveLoadShedding;
+
 struct SurviveObject {
 	SurviveContext *ctx;
 
 	char codename[4];   // 3 letters, null-terminated.  Currently HMD, WM0, WM1.
 	char drivername[8]; // 8 letters for driver.  Currently "HTC"
+	char serial_number[32]; // From the device's config, if it has one
 	void *driver;
 	int32_t buttonmask;
 	int16_t axis1;
@@ -92,6 +165,10 @@ struct SurviveObject {
 	SurvivePose FromLHPose[NUM_LIGHTHOUSES]; // Filled out by poser, contains computed position from each lighthouse.
 	void *PoserData; // Initialized to zero, configured by poser, can be anything the poser wants.
 	PoserCB PoserFn;
+	// Set by survive_object_set_poser; installed by the thread that feeds the poser before its next event. The flag is
+	// a word rather than a bool so that every platform can swap it atomically.
+	PoserCB RequestedPoserFn;
+	uint32_t poser_change_pending;
 
 	// Device-specific information about the location of the sensors.  This data will be used by the poser.
 	// These are stored in the IMU's coordinate frame so that posers don't have to do a ton of manipulation
@@ -134,6 +211,13 @@ struct SurviveObject {
 	haptic_func haptic;
 
 	SurviveSensorActivations activations;
+
+	SurviveObjectCounters counters;
+	SurviveLoadShedding shed;
+
+	// SURVIVE_LATENCY_STAGE_COUNT histograms when 'latency-stats' is set, otherwise 0
+	SurviveLatencyHistogram *latency;
+
 	void *user_ptr;
 	// Debug
 	int tsl;
@@ -148,6 +232,66 @@ SURVIVE_EXPORT const bool survive_object_charging(SurviveObject *so);
 
 SURVIVE_EXPORT const SurvivePose *survive_object_pose(SurviveObject *so);
 
+/**
+ * Switches the object to another poser, such as "MPFIT" or "PoserMPFIT", while it is running. Safe to call from any
+ * thread: the switch happens on the thread that feeds the poser, just before its next event, where the old poser gets
+ * POSERDATA_DISASSOCIATE to free its data and the new one sets itself up on its first event.
+ *
+ * @return -1 if there is no such poser.
+ */
+SURVIVE_EXPORT int survive_object_set_poser(SurviveObject *so, const char *poser);
+
+/**
+ * Takes a snapshot of the object's counters. Safe to call from any thread: each field is loaded atomically, so none
+ * is torn, but they aren't taken at the same instant and may be off from each other by the events processed while the
+ * copy is made.
+ */
+SURVIVE_EXPORT void survive_object_counters(const SurviveObject *so, SurviveObjectCounters *counters);
+
+/**
+ * Feeds one event's device timecode, handled at wall clock time 'now', to the object's 'shed-lag' estimate and starts
+ * or stops shedding load. The default light and IMU handlers call this for every event.
+ */
+SURVIVE_EXPORT void survive_object_update_lag(SurviveObject *so, survive_timecode timecode, double now);
+
+/**
+ * Copies out the latency histogram of one processing stage for the given object. Stages nest -- USB handling includes
+ * decoding, which includes disambiguation and so on down to pose delivery -- so each is the time from entering that
+ * stage until it returns. The copy is taken without locking and may be slightly torn if the object is being updated.
+ *
+ * @return false if latency stats are not enabled ('--latency-stats').
+ */
+SURVIVE_EXPORT bool survive_object_latency(const SurviveObject *so, SurviveLatencyStage stage,
+										   SurviveLatencyHistogram *histogram);
+SURVIVE_EXPORT const char *survive_latency_stage_name(SurviveLatencyStage stage);
+
+/**
+ * Estimates the given percentile (0..1) of a histogram, in nanoseconds, as the upper edge of the bucket it falls in.
+ */
+SURVIVE_EXPORT uint64_t survive_latency_percentile(const SurviveLatencyHistogram *histogram, double percentile);
+
+/**
+ * Applies the '<name>-thread-cpus' and '<name>-thread-priority' config to a thread. libsurvive does this for its own
+ * "usb", "button" and "poll" threads. 'thread' must be the og_thread_t that OGCreateThread returned; for any other
+ * thread, such as one the application created some other way, call survive_thread_configure_current from the thread
+ * itself. Failures are logged and leave the thread as it was.
+ *
+ * @return 0, or the negated errno of the last setting that could not be applied.
+ */
+SURVIVE_EXPORT int survive_thread_configure(SurviveContext *ctx, void *thread, const char *name);
+
+/**
+ * survive_thread_configure for the calling thread.
+ */
+SURVIVE_EXPORT int survive_thread_configure_current(SurviveContext *ctx, const char *name);
+
+/**
+ * Parses a CPU list like "0,2-3" into cpus[0..cpu_ct).
+ *
+ * @return the number of CPUs selected, or -1 if the list is malformed or names a CPU past cpu_ct.
+ */
+SURVIVE_EXPORT int survive_parse_cpu_list(const char *list, bool *cpus, int cpu_ct);
+
 SURVIVE_EXPORT int8_t survive_object_sensor_ct(SurviveObject *so);
 SURVIVE_EXPORT const FLT *survive_object_sensor_locations(SurviveObject *so);
 SURVIVE_EXPORT const FLT *survive_object_sensor_normals(SurviveObject *so);
@@ -178,14 +322,14 @@ struct BaseStationData {
 
 struct config_group;
 
-#define BUTTON_QUEUE_MAX_LEN 32
+#define BUTTON_QUEUE_DEFAULT_LEN 256
 
 // note: buttonId and axisId are 1-indexed values.
 // a value of 0 for an id means that no data is present in that value
 // additionally, when x and y values are both present in axis data,
 // axis1 will be x, axis2 will be y.
 typedef struct {
-	uint8_t isPopulated; // probably can remove this given the semaphore in the parent struct.   helps with debugging
+	uint32_t sequence; // Owned by the queue; tells producers and the consumer whose turn the slot is
 	uint8_t eventType;
 	uint8_t buttonId;
 	uint8_t axis1Id;
@@ -195,11 +339,15 @@ typedef struct {
 	SurviveObject *so;
 } ButtonQueueEntry;
 
+// Bounded lock-free queue of button events. Any number of threads may push; events are delivered in the order their
+// slots were claimed. When it is full new events are dropped and counted rather than blocking the USB thread.
 typedef struct {
-	uint8_t nextReadIndex;  // init to 0
-	uint8_t nextWriteIndex; // init to 0
-	void *buttonservicesem;
-	ButtonQueueEntry entry[BUTTON_QUEUE_MAX_LEN];
+	uint32_t capacity; // Always a power of two
+	uint32_t nextWriteIndex;
+	uint32_t nextReadIndex;
+	void *buttonservicesem; // Posted once per queued event, if set
+	uint64_t dropped;		// Events lost because the queue was full
+	ButtonQueueEntry *entry;
 } ButtonQueue;
 
 typedef enum { SURVIVE_STOPPED = 0, SURVIVE_RUNNING, SURVIVE_CLOSING, SURVIVE_STATE_MAX } SurviveState;
@@ -233,9 +381,11 @@ struct SurviveContext {
 	// Calibration data:
 	int activeLighthouses;
 	BaseStationData bsd[NUM_LIGHTHOUSES];
+	struct SurviveCalibrationTable *calibration_tables[NUM_LIGHTHOUSES]; // Iff 'calibration-table' is set
 	SurviveCalData *calptr;				 // If and only if the calibration subsystem is attached.
 	void *disambiguator_data;			 // global disambiguator data
 	struct SurviveRecordingData *recptr; // Iff recording is attached
+	struct SurviveTraceData *traceptr;	 // Iff '--trace' is set
 	SurviveObject **objs;
 	int objs_ct;
 
@@ -247,6 +397,29 @@ struct SurviveContext {
 
 	SurviveState state;
 
+	// When set, timing comes only from recorded timecodes and no background threads are used, so that replaying the
+	// same input gives bit-identical output.
+	bool deterministic;
+	uint64_t rng_state; // State for survive_rand; seeded from 'random-seed'
+
+	// Read once from 'visibility-filter' and 'visibility-filter-margin' since they're checked for every angle
+	bool visibility_filter;
+	FLT visibility_filter_margin;
+
+	// Read once from the 'epnp-ransac*' options. EPNP mostly runs as a seed poser, on objects whose PoserData belongs
+	// to another poser, so it has nowhere of its own to keep them.
+	bool epnp_ransac;
+	int epnp_ransac_iterations;
+	FLT epnp_ransac_threshold;
+
+	// Read once from the 'shed-*' options. data_time_factor points at the wall clock seconds per second of device time
+	// that the input is paced at, which drivers that replay at a different rate point at their own, possibly attached,
+	// setting; 0 means it isn't paced at all.
+	FLT shed_lag;
+	FLT shed_solve_period;
+	int shed_imu_divisor;
+	const FLT *data_time_factor;
+
 	void *buttonservicethread;
 	ButtonQueue buttonQueue;
 
@@ -297,6 +470,38 @@ SURVIVE_EXPORT void survive_close(SurviveContext *ctx);
 
 SURVIVE_EXPORT SurviveObject *survive_get_so_by_name(SurviveContext *ctx, const char *name);
 
+#define SURVIVE_RAND_MAX 0xFFFFFFFFu
+
+/**
+ * Returns a pseudo-random number in [0, SURVIVE_RAND_MAX] and advances the given state. Use these instead of rand()
+ * so that results don't depend on what else in the process consumed random numbers.
+ */
+SURVIVE_EXPORT uint32_t survive_rand_r(uint64_t *state);
+
+/**
+ * Same as survive_rand_r, using the state held in the context. Not thread safe; call it from the poll thread.
+ */
+SURVIVE_EXPORT uint32_t survive_rand(SurviveContext *ctx);
+
+/**
+ * Sets up a button queue with room for at least 'capacity' events. survive_startup does this for the context's queue,
+ * sized by 'button-queue-size'.
+ */
+SURVIVE_EXPORT void survive_button_queue_init(ButtonQueue *queue, uint32_t capacity);
+SURVIVE_EXPORT void survive_button_queue_free(ButtonQueue *queue);
+
+/**
+ * Queues a copy of the event; safe to call from any number of threads at once. Returns false, and counts the event in
+ * queue->dropped and its object's counters, if the queue is full.
+ */
+SURVIVE_EXPORT bool survive_button_queue_push(ButtonQueue *queue, const ButtonQueueEntry *entry);
+
+/**
+ * Takes the oldest event off the queue. Returns false if there is none ready -- which includes the moment between a
+ * producer claiming a slot and filling it in, so a false return is never a reason to stop reading.
+ */
+SURVIVE_EXPORT bool survive_button_queue_pop(ButtonQueue *queue, ButtonQueueEntry *entry);
+
 // Utilitiy functions.
 SURVIVE_EXPORT int survive_simple_inflate(SurviveContext *ctx, const uint8_t *input, int inlen, uint8_t *output, int outlen);
 SURVIVE_EXPORT int survive_send_magic(SurviveContext *ctx, int magic_code, void *data, int datalen);
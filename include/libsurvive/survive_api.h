@@ -21,9 +21,21 @@ SURVIVE_EXPORT void survive_simple_close(SurviveSimpleContext *actx);
 
 /**
  * Start the background thread which processes various inputs and produces deliverable data like position.
+ *
+ * With the 'deterministic' option set no thread is started; survive_simple_get_next_updated does the processing on
+ * the calling thread instead.
  */
 SURVIVE_EXPORT void survive_simple_start_thread(SurviveSimpleContext *actx);
 
+/**
+ * Stops the background thread and waits for it to exit, waking up any survive_simple_wait_for_update call so that it
+ * returns 0 once the remaining updates are taken. Call it once, from any thread; survive_simple_close won't stop the
+ * thread again.
+ *
+ * @return the error the thread's loop exited with, if any
+ */
+SURVIVE_EXPORT int survive_simple_stop_thread(SurviveSimpleContext *actx);
+
 /**
  * @return true iff the background thread is still running
  */
@@ -47,6 +59,12 @@ SURVIVE_EXPORT const SurviveSimpleObject *survive_simple_get_next_object(Survive
  */
 SURVIVE_EXPORT const SurviveSimpleObject *survive_simple_get_next_updated(SurviveSimpleContext *actx);
 
+/**
+ * Blocks until some object has been updated since we last looked at it, and returns it. Returns 0 once the background
+ * thread has stopped and no updates are left. This is the sleeping counterpart to survive_simple_get_next_updated.
+ */
+SURVIVE_EXPORT const SurviveSimpleObject *survive_simple_wait_for_update(SurviveSimpleContext *actx);
+
 /**
  * Gets the pose of a given object
  */
@@ -58,6 +76,12 @@ SURVIVE_EXPORT survive_timecode survive_simple_object_get_latest_pose(const Surv
  */
 SURVIVE_EXPORT const char *survive_simple_object_name(const SurviveSimpleObject *sao);
 
+/**
+ * Gets the tick rate of the timecodes returned for this object, or 0 if its poses carry no device time (lighthouses
+ * and external objects).
+ */
+SURVIVE_EXPORT uint32_t survive_simple_object_timebase_hz(const SurviveSimpleObject *sao);
+
 #ifdef __cplusplus
 }
 #endif
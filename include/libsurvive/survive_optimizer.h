@@ -14,6 +14,15 @@ typedef struct {
 	int object;
 } survive_optimizer_measurement;
 
+// Robust losses down-weight measurements whose residual is large compared to the loss scale, so that a few bad ones
+// don't pull the whole solution
+typedef enum {
+	survive_optimizer_loss_none,
+	survive_optimizer_loss_huber,
+	survive_optimizer_loss_cauchy,
+	survive_optimizer_loss_tukey,
+} survive_optimizer_loss;
+
 struct mp_par_struct;
 struct mp_result_struct;
 
@@ -24,6 +33,11 @@ typedef struct {
 	FLT current_bias;
 	SurvivePose initialPose;
 
+	survive_optimizer_loss loss;
+	// Residual, divided by the measurement's variance like all of the residuals, at which the loss starts to discount
+	// a measurement
+	FLT loss_scale;
+
 	double *parameters;
 	struct mp_par_struct *parameters_info;
 
@@ -60,7 +74,15 @@ SURVIVE_EXPORT void survive_optimizer_setup_pose(survive_optimizer *mpfit_ctx, c
 								  int use_jacobian_function);
 SURVIVE_EXPORT void survive_optimizer_setup_cameras(survive_optimizer *mpfit_ctx, SurviveContext *ctx, bool isFixed);
 
+// Parses 'none', 'huber', 'cauchy' or 'tukey'; anything else is 'none'
+SURVIVE_EXPORT survive_optimizer_loss survive_optimizer_loss_from_name(const char *name);
+// Maps residual r to one whose square is twice the loss at r, and gives how much its jacobian row has to be scaled
+SURVIVE_EXPORT FLT survive_optimizer_loss_residual(survive_optimizer_loss loss, FLT scale, FLT r, FLT *jacobian_scale);
+
 SURVIVE_EXPORT int survive_optimizer_run(survive_optimizer *optimizer, struct mp_result_struct *result);
+// Sum of the squared residuals at the current parameters, leaving out the robust loss. After a run without a loss this
+// is mpfit's bestnorm; with one, bestnorm is the robust cost instead.
+SURVIVE_EXPORT double survive_optimizer_plain_norm(survive_optimizer *optimizer);
 
 #ifdef __cplusplus
 }
@@ -40,6 +40,11 @@ SURVIVE_EXPORT void survive_reproject_full_y_jac_obj_pose(SurviveAngleReading ou
 										   const LinmathVec3d ptInObj, const SurvivePose *world2lh,
 										   const BaseStationCal *bcal);
 
+// Jacobian of survive_reproject_from_pose(InvertPose(lh2world), ptInWorld) with respect to the 7 values of lh2world;
+// row major, one row per axis.
+SURVIVE_EXPORT void survive_reproject_full_jac_lh_pose(SurviveAngleReading out, const SurvivePose *lh2world,
+										const LinmathVec3d ptInWorld, const BaseStationCal *bcal);
+
 SURVIVE_EXPORT void survive_reproject_full(const BaseStationCal *bcal, const SurvivePose *world2lh, const SurvivePose *obj2world,
 							const LinmathVec3d ptInObj, SurviveAngleReading out);
 
@@ -62,9 +67,37 @@ SURVIVE_EXPORT void survive_reproject(const SurviveContext *ctx, int lighthouse,
 // but in practice in converges pretty quickly and to a good degree of accuracy.
 // That said, all things being equal, it is better to compare reprojection to raw incoming
 // data if you are looking to minimize that error.
+//
+// With 'calibration-table' set this applies the whole calibration model through a lookup table instead of only the
+// phase.
 SURVIVE_EXPORT void survive_apply_bsd_calibration(const SurviveContext *ctx, int lh, const SurviveAngleReading in,
 								   SurviveAngleReading out);
 
+// Exact inverse of the calibration model in survive_reproject_xy: given angles 'measured' by a lighthouse with
+// calibration 'bcal', finds the angles an ideal lighthouse would have measured for the same point. Solved by fixed
+// point iteration, which converges to machine precision for any realistic calibration.
+SURVIVE_EXPORT void survive_reproject_invert_calibration(const BaseStationCal *bcal, const SurviveAngleReading measured,
+														 SurviveAngleReading ideal);
+
+// Samples per axis of a calibration table. It covers measured angles of +/- PI / 3 -- the lighthouse's field of view --
+// plus one sample of padding on each side, so a bin is about 1.9 degrees wide.
+#define SURVIVE_CALIBRATION_TABLE_SIZE 65
+
+// survive_reproject_invert_calibration tabulated over the field of view of one lighthouse, for bicubic lookup.
+typedef struct SurviveCalibrationTable {
+	BaseStationCal fcal[2]; // The calibration the table was built from
+	FLT correction[SURVIVE_CALIBRATION_TABLE_SIZE][SURVIVE_CALIBRATION_TABLE_SIZE][2]; // ideal - measured, [y][x]
+} SurviveCalibrationTable;
+
+SURVIVE_EXPORT void survive_calibration_table_build(SurviveCalibrationTable *table, const BaseStationCal *bcal);
+
+// Returns false, leaving 'ideal' untouched, when 'measured' is outside of the table.
+SURVIVE_EXPORT bool survive_calibration_table_apply(const SurviveCalibrationTable *table,
+													const SurviveAngleReading measured, SurviveAngleReading ideal);
+
+// Rebuilds the context's table for 'lh' from its current calibration; does nothing unless 'calibration-table' is set.
+SURVIVE_EXPORT void survive_calibration_table_update(SurviveContext *ctx, int lh);
+
 #ifdef __cplusplus
 }
 #endif
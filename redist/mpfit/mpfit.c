@@ -17,6 +17,7 @@
  */
 
 #include "mpfit.h"
+#include "os_generic.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,7 +27,7 @@
 static int mp_fdjac2(mp_func funct, int m, int n, int *ifree, int npar, double *x, double *fvec, double *fjac,
 					 int ldfjac, double epsfcn, double *wa, void *priv, int *nfev, double *step, double *dstep,
 					 int *dside, int *qulimited, double *ulimit, int *ddebug, double *ddrtol, double *ddatol,
-					 double *wa2, double **dvecptr);
+					 double *wa2, double **dvecptr, int nthreads);
 static void mp_qrfac(int m, int n, double *a, int lda, int pivot, int *ipvt, int lipvt, double *rdiag, double *acnorm,
 					 double *wa);
 static void mp_qrsolv(int n, double *r, int ldr, int *ipvt, double *diag, double *qtb, double *x, double *sdiag,
@@ -37,6 +38,7 @@ static double mp_enorm(int n, double *x);
 static double mp_dmax1(double a, double b);
 static double mp_dmin1(double a, double b);
 static int mp_min0(int a, int b);
+static int mp_max0(int a, int b);
 static int mp_covar(int n, double *r, int ldr, int *ipvt, double tol, double *wa);
 
 /* Macro to call user function */
@@ -307,6 +309,7 @@ int mpfit(mp_func funct, int m, int npar, double *xall, mp_par *pars, mp_config
 	conf.maxfev = 0;
 	conf.covtol = 1e-14;
 	conf.nofinitecheck = 0;
+	conf.nthreads = 1;
 
 	if (config) {
 		/* Transfer any user-specified configurations */
@@ -333,6 +336,8 @@ int mpfit(mp_func funct, int m, int npar, double *xall, mp_par *pars, mp_config
 		if (config->nofinitecheck > 0)
 			conf.nofinitecheck = config->nofinitecheck;
 		conf.maxfev = config->maxfev;
+		if (config->nthreads > 1)
+			conf.nthreads = config->nthreads;
 	}
 
 	info = MP_ERR_INPUT; /* = 0 */
@@ -447,7 +452,7 @@ int mpfit(mp_func funct, int m, int npar, double *xall, mp_par *pars, mp_config
 	ldfjac = m;
 	mp_malloc(diag, double, npar);
 	mp_malloc(wa1, double, npar);
-	mp_malloc(wa2, double, npar);
+	mp_malloc(wa2, double, mp_max0(npar, m)); /* Also holds f(x+h) for two-sided derivatives */
 	mp_malloc(wa3, double, npar);
 	mp_malloc(wa4, double, m);
 	mp_malloc(ipvt, int, npar);
@@ -491,7 +496,7 @@ OUTER_LOOP:
 
 	/* Calculate the jacobian matrix */
 	iflag = mp_fdjac2(funct, m, nfree, ifree, npar, xnew, fvec, fjac, ldfjac, conf.epsfcn, wa4, private_data, &nfev,
-					  step, dstep, mpside, qulim, ulim, ddebug, ddrtol, ddatol, wa2, dvecptr);
+					  step, dstep, mpside, qulim, ulim, ddebug, ddrtol, ddatol, wa2, dvecptr, conf.nthreads);
 	if (iflag < 0) {
 		goto CLEANUP;
 	}
@@ -1019,10 +1024,172 @@ CLEANUP:
 
 /************************fdjac2.c*************************/
 
+/* Finite-difference step for free parameter j currently at temp.  Shared
+   by the serial and threaded paths so both perturb x identically. */
+static double mp_fdjac2_step(int j, int *ifree, double temp, double eps, double *step, double *dstep, int *dside,
+							 int *qulimited, double *ulimit) {
+	int dsidei = (dside) ? (dside[ifree[j]]) : (0);
+	double h = eps * fabs(temp);
+	if (step && step[ifree[j]] > 0)
+		h = step[ifree[j]];
+	if (dstep && dstep[ifree[j]] > 0)
+		h = fabs(dstep[ifree[j]] * temp);
+	if (h == 0)
+		h = eps;
+
+	/* If negative step requested, or we are against the upper limit */
+	if ((dside && dsidei == -1) ||
+		(dside && dsidei == 0 && qulimited && ulimit && qulimited[j] && (temp > (ulimit[j] - h)))) {
+		h = -h;
+	}
+	return h;
+}
+
+/* One thread's share of the numerical columns: columns first, first+stride, ...
+   Each job perturbs its own copy of x and has its own work arrays; the
+   columns of fjac it writes are disjoint from every other job's. */
+struct mp_fdjac2_job {
+	mp_func funct;
+	int m, n, npar;
+	int *ifree;
+	double *x0, *fvec, *fjac;
+	double eps;
+	void *priv;
+	double *step, *dstep;
+	int *dside, *qulimited;
+	double *ulimit;
+
+	int first, stride;
+	double *x, *wa, *wa2;
+
+	int nfev;
+	int iflag;		 /* First negative iflag returned by funct, or 0 */
+	int failed_col; /* Column that returned it */
+};
+
+static void *mp_fdjac2_worker(void *v) {
+	struct mp_fdjac2_job *job = v;
+	int i, j, m = job->m;
+	double *x = job->x, *wa = job->wa, *wa2 = job->wa2;
+
+	for (j = job->first; j < job->n; j += job->stride) {
+		int ip = job->ifree[j];
+		int dsidei = (job->dside) ? (job->dside[ip]) : (0);
+		double *col = job->fjac + j * m;
+		double temp, h;
+
+		if (job->dside && dsidei == 3)
+			continue;
+
+		memcpy(x, job->x0, job->npar * sizeof(double));
+		temp = x[ip];
+		h = mp_fdjac2_step(j, job->ifree, temp, job->eps, job->step, job->dstep, job->dside, job->qulimited,
+						   job->ulimit);
+
+		x[ip] = temp + h;
+		job->iflag = mp_call(job->funct, m, job->npar, x, wa, 0, job->priv);
+		job->nfev++;
+		if (job->iflag < 0)
+			break;
+
+		if (dsidei <= 1) {
+			for (i = 0; i < m; i++)
+				col[i] = (wa[i] - job->fvec[i]) / h;
+		} else {
+			memcpy(wa2, wa, m * sizeof(double));
+			x[ip] = temp - h;
+			job->iflag = mp_call(job->funct, m, job->npar, x, wa, 0, job->priv);
+			job->nfev++;
+			if (job->iflag < 0)
+				break;
+			for (i = 0; i < m; i++)
+				col[i] = (wa2[i] - wa[i]) / (2 * h);
+		}
+	}
+
+	job->failed_col = j;
+	return 0;
+}
+
+/* Computes the numerical columns of fjac on nthreads threads, the calling
+   thread included.  Returns 1 if the work was done, or 0 if the buffers
+   could not be allocated and the caller should fall back to the serial loop. */
+static int mp_fdjac2_threaded(mp_func funct, int m, int n, int *ifree, int npar, double *x, double *fvec, double *fjac,
+							  double eps, void *priv, int *nfev, double *step, double *dstep, int *dside,
+							  int *qulimited, double *ulimit, int nthreads, int *iflag) {
+	struct mp_fdjac2_job *jobs;
+	og_thread_t *threads;
+	double *buffers;
+	int t, per_job = npar + 2 * m, first_failure = n;
+
+	if (nthreads > n)
+		nthreads = n;
+
+	jobs = (struct mp_fdjac2_job *)calloc(nthreads, sizeof(*jobs));
+	threads = (og_thread_t *)calloc(nthreads, sizeof(*threads));
+	buffers = (double *)malloc(sizeof(double) * per_job * nthreads);
+	if (jobs == 0 || threads == 0 || buffers == 0) {
+		free(jobs);
+		free(threads);
+		free(buffers);
+		return 0;
+	}
+
+	for (t = 0; t < nthreads; t++) {
+		struct mp_fdjac2_job *job = &jobs[t];
+		job->funct = funct;
+		job->m = m;
+		job->n = n;
+		job->npar = npar;
+		job->ifree = ifree;
+		job->x0 = x;
+		job->fvec = fvec;
+		job->fjac = fjac;
+		job->eps = eps;
+		job->priv = priv;
+		job->step = step;
+		job->dstep = dstep;
+		job->dside = dside;
+		job->qulimited = qulimited;
+		job->ulimit = ulimit;
+		job->first = t;
+		job->stride = nthreads;
+		job->x = buffers + t * per_job;
+		job->wa = job->x + npar;
+		job->wa2 = job->wa + m;
+	}
+
+	for (t = 1; t < nthreads; t++)
+		threads[t] = OGCreateThread(mp_fdjac2_worker, &jobs[t]);
+	mp_fdjac2_worker(&jobs[0]);
+	for (t = 1; t < nthreads; t++) {
+		if (threads[t])
+			OGJoinThread(threads[t]);
+		else
+			mp_fdjac2_worker(&jobs[t]);
+	}
+
+	/* Report the failure the serial loop would have stopped at */
+	*iflag = 0;
+	for (t = 0; t < nthreads; t++) {
+		if (nfev)
+			*nfev += jobs[t].nfev;
+		if (jobs[t].iflag < 0 && jobs[t].failed_col < first_failure) {
+			first_failure = jobs[t].failed_col;
+			*iflag = jobs[t].iflag;
+		}
+	}
+
+	free(jobs);
+	free(threads);
+	free(buffers);
+	return 1;
+}
+
 static int mp_fdjac2(mp_func funct, int m, int n, int *ifree, int npar, double *x, double *fvec, double *fjac,
 					 int ldfjac, double epsfcn, double *wa, void *priv, int *nfev, double *step, double *dstep,
 					 int *dside, int *qulimited, double *ulimit, int *ddebug, double *ddrtol, double *ddatol,
-					 double *wa2, double **dvec) {
+					 double *wa2, double **dvec, int nthreads) {
 	/*
 	*     **********
 	*
@@ -1103,7 +1270,6 @@ static int mp_fdjac2(mp_func funct, int m, int n, int *ifree, int npar, double *
 	int i, j, ij;
 	int iflag = 0;
 	double eps, h, temp;
-	static double zero = 0.0;
 	int has_analytical_deriv = 0, has_numerical_deriv = 0;
 	int has_debug_deriv = 0;
 
@@ -1154,6 +1320,13 @@ static int mp_fdjac2(mp_func funct, int m, int n, int *ifree, int npar, double *
 		printf("#  %10s %10s %10s %10s %10s %10s\n", "IPNT", "FUNC", "DERIV_U", "DERIV_N", "DIFF_ABS", "DIFF_REL");
 	}
 
+	/* Debug output is per column and in order, so it stays serial */
+	if (has_numerical_deriv && nthreads > 1 && !has_debug_deriv &&
+		mp_fdjac2_threaded(funct, m, n, ifree, npar, x, fvec, fjac, eps, priv, nfev, step, dstep, dside, qulimited,
+						   ulimit, nthreads, &iflag)) {
+		goto DONE;
+	}
+
 	/* Any parameters requiring numerical derivatives */
 	if (has_numerical_deriv)
 		for (j = 0; j < n; j++) { /* Loop thru free parms */
@@ -1170,20 +1343,9 @@ static int mp_fdjac2(mp_func funct, int m, int n, int *ifree, int npar, double *
 			if (dside && dsidei == 3)
 				continue;
 
+			ij = j * m;
 			temp = x[ifree[j]];
-			h = eps * fabs(temp);
-			if (step && step[ifree[j]] > 0)
-				h = step[ifree[j]];
-			if (dstep && dstep[ifree[j]] > 0)
-				h = fabs(dstep[ifree[j]] * temp);
-			if (h == zero)
-				h = eps;
-
-			/* If negative step requested, or we are against the upper limit */
-			if ((dside && dsidei == -1) ||
-				(dside && dsidei == 0 && qulimited && ulimit && qulimited[j] && (temp > (ulimit[j] - h)))) {
-				h = -h;
-			}
+			h = mp_fdjac2_step(j, ifree, temp, eps, step, dstep, dside, qulimited, ulimit);
 
 			x[ifree[j]] = temp + h;
 			iflag = mp_call(funct, m, npar, x, wa, 0, priv);
@@ -1232,7 +1394,7 @@ static int mp_fdjac2(mp_func funct, int m, int n, int *ifree, int npar, double *
 				if (!debug) {
 					/* Non-debug path for speed */
 					for (i = 0; i < m; i++, ij++) {
-						fjac[ij] = (fjac[ij] - wa[i]) / (2 * h); /* fjac[i+m*j] */
+						fjac[ij] = (wa2[i] - wa[i]) / (2 * h); /* fjac[i+m*j] */
 					}
 				} else {
 					/* Debug path for correctness */
@@ -2107,6 +2269,13 @@ static int mp_min0(int a, int b) {
 		return (b);
 }
 
+static int mp_max0(int a, int b) {
+	if (a >= b)
+		return (a);
+	else
+		return (b);
+}
+
 /************************covar.c*************************/
 /*
 c     **********
@@ -92,6 +92,10 @@ struct mp_config_struct {
 				   1 = perform check
 					*/
 	mp_iterproc iterproc; /* Placeholder pointer - must set to 0 */
+	int nthreads;		  /* Number of threads computing finite-difference derivatives.
+					 Values above 1 require a user function that may be called
+					 concurrently and does not modify x; the Jacobian is the
+					 same as the serial one.  Default: 1 */
 };
 
 /* Definition of results structure, for when fit completes */
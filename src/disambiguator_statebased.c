@@ -509,6 +509,7 @@ static void RunACodeCapture(int target_acode, Disambiguator_data_t *d, const Lig
 		const int penalty = 3;
 		if (d->confidence < penalty) {
 			SetState(d, le, LS_UNKNOWN);
+			d->so->counters.disambiguator_resets++;
 			SV_WARN("Disambiguator got lost at %u; refinding state for %s", le->timestamp, d->so->codename);
 		}
 		d->confidence -= penalty;
@@ -616,6 +617,7 @@ static void ProcessStateChange(Disambiguator_data_t *d, const LightcapElement *l
 static void PropagateState(Disambiguator_data_t *d, const LightcapElement *le) {
 	struct SurviveContext *ctx = d->so->ctx;
 	if (le->sensor_id >= d->so->sensor_ct) {
+		d->so->counters.invalid_lightcaps++;
 		SV_WARN("Invalid sensor %d detected hit", le->sensor_id);
 		return;
 	}
@@ -710,6 +712,7 @@ void DisambiguatorStateBased(SurviveObject *so, const LightcapElement *le) {
 			int penalty = timediff / d->so->timebase_hz * 10;
 			if (d->confidence < penalty) {
 				SetState(d, le, LS_UNKNOWN);
+				d->so->counters.disambiguator_resets++;
 				SV_WARN("Disambiguator got lost at %u (sync timeout %u); refinding state for %s", le->timestamp,
 						timediff, d->so->codename);
 				return;
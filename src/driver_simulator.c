@@ -12,15 +12,50 @@
 #include <survive.h>
 #include <survive_reproject.h>
 
+#include "survive_playback.h"
+
 STATIC_CONFIG_ITEM(Simulator_DRIVER_ENABLE, "simulator", 'i', "Load a Simulator driver for testing.", 0);
 STATIC_CONFIG_ITEM(Simulator_TIME, "simulator-time", 'f', "Seconds to run simulator for.", 0.0);
-
-struct SurviveDriverSimulator {
-	SurviveContext *ctx;
+STATIC_CONFIG_ITEM(Simulator_TIME_FACTOR, "time-factor", 'f',
+				   "Wall-clock seconds per simulated second. 0 runs the simulator as fast as possible.", 1.0);
+STATIC_CONFIG_ITEM(Simulator_OBJECTS, "simulator-objects", 'i', "Number of objects to simulate.", 1);
+STATIC_CONFIG_ITEM(Simulator_SENSORS, "simulator-sensors", 'i', "Number of sensors on each simulated object.", 20);
+STATIC_CONFIG_ITEM(Simulator_NOISE, "simulator-noise", 'f', "Standard deviation of the angle noise, in radians.",
+				   0.0003);
+STATIC_CONFIG_ITEM(Simulator_OCCLUSION, "simulator-occlusion", 'f',
+				   "Probability that a sensor facing the lighthouse still misses a sweep.", 0.0);
+STATIC_CONFIG_ITEM(Simulator_REFLECTIONS, "simulator-reflections", 'f',
+				   "Probability that a sensor facing away from the lighthouse reports a reflected sweep anyway.", 0.0);
+
+// Reflected light arrives from somewhere near the sensor's true direction, up to this many radians off
+#define SIMULATOR_REFLECTION_SPREAD .1
+
+#define SIMULATOR_MAX_OBJECTS 100
+
+typedef struct SimulatedObject {
 	SurviveObject *so;
+	char gt_name[16];
 
 	SurvivePose position;
 	SurviveVelocity velocity;
+} SimulatedObject;
+
+struct SurviveDriverSimulator {
+	SurviveContext *ctx;
+
+	SimulatedObject *objects;
+	size_t object_ct;
+
+	// Seeded from 'random-seed'; the simulator keeps its own stream so its output doesn't depend on who else draws
+	// from the context's.
+	uint64_t rng_state;
+
+	FLT time_factor;
+	FLT run_time;
+	FLT noise;
+	FLT occlusion;
+	FLT reflections;
+	size_t attractor_cnt;
 
 	FLT time_last_imu;
 	FLT time_last_light;
@@ -28,165 +63,188 @@ struct SurviveDriverSimulator {
 
 	FLT timestart;
 	FLT current_timestamp;
+	double wall_start;
 	int acode;
 };
 typedef struct SurviveDriverSimulator SurviveDriverSimulator;
 
-static double timestamp_in_s() {
-	static double start_time_s = 0;
-	if (start_time_s == 0.)
-		start_time_s = OGGetAbsoluteTime();
-	return OGGetAbsoluteTime() - start_time_s;
+static const LinmathVec3d attractors[] = {{1, 1, 1}, {-1, 0, 1}, {0, -1, .5}};
+
+static FLT sim_uniform(SurviveDriverSimulator *driver) {
+	return (survive_rand_r(&driver->rng_state) + .5) / ((FLT)SURVIVE_RAND_MAX + 1.);
+}
+
+static FLT sim_gaussian(SurviveDriverSimulator *driver) {
+	// Box-Muller; the second value is thrown away so the stream position doesn't depend on call parity
+	FLT u1 = sim_uniform(driver), u2 = sim_uniform(driver);
+	return sqrt(-2. * log(u1)) * cos(2. * LINMATHPI * u2);
+}
+
+static void simulate_imu(SurviveDriverSimulator *driver, SimulatedObject *obj, const SurviveVelocity *accel,
+						 bool isIniting, survive_timecode timecode) {
+	FLT accelgyro[9] = {0, 0, 9.8066, // Acc
+						0, 0, 0,	  // Gyro
+						0, 0, 0};	  // Mag
+
+	add3d(accelgyro, accelgyro, accel->Pos);
+	scale3d(accelgyro, accelgyro, 1. / 9.8066);
+
+	if (!isIniting) {
+		LinmathQuat q;
+		quatgetconjugate(q, obj->position.Rot);
+		quatrotatevector(accelgyro, q, accelgyro);
+
+		quatrotatevector(accelgyro + 3, q, obj->velocity.EulerRot);
+	}
+
+	driver->ctx->imuproc(obj->so, 3, accelgyro, timecode, 0);
+}
+
+static void simulate_sweep(SurviveDriverSimulator *driver, SimulatedObject *obj, int lh, survive_timecode timecode) {
+	SurviveContext *ctx = driver->ctx;
+	SurviveObject *so = obj->so;
+	SurvivePose world2lh = InvertPoseRtn(&ctx->bsd[lh].Pose);
+	int acode = (lh << 2) + (driver->acode & 1);
+
+	for (int idx = 0; idx < so->sensor_ct; idx++) {
+		FLT *pt = so->sensor_locations + idx * 3;
+
+		LinmathVec3d ptInWorld;
+		LinmathVec3d normalInWorld;
+		ApplyPoseToPoint(ptInWorld, &obj->position, pt);
+		quatrotatevector(normalInWorld, obj->position.Rot, so->sensor_normals + idx * 3);
+
+		LinmathPoint3d ptInLh;
+		LinmathVec3d normalInLh;
+		ApplyPoseToPoint(ptInLh, &world2lh, ptInWorld);
+		quatrotatevector(normalInLh, world2lh.Rot, normalInWorld);
+
+		if (ptInLh[2] >= 0)
+			continue;
+
+		LinmathVec3d dirLh;
+		normalize3d(dirLh, ptInLh);
+		scale3d(dirLh, dirLh, -1);
+		FLT facingness = dot3d(normalInLh, dirLh);
+		bool reflected = false;
+		if (facingness <= 0) {
+			if (driver->reflections <= 0 || sim_uniform(driver) >= driver->reflections)
+				continue;
+			reflected = true;
+		} else if (driver->occlusion > 0 && sim_uniform(driver) < driver->occlusion)
+			continue;
+
+		SurviveAngleReading ang;
+		survive_reproject_xy(ctx->bsd[lh].fcal, ptInLh, ang);
+		FLT angle = ang[driver->acode & 1] + driver->noise * sim_gaussian(driver);
+		if (reflected)
+			angle += SIMULATOR_REFLECTION_SPREAD * (2. * sim_uniform(driver) - 1.);
+
+		// SurviveObject * so, int sensor_id, int acode, survive_timecode timecode, FLT length, FLT angle,
+		// uint32_t lh);
+		ctx->angleproc(so, idx, acode, timecode, .006, angle, lh);
+	}
+	// SurviveObject * so, int sensor_id, int acode, int timeinsweep, survive_timecode timecode, survive_timecode
+	// length, uint32_t lighthouse);
+	ctx->lightproc(so, -1, acode, 0, timecode, 100, lh);
+}
+
+static void simulate_motion(SurviveDriverSimulator *driver, SimulatedObject *obj, const SurviveVelocity *accel,
+							FLT time_diff) {
+	SurviveVelocity velGain;
+	scale3d(velGain.Pos, accel->Pos, time_diff);
+	scale3d(velGain.EulerRot, accel->EulerRot, time_diff);
+
+	add3d(obj->velocity.Pos, obj->velocity.Pos, velGain.Pos);
+	add3d(obj->velocity.EulerRot, velGain.EulerRot, obj->velocity.EulerRot);
+
+	SurviveVelocity posGain;
+	scale3d(posGain.Pos, obj->velocity.Pos, time_diff);
+	scale3d(posGain.EulerRot, obj->velocity.EulerRot, time_diff);
+
+	add3d(obj->position.Pos, obj->position.Pos, posGain.Pos);
+	LinmathQuat r;
+	quatfromeuler(r, posGain.EulerRot);
+	quatrotateabout(obj->position.Rot, r, obj->position.Rot);
 }
 
 static int Simulator_poll(struct SurviveContext *ctx, void *_driver) {
 	SurviveDriverSimulator *driver = _driver;
-	static FLT last_time = 0;
-	FLT realtime = timestamp_in_s();
-
-	FLT timefactor = linmath_max(survive_configf(ctx, "time-factor", SC_GET, 1.), .00001);
-	// FLT timestamp = timestamp_in_s() / timefactor;
 	FLT timestep = 0.001;
 
-	if (last_time != 0 && last_time + timefactor * timestep > realtime) {
-		OGUSleep((timefactor * timestep + realtime - last_time) * 1e6);
+	// Steps are paced against a schedule from the first poll, so a slow step is made up for by the ones after it
+	// rather than delaying the whole run. With a time factor of 0, or in deterministic mode, there is no pacing.
+	if (!ctx->deterministic && driver->time_factor > 0) {
+		double realtime = OGGetAbsoluteTime();
+		if (driver->wall_start == 0)
+			driver->wall_start = realtime - driver->current_timestamp * driver->time_factor;
+		double due = driver->wall_start + (driver->current_timestamp + timestep) * driver->time_factor;
+		if (due > realtime) {
+			OGUSleep((due - realtime) * 1e6);
+		}
 	}
-	last_time = realtime;
 
 	FLT timestamp = (driver->current_timestamp += timestep);
-	FLT time_between_imu = 1. / driver->so->imu_freq;
+	survive_recording_set_event_time(ctx, timestamp);
+	// All simulated objects share the IMU rate of the first one
+	FLT time_between_imu = 1. / driver->objects[0].so->imu_freq;
 	FLT time_between_pulses = 0.00833333333;
-	FLT time_between_gt = time_between_imu;
 	bool isIniting = timestamp < 2;
 
-	bool update_gt = false;
+	bool update_imu = timestamp > time_between_imu + driver->time_last_imu;
+	bool update_light = timestamp > time_between_pulses + driver->time_last_light;
+	int lh = driver->acode >> 1;
 
-	FLT t = (timestamp - driver->timestart);
+	FLT time_diff = timestamp - driver->time_last_iterate;
+	bool first_iteration = driver->time_last_iterate == 0;
+	driver->time_last_iterate = timestamp;
+	if (first_iteration)
+		driver->timestart = timestamp;
 
 	// SurvivePose accel = {.Pos = {cos(t * 3) * 4, cos(t * 2) * 3, cos(t * 4) * 2},
 	//					 .Rot = {10 + cos(t) * 2, cos(t), sin(t), (cos(t) + sin(t))}};
-
-	// SurviveVelocity accel = {.EulerRot = {cos(t), sin(t), (cos(t) + sin(t))}};
-	SurviveVelocity accel = {0};
-
-	LinmathVec3d attractors[] = {{1, 1, 1}, {-1, 0, 1}, {0, -1, .5}};
-	size_t attractor_cnt = survive_configi(ctx, "attractors", SC_GET, sizeof(attractors) / sizeof(LinmathVec3d));
-	if (attractor_cnt > sizeof(attractors) / sizeof(LinmathVec3d)) {
-		attractor_cnt = sizeof(attractors) / sizeof(LinmathVec3d);
-	}
-
-	for (int i = 0; isIniting == false && i < attractor_cnt; i++) {
-		LinmathVec3d acc;
-		sub3d(acc, attractors[i], driver->position.Pos);
-		FLT r = norm3d(acc);
-		scale3d(acc, acc, 5. / r / r);
-		add3d(accel.Pos, accel.Pos, acc);
-	}
-
-	// scale3d(accel.Pos, accel.Pos, 0);
-	// scale3d(accel.Rot + 1, accel.Rot + 1, 0);
-	// quatrotatevector(accel.Pos, accel.Rot, accel.Pos);
 	survive_timecode timecode = (survive_timecode)round(timestamp * 48000000.);
 
-	if (timestamp > time_between_imu + driver->time_last_imu) {
-		update_gt = true;
-		// ( SurviveObject * so, int mask, FLT * accelgyro, survive_timecode timecode, int id );
-		FLT accelgyro[9] = {0, 0, 9.8066, // Acc
-							0, 0, 0,	  // Gyro
-							0, 0, 0};	 // Mag
+	for (size_t i = 0; i < driver->object_ct; i++) {
+		SimulatedObject *obj = &driver->objects[i];
+
+		// SurviveVelocity accel = {.EulerRot = {cos(t), sin(t), (cos(t) + sin(t))}};
+		SurviveVelocity accel = {0};
+		for (int j = 0; isIniting == false && j < driver->attractor_cnt; j++) {
+			LinmathVec3d acc;
+			sub3d(acc, attractors[j], obj->position.Pos);
+			FLT r = norm3d(acc);
+			scale3d(acc, acc, 5. / r / r);
+			add3d(accel.Pos, accel.Pos, acc);
+		}
 
-		add3d(accelgyro, accelgyro, accel.Pos);
-		scale3d(accelgyro, accelgyro, 1. / 9.8066);
+		if (update_imu)
+			simulate_imu(driver, obj, &accel, isIniting, timecode);
 
-		if (!isIniting) {
-			LinmathQuat q;
-			quatgetconjugate(q, driver->position.Rot);
-			quatrotatevector(accelgyro, q, accelgyro);
+		if (update_light)
+			simulate_sweep(driver, obj, lh, timecode);
 
-			quatrotatevector(accelgyro + 3, q, driver->velocity.EulerRot);
+		if (update_imu || update_light) {
+			survive_default_external_pose_process(ctx, obj->gt_name, &obj->position);
+			survive_default_external_velocity_process(ctx, obj->gt_name, &obj->velocity);
 		}
 
-		ctx->imuproc(driver->so, 3, accelgyro, timecode, 0);
+		if (!first_iteration && !isIniting)
+			simulate_motion(driver, obj, &accel, time_diff);
+	}
 
+	if (update_imu)
 		driver->time_last_imu = timestamp - 1e-10;
-	}
 
-	if (timestamp > time_between_pulses + driver->time_last_light) {
-		update_gt = true;
-		int lh = driver->acode >> 1;
-		for (int idx = 0; idx < driver->so->sensor_ct; idx++) {
-			FLT *pt = driver->so->sensor_locations + idx * 3;
-
-			LinmathVec3d ptInWorld;
-			LinmathVec3d normalInWorld;
-			ApplyPoseToPoint(ptInWorld, &driver->position, pt);
-			quatrotatevector(normalInWorld, driver->position.Rot, driver->so->sensor_normals + idx * 3);
-
-			SurvivePose world2lh = InvertPoseRtn(&ctx->bsd[lh].Pose);
-			LinmathPoint3d ptInLh;
-			LinmathVec3d normalInLh;
-			ApplyPoseToPoint(ptInLh, &world2lh, ptInWorld);
-			quatrotatevector(normalInLh, world2lh.Rot, normalInWorld);
-
-			SurviveAngleReading ang;
-			if (ptInLh[2] < 0) {
-				LinmathVec3d dirLh;
-				normalize3d(dirLh, ptInLh);
-				scale3d(dirLh, dirLh, -1);
-				FLT facingness = dot3d(normalInLh, dirLh);
-				if (facingness > 0) {
-					survive_reproject_xy(ctx->bsd[lh].fcal, ptInLh, ang);
-					ang[0] += .001 * rand() / RAND_MAX;
-					ang[1] += .001 * rand() / RAND_MAX;
-					// SurviveObject * so, int sensor_id, int acode, survive_timecode timecode, FLT length, FLT angle,
-					// uint32_t lh);
-					int acode = (lh << 2) + (driver->acode & 1);
-					ctx->angleproc(driver->so, idx, acode, timecode, .006, ang[driver->acode & 1], lh);
-				}
-			}
-		}
-		// SurviveObject * so, int sensor_id, int acode, int timeinsweep, survive_timecode timecode, survive_timecode
-		// length, uint32_t lighthouse);
-		int acode = (lh << 2) + (driver->acode & 1);
-		ctx->lightproc(driver->so, -1, acode, 0, timecode, 100, lh);
+	if (update_light) {
 		driver->acode = (driver->acode + 1) % 4;
 		driver->time_last_light = timestamp;
 	}
 
-	if (update_gt) {
-		survive_default_external_pose_process(ctx, "Sim_GT", &driver->position);
-		survive_default_external_velocity_process(ctx, "Sim_GT", &driver->velocity);
-	}
-
-	if (driver->time_last_iterate == 0) {
-		driver->time_last_iterate = timestamp;
-		driver->timestart = timestamp;
+	if (first_iteration)
 		return 0;
-	}
-	FLT time_diff = timestamp - driver->time_last_iterate;
-	// SV_INFO("%.013f", time_diff);
-	driver->time_last_iterate = timestamp;
-
-	if (!isIniting) {
-		SurviveVelocity velGain;
-		scale3d(velGain.Pos, accel.Pos, time_diff);
-		scale3d(velGain.EulerRot, accel.EulerRot, time_diff);
 
-		add3d(driver->velocity.Pos, driver->velocity.Pos, velGain.Pos);
-		add3d(driver->velocity.EulerRot, velGain.EulerRot, driver->velocity.EulerRot);
-
-		SurviveVelocity posGain;
-		scale3d(posGain.Pos, driver->velocity.Pos, time_diff);
-		scale3d(posGain.EulerRot, driver->velocity.EulerRot, time_diff);
-
-		add3d(driver->position.Pos, driver->position.Pos, posGain.Pos);
-		LinmathQuat r;
-		quatfromeuler(r, posGain.EulerRot);
-		quatrotateabout(driver->position.Rot, r, driver->position.Rot);
-	}
-
-	FLT time = survive_configf(ctx, "simulator-time", SC_GET, 0);
-	if (timestamp - driver->timestart > time && time > 0)
+	if (timestamp - driver->timestart > driver->run_time && driver->run_time > 0)
 		return 1;
 
 	return 0;
@@ -215,21 +273,25 @@ const BaseStationData simulated_bsd[2] = {
 	},
 };
 
-int DriverRegSimulator(SurviveContext *ctx) {
-	SurviveDriverSimulator *sp = calloc(1, sizeof(SurviveDriverSimulator));
-	sp->ctx = ctx;
-
-	sp->position.Rot[0] = 1;
-
-	SV_INFO("Setting up Simulator driver.");
+static SurviveObject *create_simulated_object(SurviveDriverSimulator *sp, SimulatedObject *obj, size_t index,
+											 int sensor_ct) {
+	SurviveContext *ctx = sp->ctx;
 
 	// Create a new SurviveObject...
 	SurviveObject *device = calloc(1, sizeof(SurviveObject));
 	device->ctx = ctx;
 	device->driver = sp;
-	memcpy(device->codename, "SM0", 4);
+	// The first object keeps the names it always had so existing recordings and tools still line up
+	if (index < 10)
+		snprintf(device->codename, sizeof(device->codename), "SM%d", (int)index);
+	else
+		snprintf(device->codename, sizeof(device->codename), "S%02d", (int)index);
+	if (index == 0)
+		strcpy(obj->gt_name, "Sim_GT");
+	else
+		snprintf(obj->gt_name, sizeof(obj->gt_name), "Sim_GT%d", (int)index);
 	memcpy(device->drivername, "SIM", 4);
-	device->sensor_ct = 20;
+	device->sensor_ct = sensor_ct;
 	device->sensor_locations = malloc(device->sensor_ct * sizeof(FLT) * 3);
 	device->sensor_normals = malloc(device->sensor_ct * sizeof(FLT) * 3);
 
@@ -238,35 +300,33 @@ int DriverRegSimulator(SurviveContext *ctx) {
 	device->imu2trackref.Rot[0] = 1;
 
 	// for (int i = 0; i < 4; i++)
-	//	sp->position.Rot[i] = 1;
-	sp->position.Rot[0] = 2;
+	//	obj->position.Rot[i] = 1;
+	obj->position.Rot[0] = 2;
 
-	quatnormalize(sp->position.Rot, sp->position.Rot);
+	quatnormalize(obj->position.Rot, obj->position.Rot);
+
+	// Spread additional objects out so they don't all trace the same path
+	if (index > 0) {
+		for (int i = 0; i < 3; i++)
+			obj->position.Pos[i] = sim_uniform(sp) - .5;
+	}
 
-	size_t attractor_cnt = survive_configi(ctx, "attractors", SC_GET, 1);
-	if (attractor_cnt) {
+	if (sp->attractor_cnt) {
 		for (int i = 0; i < 3; i++)
-			sp->velocity.Pos[i] = 2. * rand() / RAND_MAX - 1.;
+			obj->velocity.Pos[i] = 2. * sim_uniform(sp) - 1.;
 
-		sp->velocity.EulerRot[0] = .5;
-		sp->velocity.EulerRot[1] = .5;
-		sp->velocity.EulerRot[2] = .5;
+		obj->velocity.EulerRot[0] = .5;
+		obj->velocity.EulerRot[1] = .5;
+		obj->velocity.EulerRot[2] = .5;
 	}
 
 	char *cfg = 0, *loc_buf = 0, *nor_buf = 0;
 
 	FLT r = .1;
-	srand(42);
-	
-	for (int i = 0; i < ctx->activeLighthouses; i++) {
-		if (!ctx->bsd[i].PositionSet) {
-			memcpy(ctx->bsd + i, simulated_bsd + i, sizeof(simulated_bsd[i]));
-		}
-	}
 
 	for (int i = 0; i < device->sensor_ct; i++) {
-		FLT azi = rand();
-		FLT pol = rand();
+		FLT azi = 2. * LINMATHPI * sim_uniform(sp);
+		FLT pol = acos(2. * sim_uniform(sp) - 1.);
 		FLT *normals = device->sensor_normals + i * 3;
 		FLT *locations = device->sensor_locations + i * 3;
 		normals[0] = locations[0] = r * cos(azi) * sin(pol);
@@ -302,9 +362,60 @@ int DriverRegSimulator(SurviveContext *ctx) {
 	free(loc_buf);
 	free(nor_buf);
 	free(cfg);
-	sp->so = device;
-	survive_add_object(ctx, device);
-	survive_add_driver(ctx, sp, Simulator_poll, 0, 0);
+	obj->so = device;
+	return device;
+}
+
+static int Simulator_close(struct SurviveContext *ctx, void *_driver) {
+	SurviveDriverSimulator *driver = _driver;
+	free(driver->objects);
+	free(driver);
+	return 0;
+}
+
+int DriverRegSimulator(SurviveContext *ctx) {
+	SurviveDriverSimulator *sp = calloc(1, sizeof(SurviveDriverSimulator));
+	sp->ctx = ctx;
+	sp->rng_state = survive_configi(ctx, "random-seed", SC_GET, 42) ^ 0x53494d554c41544full;
+
+	sp->time_factor = survive_configf(ctx, "time-factor", SC_GET, 1.);
+	ctx->data_time_factor = &sp->time_factor;
+	sp->run_time = survive_configf(ctx, "simulator-time", SC_GET, 0);
+	sp->noise = survive_configf(ctx, "simulator-noise", SC_GET, 0.0003);
+	sp->occlusion = survive_configf(ctx, "simulator-occlusion", SC_GET, 0);
+	sp->reflections = survive_configf(ctx, "simulator-reflections", SC_GET, 0);
+
+	sp->attractor_cnt = survive_configi(ctx, "attractors", SC_GET, sizeof(attractors) / sizeof(LinmathVec3d));
+	if (sp->attractor_cnt > sizeof(attractors) / sizeof(LinmathVec3d)) {
+		sp->attractor_cnt = sizeof(attractors) / sizeof(LinmathVec3d);
+	}
+
+	int object_ct = survive_configi(ctx, "simulator-objects", SC_GET, 1);
+	int sensor_ct = survive_configi(ctx, "simulator-sensors", SC_GET, 20);
+	if (object_ct < 1 || object_ct > SIMULATOR_MAX_OBJECTS) {
+		SV_WARN("simulator-objects must be between 1 and %d; got %d", SIMULATOR_MAX_OBJECTS, object_ct);
+		object_ct = object_ct < 1 ? 1 : SIMULATOR_MAX_OBJECTS;
+	}
+	if (sensor_ct < 1 || sensor_ct > SENSORS_PER_OBJECT) {
+		SV_WARN("simulator-sensors must be between 1 and %d; got %d", SENSORS_PER_OBJECT, sensor_ct);
+		sensor_ct = sensor_ct < 1 ? 1 : SENSORS_PER_OBJECT;
+	}
+
+	SV_INFO("Setting up Simulator driver with %d object(s).", object_ct);
+
+	for (int i = 0; i < ctx->activeLighthouses; i++) {
+		if (!ctx->bsd[i].PositionSet) {
+			memcpy(ctx->bsd + i, simulated_bsd + i, sizeof(simulated_bsd[i]));
+		}
+	}
+
+	sp->object_ct = object_ct;
+	sp->objects = calloc(object_ct, sizeof(SimulatedObject));
+	for (int i = 0; i < object_ct; i++) {
+		survive_add_object(ctx, create_simulated_object(sp, &sp->objects[i], i, sensor_ct));
+	}
+
+	survive_add_driver(ctx, sp, Simulator_poll, Simulator_close, 0);
 	return 0;
 }
 
@@ -0,0 +1,260 @@
+#include "os_generic.h"
+#include "survive_config.h"
+#include "survive_default_devices.h"
+#include "survive_playback.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <survive.h>
+
+#include "driver_vive.h"
+
+STATIC_CONFIG_ITEM(USB_REPLAY, "usbreplay", 's',
+				   "Raw USB capture, as written with --usb-capture, to feed through the vive packet parsers as fast as "
+				   "possible.",
+				   "");
+
+// Packets handed to the parsers per poll, so the poll loop still gets to check whether it should stop
+#define PACKETS_PER_POLL 256
+
+typedef struct SurviveDriverUSBReplay {
+	SurviveContext *ctx;
+
+	// The whole capture is read up front so that file IO doesn't count against the decode rate
+	uint8_t *data;
+	size_t size;
+	size_t offset;
+
+	SurviveObject **objects;
+	size_t object_ct;
+
+	// Captures taken with --usb-hotplug say when each device came and went; objects are then added as they attach
+	bool hotplug;
+
+	size_t packets;
+	size_t packet_bytes;
+	double start_time;
+} SurviveDriverUSBReplay;
+
+// Records are packed back to back, so headers are copied out rather than read in place
+static const uint8_t *next_record(SurviveDriverUSBReplay *d, size_t *offset, SurviveUSBCaptureRecord *record) {
+	if (*offset + sizeof(SurviveUSBCaptureRecord) > d->size)
+		return 0;
+
+	memcpy(record, d->data + *offset, sizeof(SurviveUSBCaptureRecord));
+	record->codename[sizeof(record->codename) - 1] = 0;
+	if (record->length > d->size - *offset - sizeof(SurviveUSBCaptureRecord)) {
+		SurviveContext *ctx = d->ctx;
+		SV_WARN("USB capture is truncated at byte %zu", *offset);
+		return 0;
+	}
+
+	const uint8_t *payload = d->data + *offset + sizeof(SurviveUSBCaptureRecord);
+	*offset += sizeof(SurviveUSBCaptureRecord) + record->length;
+	return payload;
+}
+
+static SurviveObject *find_object(SurviveDriverUSBReplay *d, const char *codename) {
+	for (size_t i = 0; i < d->object_ct; i++) {
+		if (strcmp(d->objects[i]->codename, codename) == 0)
+			return d->objects[i];
+	}
+	return 0;
+}
+
+static SurviveObject *add_object(SurviveDriverUSBReplay *d, const char *codename) {
+	SurviveObject *so = survive_create_device(d->ctx, "URP", d, codename, 0);
+	d->objects = realloc(d->objects, sizeof(SurviveObject *) * (d->object_ct + 1));
+	d->objects[d->object_ct++] = so;
+	return so;
+}
+
+static bool object_is_added(SurviveContext *ctx, SurviveObject *so) {
+	for (int i = 0; i < ctx->objs_ct; i++) {
+		if (ctx->objs[i] == so)
+			return true;
+	}
+	return false;
+}
+
+static void apply_config(SurviveDriverUSBReplay *d, SurviveObject *so, const uint8_t *payload, uint32_t length) {
+	SurviveContext *ctx = d->ctx;
+
+	// A device that attaches again reports its config again
+	free(so->sensor_locations);
+	free(so->sensor_normals);
+	free(so->channel_map);
+	so->sensor_locations = so->sensor_normals = 0;
+	so->channel_map = 0;
+	so->sensor_ct = 0;
+
+	// The config parser wants a null terminated string
+	char *config = malloc(length + 1);
+	memcpy(config, payload, length);
+	config[length] = 0;
+	if (ctx->configfunction(so, config, length) != 0)
+		SV_WARN("Could not use the config for %s in the USB capture", so->codename);
+	free(config);
+}
+
+static void replay_hotplug_record(SurviveDriverUSBReplay *d, const SurviveUSBCaptureRecord *record,
+								  const uint8_t *payload) {
+	SurviveContext *ctx = d->ctx;
+	SurviveObject *so = find_object(d, record->codename);
+
+	switch (record->type) {
+	case SURVIVE_USB_CAPTURE_CONFIG:
+		if (so == 0)
+			so = add_object(d, record->codename);
+		apply_config(d, so, payload, record->length);
+		break;
+	case SURVIVE_USB_CAPTURE_ATTACH:
+		if (so == 0)
+			so = add_object(d, record->codename);
+		if (!object_is_added(ctx, so))
+			survive_add_object(ctx, so);
+		so->counters.connections++;
+		SV_INFO("%s attached at %.3fs in the USB capture", so->codename, record->time);
+		break;
+	case SURVIVE_USB_CAPTURE_DETACH:
+		if (so) {
+			so->counters.disconnections++;
+			SV_INFO("%s detached at %.3fs in the USB capture", so->codename, record->time);
+		}
+		break;
+	}
+}
+
+static int usbreplay_poll(struct SurviveContext *ctx, void *_driver) {
+	SurviveDriverUSBReplay *d = _driver;
+	if (d->start_time == 0.)
+		d->start_time = OGGetAbsoluteTime();
+
+	for (int i = 0; i < PACKETS_PER_POLL; i++) {
+		SurviveUSBCaptureRecord record;
+		const uint8_t *payload = next_record(d, &d->offset, &record);
+		if (payload == 0) {
+			double elapsed = OGGetAbsoluteTime() - d->start_time;
+			SV_INFO("Replayed %zu USB packets (%zu bytes) in %.3fs; %.0f packets/s", d->packets, d->packet_bytes,
+					elapsed, elapsed > 0 ? d->packets / elapsed : 0);
+			return -1;
+		}
+
+		if (record.type != SURVIVE_USB_CAPTURE_PACKET) {
+			if (d->hotplug) {
+				survive_recording_set_event_time(ctx, record.time);
+				replay_hotplug_record(d, &record, payload);
+			}
+			continue;
+		}
+
+		if (record.length > INTBUFFSIZE) {
+			SV_WARN("Skipping %u byte packet for %s; the parsers take at most %d", record.length, record.codename,
+					INTBUFFSIZE);
+			continue;
+		}
+
+		SurviveObject *so = find_object(d, record.codename);
+		if (so == 0 || (d->hotplug && !object_is_added(ctx, so)))
+			continue;
+
+		SurviveUSBInterface si = {.ctx = ctx,
+								  .actual_len = record.length,
+								  .assoc_obj = so,
+								  .which_interface_am_i = record.iface,
+								  .hname = so->codename};
+		memcpy(si.buffer, payload, record.length);
+
+		survive_recording_set_event_time(ctx, record.time);
+		survive_data_cb(&si);
+
+		d->packets++;
+		d->packet_bytes += record.length;
+	}
+	return 0;
+}
+
+static int usbreplay_close(struct SurviveContext *ctx, void *_driver) {
+	SurviveDriverUSBReplay *d = _driver;
+	// Objects that never attached aren't the context's to free
+	for (size_t i = 0; i < d->object_ct; i++) {
+		SurviveObject *so = d->objects[i];
+		if (!object_is_added(ctx, so)) {
+			free(so->sensor_locations);
+			free(so->sensor_normals);
+			free(so->channel_map);
+			free(so);
+		}
+	}
+	free(d->objects);
+	free(d->data);
+	free(d);
+	return 0;
+}
+
+static uint8_t *read_capture(const char *fn, size_t *size) {
+	FILE *f = fopen(fn, "rb");
+	if (f == 0)
+		return 0;
+
+	uint8_t *data = 0;
+	size_t capacity = 0;
+	*size = 0;
+	for (;;) {
+		if (*size == capacity) {
+			capacity = capacity ? capacity * 2 : (1 << 20);
+			data = realloc(data, capacity);
+		}
+		size_t r = fread(data + *size, 1, capacity - *size, f);
+		if (r == 0)
+			break;
+		*size += r;
+	}
+	fclose(f);
+	return data;
+}
+
+int DriverRegUSBReplay(SurviveContext *ctx) {
+	const char *fn = survive_configs(ctx, "usbreplay", SC_GET, "");
+
+	SurviveDriverUSBReplay *d = calloc(1, sizeof(SurviveDriverUSBReplay));
+	d->ctx = ctx;
+	d->data = read_capture(fn, &d->size);
+	size_t magic_len = strlen(SURVIVE_USB_CAPTURE_MAGIC);
+	if (d->data == 0 || d->size < magic_len || memcmp(d->data, SURVIVE_USB_CAPTURE_MAGIC, magic_len) != 0) {
+		SV_WARN("'%s' is not a USB capture file", fn);
+		usbreplay_close(ctx, d);
+		return -1;
+	}
+	d->offset = magic_len;
+	// Replays run as fast as possible, so there is no pace to fall behind
+	static const FLT unpaced = 0;
+	ctx->data_time_factor = &unpaced;
+
+	size_t offset = d->offset;
+	SurviveUSBCaptureRecord record;
+	const uint8_t *payload;
+	while (!d->hotplug && next_record(d, &offset, &record))
+		d->hotplug = record.type == SURVIVE_USB_CAPTURE_ATTACH;
+
+	// Without attach records, devices all have to exist before startup hands out posers, so find them all now.
+	// Configs come before a device's packets; a device with packets but no config still gets an object with the
+	// default setup.
+	offset = d->offset;
+	while (!d->hotplug && (payload = next_record(d, &offset, &record))) {
+		if (find_object(d, record.codename))
+			continue;
+
+		SurviveObject *so = add_object(d, record.codename);
+		if (record.type == SURVIVE_USB_CAPTURE_CONFIG)
+			apply_config(d, so, payload, record.length);
+		survive_add_object(ctx, so);
+		SV_INFO("Found %s in USB capture", so->codename);
+	}
+
+	SV_INFO("Replaying %zu bytes of raw USB packets from '%s'", d->size, fn);
+	survive_add_driver(ctx, d, usbreplay_poll, usbreplay_close, 0);
+	return 0;
+}
+
+REGISTER_LINKTIME(DriverRegUSBReplay);
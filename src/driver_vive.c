@@ -26,6 +26,7 @@
 #include "json_helpers.h"
 #include "survive_config.h"
 #include "survive_default_devices.h"
+#include "survive_latency.h"
 
 #include "driver_vive.h"
 //#define DEBUG_WATCHMAN 1
@@ -124,6 +125,17 @@ const struct DeviceInfo KnownDeviceTypes[] = {
 typedef struct SurviveUSBInterface SurviveUSBInterface;
 typedef struct SurviveViveData SurviveViveData;
 
+// Devices found at startup go straight to attached. Hotplugged ones are opened and have their config read on a thread
+// of their own, so a slow or powered off device doesn't hold up the others, and are attached by the poll thread once
+// that is done.
+enum SurviveUSBState {
+	USB_SLOT_FREE = 0,
+	USB_SLOT_OPENING,  // The opener thread owns the slot
+	USB_SLOT_OPENED,   // Waiting for the poll thread to attach it
+	USB_SLOT_ATTACHED, // Transfers are running
+	USB_SLOT_DETACHING // Unplugged; waiting for the cancelled transfers to come back
+};
+
 struct SurviveUSBInfo {
 	USBHANDLE handle;
 	const struct DeviceInfo *device_info;
@@ -131,8 +143,27 @@ struct SurviveUSBInfo {
 
 	size_t interface_cnt;
 	SurviveUSBInterface interfaces[MAX_INTERFACES_PER_DEVICE];
+
+	enum SurviveUSBState state;
+#ifndef HIDAPI
+	struct SurviveViveData *sv;
+	libusb_device *device; // Referenced while the slot is in use; hotplug only
+	og_thread_t opener;
+	int open_result;
+	char *config; // Read by the opener; parsed on the poll thread when the device is attached
+	int config_len;
+	bool unplugged; // Left while the opener was still working on it
+	double arrival_time;
+#endif
 };
 
+#ifndef HIDAPI
+typedef struct SurviveUSBHotplugEvent {
+	libusb_device *device; // Referenced until the event is handled
+	bool arrived;
+} SurviveUSBHotplugEvent;
+#endif
+
 struct SurviveViveData {
 	SurviveContext *ctx;
 	size_t udev_cnt;
@@ -140,6 +171,17 @@ struct SurviveViveData {
 	struct libusb_context *usbctx;
 	size_t read_count;
 	int seconds_per_hz_output;
+	struct SurviveUSBCapture *capture; // Iff '--usb-capture' is set
+
+	bool hotplug; // Iff '--usb-hotplug' is set and libusb supports it
+#ifndef HIDAPI
+	libusb_hotplug_callback_handle hotplug_handle;
+	// Guards the pending events, the slot states while openers run, and 'closing'
+	og_mutex_t hotplug_lock;
+	SurviveUSBHotplugEvent *hotplug_events;
+	size_t hotplug_event_cnt;
+	bool closing;
+#endif
 };
 
 #ifdef HIDAPI
@@ -192,21 +234,54 @@ static void *HAPIReceiver(void *v) {
 	return 0;
 }
 #else
+// How many failed transfers in a row an interface retries with hotplug before it stops reading the device
+#define HOTPLUG_TRANSFER_RETRIES 10
+
 static void handle_transfer(struct libusb_transfer *transfer) {
 	SurviveUSBInterface *iface = transfer->user_data;
 	SurviveContext *ctx = iface->ctx;
 
-	if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
-		SV_ERROR("Transfer problem %s %d with %s", libusb_error_name(transfer->status), transfer->status, iface->hname);
-		SV_KILL();
+	// With hotplug, a device going away is expected; its transfers are dropped and the slot is cleaned up once they
+	// all have been.
+	bool gone = transfer->status == LIBUSB_TRANSFER_NO_DEVICE || transfer->status == LIBUSB_TRANSFER_CANCELLED;
+	if (iface->stopping || (gone && iface->sv->hotplug)) {
+		libusb_free_transfer(transfer);
+		iface->transfer = 0;
 		return;
 	}
 
-	iface->actual_len = transfer->actual_length;
-	iface->cb(iface);
-	iface->packet_count++;
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+		if (!iface->sv->hotplug) {
+			SV_ERROR("Transfer problem %s %d with %s", libusb_error_name(transfer->status), transfer->status,
+					 iface->hname);
+			SV_KILL();
+			return;
+		}
+
+		// Other devices keep tracking, so a flaky one is retried and then left alone until it is plugged in again
+		if (++iface->error_cnt > HOTPLUG_TRANSFER_RETRIES) {
+			SV_WARN("Giving up on %s after %d transfer problems (%s); unplug it and plug it back in to retry",
+					iface->hname, HOTPLUG_TRANSFER_RETRIES, libusb_error_name(transfer->status));
+			libusb_free_transfer(transfer);
+			iface->transfer = 0;
+			return;
+		}
+		SV_WARN("Transfer problem %s %d with %s; retrying", libusb_error_name(transfer->status), transfer->status,
+				iface->hname);
+	} else {
+		iface->error_cnt = 0;
+		iface->actual_len = transfer->actual_length;
+		iface->cb(iface);
+		iface->packet_count++;
+	}
 
-	if (libusb_submit_transfer(transfer)) {
+	int r = libusb_submit_transfer(transfer);
+	if (r && iface->sv->hotplug) {
+		// Most likely the device is gone, and its departure will free the slot
+		SV_WARN("Error resubmitting transfer for %s (%s)", iface->hname, libusb_error_name(r));
+		libusb_free_transfer(transfer);
+		iface->transfer = 0;
+	} else if (r) {
 		SV_ERROR("Error resubmitting transfer for %s", iface->hname);
 		SV_KILL();
 	}
@@ -229,6 +304,8 @@ static int AttachInterface(SurviveViveData *sv, struct SurviveUSBInfo *usbObject
 	iface->assoc_obj = usbObject->so;
 	iface->hname = hname;
 	iface->cb = cb;
+	iface->stopping = false;
+	iface->error_cnt = 0;
 
 #ifdef HIDAPI
 	// What do here?
@@ -236,6 +313,7 @@ static int AttachInterface(SurviveViveData *sv, struct SurviveUSBInfo *usbObject
 	assert(iface->uh);
 #ifndef HID_NONBLOCKING
 	iface->servicethread = OGCreateThread(HAPIReceiver, iface);
+	survive_thread_configure(iface->ctx, iface->servicethread, "usb");
 	OGUSleep(100000);
 #else
 	hid_set_nonblocking(iface->uh, 1);
@@ -243,7 +321,7 @@ static int AttachInterface(SurviveViveData *sv, struct SurviveUSBInfo *usbObject
 #else
 	struct libusb_transfer *tx = iface->transfer = libusb_alloc_transfer(0);
 	// printf( "%p %d %p %p\n", iface, which_interface_am_i, tx, devh );
-	SV_INFO("Attaching %s(0x%x) for %s", hname, endpoint_num, assocobj->codename);
+	SV_INFO("Attaching %s(0x%x) for %s", hname, endpoint_num, assocobj ? assocobj->codename : "(none)");
 
 	if (!iface->transfer) {
 		SV_ERROR("Error: failed on libusb_alloc_transfer for %s", hname);
@@ -460,7 +538,8 @@ static int survive_open_usb_device(SurviveViveData *sv, survive_usb_device_t d,
 
 	libusb_set_auto_detach_kernel_driver(usbInfo->handle, 1);
 	for (int j = 0; j < conf->bNumInterfaces; j++) {
-		if (libusb_claim_interface(usbInfo->handle, j)) {
+		ret = libusb_claim_interface(usbInfo->handle, j);
+		if (ret) {
 			SV_ERROR("Could not claim interface %d of %s", j, info->name);
 			return ret;
 		}
@@ -474,6 +553,391 @@ static int survive_open_usb_device(SurviveViveData *sv, survive_usb_device_t d,
 }
 #endif
 
+#ifndef HIDAPI
+static int FetchConfig(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, int iface, char **config);
+static int ApplyConfig(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, char *config, int len);
+static void send_device_magic(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, int magic_code);
+
+// How long an opener waits between asking a device that doesn't answer, such as a wireless controller that is turned
+// off, for its config
+#define HOTPLUG_CONFIG_RETRY_US 1000000
+
+static const struct DeviceInfo *find_device_info(SurviveViveData *sv, libusb_device *d) {
+	const char *blacklist = survive_configs(sv->ctx, "blacklist-devs", SC_GET, "-");
+	uint16_t idVendor, idProduct;
+	if (survive_get_ids(d, &idVendor, &idProduct) < 0)
+		return 0;
+
+	for (const struct DeviceInfo *info = KnownDeviceTypes; info->name; info++) {
+		if (info->vid == idVendor && info->pid == idProduct && !strstr(blacklist, info->name))
+			return info;
+	}
+	return 0;
+}
+
+// Runs in libusb's event handling, where devices may not be opened; the poll thread takes it from here.
+static int vive_hotplug_cb(libusb_context *usbctx, libusb_device *d, libusb_hotplug_event event, void *user) {
+	SurviveViveData *sv = user;
+	if (find_device_info(sv, d) == 0)
+		return 0;
+
+	OGLockMutex(sv->hotplug_lock);
+	sv->hotplug_events = realloc(sv->hotplug_events, sizeof(SurviveUSBHotplugEvent) * (sv->hotplug_event_cnt + 1));
+	sv->hotplug_events[sv->hotplug_event_cnt++] = (SurviveUSBHotplugEvent){
+		.device = libusb_ref_device(d), .arrived = event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED};
+	OGUnlockMutex(sv->hotplug_lock);
+	return 0;
+}
+
+static bool hotplug_closing(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo) {
+	OGLockMutex(sv->hotplug_lock);
+	bool rtn = sv->closing || usbInfo->unplugged;
+	OGUnlockMutex(sv->hotplug_lock);
+	return rtn;
+}
+
+static void *vive_hotplug_opener(void *v) {
+	struct SurviveUSBInfo *usbInfo = v;
+	SurviveViveData *sv = usbInfo->sv;
+	SurviveContext *ctx = sv->ctx;
+
+	int r = survive_open_usb_device(sv, usbInfo->device, usbInfo);
+	if (r == 0) {
+		send_device_magic(sv, usbInfo, 1);
+
+		bool waiting = false;
+		while (usbInfo->device_info->type != USB_DEV_HMD && !hotplug_closing(sv, usbInfo)) {
+			// Only the raw bytes are read here; parsing them goes through the context's callbacks, which belong to
+			// the poll thread.
+			r = FetchConfig(sv, usbInfo, 0, &usbInfo->config);
+			if (r >= 0) {
+				usbInfo->config_len = r;
+				r = 0;
+				break;
+			}
+
+			if (!waiting)
+				SV_INFO("%s isn't answering; waiting for it to be turned on", usbInfo->so->codename);
+			waiting = true;
+			for (int i = 0; i < HOTPLUG_CONFIG_RETRY_US / 100000 && !hotplug_closing(sv, usbInfo); i++)
+				OGUSleep(100000);
+		}
+	}
+
+	OGLockMutex(sv->hotplug_lock);
+	usbInfo->open_result = r;
+	usbInfo->state = USB_SLOT_OPENED;
+	OGUnlockMutex(sv->hotplug_lock);
+	return 0;
+}
+
+static bool object_is_added(SurviveContext *ctx, SurviveObject *so) {
+	for (int i = 0; i < ctx->objs_ct; i++) {
+		if (ctx->objs[i] == so)
+			return true;
+	}
+	return false;
+}
+
+// Picks the first codename of the device's type that no other slot is using. A device that comes back gets the object
+// it had before, so whoever holds it keeps getting poses.
+static SurviveObject *hotplug_object_for(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo) {
+	SurviveContext *ctx = sv->ctx;
+	const struct DeviceInfo *info = usbInfo->device_info;
+	if (info->codename[0] == 0)
+		return 0;
+
+	for (int n = 0; n < 10; n++) {
+		char codename[4] = {0};
+		strcpy(codename, info->codename);
+		codename[2] += n;
+
+		bool in_use = false;
+		for (int i = 0; i < sv->udev_cnt && !in_use; i++) {
+			struct SurviveUSBInfo *other = &sv->udev[i];
+			in_use = other != usbInfo && other->state != USB_SLOT_FREE && other->so &&
+					 strcmp(other->so->codename, codename) == 0;
+		}
+		if (in_use)
+			continue;
+
+		SurviveObject *so = survive_get_so_by_name(ctx, codename);
+		if (so && so->driver == sv) {
+			// The config is read again, and the device might not be the same one; hotplug_attach compares serials
+			free(so->sensor_locations);
+			free(so->sensor_normals);
+			free(so->channel_map);
+			so->sensor_locations = so->sensor_normals = 0;
+			so->channel_map = 0;
+			so->sensor_ct = 0;
+			return so;
+		}
+		return survive_create_device(ctx, "HTC", sv, codename, 0);
+	}
+	return 0;
+}
+
+static void hotplug_device_arrived(SurviveViveData *sv, libusb_device *d) {
+	SurviveContext *ctx = sv->ctx;
+	const struct DeviceInfo *info = find_device_info(sv, d);
+
+	// Freed slots can sit below ones in use, so every slot is checked for the device before a free one is taken
+	struct SurviveUSBInfo *usbInfo = 0;
+	for (int i = 0; i < MAX_USB_DEVS; i++) {
+		struct SurviveUSBInfo *slot = &sv->udev[i];
+		if (slot->state == USB_SLOT_FREE) {
+			if (usbInfo == 0)
+				usbInfo = slot;
+		} else if (slot->device == d)
+			return; // Enumeration and a real arrival can both report the same device
+		else if (info->type == USB_DEV_HMD && slot->device_info->type == USB_DEV_HMD)
+			return;
+	}
+	if (usbInfo == 0) {
+		SV_WARN("Ignoring %s; all %d device slots are in use", info->name, MAX_USB_DEVS);
+		return;
+	}
+	if (usbInfo - sv->udev >= sv->udev_cnt)
+		sv->udev_cnt = usbInfo - sv->udev + 1;
+
+	memset(usbInfo, 0, sizeof(*usbInfo));
+	usbInfo->sv = sv;
+	usbInfo->device = libusb_ref_device(d);
+	usbInfo->device_info = info;
+	usbInfo->arrival_time = OGGetAbsoluteTime();
+	usbInfo->so = hotplug_object_for(sv, usbInfo);
+	if (usbInfo->so == 0 && info->type != USB_DEV_HMD) {
+		SV_WARN("Ignoring %s; there are too many of them plugged in", info->name);
+		libusb_unref_device(usbInfo->device);
+		memset(usbInfo, 0, sizeof(*usbInfo));
+		return;
+	}
+	usbInfo->state = USB_SLOT_OPENING;
+	SV_INFO("%s plugged in", info->name);
+	usbInfo->opener = OGCreateThread(vive_hotplug_opener, usbInfo);
+}
+
+static void hotplug_device_left(SurviveViveData *sv, libusb_device *d) {
+	SurviveContext *ctx = sv->ctx;
+	for (int i = 0; i < sv->udev_cnt; i++) {
+		struct SurviveUSBInfo *usbInfo = &sv->udev[i];
+		if (usbInfo->state == USB_SLOT_FREE || usbInfo->device != d)
+			continue;
+
+		OGLockMutex(sv->hotplug_lock);
+		usbInfo->unplugged = true;
+		OGUnlockMutex(sv->hotplug_lock);
+
+		if (usbInfo->state != USB_SLOT_ATTACHED)
+			return;
+
+		SV_INFO("%s unplugged", usbInfo->so ? usbInfo->so->codename : usbInfo->device_info->name);
+		for (int j = 0; j < usbInfo->interface_cnt; j++) {
+			SurviveUSBInterface *iface = &usbInfo->interfaces[j];
+			iface->stopping = true;
+			if (iface->transfer)
+				libusb_cancel_transfer(iface->transfer);
+		}
+		if (usbInfo->so) {
+			usbInfo->so->counters.disconnections++;
+			if (sv->capture)
+				survive_usb_capture_write(sv->capture, SURVIVE_USB_CAPTURE_DETACH, usbInfo->so->codename, 0, 0, 0);
+		}
+		usbInfo->state = USB_SLOT_DETACHING;
+		return;
+	}
+}
+
+static void hotplug_release_slot(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo) {
+	free(usbInfo->config);
+	if (usbInfo->handle)
+		libusb_close(usbInfo->handle);
+	libusb_unref_device(usbInfo->device);
+
+	// An object that never made it into the context is only known here
+	if (usbInfo->so && !object_is_added(sv->ctx, usbInfo->so)) {
+		free(usbInfo->so->sensor_locations);
+		free(usbInfo->so->sensor_normals);
+		free(usbInfo->so->channel_map);
+		free(usbInfo->so);
+	}
+	memset(usbInfo, 0, sizeof(*usbInfo));
+}
+
+static SurviveObject *attached_hmd(SurviveViveData *sv) {
+	for (int i = 0; i < sv->udev_cnt; i++) {
+		if (sv->udev[i].state == USB_SLOT_ATTACHED && sv->udev[i].device_info->type == USB_DEV_HMD_IMU_LH)
+			return sv->udev[i].so;
+	}
+	return 0;
+}
+
+static void hotplug_attach(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo) {
+	SurviveContext *ctx = sv->ctx;
+
+	// The mainboard reports into the HMD's object, so it waits for that
+	if (usbInfo->device_info->type == USB_DEV_HMD) {
+		usbInfo->so = attached_hmd(sv);
+		if (usbInfo->so == 0)
+			return;
+	}
+
+	SurviveObject *so = usbInfo->so;
+	bool reused = object_is_added(ctx, so);
+	if (usbInfo->config) {
+		char serial[sizeof(so->serial_number)];
+		strcpy(serial, so->serial_number);
+		so->serial_number[0] = 0;
+
+		char *config = usbInfo->config;
+		usbInfo->config = 0;
+		int r = ApplyConfig(sv, usbInfo, config, usbInfo->config_len);
+		if (r != 0) {
+			SV_WARN("Could not bring up %s (%d); unplug it and plug it back in to retry", usbInfo->device_info->name,
+					r);
+			hotplug_release_slot(sv, usbInfo);
+			return;
+		}
+
+		// Another device of the same type took over the codename; what the poser knew is about the old one
+		if (reused && (serial[0] == 0 || strcmp(serial, so->serial_number) != 0) && so->PoserFn) {
+			SV_INFO("%s is now %s; resetting its poser", so->codename,
+					so->serial_number[0] ? so->serial_number : "a different device");
+			PoserData pd = {.pt = POSERDATA_DISASSOCIATE};
+			so->PoserFn(so, &pd);
+			so->PoserData = 0;
+		}
+	}
+	if (!reused)
+		survive_add_object(ctx, so);
+
+	for (const struct Endpoint_t *endpoint = usbInfo->device_info->endpoints; endpoint->name; endpoint++) {
+		if (AttachInterface(sv, usbInfo, endpoint, usbInfo->handle, survive_data_cb) != 0) {
+			SV_WARN("Could not attach %s; unplug it and plug it back in to retry", so->codename);
+			break;
+		}
+	}
+
+	usbInfo->state = USB_SLOT_ATTACHED;
+	if (usbInfo->device_info->type != USB_DEV_HMD) {
+		so->counters.connections++;
+		if (sv->capture)
+			survive_usb_capture_write(sv->capture, SURVIVE_USB_CAPTURE_ATTACH, so->codename, 0, 0, 0);
+	}
+	SV_INFO("%s is tracking %.0fms after it was plugged in", so->codename,
+			(OGGetAbsoluteTime() - usbInfo->arrival_time) * 1000.);
+}
+
+// Called from the poll thread: starts openers for new devices, attaches the ones whose openers are done, and frees the
+// slots of unplugged ones once their transfers are back. Devices that are already tracking are never waited on.
+static void vive_process_hotplug(SurviveViveData *sv) {
+	SurviveContext *ctx = sv->ctx;
+
+	OGLockMutex(sv->hotplug_lock);
+	SurviveUSBHotplugEvent *events = sv->hotplug_events;
+	size_t event_cnt = sv->hotplug_event_cnt;
+	sv->hotplug_events = 0;
+	sv->hotplug_event_cnt = 0;
+	OGUnlockMutex(sv->hotplug_lock);
+
+	for (size_t i = 0; i < event_cnt; i++) {
+		if (events[i].arrived)
+			hotplug_device_arrived(sv, events[i].device);
+		else
+			hotplug_device_left(sv, events[i].device);
+		libusb_unref_device(events[i].device);
+	}
+	free(events);
+
+	for (int i = 0; i < sv->udev_cnt; i++) {
+		struct SurviveUSBInfo *usbInfo = &sv->udev[i];
+
+		OGLockMutex(sv->hotplug_lock);
+		enum SurviveUSBState state = usbInfo->state;
+		OGUnlockMutex(sv->hotplug_lock);
+
+		if (state == USB_SLOT_OPENED) {
+			if (usbInfo->opener) {
+				OGJoinThread(usbInfo->opener);
+				usbInfo->opener = 0;
+			}
+
+			if (usbInfo->unplugged || usbInfo->open_result != 0) {
+				if (!usbInfo->unplugged)
+					SV_WARN("Could not bring up %s (%d); unplug it and plug it back in to retry",
+							usbInfo->device_info->name, usbInfo->open_result);
+				hotplug_release_slot(sv, usbInfo);
+			} else {
+				hotplug_attach(sv, usbInfo);
+			}
+		} else if (state == USB_SLOT_DETACHING) {
+			bool done = true;
+			for (int j = 0; j < usbInfo->interface_cnt; j++)
+				done &= usbInfo->interfaces[j].transfer == 0;
+			if (done)
+				hotplug_release_slot(sv, usbInfo);
+		}
+	}
+}
+
+static int vive_register_hotplug(SurviveViveData *sv) {
+	SurviveContext *ctx = sv->ctx;
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+		SV_WARN("libusb has no hotplug support here; enumerating devices once instead");
+		return -1;
+	}
+
+	sv->hotplug_lock = OGCreateMutex();
+
+	// Devices that are already plugged in are reported right away
+	int r = libusb_hotplug_register_callback(
+		sv->usbctx, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, LIBUSB_HOTPLUG_ENUMERATE,
+		LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, vive_hotplug_cb, sv,
+		&sv->hotplug_handle);
+	if (r != LIBUSB_SUCCESS) {
+		SV_WARN("Could not register for hotplug events (%s); enumerating devices once instead", libusb_error_name(r));
+		OGDeleteMutex(sv->hotplug_lock);
+		sv->hotplug_lock = 0;
+		return -1;
+	}
+
+	SV_INFO("Waiting for devices to be plugged in");
+	vive_process_hotplug(sv);
+	return 0;
+}
+
+static void vive_close_hotplug(SurviveViveData *sv) {
+	libusb_hotplug_deregister_callback(sv->usbctx, sv->hotplug_handle);
+
+	OGLockMutex(sv->hotplug_lock);
+	sv->closing = true;
+	OGUnlockMutex(sv->hotplug_lock);
+
+	for (int i = 0; i < sv->udev_cnt; i++) {
+		struct SurviveUSBInfo *usbInfo = &sv->udev[i];
+		if (usbInfo->opener) {
+			OGJoinThread(usbInfo->opener);
+			usbInfo->opener = 0;
+		}
+		free(usbInfo->config);
+		usbInfo->config = 0;
+		// Objects that never got attached aren't the context's to free
+		if (usbInfo->state != USB_SLOT_FREE && usbInfo->so && !object_is_added(sv->ctx, usbInfo->so)) {
+			free(usbInfo->so->sensor_locations);
+			free(usbInfo->so->sensor_normals);
+			free(usbInfo->so->channel_map);
+			free(usbInfo->so);
+			usbInfo->so = 0;
+		}
+	}
+
+	for (size_t i = 0; i < sv->hotplug_event_cnt; i++)
+		libusb_unref_device(sv->hotplug_events[i].device);
+	free(sv->hotplug_events);
+	OGDeleteMutex(sv->hotplug_lock);
+}
+#endif
+
 int survive_usb_init(SurviveViveData *sv) {
 	SurviveContext *ctx = sv->ctx;
 	const char *blacklist = survive_configs(ctx, "blacklist-devs", SC_GET, "-");
@@ -484,6 +948,14 @@ int survive_usb_init(SurviveViveData *sv) {
 		return r;
 	}
 
+#ifndef HIDAPI
+	if (sv->hotplug) {
+		if (vive_register_hotplug(sv) == 0)
+			return 0;
+		sv->hotplug = false;
+	}
+#endif
+
 	survive_usb_devices_t devs;
 	int ret = survive_get_usb_devices(sv, &devs);
 
@@ -526,6 +998,7 @@ int survive_usb_init(SurviveViveData *sv) {
 			struct SurviveUSBInfo *usbInfo = &sv->udev[sv->udev_cnt++];
 			usbInfo->handle = 0;
 			usbInfo->device_info = info;
+			usbInfo->state = USB_SLOT_ATTACHED;
 
 			ret = survive_open_usb_device(sv, d, usbInfo);
 
@@ -556,6 +1029,7 @@ int survive_usb_init(SurviveViveData *sv) {
 
 			SurviveObject *so = survive_create_device(ctx, "HTC", sv, codename, 0);
 			survive_add_object(ctx, so);
+			so->counters.connections++;
 			usbInfo->so = so;
 
 			if (USB_DEV_HMD_IMU_LH == usbInfo->device_info->type) {
@@ -604,24 +1078,28 @@ int survive_usb_init(SurviveViveData *sv) {
 	return 0;
 }
 
+static void send_device_magic(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, int magic_code) {
+	SurviveContext *ctx = sv->ctx;
+	for (const struct Magic_t *magic = usbInfo->device_info->magics; magic->magic; magic++) {
+		if (magic->code == magic_code) {
+			uint8_t *data = alloca(sizeof(uint8_t) * magic->length);
+			memcpy(data, magic->magic, magic->length);
+
+			int r = update_feature_report(usbInfo->handle, 0, data, magic->length);
+			if (r != magic->length && usbInfo->so)
+				SV_WARN("Could not turn on %s(%d) (%d/%lu - %s)", usbInfo->so->codename, usbInfo->device_info->type, r,
+						magic->length, survive_usb_error_name(r));
+		}
+	}
+}
+
 int survive_vive_send_magic(SurviveContext *ctx, void *drv, int magic_code, void *data, int datalen) {
-	int r;
 	SurviveViveData *sv = drv;
 
+	// Hotplugged devices get sent theirs as they are opened
 	for (int i = 0; i < sv->udev_cnt; i++) {
-		struct SurviveUSBInfo *usbInfo = &sv->udev[i];
-
-		for (const struct Magic_t *magic = usbInfo->device_info->magics; magic->magic; magic++) {
-			if (magic->code == magic_code) {
-				uint8_t *data = alloca(sizeof(uint8_t) * magic->length);
-				memcpy(data, magic->magic, magic->length);
-
-				r = update_feature_report(usbInfo->handle, 0, data, magic->length);
-				if (r != magic->length && usbInfo->so)
-					SV_WARN("Could not turn on %s(%d) (%d/%lu - %s)", usbInfo->so->codename, usbInfo->device_info->type,
-							r, magic->length, survive_usb_error_name(r));
-			}
-		}
+		if (sv->udev[i].state == USB_SLOT_ATTACHED)
+			send_device_magic(sv, &sv->udev[i], magic_code);
 	}
 
 #if 0
@@ -673,7 +1151,7 @@ int survive_vive_send_haptic(SurviveObject *so, uint8_t reserved, uint16_t pulse
 	for (int i = 0; i < sv->udev_cnt; i++) {
 		struct SurviveUSBInfo *usbInfo = &sv->udev[i];
 
-		if (usbInfo->so == so) {
+		if (usbInfo->so == so && usbInfo->state == USB_SLOT_ATTACHED) {
 			r = update_feature_report(usbInfo->handle, 0, vive_controller_haptic_pulse,
 									  sizeof(vive_controller_haptic_pulse));
 			r = getupdate_feature_report(usbInfo->handle, 0, vive_controller_haptic_pulse,
@@ -710,14 +1188,27 @@ void survive_vive_usb_close(SurviveViveData *sv) {
 	// hid_exit();
 
 #else
+	if (sv->hotplug)
+		vive_close_hotplug(sv);
+
 	for (i = 0; i < sv->udev_cnt; i++) {
-		libusb_close(sv->udev[i].handle);
+		if (sv->udev[i].handle)
+			libusb_close(sv->udev[i].handle);
+		if (sv->udev[i].device)
+			libusb_unref_device(sv->udev[i].device);
 	}
 	libusb_exit(sv->usbctx);
 #endif
 }
 
 STATIC_CONFIG_ITEM(SECONDS_PER_HZ_OUTPUT, "usb-hz-output", 'i', "Seconds between outputing usb stats", -1);
+STATIC_CONFIG_ITEM(USB_CAPTURE, "usb-capture", 's',
+				   "File to write every raw USB packet and device config to, for replay with --usbreplay.", "");
+STATIC_CONFIG_ITEM(USB_HOTPLUG, "usb-hotplug", 'i',
+				   "Bring devices up as they are plugged in, each on its own thread, and drop them when unplugged, "
+				   "rather than configuring everything present at startup one after another.",
+				   0);
+
 int survive_vive_usb_poll(SurviveContext *ctx, void *v) {
 	SurviveViveData *sv = v;
 	sv->read_count++;
@@ -733,7 +1224,7 @@ int survive_vive_usb_poll(SurviveContext *ctx, void *v) {
 	if (print) {
 		seconds = now_seconds;
 		for (int i = 0; i < sv->udev_cnt; i++) {
-			if (sv->udev[i].so == 0)
+			if (sv->udev[i].so == 0 || sv->udev[i].state != USB_SLOT_ATTACHED)
 				continue;
 
 			for (int j = 0; j < sv->udev[i].interface_cnt; j++) {
@@ -759,7 +1250,15 @@ int survive_vive_usb_poll(SurviveContext *ctx, void *v) {
 	return 0;
 #endif
 #else
-	int r = libusb_handle_events(sv->usbctx);
+	int r;
+	if (sv->hotplug) {
+		// Openers finishing don't wake libusb up, so don't wait on it for long
+		struct timeval timeout = {.tv_usec = 10000};
+		r = libusb_handle_events_timeout(sv->usbctx, &timeout);
+		vive_process_hotplug(sv);
+	} else {
+		r = libusb_handle_events(sv->usbctx);
+	}
 	if (r) {
 		SurviveContext *ctx = sv->ctx;
 		SV_ERROR("Libusb poll failed. %d (%s)", r, libusb_error_name(r));
@@ -952,37 +1451,18 @@ typedef struct {
 	uint16_t triggerHighRes;
 } buttonEvent;
 
-void incrementAndPostButtonQueue(SurviveContext *ctx) {
-	ButtonQueueEntry *entry = &(ctx->buttonQueue.entry[ctx->buttonQueue.nextWriteIndex]);
-
-	if ((ctx->buttonQueue.nextWriteIndex + 1) % BUTTON_QUEUE_MAX_LEN == ctx->buttonQueue.nextReadIndex) {
-		// There's not enough space to write this entry.  Clear it out and move along
-		// printf("Button Buffer Full\n");
-		memset(entry, 0, sizeof(ButtonQueueEntry));
-		return;
-	}
-	entry->isPopulated = 1;
-	ctx->buttonQueue.nextWriteIndex++;
-	// if we've exceeded the size of the buffer, loop around to the beginning.
-	if (ctx->buttonQueue.nextWriteIndex >= BUTTON_QUEUE_MAX_LEN) {
-		ctx->buttonQueue.nextWriteIndex = 0;
-	}
-	OGUnlockSema(ctx->buttonQueue.buttonservicesem);
-
-	// clear out any old data in the entry so we always start with a clean slate.
-	entry = &(ctx->buttonQueue.entry[ctx->buttonQueue.nextWriteIndex]);
+// Queues the event and clears it so the next one starts with a clean slate. Several USB threads can get here at once;
+// the queue handles that.
+static void pushButtonEvent(SurviveObject *so, ButtonQueueEntry *entry) {
+	survive_button_queue_push(&so->ctx->buttonQueue, entry);
 	memset(entry, 0, sizeof(ButtonQueueEntry));
+	entry->so = so;
 }
 
-// important!  This must be the only place that we're posting to the buttonEntryQueue
-// if that ever needs to be changed, you will have to add locking so that only one
-// thread is posting at a time.
 void registerButtonEvent(SurviveObject *so, buttonEvent *event) {
 
-	ButtonQueueEntry *entry = &(so->ctx->buttonQueue.entry[so->ctx->buttonQueue.nextWriteIndex]);
-
-	memset(entry, 0, sizeof(ButtonQueueEntry));
-
+	ButtonQueueEntry queued = {0};
+	ButtonQueueEntry *entry = &queued;
 	entry->so = so;
 	if (event->pressedButtonsValid) {
 		// printf("trigger %8.8x\n", event->triggerHighRes);
@@ -1004,8 +1484,7 @@ void registerButtonEvent(SurviveObject *so, buttonEvent *event) {
 					// as buttonId 24 (look further down in this function)
 					entry->buttonId = 24;
 				}
-				incrementAndPostButtonQueue(so->ctx);
-				entry = &(so->ctx->buttonQueue.entry[so->ctx->buttonQueue.nextWriteIndex]);
+				pushButtonEvent(so, entry);
 			}
 		}
 		// if the trigger button is depressed & it wasn't before
@@ -1013,16 +1492,14 @@ void registerButtonEvent(SurviveObject *so, buttonEvent *event) {
 			((so->buttonmask) & (0xff000000)) != 0xff000000) {
 			entry->eventType = BUTTON_EVENT_BUTTON_DOWN;
 			entry->buttonId = 24;
-			incrementAndPostButtonQueue(so->ctx);
-			entry = &(so->ctx->buttonQueue.entry[so->ctx->buttonQueue.nextWriteIndex]);
+			pushButtonEvent(so, entry);
 		}
 		// if the trigger button isn't depressed but it was before
 		else if ((((event->pressedButtons) & (0xff000000)) != 0xff000000) &&
 				 ((so->buttonmask) & (0xff000000)) == 0xff000000) {
 			entry->eventType = BUTTON_EVENT_BUTTON_UP;
 			entry->buttonId = 24;
-			incrementAndPostButtonQueue(so->ctx);
-			entry = &(so->ctx->buttonQueue.entry[so->ctx->buttonQueue.nextWriteIndex]);
+			pushButtonEvent(so, entry);
 		}
 	}
 	if (event->triggerHighResValid) {
@@ -1030,8 +1507,7 @@ void registerButtonEvent(SurviveObject *so, buttonEvent *event) {
 			entry->eventType = BUTTON_EVENT_AXIS_CHANGED;
 			entry->axis1Id = 1;
 			entry->axis1Val = event->triggerHighRes;
-			incrementAndPostButtonQueue(so->ctx);
-			entry = &(so->ctx->buttonQueue.entry[so->ctx->buttonQueue.nextWriteIndex]);
+			pushButtonEvent(so, entry);
 		}
 	}
 	if ((event->touchpadHorizontalValid) && (event->touchpadVerticalValid)) {
@@ -1041,8 +1517,7 @@ void registerButtonEvent(SurviveObject *so, buttonEvent *event) {
 			entry->axis1Val = event->touchpadHorizontal;
 			entry->axis2Id = 3;
 			entry->axis2Val = event->touchpadVertical;
-			incrementAndPostButtonQueue(so->ctx);
-			entry = &(so->ctx->buttonQueue.entry[so->ctx->buttonQueue.nextWriteIndex]);
+			pushButtonEvent(so, entry);
 		}
 	}
 
@@ -1211,10 +1686,13 @@ static void handle_watchman(SurviveObject *so, uint8_t *readdata) {
 		*readdata = type;						// Put 'type' back on stack.
 
 		LightcapElement les[10] = {0};
+		SURVIVE_LATENCY_BEGIN(so, decode_start);
 		int lese =
 			parse_watchman_lightcap(so->ctx, so->codename, time1, so->activations.last_imu, readdata, qty, les, 10);
+		SURVIVE_LATENCY_END(so, SURVIVE_LATENCY_LIGHTCAP_DECODE, decode_start);
 
 		if (lese < 0) {
+			so->counters.invalid_lightcaps++;
 			SV_WARN("Parse error code %d", lese);
 			goto failure;
 		}
@@ -1442,6 +1920,10 @@ void survive_data_cb(SurviveUSBInterface *si) {
 	SurviveObject *obj = si->assoc_obj;
 	uint8_t *readdata = si->buffer;
 
+	SURVIVE_LATENCY_BEGIN(obj, start);
+	obj->counters.packets++;
+	if (si->sv && si->sv->capture)
+		survive_usb_capture_write(si->sv->capture, SURVIVE_USB_CAPTURE_PACKET, obj->codename, iface, si->buffer, size);
 	int id = POP1;
 	//	printf( "%16s Size: %2d ID: %d / %d\n", si->hname, size, id, iface );
 //	SV_INFO("%s interface %d", obj->codename, iface);
@@ -1643,26 +2125,25 @@ void survive_data_cb(SurviveUSBInterface *si) {
 		int a = 0; // breakpoint here
 	}
 	}
+
+	SURVIVE_LATENCY_END(obj, SURVIVE_LATENCY_USB, start);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-static int LoadConfig(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, int iface) {
-	SurviveContext *ctx = sv->ctx;
-	char *ct0conf = 0;
-
+// Reads the device's raw config and returns its length. A negative length means the device didn't answer, which is
+// what a wireless device does while it is turned off. This only talks to the device, so hotplug openers call it off
+// the poll thread.
+static int FetchConfig(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, int iface, char **config) {
 	bool extra_magic = usbInfo->device_info->type == USB_DEV_WATCHMAN1;
+	return survive_get_config(config, sv, usbInfo, iface, extra_magic);
+}
 
+// Parses a config fetched with FetchConfig into the device's object, and frees it
+static int ApplyConfig(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, char *ct0conf, int len) {
 	SurviveObject *so = usbInfo->so;
-	int len = survive_get_config(&ct0conf, sv, usbInfo, iface, extra_magic);
-	if (len < 0) {
-		survive_remove_object(ctx, so);
-		usbInfo->so = 0;
-		return len;
-	}
-
 	{
 		char raw_fname[100];
 		sprintf(raw_fname, "%s_config.json", so->codename);
@@ -1670,14 +2151,82 @@ static int LoadConfig(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, int i
 		fwrite(ct0conf, strlen(ct0conf), 1, f);
 		fclose(f);
 	}
+	if (sv->capture)
+		survive_usb_capture_write(sv->capture, SURVIVE_USB_CAPTURE_CONFIG, so->codename, 0, ct0conf, len);
+
+	int r = so->ctx->configfunction(so, ct0conf, len);
+	free(ct0conf);
+	return r;
+}
+
+// Reads the device's config into its object; the length is negative if the device didn't answer
+static int ReadConfig(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, int iface, int *len) {
+	char *ct0conf = 0;
+	*len = FetchConfig(sv, usbInfo, iface, &ct0conf);
+	if (*len < 0)
+		return *len;
+	return ApplyConfig(sv, usbInfo, ct0conf, *len);
+}
+
+static int LoadConfig(SurviveViveData *sv, struct SurviveUSBInfo *usbInfo, int iface) {
+	int len;
+	int r = ReadConfig(sv, usbInfo, iface, &len);
+	if (len < 0) {
+		survive_remove_object(sv->ctx, usbInfo->so);
+		usbInfo->so = 0;
+	}
+	return r;
+}
 
-	return so->ctx->configfunction(so, ct0conf, len);
+struct SurviveUSBCapture {
+	FILE *f;
+	og_mutex_t lock;
+	double start;
+};
+
+struct SurviveUSBCapture *survive_usb_capture_open(SurviveContext *ctx, const char *path) {
+	FILE *f = fopen(path, "wb");
+	if (f == 0) {
+		SV_WARN("Could not open '%s' to capture USB packets to", path);
+		return 0;
+	}
+	fwrite(SURVIVE_USB_CAPTURE_MAGIC, strlen(SURVIVE_USB_CAPTURE_MAGIC), 1, f);
+
+	struct SurviveUSBCapture *capture = calloc(1, sizeof(struct SurviveUSBCapture));
+	capture->f = f;
+	capture->lock = OGCreateMutex();
+	capture->start = OGGetAbsoluteTime();
+	SV_INFO("Capturing raw USB packets to '%s'", path);
+	return capture;
+}
+
+void survive_usb_capture_write(struct SurviveUSBCapture *capture, enum SurviveUSBCaptureRecordType type,
+							   const char *codename, int iface, const void *data, size_t length) {
+	SurviveUSBCaptureRecord record = {
+		.time = OGGetAbsoluteTime() - capture->start, .length = length, .type = type, .iface = iface};
+	strncpy(record.codename, codename, sizeof(record.codename) - 1);
+
+	// With HIDAPI every interface has its own receive thread
+	OGLockMutex(capture->lock);
+	fwrite(&record, sizeof(record), 1, capture->f);
+	fwrite(data, length, 1, capture->f);
+	OGUnlockMutex(capture->lock);
+}
+
+void survive_usb_capture_close(struct SurviveUSBCapture *capture) {
+	if (capture == 0)
+		return;
+	fclose(capture->f);
+	OGDeleteMutex(capture->lock);
+	free(capture);
 }
 
 int survive_vive_close(SurviveContext *ctx, void *driver) {
 	SurviveViveData *sv = driver;
 
 	survive_vive_usb_close(sv);
+	survive_usb_capture_close(sv->capture);
+	sv->capture = 0;
 	return 0;
 }
 
@@ -1687,6 +2236,11 @@ int DriverRegHTCVive(SurviveContext *ctx) {
 	survive_attach_configi(ctx, SECONDS_PER_HZ_OUTPUT_TAG, &sv->seconds_per_hz_output);
 
 	sv->ctx = ctx;
+	sv->hotplug = survive_configi(ctx, "usb-hotplug", SC_GET, 0);
+
+	const char *capture_path = survive_configs(ctx, "usb-capture", SC_GET, "");
+	if (capture_path[0])
+		sv->capture = survive_usb_capture_open(ctx, capture_path);
 
 #ifdef _WIN32
 	CreateDirectoryA("calinfo", NULL);
@@ -1703,6 +2257,12 @@ int DriverRegHTCVive(SurviveContext *ctx) {
 		goto fail_gracefully;
 	}
 
+	if (sv->hotplug) {
+		// Devices come and go from the poll loop from here on
+		survive_add_driver(ctx, sv, survive_vive_usb_poll, survive_vive_close, survive_vive_send_magic);
+		return 0;
+	}
+
 	if (sv->udev_cnt) {
 		survive_add_driver(ctx, sv, survive_vive_usb_poll, survive_vive_close, survive_vive_send_magic);
 	} else {
@@ -1724,6 +2284,7 @@ int DriverRegHTCVive(SurviveContext *ctx) {
 	return 0;
 fail_gracefully:
 	survive_vive_usb_close(sv);
+	survive_usb_capture_close(sv->capture);
 	free(sv);
 	return -1;
 }
@@ -83,9 +83,44 @@ typedef struct SurviveUSBInterface {
 	int which_interface_am_i; // for indexing into uiface
 	const char *hname;		  // human-readable names
 	size_t packet_count;
+	bool stopping; // Set when the device is detached; the transfer is freed instead of resubmitted
+	int error_cnt; // Failed transfers in a row; with hotplug, they are retried up to a limit
 } SurviveUSBInterface;
 
 void survive_data_cb(SurviveUSBInterface *si);
 int parse_watchman_lightcap(struct SurviveContext *ctx, const char *codename, uint8_t time1,
 							survive_timecode reference_time, uint8_t *readdata, size_t qty, LightcapElement *les,
-							size_t output_cnt);
\ No newline at end of file
+							size_t output_cnt);
+
+/*
+ * Raw USB capture files, written by the vive driver with '--usb-capture' and replayed with '--usbreplay'.
+ *
+ * The file starts with SURVIVE_USB_CAPTURE_MAGIC and is followed by records: a SurviveUSBCaptureRecord, then 'length'
+ * bytes. A config record holds a device's JSON config and always comes before that device's packets; a packet record
+ * holds one interrupt transfer exactly as survive_data_cb got it. With '--usb-hotplug' an attach record marks when
+ * a device started sending, after its config, and a detach record when it was unplugged; both are empty. Everything
+ * is little endian.
+ */
+#define SURVIVE_USB_CAPTURE_MAGIC "SVUSBCP1"
+
+enum SurviveUSBCaptureRecordType {
+	SURVIVE_USB_CAPTURE_CONFIG = 'C',
+	SURVIVE_USB_CAPTURE_PACKET = 'P',
+	SURVIVE_USB_CAPTURE_ATTACH = 'A',
+	SURVIVE_USB_CAPTURE_DETACH = 'D'
+};
+
+typedef struct SurviveUSBCaptureRecord {
+	double time;	  // Seconds since the capture started
+	uint32_t length;  // Bytes following this header
+	char codename[8]; // Device codename, null-terminated
+	uint8_t type;	 // SurviveUSBCaptureRecordType
+	uint8_t iface;	// USB_IF_t of a packet
+	uint8_t reserved[2];
+} SurviveUSBCaptureRecord;
+
+struct SurviveUSBCapture;
+struct SurviveUSBCapture *survive_usb_capture_open(SurviveContext *ctx, const char *path);
+void survive_usb_capture_write(struct SurviveUSBCapture *capture, enum SurviveUSBCaptureRecordType type,
+							   const char *codename, int iface, const void *data, size_t length);
+void survive_usb_capture_close(struct SurviveUSBCapture *capture);
@@ -11,6 +11,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "survive_latency.h"
+
 static uint32_t PoserData_timecode(PoserData *poser_data) {
 	switch (poser_data->pt) {
 	case POSERDATA_LIGHT: {
@@ -42,6 +44,8 @@ void PoserData_poser_pose_func(PoserData *poser_data, SurviveObject *so, const S
 	if (poser_data->poseproc) {
 		poser_data->poseproc(so, PoserData_timecode(poser_data), imu2world, poser_data->userdata);
 	} else {
+		so->counters.poses++;
+
 		static int report_in_imu = -1;
 		if (report_in_imu == -1) {
 			survive_attach_configi(so->ctx, "report-in-imu", &report_in_imu);
@@ -58,7 +62,9 @@ void PoserData_poser_pose_func(PoserData *poser_data, SurviveObject *so, const S
 		for (int i = 0; i < 7; i++)
 			assert(!isnan(((double *)imu2world)[i]));
 
+		SURVIVE_LATENCY_BEGIN(so, start);
 		so->ctx->poseproc(so, PoserData_timecode(poser_data), &head2world);
+		SURVIVE_LATENCY_END(so, SURVIVE_LATENCY_POSE_DELIVERY, start);
 	}
 }
 void PoserData_poser_pose_func_with_velocity(PoserData *poser_data, SurviveObject *so, const SurvivePose *imu2world,
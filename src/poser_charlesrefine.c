@@ -541,6 +541,12 @@ int PoserCharlesRefine(SurviveObject *so, PoserData *pd) {
 	}
 	case POSERDATA_FULL_SCENE: {
 		// return opencv_solver_fullscene(so, (PoserDataFullScene *)(pd));
+		break;
+	}
+	case POSERDATA_DISASSOCIATE: {
+		free(dd);
+		so->PoserData = 0;
+		return 0;
 	}
 	}
 	return -1;
@@ -1,5 +1,8 @@
 #include "linmath.h"
+#include "os_generic.h"
+#include "poser_charlesslow.h"
 #include "survive_cal.h"
+#include "survive_config.h"
 #include <dclapack.h>
 #include <linmath.h>
 #include <math.h>
@@ -16,8 +19,172 @@ typedef struct
 } DummyData;
 
 
+STATIC_CONFIG_ITEM(CHARLESSLOW_THREADS, "charlesslow-threads", 'i', "Threads used for the CharlesSlow grid search", 4);
+STATIC_CONFIG_ITEM(CHARLESSLOW_MIN_IMPROVEMENT, "charlesslow-min-improvement", 'f',
+				   "Stop refining a lighthouse once a CharlesSlow cycle improves its error by less than this; 0 never stops early",
+				   1e-10);
+
+#define MAX_GRID_THREADS 64
+
 static FLT RunOpti( SurviveObject * so, PoserDataFullScene * fs, int lh, int print, FLT * LighthousePos, FLT * LighthouseQuat );
 
+//One worker's share of a cycle of the grid search: a contiguous range of grid cells, numbered in the
+//order the search used to visit them (dz outermost, dx innermost).
+typedef struct
+{
+	SurviveObject * so;
+	PoserDataFullScene * fs;
+	int lh;
+	const FLT * center;     //Best position from the last cycle; the grid is offset from it.
+	const FLT * offsets;    //Offsets along each axis.
+	int steps;              //Number of offsets.
+	size_t begin, end;
+	FLT * cellErrors;       //If set, gets the error of every cell.
+
+	FLT beste;              //Best error in this range, and where it was.  The earliest cell wins ties.
+	FLT bestxyz[3];
+} GridSearchJob;
+
+static void * GridSearchWorker( void * user )
+{
+	GridSearchJob * job = user;
+	size_t steps = job->steps;
+
+	job->beste = 1e20;
+	memcpy( job->bestxyz, job->center, sizeof( job->bestxyz ) );
+
+	for( size_t cell = job->begin; cell < job->end; cell++ )
+	{
+		FLT LighthousePos[3];
+		FLT LighthouseQuat[4];
+		LighthousePos[0] = job->center[0] + job->offsets[cell % steps];
+		LighthousePos[1] = job->center[1] + job->offsets[(cell / steps) % steps];
+		LighthousePos[2] = job->center[2] + job->offsets[cell / (steps * steps)];
+
+		//Try refining the search for the best orientation several times.
+		FLT ft = RunOpti(job->so, job->fs, job->lh, 0, LighthousePos, LighthouseQuat);
+		if( job->cellErrors ) job->cellErrors[cell] = ft;
+
+		if( ft < job->beste ) { job->beste = ft; memcpy( job->bestxyz, LighthousePos, sizeof( LighthousePos ) ); }
+	}
+	return 0;
+}
+
+//Searches ever finer grids around the best position so far for where lighthouse 'lh' is, relative to the object, and
+//gives the error there.  The grid is split between 'threads' workers but merged in cell order, so the result doesn't
+//depend on how many there are.
+FLT CharlesSlowGridSearch( SurviveObject * so, PoserDataFullScene * fs, int lh, int threads, FLT minImprovement,
+						   FLT * bestxyz )
+{
+	if( threads < 1 ) threads = 1;
+	if( threads > MAX_GRID_THREADS ) threads = MAX_GRID_THREADS;
+
+	FLT beste = 1e20;
+	FLT lastBeste = 1e20;
+	int cycle;
+	bestxyz[0] = bestxyz[1] = bestxyz[2] = 0;
+
+	//STAGE1 1: Detemine vectoral position from lighthouse to target.  Does not determine lighthouse-target distance.
+	//This also is constantly optimizing the lighthouse quaternion for optimal spotting.
+	FLT fullrange = 5; //Maximum search space for positions.  (Relative to HMD)
+	
+
+	//Sweep whole area up to 30 times
+	for( cycle = 0; cycle < 30; cycle ++ )
+	{
+
+		//Adjust position, one axis at a time, over and over until we zero in.
+		{
+			//We split the space into this many groups (times 2) and
+			//if we're on the first cycle, we want to do a very linear
+			//search.  As we refine our search we can then use a more
+			//binary search technique.
+			FLT splits = 4;
+			if( cycle == 0 ) splits = 32;
+			if( cycle == 1 ) splits = 13;
+			if( cycle == 2 ) splits = 10;
+			if( cycle == 3 ) splits = 8;
+			if( cycle == 4 ) splits = 5;
+
+			//The offsets are accumulated exactly like the search always has, so the grid doesn't change.
+			FLT offsets[2 * 32 + 2];
+			int steps = 0;
+			for( FLT d = -fullrange; d < fullrange; d += fullrange/splits )
+				offsets[steps++] = d;
+			size_t cells = (size_t)steps * steps * steps;
+
+			FLT * cellErrors = 0;
+			if( cycle == 0 ) cellErrors = malloc( sizeof( FLT ) * cells );
+
+			//We search through the whole space, split into one range of cells per thread.
+			GridSearchJob jobs[MAX_GRID_THREADS];
+			og_thread_t workers[MAX_GRID_THREADS];
+			for( int t = 0; t < threads; t++ )
+			{
+				jobs[t] = (GridSearchJob){ .so = so, .fs = fs, .lh = lh, .center = bestxyz, .offsets = offsets,
+					.steps = steps, .begin = cells * t / threads, .end = cells * (t + 1) / threads,
+					.cellErrors = cellErrors };
+				if( t > 0 ) workers[t] = OGCreateThread( GridSearchWorker, &jobs[t] );
+			}
+			GridSearchWorker( &jobs[0] );
+			for( int t = 1; t < threads; t++ )
+				OGJoinThread( workers[t] );
+
+			//Merging in cell order keeps the earliest best cell, same as searching on one thread.
+			beste = 1e20;
+			FLT bestxyzrunning[3];
+			memcpy( bestxyzrunning, bestxyz, sizeof( bestxyzrunning ) );
+			for( int t = 0; t < threads; t++ )
+			{
+				if( jobs[t].beste < beste ) { beste = jobs[t].beste; memcpy( bestxyzrunning, jobs[t].bestxyz, sizeof( bestxyzrunning ) ); }
+			}
+
+			if( cycle == 0 )
+			{
+				char filename[1024];
+				sprintf( filename, "calinfo/%d_lighthouse.dat", lh );
+				FILE * f = fopen( filename, "wb" );
+				for( size_t i = 0; f && i < cells; i++ )
+				{
+					FLT dx = offsets[i % steps];
+					FLT dy = offsets[(i / steps) % steps];
+					FLT dz = offsets[i / ((size_t)steps * steps)];
+
+					FLT sk = cellErrors[i]*10.;
+					if( sk > 1 ) sk = 1;
+					uint8_t cell = (uint8_t)((1.0 - sk) * 255);
+					FLT epsilon = 0.1;
+
+					if( dz == 0 ) { /* Why is dz special? ? */
+					  if ( dx > -epsilon && dx < epsilon )
+						cell =  255;
+					  if ( dy > -epsilon && dy < epsilon )
+		                                    cell = 128;
+					}
+
+					fprintf( f, "%c", cell );
+				}
+				if( f ) fclose( f );
+				free( cellErrors );
+			}
+			memcpy( bestxyz, bestxyzrunning, sizeof( bestxyzrunning ) );
+
+			//Print out the quality of the lock this time.
+			FLT dist = sqrt(bestxyz[0]*bestxyz[0] + bestxyz[1]*bestxyz[1] + bestxyz[2]*bestxyz[2]);
+			printf( "%f %f %f (%f) = %f\n", bestxyz[0], bestxyz[1], bestxyz[2], dist, beste );
+		}
+
+		//From cycle 5 on the grid always includes its own center, so the error can't get worse;
+		//once it barely gets better, the search has converged.
+		if( cycle > 4 && minImprovement > 0 && lastBeste - beste < minImprovement ) break;
+		lastBeste = beste;
+
+		//Every cycle, tighten up the search area.
+		fullrange *= 0.25;
+	}
+	return beste;
+}
+
 int PoserCharlesSlow( SurviveObject * so, PoserData * pd )
 {
 	PoserType pt = pd->pt;
@@ -56,12 +223,12 @@ int PoserCharlesSlow( SurviveObject * so, PoserData * pd )
 
 		SurvivePose additionalTx = {0};
 
-		int lh, cycle;
-		FLT dz, dy, dx;
+		int threads = survive_configi(ctx, "charlesslow-threads", SC_GET, 4);
+		FLT minImprovement = survive_configf(ctx, "charlesslow-min-improvement", SC_GET, 1e-10);
+
+		int lh;
 		for( lh = 0; lh < 2; lh++ )
 		{
-			FLT beste = 1e20;
-
 			FLT LighthousePos[3];
 			FLT LighthouseQuat[4];
 
@@ -74,89 +241,8 @@ int PoserCharlesSlow( SurviveObject * so, PoserData * pd )
 			LighthouseQuat[3] = 0;
 
 			FLT bestxyz[3];
-			memcpy( bestxyz, LighthousePos, sizeof( LighthousePos ) );
-
-			//STAGE1 1: Detemine vectoral position from lighthouse to target.  Does not determine lighthouse-target distance.
-			//This also is constantly optimizing the lighthouse quaternion for optimal spotting.
-			FLT fullrange = 5; //Maximum search space for positions.  (Relative to HMD)
-	
-
-			//Sweep whole area 30 times
-			for( cycle = 0; cycle < 30; cycle ++ )
-			{
-
-				//Adjust position, one axis at a time, over and over until we zero in.
-				{
-					FLT bestxyzrunning[3];
-					beste = 1e20;
-
-					FILE * f;
-					if( cycle == 0 )
-					{
-						char filename[1024];
-						sprintf( filename, "calinfo/%d_lighthouse.dat", lh );
-						f = fopen( filename, "wb" );
-					}
-
-					//We split the space into this many groups (times 2) and
-					//if we're on the first cycle, we want to do a very linear
-					//search.  As we refine our search we can then use a more
-					//binary search technique.
-					FLT splits = 4;
-					if( cycle == 0 ) splits = 32;
-					if( cycle == 1 ) splits = 13;
-					if( cycle == 2 ) splits = 10;
-					if( cycle == 3 ) splits = 8;
-					if( cycle == 4 ) splits = 5;
-
-					//Wwe search throug the whole space.
-					for( dz = -fullrange; dz < fullrange; dz += fullrange/splits )
-					for( dy = -fullrange; dy < fullrange; dy += fullrange/splits )
-					for( dx = -fullrange; dx < fullrange; dx += fullrange/splits )
-					{
-						//Specificially adjust one axis at a time, searching for the best.
-						memcpy( LighthousePos, bestxyz, sizeof( LighthousePos ) );
-						LighthousePos[0] += dx;  //These are adjustments to the "best" from last frame.
-						LighthousePos[1] += dy;
-						LighthousePos[2] += dz;
-
-						FLT ft;
-						//Try refining the search for the best orientation several times.
-						ft = RunOpti(so, fs, lh, 0, LighthousePos, LighthouseQuat);
-						if( cycle == 0 )
-						{
-							FLT sk = ft*10.;
-							if( sk > 1 ) sk = 1;
-							uint8_t cell = (uint8_t)((1.0 - sk) * 255);
-							FLT epsilon = 0.1;
-
-							if( dz == 0 ) { /* Why is dz special? ? */
-							  if ( dx > -epsilon && dx < epsilon )
-								cell =  255;
-							  if ( dy > -epsilon && dy < epsilon )
-				                                    cell = 128;
-							}
-
-							fprintf( f, "%c", cell );
-						}
-
-						if( ft < beste ) { beste = ft; memcpy( bestxyzrunning, LighthousePos, sizeof( LighthousePos ) ); }
-					}
-
-					if( cycle == 0 )
-					{
-						fclose( f );
-					}
-					memcpy( bestxyz, bestxyzrunning, sizeof( bestxyz ) );
-
-					//Print out the quality of the lock this time.
-					FLT dist = sqrt(bestxyz[0]*bestxyz[0] + bestxyz[1]*bestxyz[1] + bestxyz[2]*bestxyz[2]);
-					printf( "%f %f %f (%f) = %f\n", bestxyz[0], bestxyz[1], bestxyz[2], dist, beste );
-				}
-
-				//Every cycle, tighten up the search area.
-				fullrange *= 0.25;
-			}
+			FLT beste = CharlesSlowGridSearch( so, fs, lh, threads, minImprovement, bestxyz );
+			memcpy( LighthousePos, bestxyz, sizeof( LighthousePos ) );
 
 			if( beste > 0.1 )
 			{
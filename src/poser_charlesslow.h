@@ -0,0 +1,24 @@
+#ifndef _POSER_CHARLESSLOW_H
+#define _POSER_CHARLESSLOW_H
+
+#include <survive.h>
+
+/**
+ * CharlesSlow's lighthouse search, for its test to call directly. The poser is one of the extra posers, so whatever
+ * uses this builds src/poser_charlesslow.c alongside.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Finds where lighthouse 'lh' is relative to the object from a full scene, searching on 'threads' threads until a
+// cycle improves the error by less than 'minImprovement'. Writes the position to 'bestxyz' and returns its error.
+FLT CharlesSlowGridSearch(SurviveObject *so, PoserDataFullScene *fs, int lh, int threads, FLT minImprovement,
+						  FLT *bestxyz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,30 +6,38 @@
 #include "linmath.h"
 #include "math.h"
 #include "stdio.h"
-
-static SurvivePose solve_correspondence(SurviveObject *so, epnp *pnp, bool cameraToWorld) {
+#include "survive_config.h"
+#include <malloc.h>
+#include <string.h>
+
+STATIC_CONFIG_ITEM(EPNP_RANSAC, "epnp-ransac", 'i',
+				   "Solve on random subsets of the measurements first and only use the ones the best of those agrees "
+				   "with, so a reflection or a misread sensor can't drag the pose off.",
+				   0);
+STATIC_CONFIG_ITEM(EPNP_RANSAC_ITERATIONS, "epnp-ransac-iterations", 'i',
+				   "Most subsets 'epnp-ransac' tries; it stops early once it is 99% sure it has seen a subset with no "
+				   "outliers.",
+				   24);
+STATIC_CONFIG_ITEM(EPNP_RANSAC_THRESHOLD, "epnp-ransac-threshold", 'f',
+				   "Reprojection error, in tangent units, past which 'epnp-ransac' calls a measurement an outlier.", .01);
+
+// Smallest subset that EPNP gives a usable pose for; solve_correspondence needs more than 3
+#define EPNP_RANSAC_SAMPLE 5
+
+// Turns the rotation and translation epnp_compute_pose found into a pose. A zero pose means it was degenerate.
+static SurvivePose epnp_pose(SurviveObject *so, const epnp *pnp, double r[3][3], const double t[3],
+							 bool cameraToWorld) {
 	SurvivePose rtn = {0};
 	SurviveContext *ctx = so->ctx;
-	// std::cerr << "Solving for " << cal_imagePoints.size() << " correspondents" << std::endl;
-	if (pnp->number_of_correspondences <= 3) {
-
-		SV_WARN("Can't solve for only %u points\n", pnp->number_of_correspondences);
-		return rtn;
-	}
-
-	double r[3][3];
-
-	double err = epnp_compute_pose(pnp, r, rtn.Pos);
+	copy3d(rtn.Pos, t);
 
 	CvMat R = cvMat(3, 3, CV_64F, r);
 	CvMat T = cvMat(3, 1, CV_64F, rtn.Pos);
 
 	// Super degenerate inputs will project us basically right in the camera. Detect and reject
 	if (magnitude3d(rtn.Pos) < 0.25 || magnitude3d(rtn.Pos) > 25) {
-		double err = epnp_compute_pose(pnp, r, rtn.Pos);
-
 		SV_WARN("EPNP pose is degenerate %d", pnp->number_of_correspondences);
-		return rtn;
+		return (SurvivePose){0};
 	}
 
 	// SV_INFO("EPNP for %s has err %f " SurvivePose_format, so->codename, err, SURVIVE_POSE_EXPAND(rtn));
@@ -65,6 +73,123 @@ static SurvivePose solve_correspondence(SurviveObject *so, epnp *pnp, bool camer
 	return rtn;
 }
 
+static SurvivePose solve_correspondence(SurviveObject *so, epnp *pnp, bool cameraToWorld) {
+	SurviveContext *ctx = so->ctx;
+	// std::cerr << "Solving for " << cal_imagePoints.size() << " correspondents" << std::endl;
+	if (pnp->number_of_correspondences <= 3) {
+
+		SV_WARN("Can't solve for only %u points\n", pnp->number_of_correspondences);
+		return (SurvivePose){0};
+	}
+
+	double r[3][3], t[3];
+	epnp_compute_pose(pnp, r, t);
+	return epnp_pose(so, pnp, r, t, cameraToWorld);
+}
+
+// Same projection as epnp_reprojection_error, for a single correspondence
+static FLT reprojection_error(const epnp *pnp, int i, double R[3][3], const double t[3]) {
+	const double *pw = pnp->pws + 3 * i;
+	double c[3];
+	for (int j = 0; j < 3; j++)
+		c[j] = R[j][0] * pw[0] + R[j][1] * pw[1] + R[j][2] * pw[2] + t[j];
+	if (c[2] <= 0)
+		return INFINITY;
+	double du = c[0] / c[2] - pnp->us[2 * i];
+	double dv = c[1] / c[2] - pnp->us[2 * i + 1];
+	return sqrt(du * du + dv * dv);
+}
+
+// Keeps only the correspondences that agree with the best pose solved from random minimal subsets. The kept ones are
+// moved to the front of pnp's arrays so the full solve afterwards only sees them. Returns true, with that solve in R
+// and t, when a solve on all of them already agrees with every one, so nothing needs to be solved again.
+static bool ransac_correspondences(SurviveObject *so, epnp *pnp, double R[3][3], double t[3]) {
+	SurviveContext *ctx = so->ctx;
+	int n = pnp->number_of_correspondences;
+	if (n <= EPNP_RANSAC_SAMPLE)
+		return false;
+
+	int iterations = ctx->epnp_ransac_iterations;
+	FLT threshold = ctx->epnp_ransac_threshold;
+
+	bool *inliers = alloca(sizeof(bool) * n), *best = alloca(sizeof(bool) * n);
+
+	// Most of the time nothing is wrong, and a solve on everything explains every measurement
+	epnp_compute_pose(pnp, R, t);
+	bool consistent = true;
+	for (int i = 0; i < n && consistent; i++)
+		consistent = reprojection_error(pnp, i, R, t) < threshold;
+	if (consistent) {
+		so->counters.epnp_inliers += n;
+		return true;
+	}
+
+	epnp sample = {.fu = 1, .fv = 1};
+	epnp_set_maximum_number_of_correspondences(&sample, EPNP_RANSAC_SAMPLE);
+
+	int best_cnt = 0;
+	FLT best_error = INFINITY;
+	for (int iteration = 0; iteration < iterations; iteration++) {
+		int picked[EPNP_RANSAC_SAMPLE];
+		epnp_reset_correspondences(&sample);
+		for (int s = 0; s < EPNP_RANSAC_SAMPLE; s++) {
+			bool repeat;
+			do {
+				picked[s] = survive_rand(ctx) % n;
+				repeat = false;
+				for (int k = 0; k < s; k++)
+					repeat |= picked[k] == picked[s];
+			} while (repeat);
+
+			const double *pw = pnp->pws + 3 * picked[s];
+			epnp_add_correspondence(&sample, pw[0], pw[1], pw[2], pnp->us[2 * picked[s]], pnp->us[2 * picked[s] + 1]);
+		}
+
+		epnp_compute_pose(&sample, R, t);
+
+		int cnt = 0;
+		FLT error = 0;
+		for (int i = 0; i < n; i++) {
+			FLT e = reprojection_error(pnp, i, R, t);
+			inliers[i] = e < threshold;
+			if (inliers[i]) {
+				cnt++;
+				error += e;
+			}
+		}
+
+		if (cnt > best_cnt || (cnt == best_cnt && error < best_error)) {
+			best_cnt = cnt;
+			best_error = error;
+			memcpy(best, inliers, sizeof(bool) * n);
+
+			// Subsets needed to draw one free of outliers with 99% certainty, if the best so far has them all
+			FLT clean_sample = pow((FLT)best_cnt / n, EPNP_RANSAC_SAMPLE);
+			if (clean_sample >= 1. || (clean_sample > .01 && iteration + 1 >= log(.01) / log(1. - clean_sample)))
+				break;
+		}
+	}
+	epnp_dtor(&sample);
+
+	// Without a consensus there's nothing better to go on than all of them
+	if (best_cnt < EPNP_RANSAC_SAMPLE)
+		return false;
+
+	int kept = 0;
+	for (int i = 0; i < n; i++) {
+		if (!best[i])
+			continue;
+		memmove(pnp->pws + 3 * kept, pnp->pws + 3 * i, sizeof(double) * 3);
+		memmove(pnp->us + 2 * kept, pnp->us + 2 * i, sizeof(double) * 2);
+		kept++;
+	}
+	pnp->number_of_correspondences = kept;
+
+	so->counters.epnp_inliers += kept;
+	so->counters.epnp_outliers += n - kept;
+	return false;
+}
+
 static FLT get_u(const FLT *ang) { return tan(ang[0]); }
 static FLT get_v(const FLT *ang) { return tan(ang[1]); }
 
@@ -146,9 +271,13 @@ int PoserEPNP(SurviveObject *so, PoserData *pd) {
 				if (required_meas == -1)
 					required_meas = survive_configi(so->ctx, "epnp-required-meas", SC_GET, 5);
 
+				double R[3][3], t[3];
+				bool solved = ctx->epnp_ransac && ransac_correspondences(so, &pnp, R, t);
+
 				if (pnp.number_of_correspondences >= required_meas) {
 
-					SurvivePose objInLh = solve_correspondence(so, &pnp, false);
+					SurvivePose objInLh =
+						solved ? epnp_pose(so, &pnp, R, t, false) : solve_correspondence(so, &pnp, false);
 					if (quatmagnitude(objInLh.Rot) != 0) {
 						SurvivePose *lh2world = &so->ctx->bsd[lh].Pose;
 
@@ -33,11 +33,14 @@ void general_optimizer_data_init(GeneralOptimizerData *d, SurviveObject *so) {
 }
 void general_optimizer_data_record_failure(GeneralOptimizerData *d) {
 	d->stats.error_failures++;
+	d->so->counters.solver_failures++;
 	if (d->failures_to_reset_cntr > 0)
 		d->failures_to_reset_cntr--;
 }
 bool general_optimizer_data_record_success(GeneralOptimizerData *d, FLT error) {
 	d->stats.runs++;
+	d->so->counters.solver_runs++;
+	d->so->counters.solver_error_total += error;
 	if (d->max_error <= 0 || d->max_error > error) {
 		if (d->successes_to_reset_cntr > 0)
 			d->successes_to_reset_cntr--;
@@ -89,6 +92,7 @@ bool general_optimizer_data_record_current_pose(GeneralOptimizerData *d, PoserDa
 			hdr->userdata = &locations;
 			driver(d->so, hdr);
 			d->stats.poser_seed_runs++;
+			d->so->counters.solver_seed_runs++;
 
 			if (locations.hasInfo == false) {
 				return false;
@@ -115,4 +119,8 @@ void general_optimizer_data_dtor(GeneralOptimizerData *d) {
 	SurviveContext *ctx = d->so->ctx;
 	SV_INFO("\tseed runs %d / %d", d->stats.poser_seed_runs, d->stats.runs);
 	SV_INFO("\terror failures %d", d->stats.error_failures);
+
+	survive_detach_config(ctx, "max-error", &d->max_error);
+	survive_detach_config(ctx, "failures-to-reset", &d->failures_to_reset);
+	survive_detach_config(ctx, "successes-to-reset", &d->successes_to_reset);
 }
@@ -30,6 +30,12 @@ int PoserIMU(SurviveObject *so, PoserData *pd) {
 		// SV_ERROR("IMU drift");
 		return 0;
 	}
+	case POSERDATA_DISASSOCIATE: {
+		survive_imu_tracker_free(dd);
+		free(dd);
+		so->PoserData = 0;
+		return 0;
+	}
 	}
 	return -1;
 }
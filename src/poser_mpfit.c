@@ -31,6 +31,12 @@ STATIC_CONFIG_ITEM(SENSOR_VARIANCE_PER_SEC, "sensor-variance-per-sec", 'f',
 				   "Variance per second to add to the sensor input -- discounts older data", 0.0);
 STATIC_CONFIG_ITEM(SENSOR_VARIANCE, "sensor-variance", 'f', "Base variance for each sensor input", 1.0);
 STATIC_CONFIG_ITEM(DISABLE_LIGHTHOUSE, "disable-lighthouse", 'i', "Disable given lighthouse from tracking", -1);
+STATIC_CONFIG_ITEM(OPTIMIZER_LOSS, "optimizer-loss", 's',
+				   "Robust loss for the solver's residuals; one of none, huber, cauchy or tukey", "none");
+STATIC_CONFIG_ITEM(OPTIMIZER_LOSS_SCALE, "optimizer-loss-scale", 'f',
+				   "Residual, divided by the measurement's variance like all of the solver's residuals, at which the "
+				   "robust loss starts to discount a measurement",
+				   .003);
 
 typedef struct MPFITData {
 	GeneralOptimizerData opt;
@@ -47,6 +53,9 @@ typedef struct MPFITData {
 	FLT sensor_variance;
 	FLT sensor_variance_per_second;
 
+	survive_optimizer_loss loss;
+	FLT loss_scale;
+
 	SurviveIMUTracker tracker;
 	bool useIMU;
 	bool useKalman;
@@ -116,6 +125,7 @@ static bool invalid_starting_condition(MPFITData *d, size_t meas_size) {
 		}
 		if (meas_size < d->required_meas) {
 			d->stats.meas_failures++;
+			so->counters.solver_measurement_failures++;
 		}
 		return true;
 	}
@@ -123,6 +133,14 @@ static bool invalid_starting_condition(MPFITData *d, size_t meas_size) {
 	return false;
 }
 
+// A robust loss makes mpfit report the robust cost, which stays small however wrong the outliers it discounts are. The
+// max-error check is about how well the solution explains the measurements, so it always gets the plain sum of squares.
+static double plain_error(MPFITData *d, survive_optimizer *mpfitctx, const mp_result *result, int res) {
+	if (d->loss == survive_optimizer_loss_none || res <= 0)
+		return result->bestnorm;
+	return survive_optimizer_plain_norm(mpfitctx);
+}
+
 static double run_mpfit_find_3d_structure(MPFITData *d, PoserDataLight *pdl, SurviveSensorActivations *scene,
 										  SurvivePose *out) {
 	SurviveObject *so = d->opt.so;
@@ -133,6 +151,8 @@ static double run_mpfit_find_3d_structure(MPFITData *d, PoserDataLight *pdl, Sur
 		//.current_bias = 0.001,
 		.poseLength = 1,
 		.cameraLength = so->ctx->activeLighthouses,
+		.loss = d->loss,
+		.loss_scale = d->loss_scale,
 	};
 
 	SURVIVE_OPTIMIZER_SETUP_STACK_BUFFERS(mpfitctx);
@@ -164,16 +184,18 @@ static double run_mpfit_find_3d_structure(MPFITData *d, PoserDataLight *pdl, Sur
 	mpfitctx.initialPose = *soLocation;
 
 	int res = survive_optimizer_run(&mpfitctx, &result);
+	so->counters.solver_iterations += result.niter;
 
 	double rtn = -1;
 	bool status_failure = res <= 0;
-	bool error_failure = !general_optimizer_data_record_success(&d->opt, result.bestnorm);
+	double error = plain_error(d, &mpfitctx, &result, res);
+	bool error_failure = !general_optimizer_data_record_success(&d->opt, error);
 	if (!status_failure && !error_failure) {
 		quatnormalize(soLocation->Rot, soLocation->Rot);
 		*out = *soLocation;
-		rtn = result.bestnorm;
+		rtn = error;
 	} else {
-		SV_WARN("MPFIT failure %s %f/%f (%d measurements, %d)", so->codename, result.orignorm, result.bestnorm,
+		SV_WARN("MPFIT failure %s %f/%f (%d measurements, %d)", so->codename, result.orignorm, error,
 				(int)meas_size, res);
 	}
 
@@ -198,6 +220,8 @@ static double run_mpfit_find_cameras(MPFITData *d, PoserDataFullScene *pdfs) {
 		.so = so,
 		.poseLength = 1,
 		.cameraLength = so->ctx->activeLighthouses,
+		.loss = d->loss,
+		.loss_scale = d->loss_scale,
 	};
 
 	SURVIVE_OPTIMIZER_SETUP_STACK_BUFFERS(mpfitctx);
@@ -251,8 +275,8 @@ static double run_mpfit_find_cameras(MPFITData *d, PoserDataFullScene *pdfs) {
 	double rtn = -1;
 	bool status_failure = res <= 0;
 	if (!status_failure) {
-		general_optimizer_data_record_success(&d->opt, result.bestnorm);
-		rtn = result.bestnorm;
+		rtn = plain_error(d, &mpfitctx, &result, res);
+		general_optimizer_data_record_success(&d->opt, rtn);
 
 		SurvivePose additionalTx = {0};
 		for (int i = 0; i < so->ctx->activeLighthouses; i++) {
@@ -287,6 +311,8 @@ int PoserMPFIT(SurviveObject *so, PoserData *pd) {
 
 		d->sensor_time_window = survive_configi(ctx, "time-window", SC_GET, SurviveSensorActivations_default_tolerance);
 		d->use_jacobian_function = survive_configi(ctx, "use-jacobian-function", SC_GET, 1);
+		d->loss = survive_optimizer_loss_from_name(survive_configs(ctx, "optimizer-loss", SC_GET, "none"));
+		d->loss_scale = survive_configf(ctx, "optimizer-loss-scale", SC_GET, .003);
 		survive_attach_configi(ctx, "disable-lighthouse", &d->disable_lighthouse);
 		survive_attach_configf(ctx, "sensor-variance-per-sec", &d->sensor_variance_per_second);
 		survive_attach_configf(ctx, "sensor-variance", &d->sensor_variance);
@@ -303,6 +329,8 @@ int PoserMPFIT(SurviveObject *so, PoserData *pd) {
 		SV_INFO("\tuse-imu: %d", d->useIMU);
 		SV_INFO("\tuse-kalman: %d", d->useKalman);
 		SV_INFO("\tuse-jacobian-function: %d", d->use_jacobian_function);
+		SV_INFO("\toptimizer-loss: %s (scale %f)", survive_configs(ctx, "optimizer-loss", SC_GET, "none"),
+				d->loss_scale);
 	}
 	MPFITData *d = so->PoserData;
 	switch (pd->pt) {
@@ -350,6 +378,10 @@ int PoserMPFIT(SurviveObject *so, PoserData *pd) {
 		SV_INFO("MPFIT stats:");
 		SV_INFO("\tmeas failures %d", d->stats.meas_failures);
 		general_optimizer_data_dtor(&d->opt);
+		survive_imu_tracker_free(&d->tracker);
+		survive_detach_config(ctx, "disable-lighthouse", &d->disable_lighthouse);
+		survive_detach_config(ctx, "sensor-variance-per-sec", &d->sensor_variance_per_second);
+		survive_detach_config(ctx, "sensor-variance", &d->sensor_variance);
 		free(d);
 		so->PoserData = 0;
 		return 0;
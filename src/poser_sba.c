@@ -63,6 +63,16 @@ static void metric_function(int j, int i, double *aj, double *xij, void *adata)
 	survive_reproject_from_pose(so->ctx, j, &world2lh, sensorInWorld, xij);
 }
 
+static void metric_function_jac(int j, int i, double *aj, double *Aij, void *adata) {
+	sba_context *ctx = (sba_context *)(adata);
+	SurviveObject *so = ctx->so;
+
+	FLT sensorInWorld[3] = {0};
+	ApplyPoseToPoint(sensorInWorld, &ctx->obj_pose, &so->sensor_locations[i * 3]);
+
+	survive_reproject_full_jac_lh_pose(Aij, (SurvivePose *)aj, sensorInWorld, so->ctx->bsd[j].fcal);
+}
+
 static size_t construct_input(const SurviveObject *so, PoserDataFullScene *pdfs, char *vmask, double *meas) {
 	size_t measCount = 0;
 	size_t size = so->sensor_ct * NUM_LIGHTHOUSES; // One set per lighthouse
@@ -192,6 +202,7 @@ static double run_sba_find_3d_structure(SBAData *d, PoserDataLight *pdl, Survive
 		}
 		if (meas_size < d->required_meas) {
 			d->stats.meas_failures++;
+			so->counters.solver_measurement_failures++;
 		}
 		return -1;
 	}
@@ -251,7 +262,7 @@ static double run_sba_find_3d_structure(SBAData *d, PoserDataLight *pdl, Survive
 }
 
 // Optimizes for LH position assuming object is posed at 0
-static double run_sba(PoserDataFullScene *pdfs, SurviveObject *so, int max_iterations /* = 50*/,
+static double run_sba(SBAData *d, PoserDataFullScene *pdfs, SurviveObject *so, int max_iterations /* = 50*/,
 					  double max_reproj_error /* = 0.005*/) {
 	double *covx = 0;
 
@@ -305,7 +316,7 @@ static double run_sba(PoserDataFullScene *pdfs, SurviveObject *so, int max_itera
 								covx, // covariance of measurement. Null sets to identity
 								2,	// 2 points per image
 								metric_function,
-								0,				// jacobia of metric_func
+								d->use_jacobian_function ? metric_function_jac : 0, // jacobia of metric_func
 								&sbactx,		// user data
 								max_iterations, // Max iterations
 								0,				// verbosity
@@ -409,7 +420,7 @@ int PoserSBA(SurviveObject *so, PoserData *pd) {
 	case POSERDATA_FULL_SCENE: {
 		SurviveContext *ctx = so->ctx;
 		PoserDataFullScene *pdfs = (PoserDataFullScene *)(pd);
-		double error = run_sba(pdfs, so, 100, .005);
+		double error = run_sba(d, pdfs, so, 100, .005);
 		// std::cerr << "Average reproj error: " << error << std::endl;
 		return 0;
 	}
@@ -417,6 +428,13 @@ int PoserSBA(SurviveObject *so, PoserData *pd) {
 		SV_INFO("SBA stats:");
 		SV_INFO("\tmeas failures %d", d->stats.meas_failures);
 		general_optimizer_data_dtor(&d->opt);
+		survive_imu_tracker_free(&d->tracker);
+		survive_detach_config(ctx, "use-imu", &d->useIMU);
+		survive_detach_config(ctx, "required-meas", &d->required_meas);
+		survive_detach_config(ctx, "time-window", &d->sensor_time_window);
+		survive_detach_config(ctx, "sensor-variance-per-sec", &d->sensor_variance_per_second);
+		survive_detach_config(ctx, "sensor-variance", &d->sensor_variance);
+		survive_detach_config(ctx, "use-jacobian-function", &d->use_jacobian_function);
 		free(d);
 		so->PoserData = 0;
 		return 0;
@@ -6,6 +6,8 @@
 #include <memory.h>
 #include <assert.h>
 #include "linmath.h"
+#include "os_generic.h"
+#include "poser_turveytori.h"
 #include <stddef.h>
 #include <math.h>
 #include <stdint.h>
@@ -20,14 +22,10 @@
 
 static int ttDebug = 0;
 
-#define PointToFlts(x) ((FLT*)(x))
+STATIC_CONFIG_ITEM(TURVEYTORI_PARALLEL, "turveytori-parallel", 'i',
+				   "Solve the lighthouses on separate threads when TurveyTori calibrates", 1);
 
-typedef struct
-{
-	FLT x;
-	FLT y;
-	FLT z;
-} Point;
+#define PointToFlts(x) ((FLT*)(x))
 
 void writePoint(FILE *file, double x, double y, double z, unsigned int rgb) {}
 void updateHeader(FILE * file) {}
@@ -37,20 +35,6 @@ void writePcdHeader(FILE * file) {}
 void writePointCloud(FILE *f, Point *pointCloud, unsigned int Color) {}
 void markPointWithStar(FILE *file, Point point, unsigned int color) {}
 
-typedef struct
-{
-	Point point; // location of the sensor on the tracked object;
-	Point normal; // unit vector indicating the normal for the sensor
-	double theta; // "horizontal" angular measurement from lighthouse radians
-	double phi; // "vertical" angular measurement from lighthouse in radians.
-} TrackedSensor;
-
-typedef struct
-{
-	size_t numSensors;
-	TrackedSensor sensor[0];
-} TrackedObject;
-
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846264338327
@@ -125,18 +109,6 @@ Matrix3x3 GetRotationMatrixForTorus(Point a, Point b)
 	return result;
 }
 
-typedef struct
-{
-	Point a;
-	Point b;
-	FLT angle;
-	FLT tanAngle; // tangent of angle
-	Matrix3x3 rotation;
-	Matrix3x3 invRotation; // inverse of rotation
-	char ai;
-	char bi;
-} PointsAndAngle;
-
 
 Point RotateAndTranslatePoint(Point p, Matrix3x3 rot, Point newOrigin)
 {
@@ -314,8 +286,6 @@ void estimateToroidalAndPoloidalAngleOfPoint(
 	return;
 }
 
-#define MAX_POINT_PAIRS 100
-
 FLT angleBetweenSensors(TrackedSensor *a, TrackedSensor *b)
 {
 	FLT angle = FLT_ACOS(FLT_COS(a->phi - b->phi)*FLT_COS(a->theta - b->theta));
@@ -392,79 +362,126 @@ FLT getPointFitnessForPna(Point pointIn, PointsAndAngle *pna)
 	return dist;
 }
 
-int compareFlts(const void * a, const void * b)
+void buildToriSoA(ToriSoA *tori, PointsAndAngle *pna, size_t pnaCount)
 {
-	FLT a2 = *(const FLT*)a;
-	FLT b2 = *(const FLT*)b;
-	return (a2 > b2) - (a2 < b2);
-}
+	tori->count = pnaCount;
+	for (size_t i = 0; i < pnaCount; i++)
+	{
+		Point m = midpoint(pna[i].a, pna[i].b);
+		FLT distanceBetweenPoints = distance(pna[i].a, pna[i].b);
+		FLT toroidalRadius = distanceBetweenPoints / (2 * pna[i].tanAngle);
 
-FLT getPointFitness(Point pointIn, PointsAndAngle *pna, size_t pnaCount, int deubgPrint)
-{
-	FLT fitness;
+		tori->mx[i] = m.x;
+		tori->my[i] = m.y;
+		tori->mz[i] = m.z;
 
-	FLT resultSum = 0;
-	FLT *fitnesses = alloca(sizeof(FLT) * pnaCount);
+		// RotateAndTranslatePoint takes the z coordinate from the third column.
+		tori->axisX[i] = pna[i].invRotation.val[0][2];
+		tori->axisY[i] = pna[i].invRotation.val[1][2];
+		tori->axisZ[i] = pna[i].invRotation.val[2][2];
 
-	FLT worstFitness = 0;
+		tori->toroidalRadius[i] = toroidalRadius;
+		tori->poloidalRadius[i] = FLT_SQRT(SQUARED(toroidalRadius) + SQUARED(distanceBetweenPoints / 2));
+	}
+}
 
-	for (size_t i = 0; i < pnaCount; i++)
+// This is getPointFitnessForPna squared, for every torus at once, worked down to a closed form with no trig:
+// * The torus point it picks lies in the same toroidal plane as the point, on the poloidal circle and in the
+//   direction of the point from that circle's center.  So the distance is just |poloidalHyp - poloidalRadius|,
+//   with pointH being the point relative to the center of the poloidal circle like in the original.
+// * The fudge factor is sin((poloidalAngle - pi) / 2), and only its magnitude matters since the fitnesses get
+//   FLT_FABS'ed.  Its square is (1 + cos(poloidalAngle)) / 2, which is (1 + pointH.x / poloidalHyp) / 2.
+// * The rotations are orthonormal, so the distance between the point and the torus point is the same in the
+//   friendly coordinate system, and only the point's height along the axis and distance from it are needed.
+void getPointFitnessesSquared(FLT *fitnessesOut, Point pointIn, const ToriSoA *tori)
+{
+	for (size_t i = 0; i < tori->count; i++)
 	{
-		fitness = getPointFitnessForPna(pointIn, &(pna[i]));
-
-		if (worstFitness < fitness)
-		{
-			worstFitness = fitness;
-		}
+		FLT x = pointIn.x - tori->mx[i];
+		FLT y = pointIn.y - tori->my[i];
+		FLT z = pointIn.z - tori->mz[i];
 
-		fitnesses[i] = FLT_FABS(fitness);
-		if (0)
-		{
-			printf("  [%d, %d](%f)\n", pna[i].ai, pna[i].bi, fitness);
-		}
-	}
+		FLT pointFz = x * tori->axisX[i] + y * tori->axisY[i] + z * tori->axisZ[i];
+		FLT toroidalHyp = FLT_SQRT(FLT_FABS(x * x + y * y + z * z - pointFz * pointFz));
 
+		FLT pointHx = toroidalHyp - tori->toroidalRadius[i];
+		FLT poloidalHyp = FLT_SQRT(SQUARED(pointHx) + SQUARED(pointFz));
+		FLT dist = poloidalHyp - tori->poloidalRadius[i];
 
-	qsort(fitnesses, pnaCount, sizeof(FLT), compareFlts);
+		fitnessesOut[i] = 2 * poloidalHyp * SQUARED(dist) / (poloidalHyp + pointHx);
+	}
+}
 
-	//printf("wf[%f]\n", worstFitness);
+// Partially orders values so that the smallest k of them come first, in no particular order.
+// This is all that the "best 70%" below needs, and is linear instead of a full sort.
+static void selectSmallest(FLT *values, int count, int k)
+{
+	int left = 0;
+	int right = count - 1;
+	while (left < right)
+	{
+		FLT pivot = values[k];
+		int i = left;
+		int j = right;
+		do
+		{
+			while (values[i] < pivot) i++;
+			while (pivot < values[j]) j--;
+			if (i <= j)
+			{
+				FLT tmp = values[i];
+				values[i] = values[j];
+				values[j] = tmp;
+				i++;
+				j--;
+			}
+		} while (i <= j);
+		if (j < k) left = i;
+		if (k < i) right = j;
+	}
+}
 
+FLT getPointFitness(Point pointIn, const ToriSoA *tori)
+{
+	FLT fitnesses[MAX_POINT_PAIRS];
+	getPointFitnessesSquared(fitnesses, pointIn, tori);
+
+	// Note that we're only using the best 70% of the tori.
+	// This is to remove any "bad" outliers.
+	// TODO: better algorithms exist.
+	int bestCount = (int)(tori->count * 0.70);
+	if (bestCount < (int)tori->count)
+	{
+		selectSmallest(fitnesses, (int)tori->count, bestCount);
+	}
 
-    // Note that we're only using the best 70% of the tori.
-    // This is to remove any "bad" outliers.
-    // TODO: better algorithms exist.
-	for (size_t i = 0; i < (size_t)(pnaCount * 0.70); i++)
+	FLT resultSum = 0;
+	for (int i = 0; i < bestCount; i++)
 	{
-		resultSum += SQUARED(fitnesses[i]);
+		resultSum += fitnesses[i];
 	}
 	return 1 / FLT_SQRT(resultSum);
 }
 
 // TODO: Use a central point instead of separate "minus" points for each axis.  This will reduce
 // the number of fitness calls by 1/3.
-Point getGradient(Point pointIn, PointsAndAngle *pna, size_t pnaCount, FLT precision)
+Point getGradient(Point pointIn, const ToriSoA *tori, FLT precision)
 {
 	Point result;
 
-	FLT baseFitness = getPointFitness(pointIn, pna, pnaCount, 0);
+	FLT baseFitness = getPointFitness(pointIn, tori);
 
-	Point tmpXplus = pointIn;
 	Point tmpXminus = pointIn;
-	tmpXplus.x = pointIn.x + precision;
 	tmpXminus.x = pointIn.x - precision;
-	result.x = baseFitness - getPointFitness(tmpXminus, pna, pnaCount, 0);
+	result.x = baseFitness - getPointFitness(tmpXminus, tori);
 
-	Point tmpYplus = pointIn;
 	Point tmpYminus = pointIn;
-	tmpYplus.y = pointIn.y + precision;
 	tmpYminus.y = pointIn.y - precision;
-	result.y = baseFitness - getPointFitness(tmpYminus, pna, pnaCount, 0);
+	result.y = baseFitness - getPointFitness(tmpYminus, tori);
 
-	Point tmpZplus = pointIn;
 	Point tmpZminus = pointIn;
-	tmpZplus.z = pointIn.z + precision;
 	tmpZminus.z = pointIn.z - precision;
-	result.z = baseFitness - getPointFitness(tmpZminus, pna, pnaCount, 0);
+	result.z = baseFitness - getPointFitness(tmpZminus, tori);
 
 	return result;
 }
@@ -496,10 +513,10 @@ Point getAvgPoints(Point a, Point b)
 
 // This is modifies the basic gradient descent algorithm to better handle the shallow valley case,
 // which appears to be typical of this convergence.  
-static Point RefineEstimateUsingModifiedGradientDescent1(Point initialEstimate, PointsAndAngle *pna, size_t pnaCount, FILE *logFile)
+static Point RefineEstimateUsingModifiedGradientDescent1(Point initialEstimate, const ToriSoA *tori, FILE *logFile)
 {
 	int i = 0;
-	FLT lastMatchFitness = getPointFitness(initialEstimate, pna, pnaCount, 0);
+	FLT lastMatchFitness = getPointFitness(initialEstimate, tori);
 	Point lastPoint = initialEstimate;
 
 	// The values below are somewhat magic, and definitely tunable
@@ -520,7 +537,7 @@ static Point RefineEstimateUsingModifiedGradientDescent1(Point initialEstimate,
 		i++;
 		Point point1 = lastPoint;
 		// let's get 3 iterations of gradient descent here.
-		Point gradient1 = getGradient(point1, pna, pnaCount, g / 1000 /*somewhat arbitrary*/);
+		Point gradient1 = getGradient(point1, tori, g / 1000 /*somewhat arbitrary*/);
 		Point gradientN1 = getNormalizedAndScaledVector(gradient1, g);
 
 		Point point2;
@@ -528,7 +545,7 @@ static Point RefineEstimateUsingModifiedGradientDescent1(Point initialEstimate,
 		point2.y = point1.y + gradientN1.y;
 		point2.z = point1.z + gradientN1.z;
 
-		Point gradient2 = getGradient(point2, pna, pnaCount, g / 1000 /*somewhat arbitrary*/);
+		Point gradient2 = getGradient(point2, tori, g / 1000 /*somewhat arbitrary*/);
 		Point gradientN2 = getNormalizedAndScaledVector(gradient2, g);
 
 		Point point3;
@@ -556,7 +573,7 @@ static Point RefineEstimateUsingModifiedGradientDescent1(Point initialEstimate,
 		point4.y = point3.y + specialGradient.y;
 		point4.z = point3.z + specialGradient.z;
 
-		FLT newMatchFitness = getPointFitness(point4, pna, pnaCount, 0);
+		FLT newMatchFitness = getPointFitness(point4, tori);
 
 		if (newMatchFitness > lastMatchFitness)
 		{
@@ -666,34 +683,74 @@ FLT RotationEstimateFitnessOld(Point lhPoint, FLT *quaternion, TrackedObject *ob
 	return fitness;
 }
 
-FLT RotationEstimateFitnessAxisAngle(Point lh, FLT *AxisAngle, TrackedObject *obj)
+// The sensors as the rotation fitness sees them, laid out as parallel arrays so the per sensor loop vectorizes.
+// These only depend on the lighthouse position, so they're computed once per solve instead of once per fitness call.
+typedef struct
 {
-	// For this fitness calculator, we're going to use the rotation information to figure out where
-	// we expect to see the tracked object sensors, and we'll do a sum of squares to grade
-	// the quality of the guess formed by the AxisAngle;
+	size_t count;
+	FLT x[SENSORS_PER_OBJECT]; // sensor location relative to the lighthouse
+	FLT y[SENSORS_PER_OBJECT];
+	FLT z[SENSORS_PER_OBJECT];
+	FLT dirX[SENSORS_PER_OBJECT]; // normalized vector to the sensor, as seen by the lighthouse
+	FLT dirY[SENSORS_PER_OBJECT];
+	FLT dirZ[SENSORS_PER_OBJECT];
+} SensorRays;
+
+static void buildSensorRays(SensorRays *rays, Point lh, TrackedObject *obj)
+{
+	rays->count = obj->numSensors;
+	for (size_t i = 0; i < obj->numSensors; i++)
+	{
+		rays->x[i] = obj->sensor[i].point.x - lh.x;
+		rays->y[i] = obj->sensor[i].point.y - lh.y;
+		rays->z[i] = obj->sensor[i].point.z - lh.z;
 
-	FLT fitness = 0;
+		FLT realVectFromLh[3] = {1, tan(obj->sensor[i].theta - LINMATHPI/2), tan(obj->sensor[i].phi - LINMATHPI/2)};
+		normalize3d(realVectFromLh, realVectFromLh);
 
-	// for each point in the tracked object
-	for (int i=0; i< obj->numSensors; i++)
-	{
+		rays->dirX[i] = realVectFromLh[0];
+		rays->dirY[i] = realVectFromLh[1];
+		rays->dirZ[i] = realVectFromLh[2];
+	}
+}
 
+FLT RotationEstimateFitnessAxisAngle(const SensorRays *rays, FLT *AxisAngle)
+{
+	// For this fitness calculator, we're going to use the rotation information to figure out where
+	// we expect to see the tracked object sensors, and we'll do a sum of squares to grade
+	// the quality of the guess formed by the AxisAngle;
 
-		
-		// let's see... we need to figure out where this sensor should be in the LH reference frame.
-		FLT sensorLocation[3] = {obj->sensor[i].point.x-lh.x, obj->sensor[i].point.y-lh.y, obj->sensor[i].point.z-lh.z};
+	// rotatearoundaxis used to normalize the axis in place, and the gradient descent relies on that.
+	normalize3d(AxisAngle, AxisAngle);
 
-		// And this puppy needs to be rotated...
+	// The same rotation rotatearoundaxis does, but as a matrix so the sin and cos happen once per call
+	FLT s = FLT_SIN(AxisAngle[3]);
+	FLT c = FLT_COS(AxisAngle[3]);
+	FLT u = AxisAngle[0];
+	FLT v = AxisAngle[1];
+	FLT w = AxisAngle[2];
 
-		rotatearoundaxis(sensorLocation, sensorLocation, AxisAngle, AxisAngle[3]);
+	FLT r00 = u * u * (1 - c) + c, r01 = u * v * (1 - c) - w * s, r02 = u * w * (1 - c) + v * s;
+	FLT r10 = v * u * (1 - c) + w * s, r11 = v * v * (1 - c) + c, r12 = v * w * (1 - c) - u * s;
+	FLT r20 = w * u * (1 - c) - v * s, r21 = w * v * (1 - c) + u * s, r22 = w * w * (1 - c) + c;
 
-		// Now, the vector indicating the position of the sensor, as seen by the lighthouse is:
-		FLT realVectFromLh[3] = {1, tan(obj->sensor[i].theta - LINMATHPI/2), tan(obj->sensor[i].phi - LINMATHPI/2)};
+	// for each point in the tracked object, the cosine of the angle between where the lighthouse saw it
+	// and where this rotation puts it
+	FLT cosAngles[SENSORS_PER_OBJECT];
+	for (size_t i = 0; i < rays->count; i++)
+	{
+		FLT x = r00 * rays->x[i] + r01 * rays->y[i] + r02 * rays->z[i];
+		FLT y = r10 * rays->x[i] + r11 * rays->y[i] + r12 * rays->z[i];
+		FLT z = r20 * rays->x[i] + r21 * rays->y[i] + r22 * rays->z[i];
 
-		// and the vector we're calculating given the rotation passed in is the same as the sensor location:
-		FLT calcVectFromLh[3] = {sensorLocation[0], sensorLocation[1], sensorLocation[2]};
+		cosAngles[i] = (x * rays->dirX[i] + y * rays->dirY[i] + z * rays->dirZ[i]) / FLT_SQRT(x * x + y * y + z * z);
+	}
 
-		FLT angleBetween = anglebetween3d( realVectFromLh, calcVectFromLh );
+	FLT fitness = 0;
+	for (size_t i = 0; i < rays->count; i++)
+	{
+		// Clamped the same way as anglebetween3d
+		FLT angleBetween = cosAngles[i] < -0.9999999 ? LINMATHPI : cosAngles[i] > 0.9999999 ? 0 : FLT_ACOS(cosAngles[i]);
 
 		fitness += SQUARED(angleBetween);
 	}
@@ -776,133 +833,62 @@ FLT RotationEstimateFitnessAxisAngleOriginal(Point lhPoint, FLT *quaternion, Tra
 
 // interesting-- this is one place where we could use any sensors that are only hit by
 // just an x or y axis to make our estimate better.  TODO: bring that data to this fn.
-FLT RotationEstimateFitnessQuaternion(Point lhPoint, FLT *quaternion, TrackedObject *obj)
+FLT RotationEstimateFitnessQuaternion(const SensorRays *rays, FLT *quaternion)
 {
 
 // TODO: ************************************************************************************************** THIS LIES!!!! NEED TO DO THIS IN QUATERNIONS!!!!!!!!!!!!!!!!!
-	{
-		FLT axisAngle[4];
-
-		axisanglefromquat(&(axisAngle[3]), axisAngle, quaternion);
-
-		FLT throwaway = RotationEstimateFitnessAxisAngle(lhPoint, axisAngle, obj);
-
-		return throwaway;
-	}
-
-
-
-	FLT fitness = 0;
-	for (size_t i = 0; i < obj->numSensors; i++)
-	{
-		// first, get the normal of the plane for the horizonal sweep
-		FLT theta = obj->sensor[i].theta;
-		// make two vectors that lie on the plane
-		FLT t1H[3] = { 1, tan(theta-LINMATHPI/2), 0 };
-		FLT t2H[3] = { 1, tan(theta-LINMATHPI/2), 1 };
-
-		FLT tNormH[3];
-
-		// the normal is the cross of two vectors on the plane.
-		cross3d(tNormH, t1H, t2H);
+	FLT axisAngle[4];
 
-		normalize3d(tNormH, tNormH);
-
-		// Now do the same for the vertical sweep
-
-		// first, get the normal of the plane for the horizonal sweep
-		FLT phi = obj->sensor[i].phi;
-		// make two vectors that lie on the plane
-		FLT t1V[3] = { 0, 1, tan(phi-LINMATHPI/2)};
-		FLT t2V[3] = { 1, 1, tan(phi-LINMATHPI/2)};
-
-		FLT tNormV[3];
-
-		// the normal is the cross of two vectors on the plane.
-		cross3d(tNormV, t1V, t2V);
+	axisanglefromquat(&(axisAngle[3]), axisAngle, quaternion);
 
-		normalize3d(tNormV, tNormV);
-
-
-		// First, where is the sensor in the object's reference frame?
-		FLT sensor_in_obj_reference_frame[3] = {obj->sensor->point.x, obj->sensor->point.y, obj->sensor->point.z};
-		// Where is the point, in the reference frame of the lighthouse?
-		// This has two steps, first we translate from the object's location being the
-		// origin to the lighthouse being the origin.
-		// And second, we apply the quaternion to rotate into the proper reference frame for the lighthouse.
-
-		FLT sensor_in_lh_reference_frame[3];
-		sub3d(sensor_in_lh_reference_frame, sensor_in_obj_reference_frame, (FLT[3]){lhPoint.x, lhPoint.y, lhPoint.z});
-
-		quatrotatevector(sensor_in_lh_reference_frame, quaternion, sensor_in_lh_reference_frame);
-		//rotatearoundaxis(sensor_in_lh_reference_frame, sensor_in_lh_reference_frame, quaternion, quaternion[3]);
-
-		// now the we've got the location of the sensor in the lighthouses's reference frame, given lhPoint and quaternion inputs.
-
-		// We need an arbitrary vector from the plane to the point.  
-		// Since the plane goes through the origin, this is trivial.
-		// The sensor point itself is such a vector!
-
-		// And go calculate the distances!
-		// TODO: don't need to ABS these because we square them below.
-		FLT dH = FLT_FABS(dot3d(sensor_in_lh_reference_frame, tNormH));
-		FLT dV = FLT_FABS(dot3d(sensor_in_lh_reference_frame, tNormV));
-
-		
-		fitness += SQUARED(dH);
-		fitness += SQUARED(dV);
-	}
-
-	fitness = FLT_SQRT(fitness);
-
-	return 1/fitness;
+	return RotationEstimateFitnessAxisAngle(rays, axisAngle);
 }
 
 
-void getRotationGradientQuaternion(FLT *gradientOut, Point lhPoint, FLT *quaternion, TrackedObject *obj, FLT precision)
+void getRotationGradientQuaternion(FLT *gradientOut, const SensorRays *rays, FLT *quaternion, FLT precision)
 {
 
-	FLT baseFitness = RotationEstimateFitnessQuaternion(lhPoint, quaternion, obj);
+	FLT baseFitness = RotationEstimateFitnessQuaternion(rays, quaternion);
 
 	FLT tmp0plus[4];
 	quatadd(tmp0plus, quaternion, (FLT[4]){precision, 0, 0, 0});
-	gradientOut[0] = RotationEstimateFitnessQuaternion(lhPoint, tmp0plus, obj) - baseFitness;
+	gradientOut[0] = RotationEstimateFitnessQuaternion(rays, tmp0plus) - baseFitness;
 
 	FLT tmp1plus[4];
 	quatadd(tmp1plus, quaternion, (FLT[4]){0, precision, 0, 0});
-	gradientOut[1] = RotationEstimateFitnessQuaternion(lhPoint, tmp1plus, obj) - baseFitness;
+	gradientOut[1] = RotationEstimateFitnessQuaternion(rays, tmp1plus) - baseFitness;
 
 	FLT tmp2plus[4];
 	quatadd(tmp2plus, quaternion, (FLT[4]){0, 0, precision, 0});
-	gradientOut[2] = RotationEstimateFitnessQuaternion(lhPoint, tmp2plus, obj) - baseFitness;
+	gradientOut[2] = RotationEstimateFitnessQuaternion(rays, tmp2plus) - baseFitness;
 
 	FLT tmp3plus[4];
 	quatadd(tmp3plus, quaternion, (FLT[4]){0, 0, 0, precision});
-	gradientOut[3] = RotationEstimateFitnessQuaternion(lhPoint, tmp3plus, obj) - baseFitness;
+	gradientOut[3] = RotationEstimateFitnessQuaternion(rays, tmp3plus) - baseFitness;
 
 	return;
 }
 
-void getRotationGradientAxisAngle(FLT *gradientOut, Point lhPoint, FLT *quaternion, TrackedObject *obj, FLT precision)
+void getRotationGradientAxisAngle(FLT *gradientOut, const SensorRays *rays, FLT *quaternion, FLT precision)
 {
 
-	FLT baseFitness = RotationEstimateFitnessAxisAngle(lhPoint, quaternion, obj);
+	FLT baseFitness = RotationEstimateFitnessAxisAngle(rays, quaternion);
 
 	FLT tmp0plus[4];
 	quatadd(tmp0plus, quaternion, (FLT[4]){precision, 0, 0, 0});
-	gradientOut[0] = RotationEstimateFitnessAxisAngle(lhPoint, tmp0plus, obj) - baseFitness;
+	gradientOut[0] = RotationEstimateFitnessAxisAngle(rays, tmp0plus) - baseFitness;
 
 	FLT tmp1plus[4];
 	quatadd(tmp1plus, quaternion, (FLT[4]){0, precision, 0, 0});
-	gradientOut[1] = RotationEstimateFitnessAxisAngle(lhPoint, tmp1plus, obj) - baseFitness;
+	gradientOut[1] = RotationEstimateFitnessAxisAngle(rays, tmp1plus) - baseFitness;
 
 	FLT tmp2plus[4];
 	quatadd(tmp2plus, quaternion, (FLT[4]){0, 0, precision, 0});
-	gradientOut[2] = RotationEstimateFitnessAxisAngle(lhPoint, tmp2plus, obj) - baseFitness;
+	gradientOut[2] = RotationEstimateFitnessAxisAngle(rays, tmp2plus) - baseFitness;
 
 	FLT tmp3plus[4];
 	quatadd(tmp3plus, quaternion, (FLT[4]){0, 0, 0, precision});
-	gradientOut[3] = RotationEstimateFitnessAxisAngle(lhPoint, tmp3plus, obj) - baseFitness;
+	gradientOut[3] = RotationEstimateFitnessAxisAngle(rays, tmp3plus) - baseFitness;
 
 	return;
 }
@@ -933,10 +919,10 @@ static void WhereIsTheTrackedObjectAxisAngle(FLT *posOut, FLT *rotation, Point l
 	if (ttDebug) printf("{% 04.4f, % 04.4f, % 04.4f}  ", posOut[0], posOut[1], posOut[2]);
 }
 
-static void RefineRotationEstimateAxisAngle(FLT *rotOut, Point lhPoint, FLT *initialEstimate, TrackedObject *obj)
+static void RefineRotationEstimateAxisAngle(FLT *rotOut, const SensorRays *rays, FLT *initialEstimate)
 {
 	int i = 0;
-	FLT lastMatchFitness = RotationEstimateFitnessAxisAngle(lhPoint, initialEstimate, obj);
+	FLT lastMatchFitness = RotationEstimateFitnessAxisAngle(rays, initialEstimate);
 
 	quatcopy(rotOut, initialEstimate);
 
@@ -963,7 +949,7 @@ static void RefineRotationEstimateAxisAngle(FLT *rotOut, Point lhPoint, FLT *ini
 		
 		normalize3d(point1, point1);
 
-		getRotationGradientAxisAngle(gradient1, lhPoint, point1, obj, g/10000);
+		getRotationGradientAxisAngle(gradient1, rays, point1, g/10000);
 		getNormalizedAndScaledRotationGradient(gradient1,g);
 
 		FLT point2[4];
@@ -973,7 +959,7 @@ static void RefineRotationEstimateAxisAngle(FLT *rotOut, Point lhPoint, FLT *ini
 		normalize3d(point1, point1);
 
 		FLT gradient2[4];
-		getRotationGradientAxisAngle(gradient2, lhPoint, point2, obj, g/10000);
+		getRotationGradientAxisAngle(gradient2, rays, point2, g/10000);
 		getNormalizedAndScaledRotationGradient(gradient2,g);
 
 		FLT point3[4];
@@ -1003,7 +989,7 @@ static void RefineRotationEstimateAxisAngle(FLT *rotOut, Point lhPoint, FLT *ini
 		//quatnormalize(point4,point4);
 		normalize3d(point1, point1);
 
-		FLT newMatchFitness = RotationEstimateFitnessAxisAngle(lhPoint, point4, obj);
+		FLT newMatchFitness = RotationEstimateFitnessAxisAngle(rays, point4);
 
 		if (newMatchFitness > lastMatchFitness)
 		{
@@ -1042,7 +1028,7 @@ static void RefineRotationEstimateAxisAngle(FLT *rotOut, Point lhPoint, FLT *ini
 //	quatrotatevector(objPoint, rotation, objPoint);
 //	if (ttDebug) printf("(%f, %f, %f)\n", objPoint[0], objPoint[1], objPoint[2]);
 //}
-static void WhereIsTheTrackedObjectQuaternion(FLT *posOut, FLT *rotation, Point lhPoint)
+void WhereIsTheTrackedObjectQuaternion(FLT *posOut, FLT *rotation, Point lhPoint)
 {
 	posOut[0] = -lhPoint.x;
 	posOut[1] = -lhPoint.y;
@@ -1071,11 +1057,11 @@ static void WhereIsTheTrackedObjectQuaternion(FLT *posOut, FLT *rotation, Point
 //}
 
 
-static void RefineRotationEstimateQuaternion(FLT *rotOut, Point lhPoint, FLT *initialEstimate, TrackedObject *obj)
+static void RefineRotationEstimateQuaternion(FLT *rotOut, const SensorRays *rays, FLT *initialEstimate)
 {
 	int i = 0;
 
-	FLT lastMatchFitness = RotationEstimateFitnessQuaternion(lhPoint, initialEstimate, obj);
+	FLT lastMatchFitness = RotationEstimateFitnessQuaternion(rays, initialEstimate);
 
 	//{
 	//	FLT axisAngle[4];
@@ -1113,7 +1099,7 @@ static void RefineRotationEstimateQuaternion(FLT *rotOut, Point lhPoint, FLT *in
 		
 		//normalize3d(point1, point1);
 
-		getRotationGradientQuaternion(gradient1, lhPoint, point1, obj, g/10000);
+		getRotationGradientQuaternion(gradient1, rays, point1, g/10000);
 		getNormalizedAndScaledRotationGradient(gradient1,g);
 
 		FLT point2[4];
@@ -1123,7 +1109,7 @@ static void RefineRotationEstimateQuaternion(FLT *rotOut, Point lhPoint, FLT *in
 		//normalize3d(point1, point1);
 
 		FLT gradient2[4];
-		getRotationGradientQuaternion(gradient2, lhPoint, point2, obj, g/10000);
+		getRotationGradientQuaternion(gradient2, rays, point2, g/10000);
 		getNormalizedAndScaledRotationGradient(gradient2,g);
 
 		FLT point3[4];
@@ -1153,7 +1139,7 @@ static void RefineRotationEstimateQuaternion(FLT *rotOut, Point lhPoint, FLT *in
 		quatnormalize(point4,point4);
 		//normalize3d(point1, point1);
 
-		FLT newMatchFitness = RotationEstimateFitnessQuaternion(lhPoint, point4, obj);
+		FLT newMatchFitness = RotationEstimateFitnessQuaternion(rays, point4);
 
 		if (newMatchFitness > lastMatchFitness)
 		{
@@ -1198,8 +1184,11 @@ void SolveForRotation(FLT rotOut[4], TrackedObject *obj, Point lh)
 	// not correcting for phi, but that's less important.
 
 
+	SensorRays rays;
+	buildSensorRays(&rays, lh, obj);
+
 	// Step 2, optimize the axis/ angle to match the data.
-	RefineRotationEstimateAxisAngle(rotOut, lh, zAxis, obj);
+	RefineRotationEstimateAxisAngle(rotOut, &rays, zAxis);
 
 
 	// TODO:  Need to use the quaternion version here!!!
@@ -1229,17 +1218,20 @@ void SolveForRotationQuat(FLT rotOut[4], TrackedObject *obj, Point lh)
 	//RefineRotationEstimateAxisAngle(rotOut, lh, zAxis, obj);
 
 
+	SensorRays rays;
+	buildSensorRays(&rays, lh, obj);
+
 	//// Step 2, optimize the quaternion to match the data.
-	RefineRotationEstimateQuaternion(rotOut, lh, quat1, obj);
+	RefineRotationEstimateQuaternion(rotOut, &rays, quat1);
 
 	//WhereIsTheTrackedObjectQuaternion(rotOut, lh);
 
 }
 
-static Point SolveForLighthouse(FLT posOut[3], FLT quatOut[4], TrackedObject *obj, SurviveObject *so, PoserData *pd,
-								char doLogOutput, SurvivePose *additionalTx, const int lh, const int setLhCalibration) {
-	ToriData *toriData = so->PoserData;
-
+// The solving half of SolveForLighthouse.  It only reads obj and the lighthouse's last position, so
+// the lighthouses can be estimated concurrently.
+void EstimateLighthouse(LighthouseEstimate *estimate, TrackedObject *obj, Point lastLhPos, FILE *logFile)
+{
 	//printf("Solving for Lighthouse\n");
 
 	//printf("obj->numSensors = %d;\n", obj->numSensors);
@@ -1311,15 +1303,8 @@ static Point SolveForLighthouse(FLT posOut[3], FLT quatOut[4], TrackedObject *ob
 
 	FLT avgNormF[3] = { avgNorm.x, avgNorm.y, avgNorm.z };
 
-
-	FILE *logFile = NULL;
-	if (doLogOutput)
-	{
-		logFile = fopen("pointcloud2.pcd", "wb");
-		writePcdHeader(logFile);
-		writeAxes(logFile);
-	}
-
+	ToriSoA tori;
+	buildToriSoA(&tori, pna, pnaCount);
 
 	// Point refinedEstimageGd = RefineEstimateUsingModifiedGradientDescent1(initialEstimate, pna, pnaCount, logFile);
 
@@ -1331,16 +1316,14 @@ static Point SolveForLighthouse(FLT posOut[3], FLT quatOut[4], TrackedObject *ob
 	Point p1 = getNormalizedAndScaledVector(avgNorm, 8);
 
 	// if the last lighthouse position has been populated (extremely rare it would be 0)
-	if (toriData->lastLhPos[lh].x != 0)
+	if (lastLhPos.x != 0)
 	{
-		p1.x = toriData->lastLhPos[lh].x;
-		p1.y = toriData->lastLhPos[lh].y;
-		p1.z = toriData->lastLhPos[lh].z;
+		p1 = lastLhPos;
 	}
 
 	// refinedEstimateGd is the estimate for the location of the lighthouse in the tracked 
 	// object's local coordinate system.
-	Point refinedEstimateGd = RefineEstimateUsingModifiedGradientDescent1(p1, pna, pnaCount, logFile);
+	Point refinedEstimateGd = RefineEstimateUsingModifiedGradientDescent1(p1, &tori, logFile);
 
 	FLT pf1[3] = { refinedEstimateGd.x, refinedEstimateGd.y, refinedEstimateGd.z };
 
@@ -1359,10 +1342,10 @@ static Point SolveForLighthouse(FLT posOut[3], FLT quatOut[4], TrackedObject *ob
 	if (a1 > M_PI / 2)
 	{
 		Point p2 = { .x = -refinedEstimateGd.x,.y = -refinedEstimateGd.y,.z = -refinedEstimateGd.z };
-		refinedEstimateGd = RefineEstimateUsingModifiedGradientDescent1(p2, pna, pnaCount, logFile);
+		refinedEstimateGd = RefineEstimateUsingModifiedGradientDescent1(p2, &tori, logFile);
 	}
 
-	FLT fitGd = getPointFitness(refinedEstimateGd, pna, pnaCount, 0);
+	FLT fitGd = getPointFitness(refinedEstimateGd, &tori);
 
 	FLT distance = FLT_SQRT(SQUARED(refinedEstimateGd.x) + SQUARED(refinedEstimateGd.y) + SQUARED(refinedEstimateGd.z));
 	if (ttDebug) printf(" la(% 04.4f) SnsrCnt(%2d) LhPos:(% 04.4f, % 04.4f, % 04.4f) Dist: % 08.8f ", largestAngle, (int)obj->numSensors, refinedEstimateGd.x, refinedEstimateGd.y, refinedEstimateGd.z, distance);
@@ -1397,6 +1380,24 @@ static Point SolveForLighthouse(FLT posOut[3], FLT quatOut[4], TrackedObject *ob
 	// using an SVD.  
 	SolveForRotationQuat(rotQuat, obj, refinedEstimateGd);
 	SolveForRotation(rot, obj, refinedEstimateGd);
+
+	estimate->position = refinedEstimateGd;
+	quatcopy(estimate->rot, rot);
+	quatcopy(estimate->rotQuat, rotQuat);
+}
+
+// The applying half of SolveForLighthouse: turns an estimate into the object's pose, and into the
+// lighthouse's calibration when setLhCalibration is set.
+static void ApplyLighthouseEstimate(FLT posOut[3], FLT quatOut[4], const LighthouseEstimate *estimate, SurviveObject *so,
+									PoserData *pd, SurvivePose *additionalTx, const int lh, const int setLhCalibration) {
+	ToriData *toriData = so->PoserData;
+
+	Point refinedEstimateGd = estimate->position;
+	FLT rot[4];
+	FLT rotQuat[4];
+	quatcopy(rot, estimate->rot);
+	quatcopy(rotQuat, estimate->rotQuat);
+
 	FLT objPos[3];
 	//FLT objPos2[3];
 
@@ -1519,19 +1520,49 @@ static Point SolveForLighthouse(FLT posOut[3], FLT quatOut[4], TrackedObject *ob
 	quatOut[2] = so->OutPoseIMU.Rot[2];
 	quatOut[3] = so->OutPoseIMU.Rot[3];
 
+	toriData->lastLhPos[lh].x = refinedEstimateGd.x;
+	toriData->lastLhPos[lh].y = refinedEstimateGd.y;
+	toriData->lastLhPos[lh].z = refinedEstimateGd.z;
+}
+
+static Point SolveForLighthouse(FLT posOut[3], FLT quatOut[4], TrackedObject *obj, SurviveObject *so, PoserData *pd,
+								char doLogOutput, SurvivePose *additionalTx, const int lh, const int setLhCalibration) {
+	ToriData *toriData = so->PoserData;
+
+	FILE *logFile = NULL;
+	if (doLogOutput)
+	{
+		logFile = fopen("pointcloud2.pcd", "wb");
+		writePcdHeader(logFile);
+		writeAxes(logFile);
+	}
+
+	LighthouseEstimate estimate;
+	EstimateLighthouse(&estimate, obj, toriData->lastLhPos[lh], logFile);
+	ApplyLighthouseEstimate(posOut, quatOut, &estimate, so, pd, additionalTx, lh, setLhCalibration);
+
 	if (logFile)
 	{
 		updateHeader(logFile);
 		fclose(logFile);
 	}
 
+	return estimate.position;
+}
 
-	toriData->lastLhPos[lh].x = refinedEstimateGd.x;
-	toriData->lastLhPos[lh].y = refinedEstimateGd.y;
-	toriData->lastLhPos[lh].z = refinedEstimateGd.z;
-
+// One lighthouse's share of a full scene solve.
+typedef struct
+{
+	TrackedObject *obj;
+	Point lastLhPos;
+	LighthouseEstimate estimate;
+} LighthouseJob;
 
-	return refinedEstimateGd;
+static void *EstimateLighthouseJob(void *userData)
+{
+	LighthouseJob *job = userData;
+	EstimateLighthouse(&job->estimate, job->obj, job->lastLhPos, NULL);
+	return 0;
 }
 
 static void QuickPose(SurviveObject *so, PoserData *pd, SurvivePose *additionalTx, int lh) {
@@ -1742,12 +1773,10 @@ int PoserTurveyTori( SurviveObject * so, PoserData * poserData )
 	}
 	case POSERDATA_FULL_SCENE:
 	{
-		TrackedObject *to;
+		LighthouseJob jobs[2];
 
 		PoserDataFullScene * fs = (PoserDataFullScene*)poserData;
 
-		to = malloc(sizeof(TrackedObject) + (SENSORS_PER_OBJECT * sizeof(TrackedSensor)));
-
 		// if we rotate the internal reference frame of of the tracked object from having -z being arbitrary
 		// to being the down direction as defined by the accelerometer, then when we have come up
 		// with world coordinate system, it will have Z oriented correctly.
@@ -1763,13 +1792,14 @@ int PoserTurveyTori( SurviveObject * so, PoserData * poserData )
 		angleaxisfrom2vect(&angle, axis, td->down, negZ);
 		//angleaxisfrom2vect(&angle, &axis, negZ, td->down);
 		SurvivePose additionalTx;
+		for (int lh = 0; lh < 2; lh++)
 		{
+			TrackedObject *to = malloc(sizeof(TrackedObject) + (SENSORS_PER_OBJECT * sizeof(TrackedSensor)));
 			int sensorCount = 0;
 
-
 			for (int i = 0; i < so->sensor_ct; i++)
 			{
-				if (fs->lengths[i][0][0] != -1 && fs->lengths[i][0][1] != -1) //lh 0
+				if (fs->lengths[i][lh][0] != -1 && fs->lengths[i][lh][1] != -1) 
 				{
 					FLT norm[3] = { so->sensor_normals[i * 3 + 0] , so->sensor_normals[i * 3 + 1] , so->sensor_normals[i * 3 + 2] };
 					FLT point[3] = { so->sensor_locations[i * 3 + 0] , so->sensor_locations[i * 3 + 1] , so->sensor_locations[i * 3 + 2] };
@@ -1789,59 +1819,40 @@ int PoserTurveyTori( SurviveObject * so, PoserData * poserData )
 					to->sensor[sensorCount].point.z = point[2];
 
 					FLT out[2];
-					survive_apply_bsd_calibration(ctx, 0, fs->angles[i][0], out);
-
-					to->sensor[sensorCount].theta = out[0] + LINMATHPI / 2; // lighthouse 0, angle 0 (horizontal)
-					to->sensor[sensorCount].phi = out[1] + LINMATHPI / 2;   // lighthouse 0, angle 1 (vertical)
+					survive_apply_bsd_calibration(ctx, lh, fs->angles[i][lh], out);
 
+					to->sensor[sensorCount].theta = out[0] + LINMATHPI / 2; // angle 0 (horizontal)
+					to->sensor[sensorCount].phi = out[1] + LINMATHPI / 2;   // angle 1 (vertical)
 					sensorCount++;
 				}
 			}
+
 			to->numSensors = sensorCount;
 
-			FLT pos[3], quat[4];
+			jobs[lh].obj = to;
+			jobs[lh].lastLhPos = td->lastLhPos[lh];
+		}
 
-			SolveForLighthouse(pos, quat, to, so, poserData, 0, &additionalTx, 0, 1);
+		// Neither lighthouse's solve depends on the other's, so the second one can run on its own thread.
+		// The estimates are applied in the same order either way, so the result doesn't change.
+		if (survive_configi(ctx, "turveytori-parallel", SC_GET, 1))
+		{
+			og_thread_t thread = OGCreateThread(EstimateLighthouseJob, &jobs[1]);
+			EstimateLighthouseJob(&jobs[0]);
+			OGJoinThread(thread);
 		}
+		else
 		{
-			int sensorCount = 0;
-			int lh = 1;
-
-			for (int i = 0; i < so->sensor_ct; i++)
-			{
-				if (fs->lengths[i][lh][0] != -1 && fs->lengths[i][lh][1] != -1) 
-				{
-					FLT norm[3] = { so->sensor_normals[i * 3 + 0] , so->sensor_normals[i * 3 + 1] , so->sensor_normals[i * 3 + 2] };
-					FLT point[3] = { so->sensor_locations[i * 3 + 0] , so->sensor_locations[i * 3 + 1] , so->sensor_locations[i * 3 + 2] };
-
-					quatrotatevector(norm, downQuat, norm);
-					quatrotatevector(point, downQuat, point);
-
-					//rotatearoundaxis(norm, norm, axis, angle);
-					//rotatearoundaxis(point, point, axis, angle);
-
-
-					to->sensor[sensorCount].normal.x = norm[0];
-					to->sensor[sensorCount].normal.y = norm[1];
-					to->sensor[sensorCount].normal.z = norm[2];
-					to->sensor[sensorCount].point.x = point[0];
-					to->sensor[sensorCount].point.y = point[1];
-					to->sensor[sensorCount].point.z = point[2];
-
-					FLT out[2];
-					survive_apply_bsd_calibration(ctx, lh, fs->angles[i][lh], out);
-
-					to->sensor[sensorCount].theta = out[0] + LINMATHPI / 2; // lighthouse 0, angle 0 (horizontal)
-					to->sensor[sensorCount].phi = out[1] + LINMATHPI / 2;   // lighthosue 0, angle 1 (vertical)
-					sensorCount++;
-				}
-			}
-
-			to->numSensors = sensorCount;
+			EstimateLighthouseJob(&jobs[0]);
+			EstimateLighthouseJob(&jobs[1]);
+		}
 
+		for (int lh = 0; lh < 2; lh++)
+		{
 			FLT pos[3], quat[4];
 
-			SolveForLighthouse(pos, quat, to, so, poserData, 0, &additionalTx, 1, 1);
+			ApplyLighthouseEstimate(pos, quat, &jobs[lh].estimate, so, poserData, &additionalTx, lh, 1);
+			free(jobs[lh].obj);
 		}
 
 
@@ -1874,7 +1885,6 @@ int PoserTurveyTori( SurviveObject * so, PoserData * poserData )
 
 		config_save(ctx, survive_configs(ctx, "configfile", SC_GET, "config.json"));
 
-		free(to);
 		//printf( "Full scene data.\n" );
 		break;
 	}
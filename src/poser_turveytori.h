@@ -0,0 +1,96 @@
+#ifndef _POSER_TURVEYTORI_H
+#define _POSER_TURVEYTORI_H
+
+#include <linmath.h>
+#include <stdio.h>
+#include <survive.h>
+
+/**
+ * The parts of TurveyTori's lighthouse solve that its test and tools/turveytori_bench call directly. The poser is one
+ * of the extra posers, so whatever uses these builds src/poser_turveytori.c alongside.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+	FLT x;
+	FLT y;
+	FLT z;
+} Point;
+
+typedef struct
+{
+	Point point; // location of the sensor on the tracked object;
+	Point normal; // unit vector indicating the normal for the sensor
+	double theta; // "horizontal" angular measurement from lighthouse radians
+	double phi; // "vertical" angular measurement from lighthouse in radians.
+} TrackedSensor;
+
+typedef struct
+{
+	size_t numSensors;
+	TrackedSensor sensor[0];
+} TrackedObject;
+
+// The torus of lighthouse positions that see the sensors at 'a' and 'b' 'angle' apart
+typedef struct
+{
+	Point a;
+	Point b;
+	FLT angle;
+	FLT tanAngle; // tangent of angle
+	Matrix3x3 rotation;
+	Matrix3x3 invRotation; // inverse of rotation
+	char ai;
+	char bi;
+} PointsAndAngle;
+
+#define MAX_POINT_PAIRS 100
+
+// The tori of all the sensor pairs, reduced to what the point fitness needs and laid out as parallel arrays so that
+// the fitness loop over the pairs vectorizes.  Built once per solve from the PointsAndAngle list.
+typedef struct
+{
+	size_t count;
+	FLT mx[MAX_POINT_PAIRS]; // midpoint between the two sensors
+	FLT my[MAX_POINT_PAIRS];
+	FLT mz[MAX_POINT_PAIRS];
+	FLT axisX[MAX_POINT_PAIRS]; // axis of the torus; the z row of the inverse rotation
+	FLT axisY[MAX_POINT_PAIRS];
+	FLT axisZ[MAX_POINT_PAIRS];
+	FLT toroidalRadius[MAX_POINT_PAIRS];
+	FLT poloidalRadius[MAX_POINT_PAIRS];
+} ToriSoA;
+
+// Where a lighthouse is, and how it's rotated, in the tracked object's coordinate system.
+typedef struct
+{
+	Point position;
+	FLT rot[4]; // this is axis/ angle rotation, not a quaternion!
+	FLT rotQuat[4]; // this is a quaternion!
+} LighthouseEstimate;
+
+Matrix3x3 GetRotationMatrixForTorus(Point a, Point b);
+FLT angleBetweenSensors(TrackedSensor *a, TrackedSensor *b);
+
+// How far a point is from the torus, scaled by how near it is to the torus' inner side; the trig version the poser
+// started with
+FLT getPointFitnessForPna(Point pointIn, PointsAndAngle *pna);
+
+void buildToriSoA(ToriSoA *tori, PointsAndAngle *pna, size_t pnaCount);
+// getPointFitnessForPna squared for every torus, in closed form
+void getPointFitnessesSquared(FLT *fitnessesOut, Point pointIn, const ToriSoA *tori);
+// One over the root of the sum of the best 70% of the squared fitnesses; larger is closer
+FLT getPointFitness(Point pointIn, const ToriSoA *tori);
+
+// Solves for one lighthouse from the angles in 'obj', starting from its last known position
+void EstimateLighthouse(LighthouseEstimate *estimate, TrackedObject *obj, Point lastLhPos, FILE *logFile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,15 +3,21 @@
 
 #include "survive_internal.h"
 #include <ctype.h>
+#include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <survive.h>
 
 #include "os_generic.h"
+#include "survive_atomic.h"
 #include "survive_config.h"
 #include "survive_default_devices.h"
+#include "survive_latency.h"
 #include "survive_playback.h"
+#include "survive_reproject.h"
+#include "survive_trace.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -27,6 +33,21 @@ STATIC_CONFIG_ITEM( CONFIG_FILE, "configfile", 's', "Default configuration file"
 STATIC_CONFIG_ITEM( CONFIG_D_CALI, "disable-calibrate", 'i', "Enables or disables calibration", 0 );
 STATIC_CONFIG_ITEM( CONFIG_F_CALI, "force-calibrate", 'i', "Forces calibration even if one exists.", 0 );
 STATIC_CONFIG_ITEM(CONFIG_LIGHTHOUSE_COUNT, "lighthousecount", 'i', "How many lighthouses to look for.", 2);
+STATIC_CONFIG_ITEM(CONFIG_DETERMINISTIC, "deterministic", 'i',
+				   "Use only recorded timecodes for timing and no background threads so runs are repeatable.", 0);
+STATIC_CONFIG_ITEM(CONFIG_RANDOM_SEED, "random-seed", 'i', "Seed for the per-context random number generator.", 42);
+STATIC_CONFIG_ITEM(CONFIG_BUTTON_QUEUE_SIZE, "button-queue-size", 'i',
+				   "Button and axis events that can wait for delivery before new ones are dropped.",
+				   BUTTON_QUEUE_DEFAULT_LEN);
+STATIC_CONFIG_ITEM(CONFIG_CALIBRATION_TABLE, "calibration-table", 'i',
+				   "Correct angles for the full lighthouse calibration with a precomputed table rather than only the "
+				   "phase.",
+				   0);
+STATIC_CONFIG_ITEM(CONFIG_POSER_ASSIGNMENTS, "poser-assignments", 's',
+				   "Posers for particular objects, as a comma separated list of pattern=poser such as "
+				   "'HMD=MPFIT,WM*=EPNP'. Patterns match an object's codename or serial number and may use * and ?; "
+				   "the first match wins and other objects use 'defaultposer'.",
+				   "");
 
 #ifdef WIN32
 #define RUNTIME_SYMNUM
@@ -83,6 +104,96 @@ static void survivewarn(struct SurviveContext *ctx, const char *fault) {
 	reset_stderr();
 }
 
+// The queue is the usual bounded ring with a sequence number per slot: a slot whose sequence equals the write index
+// is free for that write, and one whose sequence is one past the read index holds that read's event. Producers claim
+// slots with a compare-and-swap on nextWriteIndex, so they never wait on each other or on the consumer.
+void survive_button_queue_init(ButtonQueue *queue, uint32_t capacity) {
+	uint32_t size = 2;
+	while (size < capacity && size < 0x80000000u)
+		size <<= 1;
+
+	memset(queue, 0, sizeof(*queue));
+	queue->capacity = size;
+	queue->entry = calloc(size, sizeof(ButtonQueueEntry));
+	for (uint32_t i = 0; i < size; i++)
+		queue->entry[i].sequence = i;
+}
+
+void survive_button_queue_free(ButtonQueue *queue) {
+	free(queue->entry);
+	queue->entry = 0;
+	queue->capacity = 0;
+}
+
+bool survive_button_queue_push(ButtonQueue *queue, const ButtonQueueEntry *entry) {
+	uint32_t mask = queue->capacity - 1;
+	uint32_t pos = survive_atomic_load32(&queue->nextWriteIndex);
+	ButtonQueueEntry *slot;
+	for (;;) {
+		slot = &queue->entry[pos & mask];
+		int32_t diff = (int32_t)(survive_atomic_load32(&slot->sequence) - pos);
+		if (diff == 0) {
+			if (survive_atomic_cas32(&queue->nextWriteIndex, pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			// The consumer hasn't freed this slot from the last time around
+			survive_atomic_increment64(&queue->dropped);
+			if (entry->so)
+				survive_atomic_increment64(&entry->so->counters.buttons_dropped);
+			return false;
+		}
+		pos = survive_atomic_load32(&queue->nextWriteIndex);
+	}
+
+	slot->eventType = entry->eventType;
+	slot->buttonId = entry->buttonId;
+	slot->axis1Id = entry->axis1Id;
+	slot->axis1Val = entry->axis1Val;
+	slot->axis2Id = entry->axis2Id;
+	slot->axis2Val = entry->axis2Val;
+	slot->so = entry->so;
+	survive_atomic_store32(&slot->sequence, pos + 1);
+
+	if (entry->so)
+		survive_atomic_increment64(&entry->so->counters.buttons);
+	if (queue->buttonservicesem)
+		OGUnlockSema(queue->buttonservicesem);
+	return true;
+}
+
+bool survive_button_queue_pop(ButtonQueue *queue, ButtonQueueEntry *entry) {
+	uint32_t mask = queue->capacity - 1;
+	uint32_t pos = survive_atomic_load32(&queue->nextReadIndex);
+	ButtonQueueEntry *slot;
+	for (;;) {
+		slot = &queue->entry[pos & mask];
+		int32_t diff = (int32_t)(survive_atomic_load32(&slot->sequence) - (pos + 1));
+		if (diff == 0) {
+			if (survive_atomic_cas32(&queue->nextReadIndex, pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			// Empty, or the producer that claimed this slot is still filling it in
+			return false;
+		}
+		pos = survive_atomic_load32(&queue->nextReadIndex);
+	}
+
+	*entry = *slot;
+	survive_atomic_store32(&slot->sequence, pos + queue->capacity);
+	return true;
+}
+
+static void button_queue_dispatch(SurviveContext *ctx) {
+	ButtonQueueEntry entry;
+	while (survive_button_queue_pop(&ctx->buttonQueue, &entry)) {
+		button_process_func butt_func = ctx->buttonproc;
+		if (butt_func) {
+			butt_func(entry.so, entry.eventType, entry.buttonId, entry.axis1Id, entry.axis1Val, entry.axis2Id,
+					  entry.axis2Val);
+		}
+	}
+}
+
 static void *button_servicer(void *context) {
 	SurviveContext *ctx = (SurviveContext *)context;
 
@@ -94,37 +205,23 @@ static void *button_servicer(void *context) {
 			return NULL;
 		}
 
-		ButtonQueueEntry *entry = &(ctx->buttonQueue.entry[ctx->buttonQueue.nextReadIndex]);
-		if (entry->isPopulated == 0) {
-			// should never happen.  indicates failure of code pushing stuff onto
-			// the buttonQueue
-			// if it does happen, it will kill all future button input
-			printf("ERROR: Unpopulated ButtonQueueEntry! NextReadIndex=%d\n", ctx->buttonQueue.nextReadIndex);
-			return NULL;
-		}
-
-		// printf("ButtonEntry: eventType:%x, buttonId:%d, axis1:%d, axis1Val:%8.8x, axis2:%d, axis2Val:%8.8x\n",
-		//	entry->eventType,
-		//	entry->buttonId,
-		//	entry->axis1Id,
-		//	entry->axis1Val,
-		//	entry->axis2Id,
-		//	entry->axis2Val);
-
-		button_process_func butt_func = ctx->buttonproc;
-		if (butt_func) {
-			butt_func(entry->so, entry->eventType, entry->buttonId, entry->axis1Id, entry->axis1Val, entry->axis2Id,
-					  entry->axis2Val);
-		}
-
-		ctx->buttonQueue.nextReadIndex++;
-		if (ctx->buttonQueue.nextReadIndex >= BUTTON_QUEUE_MAX_LEN) {
-			ctx->buttonQueue.nextReadIndex = 0;
-		}
+		// Each event posts once, so an event whose producer is still mid-push when we look gets picked up on the
+		// wake its own post causes.
+		button_queue_dispatch(ctx);
 	};
 	return NULL;
 }
 
+uint32_t survive_rand_r(uint64_t *state) {
+	// splitmix64; cheap, has no bad seeds and the state is just a counter
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+uint32_t survive_rand(SurviveContext *ctx) { return survive_rand_r(&ctx->rng_state); }
+
 void survive_verify_FLT_size(uint32_t user_size) {
 	if (sizeof(FLT) != user_size) {
 		fprintf(stderr, "FLT type incompatible; the shared library libsurvive has FLT size %lu vs user program %u\n",
@@ -245,7 +342,7 @@ SurviveContext *survive_init_internal(int argc, char *const *argv) {
 		}
 	}
 
-	const char *config_prefix_fields[] = {"playback", 0};
+	const char *config_prefix_fields[] = {"playback", "usbreplay", 0};
 	for (const char **name = config_prefix_fields; *name; name++) {
 		if (!survive_config_is_set(ctx, "configfile") && survive_config_is_set(ctx, *name)) {
 			char configfile[256] = { 0 };
@@ -268,8 +365,26 @@ SurviveContext *survive_init_internal(int argc, char *const *argv) {
 
 	config_read(ctx, survive_configs(ctx, "configfile", SC_GET, "config.json"));
 	ctx->activeLighthouses = survive_configi(ctx, "lighthousecount", SC_SETCONFIG, 2);
+	ctx->deterministic = survive_configi(ctx, "deterministic", SC_GET, 0);
+	ctx->rng_state = survive_configi(ctx, "random-seed", SC_GET, 42);
+	ctx->visibility_filter = survive_configi(ctx, "visibility-filter", SC_GET, 0);
+	ctx->visibility_filter_margin = survive_configf(ctx, "visibility-filter-margin", SC_GET, .2);
+	ctx->epnp_ransac = survive_configi(ctx, "epnp-ransac", SC_GET, 0);
+	ctx->epnp_ransac_iterations = survive_configi(ctx, "epnp-ransac-iterations", SC_GET, 24);
+	ctx->epnp_ransac_threshold = survive_configf(ctx, "epnp-ransac-threshold", SC_GET, .01);
+	ctx->shed_lag = survive_configf(ctx, "shed-lag", SC_GET, 0);
+	ctx->shed_solve_period = survive_configf(ctx, "shed-solve-period", SC_GET, .05);
+	ctx->shed_imu_divisor = survive_configi(ctx, "shed-imu-divisor", SC_GET, 4);
+	static const FLT real_time_factor = 1;
+	ctx->data_time_factor = &real_time_factor;
 	config_read_lighthouse(ctx->lh_config, &(ctx->bsd[0]), 0);
 	config_read_lighthouse(ctx->lh_config, &(ctx->bsd[1]), 1);
+	if (survive_configi(ctx, "calibration-table", SC_GET, 0)) {
+		for (int i = 0; i < NUM_LIGHTHOUSES; i++) {
+			ctx->calibration_tables[i] = calloc(1, sizeof(SurviveCalibrationTable));
+			survive_calibration_table_update(ctx, i);
+		}
+	}
 
 	if( list_for_autocomplete )
 	{
@@ -339,6 +454,63 @@ survive_timecode survive_timecode_difference(survive_timecode most_recent, survi
 	return diff;
 }
 
+static bool pattern_match(const char *pattern, const char *s) {
+	if (*pattern == 0)
+		return *s == 0;
+	if (*pattern == '*')
+		return pattern_match(pattern + 1, s) || (*s && pattern_match(pattern, s + 1));
+	return *s && (*pattern == '?' || *pattern == *s) && pattern_match(pattern + 1, s + 1);
+}
+
+static bool object_matches(const SurviveObject *so, const char *pattern) {
+	return pattern_match(pattern, so->codename) || (so->serial_number[0] && pattern_match(pattern, so->serial_number));
+}
+
+// Whether the object matches one of the comma separated patterns in the given config value
+static bool object_listed(SurviveContext *ctx, const SurviveObject *so, const char *tag) {
+	const char *list = survive_configs(ctx, tag, SC_GET, "");
+	for (const char *entry = list; *entry;) {
+		size_t len = strcspn(entry, ",");
+		char buffer[128] = {0};
+		memcpy(buffer, entry, len < sizeof(buffer) - 1 ? len : sizeof(buffer) - 1);
+		entry += len + (entry[len] == ',');
+		if (buffer[0] && object_matches(so, buffer))
+			return true;
+	}
+	return false;
+}
+
+// Looks the object up in 'poser-assignments'; objects that aren't listed get 'fallback'.
+static PoserCB poser_for_object(SurviveContext *ctx, SurviveObject *so, PoserCB fallback) {
+	const char *assignments = survive_configs(ctx, "poser-assignments", SC_GET, "");
+
+	for (const char *entry = assignments; *entry;) {
+		size_t len = strcspn(entry, ",");
+		char buffer[128] = {0};
+		memcpy(buffer, entry, len < sizeof(buffer) - 1 ? len : sizeof(buffer) - 1);
+		entry += len + (entry[len] == ',');
+
+		char *poser = strchr(buffer, '=');
+		if (poser == 0) {
+			SV_WARN("Ignoring '%s' in poser-assignments; expected pattern=poser", buffer);
+			continue;
+		}
+		*poser++ = 0;
+
+		if (!object_matches(so, buffer))
+			continue;
+
+		PoserCB fn = GetDriverWithPrefix("Poser", poser);
+		if (fn == 0) {
+			SV_WARN("Ignoring '%s=%s' in poser-assignments; there is no such poser", buffer, poser);
+			continue;
+		}
+		SV_INFO("Using %s for %s", poser, so->codename);
+		return fn;
+	}
+	return fallback;
+}
+
 void *GetDriverByConfig(SurviveContext *ctx, const char *name, const char *configname, const char *configdef) {
 	const char *Preferred = survive_configs(ctx, configname, SC_SETCONFIG, configdef);
 	const char *DriverName = 0;
@@ -390,13 +562,18 @@ int survive_startup(SurviveContext *ctx) {
 	int i = 0;
 
 	survive_install_recording(ctx);
+	survive_install_trace(ctx);
 
 	// initialize the button queue
-	memset(&(ctx->buttonQueue), 0, sizeof(ctx->buttonQueue));
+	survive_button_queue_init(&ctx->buttonQueue, survive_configi(ctx, "button-queue-size", SC_GET,
+																  BUTTON_QUEUE_DEFAULT_LEN));
 	ctx->buttonQueue.buttonservicesem = OGCreateSema();
 
-	// start the thread to process button data
-	ctx->buttonservicethread = OGCreateThread(button_servicer, ctx);
+	// start the thread to process button data. In deterministic mode, survive_poll delivers them instead.
+	if (!ctx->deterministic) {
+		ctx->buttonservicethread = OGCreateThread(button_servicer, ctx);
+		survive_thread_configure(ctx, ctx->buttonservicethread, "button");
+	}
 
 	PoserCB PreferredPoserCB = GetDriverByConfig(ctx, "Poser", "defaultposer", "MPFIT");
 	ctx->lightcapfunction = GetDriverByConfig(ctx, "Disambiguator", "disambiguator", "StateBased");
@@ -431,7 +608,8 @@ int survive_startup(SurviveContext *ctx) {
 
 	// Apply poser to objects.
 	for (i = 0; i < ctx->objs_ct; i++) {
-		ctx->objs[i]->PoserFn = PreferredPoserCB;
+		ctx->objs[i]->PoserFn = poser_for_object(ctx, ctx->objs[i], PreferredPoserCB);
+		ctx->objs[i]->shed.noncritical = object_listed(ctx, ctx->objs[i], "shed-objects");
 	}
 
 	// saving the config extra to make sure that the user has a config file they can change.
@@ -569,10 +747,17 @@ void survive_install_lighthouse_pose_fn(SurviveContext *ctx, lighthouse_pose_fun
 
 int survive_add_object(SurviveContext *ctx, SurviveObject *obj) {
 	SV_INFO("Adding tracked object %s from %s", obj->codename, obj->drivername);
+	survive_latency_install(obj);
 	int oldct = ctx->objs_ct;
 	ctx->objs = realloc(ctx->objs, sizeof(SurviveObject *) * (oldct + 1));
 	ctx->objs[oldct] = obj;
 	ctx->objs_ct = oldct + 1;
+
+	// Objects that show up after startup, such as hotplugged devices, missed the poser assignment there
+	if (ctx->state == SURVIVE_RUNNING && obj->PoserFn == 0)
+		obj->PoserFn = poser_for_object(ctx, obj, GetDriverByConfig(ctx, "Poser", "defaultposer", "MPFIT"));
+	if (ctx->state == SURVIVE_RUNNING)
+		obj->shed.noncritical = object_listed(ctx, obj, "shed-objects");
 	return 0;
 }
 
@@ -641,8 +826,12 @@ void survive_close(SurviveContext *ctx) {
 
 	ctx->state = SURVIVE_CLOSING;
 
-	// unlock/ post to button service semaphore so the thread can kill itself
-	OGUnlockSema(ctx->buttonQueue.buttonservicesem);
+	// unlock/ post to button service semaphore so the thread can kill itself. It doesn't exist if the context was
+	// never started.
+	if (ctx->buttonQueue.buttonservicesem)
+		OGUnlockSema(ctx->buttonQueue.buttonservicesem);
+	if (ctx->buttonservicethread)
+		OGJoinThread(ctx->buttonservicethread);
 
 	while ((DriverName = GetDriverNameMatching("DriverUnreg", r++))) {
 		DeviceDriver dd = GetDriver(DriverName);
@@ -669,13 +858,29 @@ void survive_close(SurviveContext *ctx) {
 		}
 	}
 
+	for (i = 0; i < ctx->objs_ct; i++) {
+		survive_latency_report(ctx->objs[i]);
+	}
+
+	if (ctx->buttonQueue.dropped) {
+		SV_WARN("%" PRIu64 " button events were dropped because the button queue was full; consider raising "
+				"'button-queue-size' from %u",
+				ctx->buttonQueue.dropped, ctx->buttonQueue.capacity);
+	}
+	survive_button_queue_free(&ctx->buttonQueue);
+	if (ctx->buttonQueue.buttonservicesem)
+		OGDeleteSema(ctx->buttonQueue.buttonservicesem);
+
 	config_save(ctx, survive_configs(ctx, "configfile", SC_GET, "config.json"));
+	// The button and driver threads are joined by now, so nothing else can be writing spans
+	survive_trace_close(ctx);
 
 	destroy_config_group(ctx->global_config_values);
 	destroy_config_group(ctx->temporary_config_values);
 	destroy_config_group(ctx->lh_config);
 
 	for (i = 0; i < ctx->objs_ct; i++) {
+		survive_latency_free(ctx->objs[i]);
 		free(ctx->objs[i]->sensor_locations);
 		free(ctx->objs[i]->sensor_normals);
 		free(ctx->objs[i]);
@@ -690,7 +895,9 @@ void survive_close(SurviveContext *ctx) {
 	free(ctx->temporary_config_values);
 	free(ctx->lh_config);
 	free(ctx->calptr);
-	free(ctx->recptr);
+	for (i = 0; i < NUM_LIGHTHOUSES; i++)
+		free(ctx->calibration_tables[i]);
+	survive_destroy_recording(ctx);
 
 	free(ctx);
 }
@@ -711,6 +918,10 @@ int survive_poll(struct SurviveContext *ctx) {
 			return r;
 	}
 
+	if (ctx->deterministic) {
+		button_queue_dispatch(ctx);
+	}
+
 	return 0;
 }
 
@@ -777,6 +988,31 @@ const bool survive_object_charging(SurviveObject *so) { return so->charging; }
 
 const SurvivePose *survive_object_pose(SurviveObject *so) { return &so->OutPose; }
 
+int survive_object_set_poser(SurviveObject *so, const char *poser) {
+	SurviveContext *ctx = so->ctx;
+	PoserCB fn = GetDriverWithPrefix("Poser", poser);
+	if (fn == 0) {
+		SV_WARN("Can't switch %s to %s; there is no such poser", so->codename, poser);
+		return -1;
+	}
+
+	SV_INFO("Switching %s to %s", so->codename, poser);
+	survive_atomic_store_ptr(&so->RequestedPoserFn, fn);
+	survive_atomic_store32(&so->poser_change_pending, 1);
+	return 0;
+}
+
+void survive_object_counters(const SurviveObject *so, SurviveObjectCounters *counters) {
+	// Every field after 'time' is 64 bits wide, so they're loaded one word at a time; solver_error_total is copied as
+	// its bit pattern.
+	const uint64_t *src = (const uint64_t *)&so->counters.packets;
+	uint64_t *dst = (uint64_t *)&counters->packets;
+	size_t words = (sizeof(SurviveObjectCounters) - offsetof(SurviveObjectCounters, packets)) / sizeof(uint64_t);
+	for (size_t i = 0; i < words; i++)
+		dst[i] = survive_atomic_load64(&src[i]);
+	counters->time = OGGetAbsoluteTime();
+}
+
 int8_t survive_object_sensor_ct(SurviveObject *so) { return so->sensor_ct; }
 const FLT *survive_object_sensor_locations(SurviveObject *so) { return so->sensor_locations; }
 const FLT *survive_object_sensor_normals(SurviveObject *so) { return so->sensor_normals; }
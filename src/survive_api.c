@@ -35,6 +35,12 @@ struct SurviveSimpleContext {
 	og_thread_t thread;
 	og_mutex_t poll_mutex;
 
+	// survive_simple_wait_for_update sleeps on this. It's only posted for threads counted in 'waiters' that haven't
+	// been woken yet, so its count never grows past the number of threads that will take it. Both counts are guarded
+	// by poll_mutex.
+	og_sema_t update_sema;
+	int waiters, wakeups;
+
 	size_t external_object_ct;
 	struct SurviveSimpleObject *external_objects;
 
@@ -60,14 +66,36 @@ SurviveSimpleObject *find_or_create_external(struct SurviveSimpleContext *actx,
 	return so;
 }
 
+// Must be called with poll_mutex held
+static void wake_waiter(struct SurviveSimpleContext *actx) {
+	if (actx->wakeups < actx->waiters) {
+		actx->wakeups++;
+		OGUnlockSema(actx->update_sema);
+	}
+}
+
+static void wake_all_waiters(struct SurviveSimpleContext *actx) {
+	OGLockMutex(actx->poll_mutex);
+	while (actx->wakeups < actx->waiters)
+		wake_waiter(actx);
+	OGUnlockMutex(actx->poll_mutex);
+}
+
+// Must be called with poll_mutex held
+static void mark_updated(struct SurviveSimpleContext *actx, struct SurviveSimpleObject *obj) {
+	if (!obj->has_update)
+		wake_waiter(actx);
+	obj->has_update = true;
+}
+
 static void external_pose_fn(SurviveContext *ctx, const char *name, const SurvivePose *pose) {
 	struct SurviveSimpleContext *actx = ctx->user_ptr;
 	OGLockMutex(actx->poll_mutex);
 	survive_default_external_pose_process(ctx, name, pose);
 
 	struct SurviveSimpleObject *so = find_or_create_external(actx, name);
-	so->has_update = true;
 	so->data.seo.pose = *pose;
+	mark_updated(actx, so);
 	OGUnlockMutex(actx->poll_mutex);
 }
 static void pose_fn(SurviveObject *so, uint32_t timecode, SurvivePose *pose) {
@@ -76,7 +104,7 @@ static void pose_fn(SurviveObject *so, uint32_t timecode, SurvivePose *pose) {
 	survive_default_raw_pose_process(so, timecode, pose);
 
 	intptr_t idx = (intptr_t)so->user_ptr;
-	actx->objects[idx].has_update = true;
+	mark_updated(actx, &actx->objects[idx]);
 	OGUnlockMutex(actx->poll_mutex);
 }
 static void lh_fn(SurviveContext *ctx, uint8_t lighthouse, SurvivePose *lighthouse_pose,
@@ -85,7 +113,7 @@ static void lh_fn(SurviveContext *ctx, uint8_t lighthouse, SurvivePose *lighthou
 	OGLockMutex(actx->poll_mutex);
 	survive_default_lighthouse_pose_process(ctx, lighthouse, lighthouse_pose, object_pose);
 
-	actx->objects[lighthouse].has_update = true;
+	mark_updated(actx, &actx->objects[lighthouse]);
 
 	OGUnlockMutex(actx->poll_mutex);
 }
@@ -103,6 +131,7 @@ struct SurviveSimpleContext *survive_simple_init(int argc, char *const *argv) {
 	actx->object_ct = object_ct;
 	actx->ctx = ctx;
 	actx->poll_mutex = OGCreateMutex();
+	actx->update_sema = OGCreateSema();
 	ctx->user_ptr = actx;
 	intptr_t i = 0;
 	for (i = 0; i < ctx->activeLighthouses; i++) {
@@ -132,6 +161,10 @@ struct SurviveSimpleContext *survive_simple_init(int argc, char *const *argv) {
 
 int survive_simple_stop_thread(struct SurviveSimpleContext *actx) {
 	actx->running = false;
+	wake_all_waiters(actx);
+	if (actx->thread == 0)
+		return 0;
+
 	intptr_t error = (intptr_t)OGJoinThread(actx->thread);
 	if (error != 0) {
 		SurviveContext *ctx = actx->ctx;
@@ -146,6 +179,7 @@ void survive_simple_close(struct SurviveSimpleContext *actx) {
 	}
 
 	survive_close(actx->ctx);
+	OGDeleteSema(actx->update_sema);
 }
 
 static inline void *__simple_thread(void *_actx) {
@@ -155,12 +189,19 @@ static inline void *__simple_thread(void *_actx) {
 		error = survive_poll(actx->ctx);
 	}
 	actx->running = false;
+	wake_all_waiters(actx);
 	return (void*)error; 
 }
 bool survive_simple_is_running(struct SurviveSimpleContext *actx) { return actx->running; }
 void survive_simple_start_thread(struct SurviveSimpleContext *actx) {
 	actx->running = true;
+
+	// In deterministic mode there is no background thread; survive_simple_get_next_updated polls on the caller's
+	// thread so every update is seen in order regardless of scheduling.
+	if (actx->ctx->deterministic)
+		return;
 	actx->thread = OGCreateThread(__simple_thread, actx);
+	survive_thread_configure(actx->ctx, actx->thread, "poll");
 }
 
 const struct SurviveSimpleObject *survive_simple_get_next_object(struct SurviveSimpleContext *actx,
@@ -175,20 +216,65 @@ const struct SurviveSimpleObject *survive_simple_get_first_object(struct Survive
 	return actx->objects;
 }
 
-const struct SurviveSimpleObject *survive_simple_get_next_updated(struct SurviveSimpleContext *actx) {
-	for (int i = 0; i < actx->object_ct; i++) {
+// Must be called with poll_mutex held
+static const struct SurviveSimpleObject *take_next_updated(struct SurviveSimpleContext *actx) {
+	const struct SurviveSimpleObject *rtn = 0;
+	for (int i = 0; i < actx->object_ct && rtn == 0; i++) {
 		if (actx->objects[i].has_update) {
 			actx->objects[i].has_update = false;
-			return &actx->objects[i];
+			rtn = &actx->objects[i];
 		}
 	}
-	for (int i = 0; i < actx->external_object_ct; i++) {
+	for (int i = 0; i < actx->external_object_ct && rtn == 0; i++) {
 		if (actx->external_objects[i].has_update) {
 			actx->external_objects[i].has_update = false;
-			return &actx->external_objects[i];
+			rtn = &actx->external_objects[i];
 		}
 	}
-	return 0;
+	return rtn;
+}
+
+static const struct SurviveSimpleObject *get_next_updated(struct SurviveSimpleContext *actx) {
+	OGLockMutex(actx->poll_mutex);
+	const struct SurviveSimpleObject *rtn = take_next_updated(actx);
+	OGUnlockMutex(actx->poll_mutex);
+	return rtn;
+}
+
+const struct SurviveSimpleObject *survive_simple_get_next_updated(struct SurviveSimpleContext *actx) {
+	const struct SurviveSimpleObject *rtn = get_next_updated(actx);
+	if (actx->thread != 0 || !actx->ctx->deterministic)
+		return rtn;
+
+	while (rtn == 0 && actx->running) {
+		if (survive_poll(actx->ctx) != 0)
+			actx->running = false;
+		rtn = get_next_updated(actx);
+	}
+	return rtn;
+}
+
+const struct SurviveSimpleObject *survive_simple_wait_for_update(struct SurviveSimpleContext *actx) {
+	// Without a poll thread, get_next_updated already polls until there is an update or the input ends
+	if (actx->thread == 0)
+		return survive_simple_get_next_updated(actx);
+
+	// Registering as a waiter under the same lock as the check means an update can't slip in between the two
+	OGLockMutex(actx->poll_mutex);
+	const struct SurviveSimpleObject *rtn = take_next_updated(actx);
+	while (rtn == 0 && actx->running) {
+		actx->waiters++;
+		OGUnlockMutex(actx->poll_mutex);
+		OGLockSema(actx->update_sema);
+		OGLockMutex(actx->poll_mutex);
+		actx->waiters--;
+		actx->wakeups--;
+
+		// Another thread may have taken the update this one was woken for; then it waits again
+		rtn = take_next_updated(actx);
+	}
+	OGUnlockMutex(actx->poll_mutex);
+	return rtn;
 }
 
 uint32_t survive_simple_object_get_latest_pose(const struct SurviveSimpleObject *sao, SurvivePose *pose) {
@@ -222,3 +308,9 @@ uint32_t survive_simple_object_get_latest_pose(const struct SurviveSimpleObject
 }
 
 const char *survive_simple_object_name(const SurviveSimpleObject *sao) { return sao->name; }
+
+uint32_t survive_simple_object_timebase_hz(const SurviveSimpleObject *sao) {
+	if (sao->type == SurviveSimpleObject_OBJECT)
+		return sao->data.so->timebase_hz;
+	return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef _SURVIVE_ATOMIC_H
+#define _SURVIVE_ATOMIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The few atomics the lock free handoffs between threads need, as GCC/Clang builtins or their Interlocked*
+ * equivalents on MSVC. Loads acquire and stores release. The 32 bit operations are for uint32_t values and the
+ * counters are uint64_t; pointers, including function pointers, go through the _ptr variants.
+ */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define survive_atomic_load32(p) ((uint32_t)InterlockedOr((volatile long *)(p), 0))
+#define survive_atomic_store32(p, v) InterlockedExchange((volatile long *)(p), (long)(v))
+#define survive_atomic_exchange32(p, v) ((uint32_t)InterlockedExchange((volatile long *)(p), (long)(v)))
+#define survive_atomic_cas32(p, expected, desired)                                                                     \
+	(InterlockedCompareExchange((volatile long *)(p), (long)(desired), (long)(expected)) == (long)(expected))
+#define survive_atomic_increment64(p) InterlockedIncrement64((volatile __int64 *)(p))
+#define survive_atomic_load64(p) ((uint64_t)InterlockedOr64((volatile __int64 *)(p), 0))
+#define survive_atomic_load_ptr(p) InterlockedCompareExchangePointer((void *volatile *)(p), 0, 0)
+#define survive_atomic_store_ptr(p, v) InterlockedExchangePointer((void *volatile *)(p), (void *)(v))
+#else
+#define survive_atomic_load32(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define survive_atomic_store32(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define survive_atomic_exchange32(p, v) __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL)
+#define survive_atomic_cas32(p, expected, desired)                                                                     \
+	__atomic_compare_exchange_n(p, &(uint32_t){expected}, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+#define survive_atomic_increment64(p) __atomic_fetch_add(p, 1, __ATOMIC_RELAXED)
+#define survive_atomic_load64(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define survive_atomic_load_ptr(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define survive_atomic_store_ptr(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+#endif
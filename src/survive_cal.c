@@ -90,6 +90,7 @@ void ootx_packet_clbk_d(ootx_decoder_context *ct, ootx_packet* packet)
 	b->accel[2] = v6.accel_dir_z;
 	b->mode = v6.mode_current;
 	b->OOTXSet = 1;
+	survive_calibration_table_update(ctx, id);
 
 	config_set_lighthouse(ctx->lh_config,b,id);
 	lighthouses_completed++;
@@ -1,5 +1,6 @@
 // (C) 2017 <>< Joshua Allen, Under MIT/x11 License.
 #include "survive_config.h"
+#include "survive_trace.h"
 #include <assert.h>
 #include <json_helpers.h>
 #include <string.h>
@@ -541,6 +542,7 @@ SurviveContext *survive_context;
 
 void config_save(SurviveContext *sctx, const char *path) {
 	uint16_t i = 0;
+	SURVIVE_TRACE_BEGIN(sctx, start);
 
 	FILE *f = fopen(path, "w");
 
@@ -549,6 +551,7 @@ void config_save(SurviveContext *sctx, const char *path) {
 	write_config_group(f, sctx->lh_config + 1, "lighthouse1");
 
 	fclose(f);
+	SURVIVE_TRACE_END(sctx, "config-save", 0, start);
 }
 
 void print_json_value(char *tag, char **values, uint16_t count) {
@@ -909,8 +912,9 @@ SURVIVE_EXPORT void survive_detach_config(SurviveContext *ctx, const char *tag,
 			update_list_t * v = *ul;
 			*ul = (*ul)->next;
 			free( v );
+		} else {
+			ul = &((*ul)->next);
 		}
-		ul = &((*ul)->next);
 	}
 }
 
@@ -276,7 +276,16 @@ static int process_jsontok(scratch_space_t *scratch, char *d, stack_entry_t *sta
 			//print_stack_spot(d, &entry);
 			j += process_jsontok(scratch, d, &entry, entry.key, count - j);
 
-			j += process_jsontok(scratch, d, &entry, t + 1 + j, count - j);
+			jsmntok_t *value = t + 1 + j;
+			if (value->type == JSMN_STRING && jsoneq(d, entry.key, "device_serial_number") == 0) {
+				SurviveObject *so = scratch->so;
+				int len = value->end - value->start;
+				if (len > (int)sizeof(so->serial_number) - 1)
+					len = sizeof(so->serial_number) - 1;
+				memcpy(so->serial_number, d + value->start, len);
+				so->serial_number[len] = 0;
+			}
+			j += process_jsontok(scratch, d, &entry, value, count - j);
 		}
 		return j + 1;
 	} else if (t->type == JSMN_ARRAY) {
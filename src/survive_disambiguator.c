@@ -1,5 +1,6 @@
 #include "survive.h"
 
+#include "survive_latency.h"
 #include "survive_playback.h"
 #include <assert.h>
 #include <os_generic.h>
@@ -8,6 +9,7 @@
 //#define LOG_LIGHTDATA
 
 void handle_lightcap(SurviveObject *so, LightcapElement *le) {
+	so->counters.lightcaps++;
 	survive_recording_lightcap(so, le);
 #ifdef LOG_LIGHTDATA
 	static FILE *flog;
@@ -23,5 +25,7 @@ void handle_lightcap(SurviveObject *so, LightcapElement *le) {
 		le->sensor_id = so->channel_map[le->sensor_id];
 		assert(le->sensor_id != -1);
 	}
+	SURVIVE_LATENCY_BEGIN(so, start);
 	so->ctx->lightcapfunction(so, le);
+	SURVIVE_LATENCY_END(so, SURVIVE_LATENCY_DISAMBIGUATE, start);
 }
@@ -12,6 +12,10 @@ static const char *DriverNames[MAX_DRIVERS];
 static int NrDrivers;
 
 void RegisterDriver(const char *element, void *data) {
+	if (NrDrivers >= MAX_DRIVERS) {
+		fprintf(stderr, "Can't register %s; all %d driver slots are taken\n", element, MAX_DRIVERS);
+		return;
+	}
 	Drivers[NrDrivers] = data;
 	DriverNames[NrDrivers] = element;
 	NrDrivers++;
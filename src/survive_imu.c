@@ -439,6 +439,20 @@ void survive_imu_tracker_init(SurviveIMUTracker *tracker, SurviveObject *so) {
 	SV_INFO("\t%s: %f", IMU_GYRO_VARIANCE_TAG, tracker->gyro_var);
 }
 
+void survive_imu_tracker_free(SurviveIMUTracker *tracker) {
+	struct SurviveContext *ctx = tracker->so->ctx;
+	survive_detach_config(ctx, VELOCITY_POSITION_VARIANCE_SEC_TAG, &tracker->velocity.Pos.info.variance_per_second);
+	survive_detach_config(ctx, VELOCITY_ROT_VARIANCE_SEC_TAG, &tracker->velocity.EulerRot.info.variance_per_second);
+	survive_detach_config(ctx, OBS_VELOCITY_POSITION_VAR_TAG, &tracker->obs_variance);
+	survive_detach_config(ctx, OBS_VELOCITY_ROTATION_VAR_TAG, &tracker->obs_rot_variance);
+	survive_detach_config(ctx, POSE_POSITION_VARIANCE_SEC_TAG, &tracker->pose.Pos.info.variance_per_second);
+	survive_detach_config(ctx, POSE_ROT_VARIANCE_SEC_TAG, &tracker->pose.Rot.info.variance_per_second);
+	survive_detach_config(ctx, IMU_MAHONY_VARIANCE_TAG, &tracker->mahony_variance);
+	survive_detach_config(ctx, USE_OBS_VELOCITY_TAG, &tracker->use_obs_velocity);
+	survive_detach_config(ctx, IMU_ACC_VARIANCE_TAG, &tracker->acc_var);
+	survive_detach_config(ctx, IMU_GYRO_VARIANCE_TAG, &tracker->gyro_var);
+}
+
 SurviveVelocity survive_imu_velocity(const SurviveIMUTracker *tracker) {
 	SurviveVelocity rtn;
 	copy3d(rtn.Pos, tracker->velocity.Pos.v);
@@ -93,6 +93,8 @@ SURVIVE_EXPORT FLT survive_imu_tracker_predict_pos(const SurviveIMUTracker *trac
 SURVIVE_EXPORT FLT survive_imu_tracker_predict_rot(const SurviveIMUTracker *tracker, survive_timecode timecode,
 												   LinmathQuat out);
 SURVIVE_EXPORT void survive_imu_tracker_init(SurviveIMUTracker *tracker, SurviveObject *so);
+// Stops config changes from being written into the tracker, so it can be freed while the context lives on
+SURVIVE_EXPORT void survive_imu_tracker_free(SurviveIMUTracker *tracker);
 SURVIVE_EXPORT void survive_imu_tracker_integrate_imu(SurviveIMUTracker *tracker, PoserDataIMU *data);
 SURVIVE_EXPORT void survive_imu_tracker_integrate_observation(uint32_t timecode, SurviveIMUTracker *tracker,
 															  const SurvivePose *pose, const FLT *variance);
@@ -11,7 +11,7 @@
 
 
 //Driver registration
-#define MAX_DRIVERS 32
+#define MAX_DRIVERS 64
 
 SURVIVE_EXPORT void * GetDriver( const char * name );
 SURVIVE_EXPORT const char * GetDriverNameMatching( const char * prefix, int place );
@@ -0,0 +1,111 @@
+#include "survive_latency.h"
+#include "survive_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+STATIC_CONFIG_ITEM(LATENCY_STATS, "latency-stats", 'i',
+				   "Keep per-object latency histograms for each processing stage and print them on close.", 0);
+
+static const char *stage_names[SURVIVE_LATENCY_STAGE_COUNT] = {
+	"usb", "lightcap-decode", "disambiguate", "angle", "poser", "pose-delivery",
+};
+
+uint64_t survive_latency_now_ns() {
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static int bucket_for(uint64_t ns) {
+	int bucket = 0;
+	while (ns > 1 && bucket < SURVIVE_LATENCY_BUCKETS - 1) {
+		ns >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+void survive_latency_record(SurviveObject *so, SurviveLatencyStage stage, uint64_t start_ns) {
+	uint64_t ns = survive_latency_now_ns() - start_ns;
+	SurviveLatencyHistogram *h = &so->latency[stage];
+	h->count++;
+	h->total_ns += ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+	h->buckets[bucket_for(ns)]++;
+
+	if (survive_atomic_load_ptr(&so->ctx->traceptr))
+		survive_trace_span(so->ctx, stage_names[stage], so->codename, start_ns, start_ns + ns);
+}
+
+void survive_latency_install(SurviveObject *so) {
+	// Traces are built from the same instrumentation
+	SurviveContext *ctx = so->ctx;
+	bool enabled = survive_configi(ctx, "latency-stats", SC_GET, 0) || survive_configs(ctx, "trace", SC_GET, "")[0];
+	if (so->latency == 0 && enabled)
+		so->latency = calloc(SURVIVE_LATENCY_STAGE_COUNT, sizeof(SurviveLatencyHistogram));
+}
+
+void survive_latency_free(SurviveObject *so) {
+	free(so->latency);
+	so->latency = 0;
+}
+
+bool survive_object_latency(const SurviveObject *so, SurviveLatencyStage stage, SurviveLatencyHistogram *histogram) {
+	if (so->latency == 0 || stage >= SURVIVE_LATENCY_STAGE_COUNT)
+		return false;
+	memcpy(histogram, &so->latency[stage], sizeof(*histogram));
+	return true;
+}
+
+const char *survive_latency_stage_name(SurviveLatencyStage stage) {
+	return stage < SURVIVE_LATENCY_STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+uint64_t survive_latency_percentile(const SurviveLatencyHistogram *histogram, double percentile) {
+	if (histogram->count == 0)
+		return 0;
+
+	uint64_t target = (uint64_t)(percentile * histogram->count);
+	uint64_t seen = 0;
+	for (int i = 0; i < SURVIVE_LATENCY_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen > target) {
+			uint64_t edge = 2ull << i;
+			return edge < histogram->max_ns ? edge : histogram->max_ns;
+		}
+	}
+	return histogram->max_ns;
+}
+
+void survive_latency_report(SurviveObject *so) {
+	SurviveContext *ctx = so->ctx;
+	if (so->latency == 0 || !survive_configi(ctx, "latency-stats", SC_GET, 0))
+		return;
+
+	SV_INFO("Latency for %s (us):        count      mean       p50       p99       max", so->codename);
+	for (int i = 0; i < SURVIVE_LATENCY_STAGE_COUNT; i++) {
+		const SurviveLatencyHistogram *h = &so->latency[i];
+		if (h->count == 0)
+			continue;
+		SV_INFO("\t%-16s %12llu %9.2f %9.2f %9.2f %9.2f", stage_names[i], (unsigned long long)h->count,
+				h->total_ns / 1000. / h->count, survive_latency_percentile(h, .5) / 1000.,
+				survive_latency_percentile(h, .99) / 1000., h->max_ns / 1000.);
+	}
+}
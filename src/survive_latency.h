@@ -0,0 +1,28 @@
+#ifndef _SURVIVE_LATENCY_H
+#define _SURVIVE_LATENCY_H
+
+#include <survive.h>
+
+/**
+ * Per-stage latency instrumentation. Wrap a stage in SURVIVE_LATENCY_BEGIN / SURVIVE_LATENCY_END; when latency stats
+ * aren't enabled for the object this costs one branch, and building with SURVIVE_DISABLE_LATENCY_STATS removes it
+ * entirely.
+ */
+SURVIVE_EXPORT uint64_t survive_latency_now_ns();
+SURVIVE_EXPORT void survive_latency_record(SurviveObject *so, SurviveLatencyStage stage, uint64_t start_ns);
+
+void survive_latency_install(SurviveObject *so);
+void survive_latency_report(SurviveObject *so);
+void survive_latency_free(SurviveObject *so);
+
+#ifndef SURVIVE_DISABLE_LATENCY_STATS
+#define SURVIVE_LATENCY_BEGIN(so, name) uint64_t name = (so)->latency ? survive_latency_now_ns() : 0
+#define SURVIVE_LATENCY_END(so, stage, name)                                                                           \
+	if ((so)->latency)                                                                                                 \
+	survive_latency_record((so), (stage), (name))
+#else
+#define SURVIVE_LATENCY_BEGIN(so, name)
+#define SURVIVE_LATENCY_END(so, stage, name)
+#endif
+
+#endif
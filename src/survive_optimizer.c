@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 #include <survive_optimizer.h>
 #include <survive_reproject.h>
 
@@ -119,6 +120,68 @@ typedef void (*reproject_axis_jacob_fn_t)(SurviveAngleReading, const SurvivePose
 static const reproject_axis_jacob_fn_t reproject_axis_jacob_fns[] = {survive_reproject_full_x_jac_obj_pose,
 																	 survive_reproject_full_y_jac_obj_pose};
 
+survive_optimizer_loss survive_optimizer_loss_from_name(const char *name) {
+	if (name == 0)
+		return survive_optimizer_loss_none;
+	if (strcmp(name, "huber") == 0)
+		return survive_optimizer_loss_huber;
+	if (strcmp(name, "cauchy") == 0)
+		return survive_optimizer_loss_cauchy;
+	if (strcmp(name, "tukey") == 0)
+		return survive_optimizer_loss_tukey;
+	return survive_optimizer_loss_none;
+}
+
+FLT survive_optimizer_loss_residual(survive_optimizer_loss loss, FLT scale, FLT r, FLT *jacobian_scale) {
+	*jacobian_scale = 1;
+	if (scale <= 0 || r == 0)
+		return r;
+
+	// rho is the loss, and rho' its derivative; returns r' with r'^2 / 2 = rho(r) so that the sum of squares mpfit
+	// minimizes is the robust cost, and dr'/dr = rho'(r) / r'.
+	FLT sign = r < 0 ? -1 : 1;
+	FLT u = fabs(r) / scale;
+	FLT robust = r;
+	switch (loss) {
+	case survive_optimizer_loss_huber:
+		if (u <= 1)
+			return r;
+		robust = sign * scale * sqrt(2 * u - 1);
+		*jacobian_scale = scale / fabs(robust);
+		return robust;
+	case survive_optimizer_loss_cauchy:
+		robust = sign * scale * sqrt(log1p(u * u));
+		if (robust != 0)
+			*jacobian_scale = r / (1 + u * u) / robust;
+		return robust;
+	case survive_optimizer_loss_tukey:
+		if (u >= 1) {
+			*jacobian_scale = 0;
+			return sign * scale / sqrt(3);
+		}
+		// 1 - (1 - u^2)^3, written so it doesn't lose precision for small u
+		robust = sign * scale * sqrt(u * u * (3 - 3 * u * u + u * u * u * u) / 3);
+		if (robust != 0)
+			*jacobian_scale = r * (1 - u * u) * (1 - u * u) / robust;
+		return robust;
+	default:
+		return r;
+	}
+}
+
+// Replaces a residual and its jacobian row with their robust counterparts. The weights follow the residuals on every
+// evaluation, so each of mpfit's iterations is a reweighted least squares step.
+static void apply_loss(const survive_optimizer *ctx, int i, double *deviates, double **derivs) {
+	FLT jacobian_scale;
+	deviates[i] = survive_optimizer_loss_residual(ctx->loss, ctx->loss_scale, deviates[i], &jacobian_scale);
+	if (derivs && jacobian_scale != 1) {
+		for (int j = 0; j < 7; j++) {
+			if (derivs[j])
+				derivs[j][i] *= jacobian_scale;
+		}
+	}
+}
+
 static int mpfunc(int m, int n, double *p, double *deviates, double **derivs, void *private) {
 	survive_optimizer *mpfunc_ctx = private;
 
@@ -216,6 +279,12 @@ static int mpfunc(int m, int n, double *p, double *deviates, double **derivs, vo
 			}
 		}
 
+		if (mpfunc_ctx->loss != survive_optimizer_loss_none) {
+			apply_loss(mpfunc_ctx, i, deviates, derivs);
+			if (nextIsPair)
+				apply_loss(mpfunc_ctx, i + 1, deviates, derivs);
+		}
+
 		// Skip the next point -- we handled it already
 		if (nextIsPair)
 			i++;
@@ -224,6 +293,21 @@ static int mpfunc(int m, int n, double *p, double *deviates, double **derivs, vo
 	return 0;
 }
 
+double survive_optimizer_plain_norm(survive_optimizer *optimizer) {
+	survive_optimizer_loss loss = optimizer->loss;
+	optimizer->loss = survive_optimizer_loss_none;
+
+	int m = optimizer->measurementsCnt;
+	double *deviates = alloca(sizeof(double) * m);
+	mpfunc(m, survive_optimizer_get_parameters_count(optimizer), optimizer->parameters, deviates, 0, optimizer);
+	optimizer->loss = loss;
+
+	double norm = 0;
+	for (int i = 0; i < m; i++)
+		norm += deviates[i] * deviates[i];
+	return norm;
+}
+
 int survive_optimizer_run(survive_optimizer *optimizer, struct mp_result_struct *result) {
 	SurviveContext *ctx = optimizer->so->ctx;
 	// SV_INFO("Run start");
@@ -9,6 +9,7 @@
 
 #include "survive_config.h"
 #include "survive_default_devices.h"
+#include "survive_playback.h"
 
 #include "os_generic.h"
 #include "stdarg.h"
@@ -25,12 +26,18 @@ STATIC_CONFIG_ITEM( RECORD, "record", 's', "File to record to if you wish to mak
 STATIC_CONFIG_ITEM(RECORD_STDOUT, "record-stdout", 'i', "Whether or not to dump recording data to stdout", 0);
 STATIC_CONFIG_ITEM( PLAYBACK, "playback", 's', "File to be used for playback if playing a recording.", "" );
 STATIC_CONFIG_ITEM( PLAYBACK_FACTOR, "playback-factor", 'f', "Time factor of playback -- 1 is run at the same timing as original, 0 is run as fast as possible.", 1.0f );
+STATIC_CONFIG_ITEM(PLAYBACK_MULTIPLEX, "playback-multiplex", 'i',
+				   "Number of objects to create for each recorded device; each receives the same events.", 1);
 
 
 typedef struct SurviveRecordingData {
 	bool alwaysWriteStdOut;
 	bool writeRawLight;
 	FILE *output_file;
+
+	// In deterministic mode, lines are stamped with this instead of wall-clock time
+	bool useEventTime;
+	double event_time;
 } SurviveRecordingData;
 
 static double timestamp_in_us() {
@@ -40,8 +47,13 @@ static double timestamp_in_us() {
 	return OGGetAbsoluteTime() - start_time_us;
 }
 
+void survive_recording_set_event_time(SurviveContext *ctx, double time_s) {
+	if (ctx->recptr)
+		ctx->recptr->event_time = time_s;
+}
+
 static void write_to_output(SurviveRecordingData *recordingData, const char *format, ...) {
-	double ts = timestamp_in_us();
+	double ts = recordingData->useEventTime ? recordingData->event_time : timestamp_in_us();
 
 	if (recordingData->output_file) {
 		va_list args;
@@ -92,7 +104,7 @@ void survive_recording_velocity_process(SurviveObject *so, uint8_t lighthouse, c
 	write_to_output(recordingData, "%s VELOCITY %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", so->codename, pose->Pos[0],
 					pose->Pos[1], pose->Pos[2], pose->EulerRot[0], pose->EulerRot[1], pose->EulerRot[2]);
 }
-void survive_recording_raw_pose_process(SurviveObject *so, uint8_t lighthouse, SurvivePose *pose) {
+void survive_recording_raw_pose_process(SurviveObject *so, uint8_t lighthouse, const SurvivePose *pose) {
 	SurviveRecordingData *recordingData = so->ctx->recptr;
 	if (recordingData == 0)
 		return;
@@ -206,68 +218,30 @@ struct SurvivePlaybackData {
 	int lineno;
 
 	double next_time_us;
+	double start_time;
 	FLT playback_factor;
 	bool hasRawLight;
+	bool hasLightcode;
 };
 typedef struct SurvivePlaybackData SurvivePlaybackData;
 
-static int parse_and_run_imu(const char *line, SurvivePlaybackData *driver) {
-	char dev[10];
-	int timecode = 0;
-	FLT accelgyro[9] = { 0 };
-	int mask;
-	int id;
+// With 'playback-multiplex' set, each recorded device is instantiated several times under the same codename; this
+// walks all of the instances for the given name.
+static SurviveObject *next_playback_device(SurvivePlaybackData *driver, const char *dev, int *cursor) {
 	SurviveContext *ctx = driver->ctx;
-
-	int rr = sscanf(line, "%s I %d %d " FLT_format " " FLT_format " " FLT_format " " FLT_format " " FLT_format
-						  " " FLT_format " " FLT_format " " FLT_format " " FLT_format "%d",
-					dev, &mask, &timecode, &accelgyro[0], &accelgyro[1], &accelgyro[2], &accelgyro[3], &accelgyro[4],
-					&accelgyro[5], &accelgyro[6], &accelgyro[7], &accelgyro[8], &id);
-
-	if (rr == 10) {
-		// Older formats might not have mag data
-		id = accelgyro[6];
-		accelgyro[6] = 0;
-	} else if (rr != 13) {
-		SV_WARN("On line %d, only %d values read: '%s'", driver->lineno, rr, line);
-		return -1;
-	}
-
-	SurviveObject *so = survive_get_so_by_name(driver->ctx, dev);
-	if (!so) {
-		static bool display_once = false;
-		if (display_once == false) {
-			SV_ERROR("Could not find device named %s from lineno %d\n", dev, driver->lineno);
+	for (; *cursor < ctx->objs_ct; (*cursor)++) {
+		SurviveObject *so = ctx->objs[*cursor];
+		if (so->driver == driver && strcmp(so->codename, dev) == 0) {
+			(*cursor)++;
+			return so;
 		}
-		display_once = true;
-		return -1;
 	}
-
-	driver->ctx->imuproc(so, mask, accelgyro, timecode, id);
 	return 0;
 }
 
-static int parse_and_run_externalpose(const char *line, SurvivePlaybackData *driver) {
-	char name[128] = { 0 };
-	SurvivePose pose;
-
-	int rr = sscanf(line, "%s EXTERNAL_POSE " SurvivePose_format "\n", name, &pose.Pos[0], &pose.Pos[1], &pose.Pos[2],
-					&pose.Rot[0], &pose.Rot[1], &pose.Rot[2], &pose.Rot[3]);
-
-	SurviveContext *ctx = driver->ctx;
-	ctx->externalposeproc(ctx, name, &pose);
-	return 0;
-}
-
-static int parse_and_run_rawlight(const char *line, SurvivePlaybackData *driver) {
-	driver->hasRawLight = 1;
-
-	char dev[10];
-	char op[10];
-	LightcapElement le;
-	int rr = sscanf(line, "%s %s %hhu %u %hu\n", dev, op, &le.sensor_id, &le.timestamp, &le.length);
-
-	SurviveObject *so = survive_get_so_by_name(driver->ctx, dev);
+static SurviveObject *first_playback_device(SurvivePlaybackData *driver, const char *dev, int *cursor) {
+	*cursor = 0;
+	SurviveObject *so = next_playback_device(driver, dev, cursor);
 	if (!so) {
 		static bool display_once = false;
 		SurviveContext *ctx = driver->ctx;
@@ -275,47 +249,153 @@ static int parse_and_run_rawlight(const char *line, SurvivePlaybackData *driver)
 			SV_ERROR("Could not find device named %s from lineno %d\n", dev, driver->lineno);
 		}
 		display_once = true;
+	}
+	return so;
+}
 
+int survive_parse_recording_line(const char *line, SurviveRecordingEvent *event) {
+	memset(event, 0, sizeof(*event));
+
+	char op[32];
+	int end = 0;
+	if (sscanf(line, "%31s %31s %n", event->dev, op, &end) < 2)
 		return -1;
+	const char *args = line + end;
+
+	int rr = 0;
+	switch (op[0]) {
+	case 'A':
+		if (op[1] != 0)
+			break;
+		event->type = SURVIVE_RECORDING_ANGLE;
+		rr = sscanf(args, "%d %d %u " FLT_format " " FLT_format " %u", &event->data.angle.sensor_id,
+					&event->data.angle.acode, &event->data.angle.timecode, &event->data.angle.length,
+					&event->data.angle.angle, &event->data.angle.lh);
+		return rr == 6 ? 0 : -1;
+	case 'C':
+		if (strcmp(op, "CONFIG") == 0) {
+			event->type = SURVIVE_RECORDING_CONFIG;
+			event->data.config = args;
+			return 0;
+		}
+		if (op[1] != 0)
+			break;
+		event->type = SURVIVE_RECORDING_LIGHTCAP;
+		rr = sscanf(args, "%hhu %u %hu", &event->data.lightcap.sensor_id, &event->data.lightcap.timestamp,
+					&event->data.lightcap.length);
+		return rr == 3 ? 0 : -1;
+	case 'E':
+		if (strcmp(op, "EXTERNAL_POSE") == 0) {
+			event->type = SURVIVE_RECORDING_EXTERNAL_POSE;
+			rr = sscanf(args, SurvivePose_format, &event->data.pose.Pos[0], &event->data.pose.Pos[1],
+						&event->data.pose.Pos[2], &event->data.pose.Rot[0], &event->data.pose.Rot[1],
+						&event->data.pose.Rot[2], &event->data.pose.Rot[3]);
+			return rr == 7 ? 0 : -1;
+		}
+		if (strcmp(op, "EXTERNAL_VELOCITY") == 0) {
+			event->type = SURVIVE_RECORDING_EXTERNAL_VELOCITY;
+			return 0;
+		}
+		break;
+	case 'I':
+		if (op[1] != 0)
+			break;
+		event->type = SURVIVE_RECORDING_IMU;
+		FLT *accelgyro = event->data.imu.accelgyro;
+		rr = sscanf(args, "%d %u " FLT_format " " FLT_format " " FLT_format " " FLT_format " " FLT_format " " FLT_format
+						  " " FLT_format " " FLT_format " " FLT_format "%d",
+					&event->data.imu.mask, &event->data.imu.timecode, &accelgyro[0], &accelgyro[1], &accelgyro[2],
+					&accelgyro[3], &accelgyro[4], &accelgyro[5], &accelgyro[6], &accelgyro[7], &accelgyro[8],
+					&event->data.imu.id);
+		if (rr == 9) {
+			// Older formats might not have mag data
+			event->data.imu.id = accelgyro[6];
+			accelgyro[6] = 0;
+			return 0;
+		}
+		return rr == 12 ? 0 : -1;
+	case 'L':
+	case 'R':
+		if (strcmp(op, "LH_POSE") == 0) {
+			event->type = SURVIVE_RECORDING_LH_POSE;
+			return 0;
+		}
+		if (strcmp(op, "LOG") == 0) {
+			event->type = SURVIVE_RECORDING_INFO;
+			return 0;
+		}
+		if (op[1] != 0)
+			break;
+		event->type = SURVIVE_RECORDING_LIGHT;
+		char axis[32];
+		rr = sscanf(args, "%31s %d %d %d %u %u %u", axis, &event->data.light.sensor_id, &event->data.light.acode,
+					&event->data.light.timeinsweep, &event->data.light.timecode, &event->data.light.length,
+					&event->data.light.lh);
+		return rr == 7 ? 0 : -1;
+	case 'P':
+		if (strcmp(op, "POSE") != 0)
+			break;
+		event->type = SURVIVE_RECORDING_POSE;
+		rr = sscanf(args, SurvivePose_format, &event->data.pose.Pos[0], &event->data.pose.Pos[1],
+					&event->data.pose.Pos[2], &event->data.pose.Rot[0], &event->data.pose.Rot[1],
+					&event->data.pose.Rot[2], &event->data.pose.Rot[3]);
+		return rr == 7 ? 0 : -1;
+	case 'V':
+		if (strcmp(op, "VELOCITY") != 0)
+			break;
+		event->type = SURVIVE_RECORDING_VELOCITY;
+		rr = sscanf(args, FLT_format " " FLT_format " " FLT_format " " FLT_format " " FLT_format " " FLT_format,
+					&event->data.velocity.Pos[0], &event->data.velocity.Pos[1], &event->data.velocity.Pos[2],
+					&event->data.velocity.EulerRot[0], &event->data.velocity.EulerRot[1],
+					&event->data.velocity.EulerRot[2]);
+		return rr == 6 ? 0 : -1;
 	}
 
-	handle_lightcap(so, &le);
+	event->type = SURVIVE_RECORDING_UNKNOWN;
 	return 0;
 }
 
-static int parse_and_run_lightcode(const char *line, SurvivePlaybackData *driver) {
-	char lhn[10];
-	char axn[10];
-	char dev[10];
-	uint32_t timecode = 0;
-	int sensor_id = 0;
-	int acode = 0;
-	int timeinsweep = 0;
-	uint32_t length = 0;
-	uint32_t lh = 0;
-	SurviveContext *ctx = driver->ctx;
-
-	int rr = sscanf(line, "%8s %8s %8s %u %d %d %d %u %u\n", dev, lhn, axn, &sensor_id, &acode, &timeinsweep, &timecode,
-					&length, &lh);
-
-	if (rr != 9) {
-		SV_WARN("Warning:  On line %d, only %d values read: '%s'\n", driver->lineno, rr, line);
-		return -1;
+static void run_lightcap(SurvivePlaybackData *driver, const SurviveRecordingEvent *event) {
+	int cursor;
+	for (SurviveObject *so = first_playback_device(driver, event->dev, &cursor); so;
+		 so = next_playback_device(driver, event->dev, &cursor)) {
+		so->counters.packets++;
+		// handle_lightcap remaps the sensor id in place
+		LightcapElement le = event->data.lightcap;
+		handle_lightcap(so, &le);
 	}
+}
 
-	SurviveObject *so = survive_get_so_by_name(driver->ctx, dev);
-	if (!so) {
-		static bool display_once = false;
-		if (display_once == false) {
-			SV_ERROR("Could not find device named %s from lineno %d\n", dev, driver->lineno);
-		}
-		display_once = true;
+static void run_light(SurvivePlaybackData *driver, const SurviveRecordingEvent *event) {
+	int cursor;
+	for (SurviveObject *so = first_playback_device(driver, event->dev, &cursor); so;
+		 so = next_playback_device(driver, event->dev, &cursor)) {
+		so->counters.packets++;
+		driver->ctx->lightproc(so, event->data.light.sensor_id, event->data.light.acode, event->data.light.timeinsweep,
+							   event->data.light.timecode, event->data.light.length, event->data.light.lh);
+	}
+}
 
-		return -1;
+static void run_angle(SurvivePlaybackData *driver, const SurviveRecordingEvent *event) {
+	int cursor;
+	for (SurviveObject *so = first_playback_device(driver, event->dev, &cursor); so;
+		 so = next_playback_device(driver, event->dev, &cursor)) {
+		so->counters.packets++;
+		driver->ctx->angleproc(so, event->data.angle.sensor_id, event->data.angle.acode, event->data.angle.timecode,
+							   event->data.angle.length, event->data.angle.angle, event->data.angle.lh);
 	}
+}
 
-	driver->ctx->lightproc(so, sensor_id, acode, timeinsweep, timecode, length, lh);
-	return 0;
+static void run_imu(SurvivePlaybackData *driver, const SurviveRecordingEvent *event) {
+	int cursor;
+	for (SurviveObject *so = first_playback_device(driver, event->dev, &cursor); so;
+		 so = next_playback_device(driver, event->dev, &cursor)) {
+		so->counters.packets++;
+		// imuproc takes a mutable buffer, so each object gets its own copy
+		FLT accelgyro[9];
+		memcpy(accelgyro, event->data.imu.accelgyro, sizeof(accelgyro));
+		driver->ctx->imuproc(so, event->data.imu.mask, accelgyro, event->data.imu.timecode, event->data.imu.id);
+	}
 }
 
 static int playback_poll(struct SurviveContext *ctx, void *_driver) {
@@ -341,8 +421,15 @@ static int playback_poll(struct SurviveContext *ctx, void *_driver) {
 			line = 0;
 		}
 
-		if (driver->next_time_us * driver->playback_factor > timestamp_in_us())
+		// In deterministic mode, the recorded time only orders events; it never waits on the wall clock.
+		// Playback is timed from this driver's first poll rather than process start, so that successive contexts in
+		// one process each replay from the beginning of the file.
+		if (driver->start_time == 0.)
+			driver->start_time = OGGetAbsoluteTime();
+		if (!ctx->deterministic &&
+			driver->next_time_us * driver->playback_factor > OGGetAbsoluteTime() - driver->start_time)
 			return 0;
+		survive_recording_set_event_time(ctx, driver->next_time_us);
 		driver->next_time_us = 0;
 
 		size_t n = 0;
@@ -354,37 +441,46 @@ static int playback_poll(struct SurviveContext *ctx, void *_driver) {
 		while (r && (line[r - 1] == '\n' || line[r - 1] == '\r')) {
 			line[--r] = 0;
 		}
-		char dev[32];
-		char op[32];
-		if (sscanf(line, "%31s %31s", dev, op) < 2) {
+		SurviveRecordingEvent event;
+		if (survive_parse_recording_line(line, &event) != 0) {
+			SV_WARN("On line %d, could not parse '%s'", driver->lineno, line);
 			free(line);
 			return 0;
 		}
 
-		switch (op[0]) {
-		case 'E':
-			if (strcmp(op, "EXTERNAL_POSE") == 0) {
-				parse_and_run_externalpose(line, driver);
-				break;
+		switch (event.type) {
+		case SURVIVE_RECORDING_EXTERNAL_POSE:
+			ctx->externalposeproc(ctx, event.dev, &event.data.pose);
+			break;
+		case SURVIVE_RECORDING_LIGHTCAP:
+			driver->hasRawLight = true;
+			run_lightcap(driver, &event);
+			break;
+		case SURVIVE_RECORDING_LIGHT:
+			if (driver->hasRawLight == false) {
+				if (event.data.light.sensor_id >= 0)
+					driver->hasLightcode = true;
+				run_light(driver, &event);
 			}
-		case 'C':
-			parse_and_run_rawlight(line, driver);
 			break;
-		case 'L':
-		case 'R':
-			if (op[1] == 0 && driver->hasRawLight == false)
-				parse_and_run_lightcode(line, driver);
+		case SURVIVE_RECORDING_IMU:
+			run_imu(driver, &event);
 			break;
-		case 'I':
-			if (op[1] == 0)
-				parse_and_run_imu(line, driver);
+		case SURVIVE_RECORDING_ANGLE:
+			// Angles are normally derived from the light data that precedes them; only replay them when they are
+			// the lowest level data in the recording, as with the simulator.
+			if (driver->hasRawLight == false && driver->hasLightcode == false)
+				run_angle(driver, &event);
 			break;
-		case 'A':
-		case 'P':
-		case 'V':
+		case SURVIVE_RECORDING_CONFIG:
+		case SURVIVE_RECORDING_POSE:
+		case SURVIVE_RECORDING_VELOCITY:
+		case SURVIVE_RECORDING_EXTERNAL_VELOCITY:
+		case SURVIVE_RECORDING_LH_POSE:
+		case SURVIVE_RECORDING_INFO:
 			break;
-		default:
-			SV_WARN("Playback doesn't understand '%s' op in '%s'", op, line);
+		case SURVIVE_RECORDING_UNKNOWN:
+			SV_WARN("Playback doesn't understand '%s'", line);
 		}
 
 		free(line);
@@ -422,6 +518,7 @@ void survive_install_recording(SurviveContext *ctx) {
 			ctx->recptr = 0;
 			return;
 		}
+		ctx->recptr->useEventTime = ctx->deterministic;
 		SV_INFO("Recording to '%s'", dataout_file);
 		ctx->recptr->alwaysWriteStdOut = record_to_stdout;
 		if (record_to_stdout) {
@@ -432,6 +529,16 @@ void survive_install_recording(SurviveContext *ctx) {
 	}
 }
 
+void survive_destroy_recording(SurviveContext *ctx) {
+	if (ctx->recptr == 0)
+		return;
+
+	if (ctx->recptr->output_file)
+		fclose(ctx->recptr->output_file);
+	free(ctx->recptr);
+	ctx->recptr = 0;
+}
+
 int DriverRegPlayback(SurviveContext *ctx) {
 	const char *playback_file = survive_configs(ctx, "playback", SC_GET, "");
 
@@ -451,10 +558,18 @@ int DriverRegPlayback(SurviveContext *ctx) {
 	}
 
 	survive_attach_configf( ctx, "playback-factor", &sp->playback_factor );
+	// Load shedding measures lag against the pace the file is replayed at
+	ctx->data_time_factor = &sp->playback_factor;
 
 	SV_INFO("Using playback file '%s' with timefactor of %f", playback_file, sp->playback_factor );
 
-	FLT time;
+	int multiplex = survive_configi(ctx, "playback-multiplex", SC_GET, 1);
+	if (multiplex < 1)
+		multiplex = 1;
+	if (multiplex > 1)
+		SV_INFO("Creating %d objects per recorded device", multiplex);
+
+	double time;
 	while (!feof(sp->playback_file) && !ferror(sp->playback_file)) {
 		char *line = 0;
 		size_t n;
@@ -465,10 +580,8 @@ int DriverRegPlayback(SurviveContext *ctx) {
 			continue;
 		}
 
-		char dev[32];
-		char command[32];
-
-		if (sscanf(line, "%lf %s %s", &time, dev, command) != 3) {
+		int end = 0;
+		if (sscanf(line, "%lf %n", &time, &end) != 1) {
 			free(line);
 			break;
 		}
@@ -479,24 +592,22 @@ int DriverRegPlayback(SurviveContext *ctx) {
 			break;
 		}
 
-		if (strcmp(command, "CONFIG") == 0) {
-			char *configStart = line;
-
-			// Skip three spaces
-			for (int i = 0; i < 3; i++) {
-				while (*(++configStart) != ' ')
-					;
-			}
-			size_t len = strlen(configStart);
-
-			SurviveObject *so = survive_create_device(ctx, "Playback", sp, dev, 0);
-
-			if (ctx->configfunction(so, configStart, len) == 0) {
-				SV_INFO("Found %s in playback file...", dev);
-				survive_add_object(ctx, so);
-			} else {
-				SV_WARN("Found %s in playback file, but could not read config description", dev);
-				free(so);
+		SurviveRecordingEvent event;
+		if (survive_parse_recording_line(line + end, &event) == 0 && event.type == SURVIVE_RECORDING_CONFIG) {
+			const char *dev = event.dev;
+			size_t len = strlen(event.data.config);
+
+			for (int i = 0; i < multiplex; i++) {
+				SurviveObject *so = survive_create_device(ctx, "Playback", sp, dev, 0);
+
+				if (ctx->configfunction(so, (char *)event.data.config, len) == 0) {
+					SV_INFO("Found %s in playback file...", dev);
+					survive_add_object(ctx, so);
+				} else {
+					SV_WARN("Found %s in playback file, but could not read config description", dev);
+					free(so);
+					break;
+				}
 			}
 		}
 
@@ -1,6 +1,66 @@
 #include <survive.h>
 
 void survive_install_recording(SurviveContext *ctx);
+void survive_destroy_recording(SurviveContext *ctx);
+
+typedef enum SurviveRecordingEventType {
+	SURVIVE_RECORDING_UNKNOWN = 0,
+	SURVIVE_RECORDING_CONFIG,
+	SURVIVE_RECORDING_LIGHTCAP,
+	SURVIVE_RECORDING_LIGHT,
+	SURVIVE_RECORDING_ANGLE,
+	SURVIVE_RECORDING_IMU,
+	SURVIVE_RECORDING_POSE,
+	SURVIVE_RECORDING_VELOCITY,
+	SURVIVE_RECORDING_EXTERNAL_POSE,
+	SURVIVE_RECORDING_EXTERNAL_VELOCITY,
+	SURVIVE_RECORDING_LH_POSE,
+	SURVIVE_RECORDING_INFO,
+} SurviveRecordingEventType;
+
+typedef struct SurviveRecordingEvent {
+	SurviveRecordingEventType type;
+	// Device codename; the lighthouse index for LH_POSE and "INFO" for log lines
+	char dev[32];
+
+	union {
+		LightcapElement lightcap;
+		struct {
+			int sensor_id, acode, timeinsweep;
+			uint32_t timecode, length, lh;
+		} light;
+		struct {
+			int sensor_id, acode;
+			uint32_t timecode;
+			FLT length, angle;
+			uint32_t lh;
+		} angle;
+		struct {
+			int mask;
+			uint32_t timecode;
+			FLT accelgyro[9];
+			int id;
+		} imu;
+		SurvivePose pose; // POSE and EXTERNAL_POSE
+		SurviveVelocity velocity;
+		const char *config; // Points into the parsed line
+	} data;
+} SurviveRecordingEvent;
+
+/**
+ * Parses one line of a recording, minus its leading timestamp. Playback and the offline converters share this so they
+ * interpret recordings identically. Lines with ops this doesn't know parse as SURVIVE_RECORDING_UNKNOWN; only the
+ * payloads of the light, angle, imu, pose and velocity events are filled in.
+ *
+ * @return 0 on success, -1 if the line is malformed.
+ */
+SURVIVE_EXPORT int survive_parse_recording_line(const char *line, SurviveRecordingEvent *event);
+
+/**
+ * In deterministic mode, recordings are stamped with the time of the event being processed rather than wall-clock
+ * time. Event sources call this to advance that time.
+ */
+SURVIVE_EXPORT void survive_recording_set_event_time(SurviveContext *ctx, double time_s);
 void survive_recording_config_process(SurviveObject *so, char *ct0conf, int len);
 
 void survive_recording_lighthouse_process(SurviveContext *ctx, uint8_t lighthouse, SurvivePose *lh_pose,
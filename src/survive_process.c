@@ -1,19 +1,139 @@
 //<>< (C) 2016 C. N. Lohr, FULLY Under MIT/x11 License.
 //All MIT/x11 Licensed Code in this file may be relicensed freely under the GPL or LGPL licenses.
 
+#include "survive_atomic.h"
 #include "survive_cal.h"
 #include "survive_config.h"
 #include "survive_default_devices.h"
+#include "survive_latency.h"
 #include "survive_playback.h"
+#include <os_generic.h>
 #include <assert.h>
+#include <math.h>
 
 //XXX TODO: Once data is avialble in the context, use the stuff here to handle converting from time codes to
 //proper angles, then from there perform the rest of the solution. 
 
 #define TIMECENTER_TICKS (48000000/240) //for now.
 
-void survive_default_light_process( SurviveObject * so, int sensor_id, int acode, int timeinsweep, uint32_t timecode, uint32_t length, uint32_t lh)
-{
+STATIC_CONFIG_ITEM(VISIBILITY_FILTER, "visibility-filter", 'i',
+				   "Drop angles from sensors that the latest pose says face away from the lighthouse.", 0);
+STATIC_CONFIG_ITEM(VISIBILITY_FILTER_MARGIN, "visibility-filter-margin", 'f',
+				   "How far past edge-on, as the cosine of the angle, a sensor may face away before its angles are "
+				   "dropped by 'visibility-filter'.",
+				   .2);
+
+// Poses older than this say too little about where the sensors point now for the visibility filter to use them
+#define VISIBILITY_FILTER_MAX_POSE_AGE .05
+
+STATIC_CONFIG_ITEM(SHED_LAG, "shed-lag", 'f',
+				   "Seconds an object's events may trail its clock before load is shed to catch up; 0 never sheds.",
+				   0.);
+STATIC_CONFIG_ITEM(SHED_OBJECTS, "shed-objects", 's',
+				   "Comma separated codename or serial patterns of objects that skip every solve while shedding load.",
+				   "");
+STATIC_CONFIG_ITEM(SHED_SOLVE_PERIOD, "shed-solve-period", 'f',
+				   "While shedding load, seconds of data between the light solves let through for other objects.", .05);
+STATIC_CONFIG_ITEM(SHED_IMU_DIVISOR, "shed-imu-divisor", 'i',
+				   "While shedding load, only every Nth IMU sample reaches the poser.", 4);
+
+// How fast the lag estimate's idea of the fastest possible delivery may drift, in seconds per second, so that clock
+// drift between the device and the host doesn't read as a growing backlog
+#define SHED_CLOCK_DRIFT 1e-3
+
+// Light and IMU events share the estimate and arrive slightly out of order, since a batch of sweeps is stamped before
+// the IMU samples sent along with it; only stepping back further than this means the device clock was reset.
+#define SHED_CLOCK_RESET 1.
+
+// The lag estimate is the event's wall clock time less its device time, compared to the smallest such difference
+// seen, which is when an event was handled with the least delay. Shedding starts at 'shed-lag' and stops once the
+// lag is back under half of it.
+void survive_object_update_lag(SurviveObject *so, survive_timecode timecode, double now) {
+	SurviveContext *ctx = so->ctx;
+	SurviveLoadShedding *shed = &so->shed;
+	// Read each time since playback's factor can be changed while it runs
+	FLT data_time_factor = *ctx->data_time_factor;
+	if (ctx->shed_lag <= 0 || ctx->deterministic || data_time_factor <= 0 || so->timebase_hz == 0)
+		return;
+
+	double step = 0;
+	if (shed->started) {
+		// Timecodes wrap; only forward steps under half the range count as progress.
+		survive_timecode ticks = timecode - shed->last_timecode;
+		if (ticks < 0x80000000u) {
+			step = ticks / (double)so->timebase_hz;
+			shed->data_time += step;
+		} else if ((survive_timecode)-ticks < SHED_CLOCK_RESET * so->timebase_hz) {
+			// Arrived out of order; the events around it say how far behind the object is
+			return;
+		} else {
+			// The device clock was reset, so the estimate starts over from here
+			shed->started = false;
+			shed->shedding = false;
+		}
+	}
+	shed->last_timecode = timecode;
+
+	double offset = now - shed->data_time * data_time_factor;
+	if (!shed->started || offset < shed->min_offset + step * SHED_CLOCK_DRIFT) {
+		shed->min_offset = offset;
+	} else {
+		shed->min_offset += step * SHED_CLOCK_DRIFT;
+	}
+	shed->started = true;
+	shed->lag = offset - shed->min_offset;
+
+	if (!shed->shedding && shed->lag > ctx->shed_lag) {
+		shed->shedding = true;
+		shed->last_solve = -1;
+		so->counters.shed_starts++;
+		SV_INFO("%s is %.0fms behind; shedding load", so->codename, shed->lag * 1000.);
+	} else if (shed->shedding && shed->lag < ctx->shed_lag / 2) {
+		shed->shedding = false;
+	}
+}
+
+static bool shed_light_solve(SurviveObject *so) {
+	SurviveLoadShedding *shed = &so->shed;
+	if (!shed->shedding)
+		return false;
+	bool due = shed->last_solve < 0 || shed->data_time - shed->last_solve >= so->ctx->shed_solve_period;
+	if (!shed->noncritical && due) {
+		shed->last_solve = shed->data_time;
+		return false;
+	}
+	so->counters.shed_solves++;
+	return true;
+}
+
+static bool shed_imu(SurviveObject *so) {
+	SurviveLoadShedding *shed = &so->shed;
+	if (!shed->shedding || so->ctx->shed_imu_divisor <= 1 || ++shed->imu_seen % so->ctx->shed_imu_divisor == 0)
+		return false;
+	so->counters.shed_imu++;
+	return true;
+}
+
+// Installs a poser asked for with survive_object_set_poser. Only the thread that feeds the poser calls this, so the
+// old poser is never running when it is told to let go of the object.
+static void update_poser(SurviveObject *so) {
+	if (!survive_atomic_load32(&so->poser_change_pending) || !survive_atomic_exchange32(&so->poser_change_pending, 0))
+		return;
+
+	PoserCB fn = (PoserCB)survive_atomic_load_ptr(&so->RequestedPoserFn);
+	if (fn == so->PoserFn)
+		return;
+
+	if (so->PoserFn) {
+		PoserData pd = {.pt = POSERDATA_DISASSOCIATE};
+		so->PoserFn(so, &pd);
+	}
+	so->PoserData = 0;
+	so->PoserFn = fn;
+}
+
+static void light_process(SurviveObject *so, int sensor_id, int acode, int timeinsweep, uint32_t timecode,
+						  uint32_t length, uint32_t lh) {
 	SurviveContext * ctx = so->ctx;
 	int base_station = lh;
 	int axis = acode & 1;
@@ -26,6 +146,7 @@ void survive_default_light_process( SurviveObject * so, int sensor_id, int acode
 
 	//We don't use sync times, yet.
 	if (sensor_id <= -1) {
+		update_poser(so);
 		if (so->PoserFn) {
 			PoserDataLight l = {
 				.hdr =
@@ -39,7 +160,9 @@ void survive_default_light_process( SurviveObject * so, int sensor_id, int acode
 				.angle = 0,
 				.lh = lh,
 			};
+			SURVIVE_LATENCY_BEGIN(so, start);
 			so->PoserFn(so, (PoserData *)&l);
+			SURVIVE_LATENCY_END(so, SURVIVE_LATENCY_POSER, start);
 		}
 		return;
 	}
@@ -50,6 +173,7 @@ void survive_default_light_process( SurviveObject * so, int sensor_id, int acode
 	if( sensor_id < 0 ) return;
 
 	if (timeinsweep > 2 * TIMECENTER_TICKS) {
+		so->counters.invalid_lightcaps++;
 		SV_WARN("Disambiguator gave invalid timeinsweep %s %u", so->codename, timeinsweep);
 		return;
 	}
@@ -62,6 +186,34 @@ void survive_default_light_process( SurviveObject * so, int sensor_id, int acode
 	ctx->angleproc( so, sensor_id, acode, timecode, length_sec, angle, lh);
 }
 
+void survive_default_light_process(SurviveObject *so, int sensor_id, int acode, int timeinsweep, uint32_t timecode,
+								   uint32_t length, uint32_t lh) {
+	SURVIVE_LATENCY_BEGIN(so, start);
+	light_process(so, sensor_id, acode, timeinsweep, timecode, length, lh);
+	SURVIVE_LATENCY_END(so, SURVIVE_LATENCY_ANGLE, start);
+}
+
+
+// Whether the sensor could have seen lighthouse 'lh' given the object's latest pose. Without a recent pose, a placed
+// lighthouse and the sensor's normal there is nothing to go on, so the answer is yes.
+static bool sensor_may_see_lighthouse(SurviveObject *so, int sensor_id, uint32_t timecode, uint32_t lh) {
+	SurviveContext *ctx = so->ctx;
+	if (lh >= NUM_LIGHTHOUSES || !ctx->bsd[lh].PositionSet || so->sensor_normals == 0 || sensor_id >= so->sensor_ct)
+		return true;
+
+	const SurvivePose *imu2world = &so->OutPoseIMU;
+	int32_t age = (int32_t)(timecode - so->OutPose_timecode);
+	if (quatmagnitude(imu2world->Rot) == 0 || fabs((FLT)age) > VISIBILITY_FILTER_MAX_POSE_AGE * so->timebase_hz)
+		return true;
+
+	LinmathPoint3d ptInWorld;
+	LinmathVec3d normalInWorld, toLh;
+	ApplyPoseToPoint(ptInWorld, imu2world, so->sensor_locations + sensor_id * 3);
+	quatrotatevector(normalInWorld, imu2world->Rot, so->sensor_normals + sensor_id * 3);
+	sub3d(toLh, ctx->bsd[lh].Pose.Pos, ptInWorld);
+	normalize3d(toLh, toLh);
+	return dot3d(normalInWorld, toLh) > -ctx->visibility_filter_margin;
+}
 
 void survive_default_angle_process( SurviveObject * so, int sensor_id, int acode, uint32_t timecode, FLT length, FLT angle, uint32_t lh)
 {
@@ -80,17 +232,35 @@ void survive_default_angle_process( SurviveObject * so, int sensor_id, int acode
 		.lh = lh,
 	};
 
-	// Simulate the use of only one lighthouse in playback mode.
-	if (lh < ctx->activeLighthouses)
-		SurviveSensorActivations_add(&so->activations, &l);
-
 	survive_recording_angle_process(so, sensor_id, acode, timecode, length, angle, lh);
 
 	if (ctx->calptr) {
 		survive_cal_angle(so, sensor_id, acode, timecode, length, angle, lh);
 	}
+
+	// Reflections, crosstalk and misidentified sweeps show up on sensors pointing the wrong way; the recording and
+	// calibration above still see them so that a run can be replayed with the filter off.
+	if (ctx->visibility_filter && !sensor_may_see_lighthouse(so, sensor_id, timecode, lh)) {
+		so->counters.angles_rejected++;
+		return;
+	}
+
+	so->counters.angles++;
+	survive_object_update_lag(so, timecode, OGGetAbsoluteTime());
+
+	// Simulate the use of only one lighthouse in playback mode.
+	if (lh < ctx->activeLighthouses)
+		SurviveSensorActivations_add(&so->activations, &l);
+
+	// Skipped sweeps still land in the activations above, so the solves that do run see the latest angles
+	if (shed_light_solve(so))
+		return;
+
+	update_poser(so);
 	if (so->PoserFn) {
+		SURVIVE_LATENCY_BEGIN(so, start);
 		so->PoserFn( so, (PoserData *)&l );
+		SURVIVE_LATENCY_END(so, SURVIVE_LATENCY_POSER, start);
 	}
 }	
 
@@ -183,10 +353,15 @@ void survive_default_imu_process( SurviveObject * so, int mask, FLT * accelgyrom
 		.timecode = timecode,
 	};
 
+	so->counters.imu++;
 	SurviveSensorActivations_add_imu(&so->activations, &imu);
+	survive_object_update_lag(so, timecode, OGGetAbsoluteTime());
 
-	if (so->PoserFn) {
+	update_poser(so);
+	if (so->PoserFn && !shed_imu(so)) {
+		SURVIVE_LATENCY_BEGIN(so, start);
 		so->PoserFn( so, (PoserData *)&imu );
+		SURVIVE_LATENCY_END(so, SURVIVE_LATENCY_POSER, start);
 	}
 
 	survive_recording_imu_process(so, mask, accelgyromag, timecode, id);
@@ -1,6 +1,7 @@
 #include "survive_reproject.h"
 #include "survive_reproject.generated.h"
 #include <assert.h>
+#include <string.h>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -101,6 +102,77 @@ void survive_reproject_full_jac_obj_pose(SurviveAngleReading out, const SurviveP
 							curve_1, gibPhase_0, gibPhase_1, gibMag_0, gibMag_1);
 }
 
+void survive_reproject_full_jac_lh_pose(SurviveAngleReading out, const SurvivePose *lh2world,
+										const LinmathVec3d ptInWorld, const BaseStationCal *bcal) {
+	// The point in the lighthouse frame is rotate(r, ptInWorld - lh2world.Pos) with r the reciprocal of lh2world.Rot,
+	// which is what InvertPose and ApplyPoseToPoint evaluate; the quaternion need not be normalized.
+	const FLT *q = lh2world->Rot;
+	LinmathQuat r;
+	quatgetreciprocal(r, q);
+
+	LinmathVec3d d, ptInLh;
+	sub3d(d, ptInWorld, lh2world->Pos);
+	quatrotatevector(ptInLh, r, d);
+
+	// d(angles)/d(ptInLh) are the position columns of the generated jacobian for an object at ptInLh, seen from a
+	// lighthouse at the origin.
+	const SurvivePose pt_pose = {.Pos = {ptInLh[0], ptInLh[1], ptInLh[2]}, .Rot = {1}};
+	const SurvivePose origin = LinmathPose_Identity;
+	const LinmathVec3d zero = {0};
+	FLT jac_pt[14];
+	survive_reproject_full_jac_obj_pose(jac_pt, &pt_pose, zero, &origin, bcal);
+
+	// d(ptInLh)/d(lh2world.Pos) = -R(r)
+	FLT dpos[3][3];
+	for (int k = 0; k < 3; k++) {
+		LinmathVec3d e = {0}, col;
+		e[k] = 1;
+		quatrotatevector(col, r, e);
+		for (int i = 0; i < 3; i++)
+			dpos[i][k] = -col[i];
+	}
+
+	// d(ptInLh)/dr, from rotate(r, d) = d + 2 u x (u x d) + 2 w (u x d) with w = r[0], u = r[1..3]
+	const FLT w = r[0];
+	const FLT *u = &r[1];
+	FLT drot[3][4];
+	LinmathVec3d uxd;
+	cross3d(uxd, u, d);
+	const FLT udotd = dot3d(u, d);
+	for (int i = 0; i < 3; i++)
+		drot[i][0] = 2 * uxd[i];
+	for (int k = 0; k < 3; k++) {
+		LinmathVec3d e = {0}, exd;
+		e[k] = 1;
+		cross3d(exd, e, d);
+		for (int i = 0; i < 3; i++)
+			drot[i][k + 1] = 2 * ((i == k) * udotd + u[i] * d[k] - 2 * d[i] * u[k]) + 2 * w * exd[i];
+	}
+
+	// dr/dq for r = conj(q) / |q|; despite its name quatinvsqmagnitude is 1 / |q|
+	const FLT m = quatinvsqmagnitude(q);
+	const FLT sign[4] = {1, -1, -1, -1};
+	FLT dr[4][4];
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			dr[i][j] = sign[i] * ((i == j) * m - m * m * m * q[i] * q[j]);
+
+	for (int axis = 0; axis < 2; axis++) {
+		const FLT *jp = &jac_pt[axis * 7];
+		FLT *o = &out[axis * 7];
+
+		FLT jr[4] = {0};
+		for (int k = 0; k < 4; k++)
+			for (int i = 0; i < 3; i++)
+				jr[k] += jp[i] * drot[i][k];
+
+		for (int k = 0; k < 3; k++)
+			o[k] = jp[0] * dpos[0][k] + jp[1] * dpos[1][k] + jp[2] * dpos[2][k];
+		for (int j = 0; j < 4; j++)
+			o[3 + j] = jr[0] * dr[0][j] + jr[1] * dr[1][j] + jr[2] * dr[2][j] + jr[3] * dr[3][j];
+	}
+}
+
 void survive_reproject_from_pose_with_bcal(const BaseStationCal *bcal, const SurvivePose *world2lh,
 										   LinmathVec3d const ptInWorld, SurviveAngleReading out) {
 	LinmathPoint3d ptInLh;
@@ -121,6 +193,102 @@ void survive_reproject(const SurviveContext *ctx, int lighthouse, LinmathVec3d c
 
 void survive_apply_bsd_calibration(const SurviveContext *ctx, int lh, const FLT *in, SurviveAngleReading out) {
 	const BaseStationCal *cal = ctx->bsd[lh].fcal;
+	const SurviveCalibrationTable *table = ctx->calibration_tables[lh];
+	if (table) {
+		// A table built from some other calibration is stale until survive_calibration_table_update is called; solving
+		// exactly in the meantime is slower but still right.
+		if (memcmp(table->fcal, cal, sizeof(table->fcal)) != 0 || !survive_calibration_table_apply(table, in, out))
+			survive_reproject_invert_calibration(cal, in, out);
+		return;
+	}
+
 	out[0] = in[0] + cal[0].phase;
 	out[1] = in[1] + cal[1].phase;
 }
+
+#define CALIBRATION_INVERT_MAX_ITERATIONS 32
+#define CALIBRATION_TABLE_EXTENT (M_PI / 3.)
+
+void survive_reproject_invert_calibration(const BaseStationCal *bcal, const SurviveAngleReading measured,
+										  SurviveAngleReading ideal) {
+	// The calibration only perturbs the ideal angles slightly, so stepping by the residual contracts quickly. An ideal
+	// lighthouse measures (ix, iy) for the point (-tan(ix), tan(iy), -1).
+	SurviveAngleReading guess = {measured[0] + bcal[0].phase, measured[1] + bcal[1].phase};
+	for (int i = 0; i < CALIBRATION_INVERT_MAX_ITERATIONS; i++) {
+		LinmathPoint3d ptInLh = {-tan(guess[0]), tan(guess[1]), -1};
+		SurviveAngleReading predicted;
+		survive_reproject_xy(bcal, ptInLh, predicted);
+
+		FLT dx = measured[0] - predicted[0], dy = measured[1] - predicted[1];
+		guess[0] += dx;
+		guess[1] += dy;
+		if (fabs(dx) < 1e-13 && fabs(dy) < 1e-13)
+			break;
+	}
+	ideal[0] = guess[0];
+	ideal[1] = guess[1];
+}
+
+// Samples run one step past the field of view on every side so that the interpolation never has to clamp
+#define CALIBRATION_TABLE_STEP (2. * CALIBRATION_TABLE_EXTENT / (SURVIVE_CALIBRATION_TABLE_SIZE - 3))
+
+void survive_calibration_table_build(SurviveCalibrationTable *table, const BaseStationCal *bcal) {
+	memcpy(table->fcal, bcal, sizeof(table->fcal));
+
+	const FLT origin = -CALIBRATION_TABLE_EXTENT - CALIBRATION_TABLE_STEP;
+	for (int y = 0; y < SURVIVE_CALIBRATION_TABLE_SIZE; y++) {
+		for (int x = 0; x < SURVIVE_CALIBRATION_TABLE_SIZE; x++) {
+			SurviveAngleReading measured = {origin + x * CALIBRATION_TABLE_STEP, origin + y * CALIBRATION_TABLE_STEP};
+			SurviveAngleReading ideal;
+			survive_reproject_invert_calibration(bcal, measured, ideal);
+			table->correction[y][x][0] = ideal[0] - measured[0];
+			table->correction[y][x][1] = ideal[1] - measured[1];
+		}
+	}
+}
+
+static inline void catmull_rom_weights(FLT t, FLT w[4]) {
+	FLT t2 = t * t, t3 = t2 * t;
+	w[0] = .5 * (-t3 + 2 * t2 - t);
+	w[1] = .5 * (3 * t3 - 5 * t2 + 2);
+	w[2] = .5 * (-3 * t3 + 4 * t2 + t);
+	w[3] = .5 * (t3 - t2);
+}
+
+bool survive_calibration_table_apply(const SurviveCalibrationTable *table, const SurviveAngleReading measured,
+									 SurviveAngleReading ideal) {
+	const FLT scale = 1. / CALIBRATION_TABLE_STEP;
+	FLT fx = (measured[0] + CALIBRATION_TABLE_EXTENT) * scale + 1;
+	FLT fy = (measured[1] + CALIBRATION_TABLE_EXTENT) * scale + 1;
+	const FLT last = SURVIVE_CALIBRATION_TABLE_SIZE - 2;
+	if (!(fx >= 1 && fy >= 1 && fx <= last && fy <= last))
+		return false;
+
+	// Bicubic rather than bilinear; the curve term is quadratic in the angles, which Catmull-Rom reproduces exactly.
+	// The upper edge uses the last bin, at its far corner.
+	int x = fx < last ? (int)fx : (int)last - 1;
+	int y = fy < last ? (int)fy : (int)last - 1;
+	FLT wx[4], wy[4];
+	catmull_rom_weights(fx - x, wx);
+	catmull_rom_weights(fy - y, wy);
+
+	SurviveAngleReading out = {measured[0], measured[1]};
+	for (int j = 0; j < 4; j++) {
+		FLT row[2] = {0};
+		for (int i = 0; i < 4; i++) {
+			const FLT *c = table->correction[y - 1 + j][x - 1 + i];
+			row[0] += wx[i] * c[0];
+			row[1] += wx[i] * c[1];
+		}
+		out[0] += wy[j] * row[0];
+		out[1] += wy[j] * row[1];
+	}
+	ideal[0] = out[0];
+	ideal[1] = out[1];
+	return true;
+}
+
+void survive_calibration_table_update(SurviveContext *ctx, int lh) {
+	if (ctx->calibration_tables[lh])
+		survive_calibration_table_build(ctx->calibration_tables[lh], ctx->bsd[lh].fcal);
+}
@@ -0,0 +1,171 @@
+// pthread_setaffinity_np and the CPU_* macros are GNU extensions
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <os_generic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <survive.h>
+
+#include "survive_config.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+STATIC_CONFIG_ITEM(USB_THREAD_CPUS, "usb-thread-cpus", 's',
+				   "CPUs the USB receive threads may run on, as a list like '2,4-5'. Empty for any.", "");
+STATIC_CONFIG_ITEM(USB_THREAD_PRIORITY, "usb-thread-priority", 'i',
+				   "SCHED_FIFO priority, 1-99, for the USB receive threads. 0 keeps the default scheduling.", 0);
+STATIC_CONFIG_ITEM(BUTTON_THREAD_CPUS, "button-thread-cpus", 's',
+				   "CPUs the button servicing thread may run on, as a list like '2,4-5'. Empty for any.", "");
+STATIC_CONFIG_ITEM(BUTTON_THREAD_PRIORITY, "button-thread-priority", 'i',
+				   "SCHED_FIFO priority, 1-99, for the button servicing thread. 0 keeps the default scheduling.", 0);
+STATIC_CONFIG_ITEM(POLL_THREAD_CPUS, "poll-thread-cpus", 's',
+				   "CPUs the survive_simple poll thread may run on, as a list like '2,4-5'. Empty for any.", "");
+STATIC_CONFIG_ITEM(POLL_THREAD_PRIORITY, "poll-thread-priority", 'i',
+				   "SCHED_FIFO priority, 1-99, for the survive_simple poll thread. 0 keeps the default scheduling.", 0);
+
+int survive_parse_cpu_list(const char *list, bool *cpus, int cpu_ct) {
+	memset(cpus, 0, sizeof(bool) * cpu_ct);
+
+	int selected = 0;
+	const char *p = list;
+	while (*p) {
+		char *end;
+		long first = strtol(p, &end, 10), last = first;
+		if (end == p || first < 0)
+			return -1;
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			if (end == p + 1 || last < first)
+				return -1;
+			p = end;
+		}
+		if (last >= cpu_ct)
+			return -1;
+		for (long cpu = first; cpu <= last; cpu++) {
+			selected += !cpus[cpu];
+			cpus[cpu] = true;
+		}
+
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return -1;
+	}
+	return selected;
+}
+
+#ifdef _WIN32
+#define SURVIVE_MAX_CPUS 64
+#define PRIORITY_POLICY "Windows"
+#define PRIORITY_PERMISSION_HINT ""
+typedef HANDLE native_thread_t;
+#else
+#define SURVIVE_MAX_CPUS CPU_SETSIZE
+#define PRIORITY_POLICY "SCHED_FIFO"
+#define PRIORITY_PERMISSION_HINT "; it needs CAP_SYS_NICE or an rtprio limit"
+typedef pthread_t native_thread_t;
+#endif
+
+static int set_affinity(native_thread_t thread, const bool *cpus) {
+#if defined(_WIN32)
+	DWORD_PTR mask = 0;
+	for (int i = 0; i < SURVIVE_MAX_CPUS; i++) {
+		if (cpus[i])
+			mask |= (DWORD_PTR)1 << i;
+	}
+	return SetThreadAffinityMask(thread, mask) ? 0 : EINVAL;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < SURVIVE_MAX_CPUS; i++) {
+		if (cpus[i])
+			CPU_SET(i, &set);
+	}
+	return pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+	return ENOTSUP;
+#endif
+}
+
+static int set_priority(native_thread_t thread, int priority) {
+#ifdef _WIN32
+	// Windows has no SCHED_FIFO; the same 1-99 range is spread over the three levels above normal
+	if (priority < 1 || priority > 99)
+		return EINVAL;
+	int level = priority <= 33	 ? THREAD_PRIORITY_ABOVE_NORMAL
+				: priority <= 66 ? THREAD_PRIORITY_HIGHEST
+								 : THREAD_PRIORITY_TIME_CRITICAL;
+	if (SetThreadPriority(thread, level))
+		return 0;
+	return GetLastError() == ERROR_ACCESS_DENIED ? EPERM : EINVAL;
+#else
+	if (priority < sched_get_priority_min(SCHED_FIFO) || priority > sched_get_priority_max(SCHED_FIFO))
+		return EINVAL;
+	struct sched_param param = {.sched_priority = priority};
+	return pthread_setschedparam(thread, SCHED_FIFO, &param);
+#endif
+}
+
+static int configure_thread(SurviveContext *ctx, native_thread_t thread, const char *name) {
+	char key[64];
+	snprintf(key, sizeof(key), "%s-thread-cpus", name);
+	const char *cpu_list = survive_configs(ctx, key, SC_GET, "");
+	snprintf(key, sizeof(key), "%s-thread-priority", name);
+	int priority = survive_configi(ctx, key, SC_GET, 0);
+
+	int rtn = 0;
+	if (cpu_list && *cpu_list) {
+		bool *cpus = calloc(SURVIVE_MAX_CPUS, sizeof(bool));
+		int err = survive_parse_cpu_list(cpu_list, cpus, SURVIVE_MAX_CPUS) > 0 ? set_affinity(thread, cpus) : EINVAL;
+		free(cpus);
+		if (err) {
+			SV_WARN("Could not restrict the %s thread to CPUs '%s': %s", name, cpu_list, strerror(err));
+			rtn = -err;
+		} else {
+			SV_INFO("Running the %s thread on CPUs %s", name, cpu_list);
+		}
+	}
+
+	if (priority > 0) {
+		int err = set_priority(thread, priority);
+		if (err == EPERM) {
+			SV_WARN("Not permitted to give the %s thread " PRIORITY_POLICY " priority %d" PRIORITY_PERMISSION_HINT
+					". Keeping the default scheduling.",
+					name, priority);
+		} else if (err) {
+			SV_WARN("Could not give the %s thread " PRIORITY_POLICY " priority %d: %s", name, priority, strerror(err));
+		} else {
+			SV_INFO("Running the %s thread with " PRIORITY_POLICY " priority %d", name, priority);
+		}
+		if (err && rtn == 0)
+			rtn = -err;
+	}
+	return rtn;
+}
+
+int survive_thread_configure(SurviveContext *ctx, void *thread, const char *name) {
+	if (thread == 0)
+		return -EINVAL;
+#ifdef _WIN32
+	return configure_thread(ctx, (HANDLE)thread, name);
+#else
+	return configure_thread(ctx, *(pthread_t *)thread, name);
+#endif
+}
+
+int survive_thread_configure_current(SurviveContext *ctx, const char *name) {
+#ifdef _WIN32
+	return configure_thread(ctx, GetCurrentThread(), name);
+#else
+	return configure_thread(ctx, pthread_self(), name);
+#endif
+}
@@ -0,0 +1,124 @@
+#include "survive_trace.h"
+#include "survive_atomic.h"
+
+#include <os_generic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+STATIC_CONFIG_ITEM(TRACE, "trace", 's',
+				   "File to write a Chrome trace-event timeline of processing stages to, for chrome://tracing or Perfetto.",
+				   "");
+
+typedef struct SurviveTraceData {
+	FILE *f;
+	og_mutex_t lock;
+	uint64_t start_ns;
+	bool first;
+
+	int generation;
+	int thread_count;
+} SurviveTraceData;
+
+// Trace viewers want small integer thread ids; threads are numbered per trace in the order they first emit a span.
+static THREAD_LOCAL int thread_generation;
+static THREAD_LOCAL int thread_id;
+static int trace_generations;
+
+void survive_install_trace(SurviveContext *ctx) {
+	const char *path = survive_configs(ctx, "trace", SC_GET, "");
+	if (path[0] == 0 || ctx->traceptr)
+		return;
+
+	FILE *f = fopen(path, "w");
+	if (f == 0) {
+		SV_WARN("Could not open %s for writing a trace", path);
+		return;
+	}
+	SV_INFO("Writing trace to '%s'", path);
+
+	SurviveTraceData *trace = calloc(1, sizeof(SurviveTraceData));
+	trace->f = f;
+	trace->lock = OGCreateMutex();
+	trace->start_ns = survive_latency_now_ns();
+	trace->first = true;
+	trace->generation = ++trace_generations;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	survive_atomic_store_ptr(&ctx->traceptr, trace);
+}
+
+static void write_separator(SurviveTraceData *trace) {
+	if (!trace->first)
+		fputs(",\n", trace->f);
+	trace->first = false;
+}
+
+// Names come from codenames and config, so quotes, backslashes and control characters are escaped
+static void write_json_string(FILE *f, const char *s) {
+	fputc('"', f);
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+void survive_trace_span(SurviveContext *ctx, const char *name, const char *object, uint64_t start_ns,
+						uint64_t end_ns) {
+	SurviveTraceData *trace = survive_atomic_load_ptr(&ctx->traceptr);
+	if (trace == 0)
+		return;
+
+	OGLockMutex(trace->lock);
+	if (thread_generation != trace->generation) {
+		thread_generation = trace->generation;
+		thread_id = ++trace->thread_count;
+		write_separator(trace);
+		fprintf(trace->f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+				thread_id, thread_id);
+	}
+
+	// Spans that started before the trace was opened are clipped to its start
+	uint64_t start = start_ns > trace->start_ns ? start_ns - trace->start_ns : 0;
+	uint64_t end = end_ns > trace->start_ns ? end_ns - trace->start_ns : 0;
+
+	write_separator(trace);
+	fputs("{\"name\":", trace->f);
+	write_json_string(trace->f, name);
+	fprintf(trace->f, ",\"cat\":\"libsurvive\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", thread_id,
+			start / 1000., (end - start) / 1000.);
+	if (object) {
+		fputs(",\"args\":{\"object\":", trace->f);
+		write_json_string(trace->f, object);
+		fputc('}', trace->f);
+	}
+	fputc('}', trace->f);
+	OGUnlockMutex(trace->lock);
+}
+
+// Only called once the threads that emit spans have been joined. Clearing the pointer first keeps spans from anything
+// still running on this thread out of the trace that is about to be freed.
+void survive_trace_close(SurviveContext *ctx) {
+	SurviveTraceData *trace = survive_atomic_load_ptr(&ctx->traceptr);
+	if (trace == 0)
+		return;
+	survive_atomic_store_ptr(&ctx->traceptr, 0);
+
+	OGLockMutex(trace->lock);
+	fprintf(trace->f, "\n]}\n");
+	fclose(trace->f);
+	OGUnlockMutex(trace->lock);
+
+	OGDeleteMutex(trace->lock);
+	free(trace);
+}
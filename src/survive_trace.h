@@ -0,0 +1,30 @@
+#ifndef _SURVIVE_TRACE_H
+#define _SURVIVE_TRACE_H
+
+#include "survive_atomic.h"
+#include "survive_latency.h"
+
+/**
+ * Timeline output in the Chrome trace-event JSON format, viewable in chrome://tracing or Perfetto. Per-object stages
+ * are traced through the SURVIVE_LATENCY_* instrumentation; other spans use SURVIVE_TRACE_BEGIN / SURVIVE_TRACE_END,
+ * which cost one branch when '--trace' isn't set.
+ */
+void survive_install_trace(SurviveContext *ctx);
+// Must only be called after every thread that could emit a span has been joined
+void survive_trace_close(SurviveContext *ctx);
+
+SURVIVE_EXPORT void survive_trace_span(SurviveContext *ctx, const char *name, const char *object, uint64_t start_ns,
+									   uint64_t end_ns);
+
+#ifndef SURVIVE_DISABLE_LATENCY_STATS
+#define SURVIVE_TRACE_BEGIN(ctx, name)                                                                                 \
+	uint64_t name = survive_atomic_load_ptr(&(ctx)->traceptr) ? survive_latency_now_ns() : 0
+#define SURVIVE_TRACE_END(ctx, span, object, name)                                                                     \
+	if (survive_atomic_load_ptr(&(ctx)->traceptr))                                                                     \
+	survive_trace_span((ctx), (span), (object), (name), survive_latency_now_ns())
+#else
+#define SURVIVE_TRACE_BEGIN(ctx, name)
+#define SURVIVE_TRACE_END(ctx, span, object, name)
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+#include "os_generic.h"
+#include "test_case.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PRODUCERS 4
+#define EVENTS_PER_PRODUCER 200000
+
+typedef struct {
+	ButtonQueue queue;
+	SurviveObject objects[PRODUCERS];
+	int producer;
+	og_mutex_t lock;
+	int producers_done;
+} StressData;
+
+// Each event carries its producer in axis1Id and a per-producer sequence number split over the two axis values.
+static void *producer(void *v) {
+	StressData *d = v;
+	OGLockMutex(d->lock);
+	int id = d->producer++;
+	OGUnlockMutex(d->lock);
+
+	for (uint32_t seq = 0; seq < EVENTS_PER_PRODUCER; seq++) {
+		ButtonQueueEntry entry = {.eventType = BUTTON_EVENT_AXIS_CHANGED,
+								  .axis1Id = id,
+								  .axis1Val = seq & 0xFFFF,
+								  .axis2Id = id,
+								  .axis2Val = seq >> 16,
+								  .so = &d->objects[id]};
+		survive_button_queue_push(&d->queue, &entry);
+	}
+
+	OGLockMutex(d->lock);
+	d->producers_done++;
+	OGUnlockMutex(d->lock);
+	OGUnlockSema(d->queue.buttonservicesem);
+	return 0;
+}
+
+static int check_entry(StressData *d, const ButtonQueueEntry *entry, int64_t *last_seq) {
+	int id = entry->axis1Id;
+	if (id >= PRODUCERS || entry->axis2Id != id || entry->so != &d->objects[id] ||
+		entry->eventType != BUTTON_EVENT_AXIS_CHANGED) {
+		fprintf(stderr, "Corrupt button event from producer %d\n", id);
+		return survive_test_assert();
+	}
+
+	int64_t seq = entry->axis1Val | ((int64_t)entry->axis2Val << 16);
+	if (seq <= last_seq[id]) {
+		fprintf(stderr, "Producer %d: event %d delivered after %d\n", id, (int)seq, (int)last_seq[id]);
+		return survive_test_assert();
+	}
+	last_seq[id] = seq;
+	return 0;
+}
+
+// Floods a small queue from several threads while one consumer drains it the way button_servicer does. Every event
+// must either arrive intact and in its producer's order, or be counted as dropped.
+TEST(ButtonQueue, MultiProducerStress) {
+	StressData *d = calloc(1, sizeof(StressData));
+	survive_button_queue_init(&d->queue, 50);
+	ASSERT_DOUBLE_EQ((double)d->queue.capacity, 64.);
+	d->queue.buttonservicesem = OGCreateSema();
+	d->lock = OGCreateMutex();
+
+	og_thread_t threads[PRODUCERS];
+	for (int i = 0; i < PRODUCERS; i++)
+		threads[i] = OGCreateThread(producer, d);
+
+	int64_t last_seq[PRODUCERS];
+	for (int i = 0; i < PRODUCERS; i++)
+		last_seq[i] = -1;
+
+	uint64_t delivered = 0;
+	int done = 0;
+	while (!done) {
+		OGLockSema(d->queue.buttonservicesem);
+		OGLockMutex(d->lock);
+		done = d->producers_done == PRODUCERS;
+		OGUnlockMutex(d->lock);
+
+		ButtonQueueEntry entry;
+		while (survive_button_queue_pop(&d->queue, &entry)) {
+			ASSERT_SUCCESS(check_entry(d, &entry, last_seq));
+			delivered++;
+		}
+	}
+
+	for (int i = 0; i < PRODUCERS; i++)
+		OGJoinThread(threads[i]);
+
+	uint64_t sent = (uint64_t)PRODUCERS * EVENTS_PER_PRODUCER;
+	uint64_t object_delivered = 0, object_dropped = 0;
+	for (int i = 0; i < PRODUCERS; i++) {
+		object_delivered += d->objects[i].counters.buttons;
+		object_dropped += d->objects[i].counters.buttons_dropped;
+	}
+	fprintf(stderr, "%llu events delivered, %llu dropped\n", (unsigned long long)delivered,
+			(unsigned long long)d->queue.dropped);
+
+	if (delivered + d->queue.dropped != sent || object_delivered != delivered || object_dropped != d->queue.dropped) {
+		fprintf(stderr, "Lost events: sent %llu, delivered %llu (%llu by object), dropped %llu (%llu by object)\n",
+				(unsigned long long)sent, (unsigned long long)delivered, (unsigned long long)object_delivered,
+				(unsigned long long)d->queue.dropped, (unsigned long long)object_dropped);
+		return survive_test_assert();
+	}
+
+	// The queue must keep working after overflowing
+	ButtonQueueEntry entry = {.eventType = BUTTON_EVENT_BUTTON_DOWN, .buttonId = 3}, out;
+	for (uint32_t i = 0; i < d->queue.capacity; i++)
+		ASSERT_GT((double)survive_button_queue_push(&d->queue, &entry), 0.);
+	ASSERT_DOUBLE_EQ((double)survive_button_queue_push(&d->queue, &entry), 0.);
+	for (uint32_t i = 0; i < d->queue.capacity; i++)
+		ASSERT_GT((double)survive_button_queue_pop(&d->queue, &out), 0.);
+	ASSERT_DOUBLE_EQ((double)survive_button_queue_pop(&d->queue, &out), 0.);
+	ASSERT_DOUBLE_EQ((double)out.buttonId, 3.);
+
+	OGDeleteSema(d->queue.buttonservicesem);
+	OGDeleteMutex(d->lock);
+	survive_button_queue_free(&d->queue);
+	free(d);
+	return 0;
+}
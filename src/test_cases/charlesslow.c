@@ -0,0 +1,73 @@
+#include "poser_charlesslow.h"
+#include "test_case.h"
+#include <string.h>
+
+#define SCENE_SENSORS 12
+
+static const FLT scene_lighthouses[NUM_LIGHTHOUSES][3] = {{1.5, .8, 2.}, {-1.2, 1.1, 2.2}};
+
+// Sensors on the top half of a sphere, facing out, seen by lighthouses that look at its center
+static void build_scene(SurviveObject *so, PoserDataFullScene *fs) {
+	for (int p = 0; p < SCENE_SENSORS; p++) {
+		FLT azimuth = p * 2 * LINMATHPI / SCENE_SENSORS, elevation = (p % 3 + 1) * LINMATHPI / 8;
+		FLT normal[3] = {cos(azimuth) * cos(elevation), sin(azimuth) * cos(elevation), sin(elevation)};
+		copy3d(&so->sensor_normals[p * 3], normal);
+		scale3d(&so->sensor_locations[p * 3], normal, .08);
+	}
+
+	for (int lh = 0; lh < NUM_LIGHTHOUSES; lh++) {
+		FLT forward[3] = {0, 0, 1}, toCenter[3], lhRot[4];
+		scale3d(toCenter, scene_lighthouses[lh], -1);
+		normalize3d(toCenter, toCenter);
+		quatfrom2vectors(lhRot, forward, toCenter);
+
+		FLT worldToLh[4];
+		quatgetreciprocal(worldToLh, lhRot);
+		for (int p = 0; p < SCENE_SENSORS; p++) {
+			FLT ray[3];
+			sub3d(ray, &so->sensor_locations[p * 3], scene_lighthouses[lh]);
+			quatrotatevector(ray, worldToLh, ray);
+			normalize3d(ray, ray);
+			fs->angles[p][lh][0] = asin(ray[0]);
+			fs->angles[p][lh][1] = asin(ray[1]);
+			fs->lengths[p][lh][0] = fs->lengths[p][lh][1] = .005;
+		}
+	}
+}
+
+// The grid is split between threads but merged in cell order, so how many threads search it can't change the result.
+TEST(CharlesSlow, ThreadCountDoesNotChangePoses) {
+	const char *configfile = "charlesslow_test.json";
+	remove(configfile);
+	char *args[] = {"survive_tests", "--configfile", (char *)configfile};
+	SurviveContext *ctx = survive_init(sizeof(args) / sizeof(args[0]), args);
+	if (ctx == 0)
+		return survive_test_assert();
+
+	FLT locations[SCENE_SENSORS * 3], normals[SCENE_SENSORS * 3];
+	SurviveObject so = {.ctx = ctx, .codename = "CS0", .sensor_ct = SCENE_SENSORS};
+	so.sensor_locations = locations;
+	so.sensor_normals = normals;
+
+	PoserDataFullScene fs = {.hdr = {.pt = POSERDATA_FULL_SCENE}};
+	build_scene(&so, &fs);
+
+	int rtn = 0;
+	for (int lh = 0; lh < NUM_LIGHTHOUSES; lh++) {
+		FLT serial[3], threaded[3];
+		FLT serial_error = CharlesSlowGridSearch(&so, &fs, lh, 1, 1e-10, serial);
+		FLT threaded_error = CharlesSlowGridSearch(&so, &fs, lh, 4, 1e-10, threaded);
+		if (memcmp(serial, threaded, sizeof(serial)) != 0 || serial_error != threaded_error) {
+			fprintf(stderr, "Lighthouse %d: %f %f %f (%g) != %f %f %f (%g)\n", lh, serial[0], serial[1], serial[2],
+					serial_error, threaded[0], threaded[1], threaded[2], threaded_error);
+			rtn = survive_test_assert();
+		}
+
+		// The poser gives up on a lighthouse past this error, so the comparison wouldn't mean anything
+		EXPECT(rtn, serial_error < .1);
+	}
+
+	survive_close(ctx);
+	remove(configfile);
+	return rtn;
+}
@@ -0,0 +1,136 @@
+#include "test_case.h"
+
+#define SHED_TEST_TIMEBASE_HZ 48000000
+#define SHED_TEST_TICKS_PER_MS (SHED_TEST_TIMEBASE_HZ / 1000)
+
+#define SHED_TEST_CONFIG "load_shedding_test.json"
+
+static SurviveContext *shedding_context() {
+	remove(SHED_TEST_CONFIG);
+	char *args[] = {"survive_tests", "--configfile", SHED_TEST_CONFIG, "--shed-lag", ".05"};
+	return survive_init(sizeof(args) / sizeof(args[0]), args);
+}
+
+// Closing saves the config, so it's removed after
+static void close_shedding_context(SurviveContext *ctx) {
+	survive_close(ctx);
+	remove(SHED_TEST_CONFIG);
+}
+
+// Feeds 'ms' milliseconds of IMU samples, one per millisecond, handled 'wall_per_ms' seconds apart. Every fourth sample
+// is followed by a batch of sweeps stamped up to 3ms earlier, the way light arrives from hardware.
+static void feed_events(SurviveObject *so, survive_timecode *timecode, double *now, int ms, double wall_per_ms) {
+	for (int i = 0; i < ms; i++) {
+		*timecode += SHED_TEST_TICKS_PER_MS;
+		*now += wall_per_ms;
+		survive_object_update_lag(so, *timecode, *now);
+		if (i % 4 == 3) {
+			for (int sweep = 3; sweep > 0; sweep--)
+				survive_object_update_lag(so, *timecode - sweep * SHED_TEST_TICKS_PER_MS, *now);
+		}
+	}
+}
+
+// Light that is a little older than the latest IMU sample mustn't restart the estimate, or lag could never build up
+TEST(LoadShedding, OutOfOrderLightAndImu) {
+	SurviveContext *ctx = shedding_context();
+	if (ctx == 0)
+		return survive_test_assert();
+	SurviveObject so = {.ctx = ctx, .codename = "SH0", .timebase_hz = SHED_TEST_TIMEBASE_HZ};
+
+	survive_timecode timecode = 0xfff00000; // wraps on the way
+	double now = 0;
+	int rtn = 0;
+
+	// Keeping up, nothing is shed
+	feed_events(&so, &timecode, &now, 500, .001);
+	EXPECT(rtn, !so.shed.shedding && so.counters.shed_starts == 0);
+	EXPECT(rtn, so.shed.lag < .001);
+
+	// Taking twice as long as the data lasts, the lag grows by about a millisecond per millisecond
+	feed_events(&so, &timecode, &now, 500, .002);
+	EXPECT(rtn, so.shed.shedding && so.counters.shed_starts == 1);
+	EXPECT(rtn, so.shed.lag > .4);
+
+	// Handling events faster than they were recorded catches up until shedding stops
+	feed_events(&so, &timecode, &now, 1500, .0005);
+	EXPECT(rtn, !so.shed.shedding && so.counters.shed_starts == 1);
+
+	close_shedding_context(ctx);
+	return rtn;
+}
+
+// A device whose clock jumps back by more than the out of order slack was reset; the estimate starts over
+TEST(LoadShedding, ClockReset) {
+	SurviveContext *ctx = shedding_context();
+	if (ctx == 0)
+		return survive_test_assert();
+	SurviveObject so = {.ctx = ctx, .codename = "SH0", .timebase_hz = SHED_TEST_TIMEBASE_HZ};
+
+	survive_timecode timecode = 3000 * SHED_TEST_TICKS_PER_MS;
+	double now = 0;
+	int rtn = 0;
+
+	feed_events(&so, &timecode, &now, 500, .002);
+	EXPECT(rtn, so.shed.shedding);
+
+	timecode = 0;
+	feed_events(&so, &timecode, &now, 100, .001);
+	EXPECT(rtn, !so.shed.shedding && so.shed.lag < .001);
+	EXPECT(rtn, so.counters.shed_starts == 1);
+
+	close_shedding_context(ctx);
+	return rtn;
+}
+
+static int count_poser_fn(SurviveObject *so, PoserData *pd) {
+	int *counts = so->user_ptr;
+	counts[pd->pt == POSERDATA_IMU]++;
+	return 0;
+}
+
+// Sends 20 sweeps and 20 IMU samples, 1/64s of data apart, through the default handlers
+static void feed_poser(SurviveObject *so, int *counts) {
+	counts[0] = counts[1] = 0;
+	so->shed.imu_seen = 0;
+	so->shed.last_solve = -1;
+	for (int i = 0; i < 20; i++) {
+		FLT accelgyro[9] = {0};
+		so->shed.data_time = i / 64.;
+		survive_default_angle_process(so, 0, 0, i * SHED_TEST_TIMEBASE_HZ / 64, .005, .1, 0);
+		survive_default_imu_process(so, 3, accelgyro, i * SHED_TEST_TIMEBASE_HZ / 64, 0);
+	}
+}
+
+// What shedding keeps from the poser, with the estimate held still so the decisions don't depend on the clock
+TEST(LoadShedding, SkipsSolvesAndImu) {
+	SurviveContext *ctx = shedding_context();
+	if (ctx == 0)
+		return survive_test_assert();
+	static const FLT unpaced = 0;
+	ctx->data_time_factor = &unpaced;
+
+	int counts[2];
+	SurviveObject so = {.ctx = ctx, .codename = "SH0", .timebase_hz = SHED_TEST_TIMEBASE_HZ};
+	so.PoserFn = count_poser_fn;
+	so.user_ptr = counts;
+	int rtn = 0;
+
+	feed_poser(&so, counts);
+	EXPECT(rtn, counts[0] == 20 && counts[1] == 20);
+	EXPECT(rtn, so.counters.shed_solves == 0 && so.counters.shed_imu == 0);
+
+	// One solve per 'shed-solve-period' (.05s) and every 4th IMU sample
+	so.shed.shedding = true;
+	feed_poser(&so, counts);
+	EXPECT(rtn, counts[0] == 5 && counts[1] == 5);
+	EXPECT(rtn, so.counters.shed_solves == 15 && so.counters.shed_imu == 15);
+
+	// Objects matched by 'shed-objects' skip every solve
+	so.shed.noncritical = true;
+	feed_poser(&so, counts);
+	EXPECT(rtn, counts[0] == 0 && counts[1] == 5);
+
+	close_shedding_context(ctx);
+	return rtn;
+}
@@ -13,7 +13,7 @@ int main(int argc, char **argv) {
 		int r = dd();
 		fprintf(stderr, "Test %s reports status %d\n", DriverName, r);
 
-		failed &= r == 0;
+		failed |= r != 0;
 	}
 
 	return failed ? -1 : 0;
@@ -0,0 +1,104 @@
+#include "mpfit/mpfit.h"
+#include "test_case.h"
+#include <string.h>
+#include <survive_optimizer.h>
+
+#define PEAKS 6
+#define PARAMS (3 * PEAKS)
+#define SAMPLES 240
+
+typedef struct {
+	double t[SAMPLES];
+	double y[SAMPLES];
+} PeakData;
+
+// Sum of gaussians; the amplitude of the first peak has an analytic derivative so the threaded path has to leave its
+// column alone.
+static int peaks_fn(int m, int n, double *p, double *deviates, double **derivs, void *private) {
+	PeakData *data = private;
+	for (int i = 0; i < m; i++) {
+		double model = 0;
+		for (int k = 0; k < PEAKS; k++) {
+			double d = (data->t[i] - p[3 * k + 1]) / p[3 * k + 2];
+			double g = exp(-.5 * d * d);
+			model += p[3 * k] * g;
+			if (k == 0 && derivs && derivs[0])
+				derivs[0][i] = -g;
+		}
+		deviates[i] = data->y[i] - model;
+	}
+	return 0;
+}
+
+static int fit_peaks(PeakData *data, int nthreads, double *p, mp_result *result) {
+	mp_par pars[PARAMS];
+	memset(pars, 0, sizeof(pars));
+	pars[0].side = 3;
+	pars[4].side = 2;
+	pars[7].side = 2;
+	pars[11].fixed = 1;
+
+	for (int k = 0; k < PEAKS; k++) {
+		p[3 * k] = 1 + .1 * k;
+		p[3 * k + 1] = k + .3;
+		p[3 * k + 2] = .5;
+	}
+
+	mp_config config = {0};
+	config.nthreads = nthreads;
+	memset(result, 0, sizeof(*result));
+	return mpfit(peaks_fn, SAMPLES, PARAMS, p, pars, &config, data, result);
+}
+
+TEST(MPFit, ThreadedJacobianMatchesSerial) {
+	PeakData data;
+	for (int i = 0; i < SAMPLES; i++) {
+		data.t[i] = i * PEAKS / (double)SAMPLES;
+		data.y[i] = 0;
+		for (int k = 0; k < PEAKS; k++) {
+			double d = (data.t[i] - (k + .5)) / (.3 + .05 * k);
+			data.y[i] += (1.5 + .2 * k) * exp(-.5 * d * d);
+		}
+		data.y[i] += .01 * sin(i * 12.9898);
+	}
+
+	double serial[PARAMS], threaded[PARAMS];
+	mp_result serial_result, threaded_result;
+	int serial_status = fit_peaks(&data, 1, serial, &serial_result);
+	ASSERT_GT((double)serial_status, 0.);
+
+	for (int nthreads = 2; nthreads <= 7; nthreads++) {
+		int status = fit_peaks(&data, nthreads, threaded, &threaded_result);
+		if (status != serial_status || threaded_result.nfev != serial_result.nfev ||
+			threaded_result.bestnorm != serial_result.bestnorm || memcmp(serial, threaded, sizeof(serial)) != 0) {
+			fprintf(stderr, "%d threads: status %d/%d, nfev %d/%d, chi2 %.17g/%.17g\n", nthreads, status,
+					serial_status, threaded_result.nfev, serial_result.nfev, threaded_result.bestnorm,
+					serial_result.bestnorm);
+			return survive_test_assert();
+		}
+	}
+	return 0;
+}
+
+// The jacobian scale of each robust loss must be the derivative of the residual it maps to, or mpfit's steps won't
+// match its cost. Small residuals keep (nearly) their value.
+TEST(MPFit, RobustLossMatchesFiniteDifference) {
+	const survive_optimizer_loss losses[] = {survive_optimizer_loss_huber, survive_optimizer_loss_cauchy,
+											 survive_optimizer_loss_tukey};
+	const FLT scale = .003, h = 1e-9;
+	const FLT rs[] = {1e-5, -.0005, .002, -.004, .01, -.05};
+
+	for (int l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+		FLT jacobian_scale, ignored;
+		ASSERT_DOUBLE_EQ(survive_optimizer_loss_residual(losses[l], scale, 0, &jacobian_scale), 0.);
+		ASSERT_DOUBLE_EQ(survive_optimizer_loss_residual(losses[l], scale, 1e-5, &jacobian_scale) / 1e-5, 1.);
+
+		for (int i = 0; i < sizeof(rs) / sizeof(rs[0]); i++) {
+			survive_optimizer_loss_residual(losses[l], scale, rs[i], &jacobian_scale);
+			FLT plus = survive_optimizer_loss_residual(losses[l], scale, rs[i] + h, &ignored);
+			FLT minus = survive_optimizer_loss_residual(losses[l], scale, rs[i] - h, &ignored);
+			ASSERT_DOUBLE_EQ(jacobian_scale, (plus - minus) / (2 * h));
+		}
+	}
+	return 0;
+}
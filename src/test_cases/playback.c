@@ -0,0 +1,546 @@
+#include "../survive_playback.h"
+#include "../survive_trace.h"
+#include "os_generic.h"
+#include "test_case.h"
+#include <jsmn.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	size_t cnt;
+	SurvivePose *poses;
+	survive_timecode *timecodes;
+} PoseLog;
+
+static void log_pose_fn(SurviveObject *so, survive_timecode timecode, SurvivePose *pose) {
+	PoseLog *log = so->ctx->user_ptr;
+	log->poses = realloc(log->poses, sizeof(SurvivePose) * (log->cnt + 1));
+	log->timecodes = realloc(log->timecodes, sizeof(survive_timecode) * (log->cnt + 1));
+	log->poses[log->cnt] = *pose;
+	log->timecodes[log->cnt] = timecode;
+	log->cnt++;
+
+	survive_default_raw_pose_process(so, timecode, pose);
+}
+
+static int run_to_completion(int argc, char *const *argv, PoseLog *log) {
+	SurviveContext *ctx = survive_init(argc, argv);
+	if (ctx == 0)
+		return -1;
+
+	ctx->user_ptr = log;
+	survive_install_pose_fn(ctx, log_pose_fn);
+	survive_startup(ctx);
+	while (survive_poll(ctx) == 0) {
+	}
+	survive_close(ctx);
+	return 0;
+}
+
+static void free_log(PoseLog *log) {
+	free(log->poses);
+	free(log->timecodes);
+}
+
+// Records 3 seconds of simulation; with 'reflections', that share of the sensors facing away from a lighthouse see a
+// reflection of its sweep
+static int record_simulation(const char *recording, const char *config, const char *reflections) {
+	char *record_args[] = {"survive_tests",	  "--simulator",		 "--simulator-time",		"3",
+						   "--deterministic", "--record",			 (char *)recording,			"--configfile",
+						   (char *)config,	  "--disable-calibrate", "--simulator-reflections", (char *)reflections};
+	int argc = sizeof(record_args) / sizeof(record_args[0]) - (reflections ? 0 : 2);
+	PoseLog sim = {0};
+	int rtn = run_to_completion(argc, record_args, &sim);
+	free_log(&sim);
+	return rtn;
+}
+
+static int record_simulator(const char *recording, const char *config) {
+	return record_simulation(recording, config, 0);
+}
+
+static int record_reflection_simulator(const char *recording, const char *config) {
+	return record_simulation(recording, config, ".05");
+}
+
+TEST(Playback, DeterministicReplay) {
+	const char *recording = "deterministic_replay_test.rec";
+	const char *config = "deterministic_replay_test.json";
+	remove(config);
+
+	ASSERT_SUCCESS(record_simulator(recording, config));
+
+	char *playback_args[] = {"survive_tests", "--playback",	(char *)recording,	 "--deterministic",
+							 "--configfile",  (char *)config, "--disable-calibrate"};
+	PoseLog first = {0}, second = {0};
+	ASSERT_SUCCESS(run_to_completion(sizeof(playback_args) / sizeof(playback_args[0]), playback_args, &first));
+	ASSERT_SUCCESS(run_to_completion(sizeof(playback_args) / sizeof(playback_args[0]), playback_args, &second));
+
+	int rtn = 0;
+	if (first.cnt == 0 || first.cnt != second.cnt) {
+		fprintf(stderr, "Replays gave %u and %u poses\n", (unsigned)first.cnt, (unsigned)second.cnt);
+		rtn = survive_test_assert();
+	} else if (memcmp(first.poses, second.poses, sizeof(SurvivePose) * first.cnt) != 0 ||
+			   memcmp(first.timecodes, second.timecodes, sizeof(survive_timecode) * first.cnt) != 0) {
+		fprintf(stderr, "Replays of %s gave different poses\n", recording);
+		rtn = survive_test_assert();
+	}
+
+	free_log(&first);
+	free_log(&second);
+	remove(recording);
+	remove(config);
+	return rtn;
+}
+
+TEST(Playback, ParseRecordingLine) {
+	SurviveRecordingEvent event;
+
+	ASSERT_SUCCESS(survive_parse_recording_line("SM0 I 3 96000 0.1 0.2 1.0 0.4 0.5 0.6  0.7 0.8 0.9 2", &event));
+	if (event.type != SURVIVE_RECORDING_IMU || strcmp(event.dev, "SM0") != 0 || event.data.imu.timecode != 96000 ||
+		event.data.imu.id != 2)
+		return -1;
+	ASSERT_DOUBLE_EQ(event.data.imu.accelgyro[2], 1.0);
+	ASSERT_DOUBLE_EQ(event.data.imu.accelgyro[8], 0.9);
+
+	// Older recordings have no magnetometer values
+	ASSERT_SUCCESS(survive_parse_recording_line("HMD I 3 96000 0.1 0.2 1.0 0.4 0.5 0.6 5", &event));
+	if (event.type != SURVIVE_RECORDING_IMU || event.data.imu.id != 5)
+		return -1;
+	ASSERT_DOUBLE_EQ(event.data.imu.accelgyro[6], 0.0);
+
+	ASSERT_SUCCESS(survive_parse_recording_line("SM0 R Y 7 5 1200 864000 100 1", &event));
+	if (event.type != SURVIVE_RECORDING_LIGHT || event.data.light.sensor_id != 7 || event.data.light.acode != 5 ||
+		event.data.light.timeinsweep != 1200 || event.data.light.timecode != 864000 || event.data.light.lh != 1)
+		return -1;
+
+	ASSERT_SUCCESS(survive_parse_recording_line("SM0 A 3 1 864000 0.000100 -0.250000 1", &event));
+	if (event.type != SURVIVE_RECORDING_ANGLE || event.data.angle.sensor_id != 3 || event.data.angle.lh != 1)
+		return -1;
+	ASSERT_DOUBLE_EQ(event.data.angle.angle, -0.25);
+
+	ASSERT_SUCCESS(survive_parse_recording_line("T20 C 12 4000000 250", &event));
+	if (event.type != SURVIVE_RECORDING_LIGHTCAP || event.data.lightcap.sensor_id != 12 ||
+		event.data.lightcap.timestamp != 4000000 || event.data.lightcap.length != 250)
+		return -1;
+
+	ASSERT_SUCCESS(survive_parse_recording_line("T20 CONFIG {\"a\": 1}", &event));
+	if (event.type != SURVIVE_RECORDING_CONFIG || strcmp(event.data.config, "{\"a\": 1}") != 0)
+		return -1;
+
+	ASSERT_SUCCESS(survive_parse_recording_line("SM0 POSE 1 2 3 1 0 0 0", &event));
+	if (event.type != SURVIVE_RECORDING_POSE)
+		return -1;
+	ASSERT_DOUBLE_EQ(event.data.pose.Pos[2], 3.0);
+
+	ASSERT_SUCCESS(survive_parse_recording_line("INFO LOG Some message", &event));
+	if (event.type != SURVIVE_RECORDING_INFO)
+		return -1;
+
+	ASSERT_SUCCESS(survive_parse_recording_line("SM0 NOT_AN_OP 1 2", &event));
+	if (event.type != SURVIVE_RECORDING_UNKNOWN)
+		return -1;
+
+	if (survive_parse_recording_line("SM0 I 3 96000 0.1", &event) == 0)
+		return -1;
+	return 0;
+}
+
+static uint64_t count_lines(const char *recording, const char *pattern) {
+	FILE *f = fopen(recording, "r");
+	if (f == 0)
+		return 0;
+
+	uint64_t cnt = 0;
+	char line[512];
+	while (fgets(line, sizeof(line), f)) {
+		if (strstr(line, pattern))
+			cnt++;
+	}
+	fclose(f);
+	return cnt;
+}
+
+TEST(Playback, CountersMove) {
+	const char *recording = "counters_test.rec";
+	const char *config = "counters_test.json";
+	remove(config);
+	ASSERT_SUCCESS(record_simulator(recording, config));
+
+	char *playback_args[] = {"survive_tests", "--playback",	(char *)recording,	 "--deterministic",
+							 "--configfile",  (char *)config, "--disable-calibrate"};
+	SurviveContext *ctx = survive_init(sizeof(playback_args) / sizeof(playback_args[0]), playback_args);
+	if (ctx == 0)
+		return -1;
+	survive_startup(ctx);
+
+	SurviveObjectCounters start = {0}, mid = {0}, end = {0};
+	SurviveObject *so = survive_get_so_by_name(ctx, "SM0");
+	if (so) {
+		survive_object_counters(so, &start);
+		for (int i = 0; i < 5000 && survive_poll(ctx) == 0; i++) {
+		}
+		survive_object_counters(so, &mid);
+		while (survive_poll(ctx) == 0) {
+		}
+		survive_object_counters(so, &end);
+	}
+	survive_close(ctx);
+
+	uint64_t recorded_imu = count_lines(recording, " SM0 I ");
+	remove(recording);
+	remove(config);
+
+	if (so == 0)
+		return survive_test_assert();
+
+	int rtn = 0;
+	EXPECT(rtn, start.packets == 0 && start.imu == 0 && start.poses == 0);
+	EXPECT(rtn, mid.packets > 0 && mid.imu > 0 && mid.angles > 0);
+	EXPECT(rtn, end.packets > mid.packets && end.imu > mid.imu && end.angles > mid.angles);
+	EXPECT(rtn, end.poses >= mid.poses);
+	EXPECT(rtn, end.time >= mid.time && mid.time >= start.time);
+
+	// Every recorded imu line reaches the object exactly once
+	EXPECT(rtn, end.imu == recorded_imu);
+	EXPECT(rtn, end.packets >= end.imu + end.angles);
+
+	// The simulator records angles, so nothing goes through the disambiguator
+	EXPECT(rtn, end.lightcaps == 0 && end.invalid_lightcaps == 0 && end.disambiguator_resets == 0);
+
+	EXPECT(rtn, end.poses > 0);
+	EXPECT(rtn, end.solver_runs > 0);
+	EXPECT(rtn, end.solver_error_total > 0);
+	return rtn;
+}
+
+static char *read_file(const char *path, size_t *len) {
+	FILE *f = fopen(path, "rb");
+	if (f == 0)
+		return 0;
+	fseek(f, 0, SEEK_END);
+	*len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *data = malloc(*len + 1);
+	*len = fread(data, 1, *len, f);
+	data[*len] = 0;
+	fclose(f);
+	return data;
+}
+
+static bool token_is(const char *js, const jsmntok_t *t, const char *s) {
+	return t->type == JSMN_STRING && (int)strlen(s) == t->end - t->start && strncmp(js + t->start, s, t->end - t->start) == 0;
+}
+
+// Index of the first token after t[i] and everything nested in it
+static int skip_token(const jsmntok_t *t, int i, int cnt) {
+	int end = t[i].end;
+	for (i++; i < cnt && t[i].start < end; i++)
+		;
+	return i;
+}
+
+TEST(Playback, TraceIsWellFormed) {
+	const char *recording = "trace_test.rec";
+	const char *config = "trace_test.json";
+	const char *trace = "trace_test.trace.json";
+	remove(config);
+	ASSERT_SUCCESS(record_simulator(recording, config));
+
+	char *playback_args[] = {"survive_tests", "--playback", (char *)recording, "--deterministic",		"--configfile",
+							 (char *)config,  "--trace",	(char *)trace,	   "--disable-calibrate"};
+	PoseLog log = {0};
+	ASSERT_SUCCESS(run_to_completion(sizeof(playback_args) / sizeof(playback_args[0]), playback_args, &log));
+	free_log(&log);
+
+	size_t len = 0;
+	char *js = read_file(trace, &len);
+	remove(recording);
+	remove(config);
+	remove(trace);
+	if (js == 0)
+		return survive_test_assert();
+
+	jsmn_parser parser;
+	jsmn_init(&parser);
+	int cnt = jsmn_parse(&parser, js, len, 0, 0);
+	jsmntok_t *t = cnt > 0 ? calloc(cnt, sizeof(jsmntok_t)) : 0;
+	if (t) {
+		jsmn_init(&parser);
+		cnt = jsmn_parse(&parser, js, len, t, cnt);
+	}
+
+	int rtn = 0;
+	int spans = 0, poser_spans = 0, delivery_spans = 0, config_spans = 0;
+	if (t == 0 || cnt <= 0 || t[0].type != JSMN_OBJECT || t[0].end != (int)strlen(js) - 1) {
+		fprintf(stderr, "Trace isn't a single JSON object (%d)\n", cnt);
+		rtn = survive_test_assert();
+	} else {
+		int i = 1;
+		while (i < cnt && !token_is(js, &t[i], "traceEvents"))
+			i = skip_token(t, i + 1, cnt);
+
+		if (i + 1 >= cnt || t[i + 1].type != JSMN_ARRAY) {
+			fprintf(stderr, "Trace has no traceEvents array\n");
+			rtn = survive_test_assert();
+		} else {
+			int events = t[i + 1].size;
+			int e = i + 2;
+			for (int n = 0; n < events && rtn == 0; n++) {
+				if (t[e].type != JSMN_OBJECT) {
+					fprintf(stderr, "Trace event %d isn't an object\n", n);
+					rtn = survive_test_assert();
+					break;
+				}
+
+				bool has_name = false, has_tid = false, has_ts = false, is_span = false, is_poser = false,
+					 is_delivery = false, is_config = false;
+				int keys = t[e].size;
+				int k = e + 1;
+				for (int key = 0; key < keys; key++) {
+					has_name |= token_is(js, &t[k], "name");
+					has_tid |= token_is(js, &t[k], "tid");
+					has_ts |= token_is(js, &t[k], "ts");
+					if (token_is(js, &t[k], "ph"))
+						is_span = js[t[k + 1].start] == 'X';
+					if (token_is(js, &t[k], "name")) {
+						is_poser = token_is(js, &t[k + 1], "poser");
+						is_delivery = token_is(js, &t[k + 1], "pose-delivery");
+						is_config = token_is(js, &t[k + 1], "config-save");
+					}
+					k = skip_token(t, k + 1, cnt);
+				}
+
+				if (!has_name || !has_tid || (is_span && !has_ts)) {
+					fprintf(stderr, "Trace event %d is missing fields\n", n);
+					rtn = survive_test_assert();
+				}
+				spans += is_span;
+				poser_spans += is_span && is_poser;
+				delivery_spans += is_span && is_delivery;
+				config_spans += is_span && is_config;
+				e = k;
+			}
+		}
+	}
+
+	if (rtn == 0 && (spans == 0 || poser_spans == 0 || delivery_spans == 0 || config_spans == 0)) {
+		fprintf(stderr, "Trace has %d spans; %d poser, %d pose delivery, %d config save\n", spans, poser_spans,
+				delivery_spans, config_spans);
+		rtn = survive_test_assert();
+	}
+
+	free(t);
+	free(js);
+	return rtn;
+}
+
+// Span and object names go into the trace as JSON strings, whatever characters they have
+TEST(Playback, TraceEscapesNames) {
+	const char *config = "trace_escape_test.json";
+	const char *trace = "trace_escape_test.trace.json";
+	remove(config);
+	char *args[] = {"survive_tests", "--configfile", (char *)config, "--trace", (char *)trace};
+	SurviveContext *ctx = survive_init(sizeof(args) / sizeof(args[0]), args);
+	if (ctx == 0)
+		return survive_test_assert();
+	survive_install_trace(ctx); // As survive_startup would, without starting any drivers
+	uint64_t now = survive_latency_now_ns();
+	survive_trace_span(ctx, "a \"quoted\" span", "back\\slash\n", now, now + 1000);
+	survive_close(ctx);
+
+	size_t len = 0;
+	char *js = read_file(trace, &len);
+	remove(config);
+	remove(trace);
+	if (js == 0)
+		return survive_test_assert();
+
+	jsmn_parser parser;
+	jsmn_init(&parser);
+	int cnt = jsmn_parse(&parser, js, len, 0, 0);
+
+	int rtn = 0;
+	EXPECT(rtn, cnt > 0);
+	EXPECT(rtn, strstr(js, "\"name\":\"a \\\"quoted\\\" span\"") != 0);
+	EXPECT(rtn, strstr(js, "\"object\":\"back\\\\slash\\u000a\"") != 0);
+	free(js);
+	return rtn;
+}
+
+// Poses within this distance of the ground truth count as close
+#define ACCURACY_CLOSE_ENOUGH .05
+
+typedef struct {
+	SurvivePose gt;
+	bool has_gt;
+	size_t cnt, close;
+	FLT error_total;
+	double seconds;
+	SurviveObjectCounters counters;
+} AccuracyLog;
+
+static void accuracy_pose_fn(SurviveObject *so, survive_timecode timecode, SurvivePose *pose) {
+	AccuracyLog *log = so->ctx->user_ptr;
+	if (log->has_gt && strcmp(so->codename, "SM0") == 0) {
+		FLT error = dist3d(pose->Pos, log->gt.Pos);
+		log->error_total += error;
+		log->close += error < ACCURACY_CLOSE_ENOUGH;
+		log->cnt++;
+	}
+	survive_default_raw_pose_process(so, timecode, pose);
+}
+
+static void accuracy_external_pose_fn(SurviveContext *ctx, const char *name, const SurvivePose *pose) {
+	AccuracyLog *log = ctx->user_ptr;
+	if (strcmp(name, "Sim_GT") == 0) {
+		log->gt = *pose;
+		log->has_gt = true;
+	}
+	survive_default_external_pose_process(ctx, name, pose);
+}
+
+static int run_for_accuracy(int argc, char *const *argv, AccuracyLog *log) {
+	SurviveContext *ctx = survive_init(argc, argv);
+	if (ctx == 0)
+		return -1;
+
+	ctx->user_ptr = log;
+	survive_install_pose_fn(ctx, accuracy_pose_fn);
+	survive_install_external_pose_fn(ctx, accuracy_external_pose_fn);
+	survive_startup(ctx);
+	double start = OGGetAbsoluteTime();
+	while (survive_poll(ctx) == 0) {
+	}
+	log->seconds = OGGetAbsoluteTime() - start;
+
+	SurviveObject *so = survive_get_so_by_name(ctx, "SM0");
+	if (so)
+		survive_object_counters(so, &log->counters);
+	survive_close(ctx);
+	return so ? 0 : -1;
+}
+
+// Replays a simulation where sensors facing away from a lighthouse sometimes see a reflection of its sweep, with and
+// without the visibility filter. The filter should drop those angles without making the solution any worse.
+TEST(Playback, VisibilityFilter) {
+	const char *recording = "visibility_filter_test.rec";
+	const char *config = "visibility_filter_test.json";
+	remove(config);
+
+	ASSERT_SUCCESS(record_reflection_simulator(recording, config));
+
+	char *unfiltered_args[] = {"survive_tests", "--playback",	  (char *)recording,	"--deterministic",
+							   "--configfile",  (char *)config, "--disable-calibrate"};
+	char *filtered_args[] = {"survive_tests",		"--playback",		 (char *)recording, "--deterministic",
+							 "--configfile",		(char *)config,		 "--disable-calibrate",
+							 "--visibility-filter", "1"};
+	AccuracyLog unfiltered = {0}, filtered = {0};
+	int rtn = run_for_accuracy(sizeof(unfiltered_args) / sizeof(unfiltered_args[0]), unfiltered_args, &unfiltered);
+	if (rtn == 0)
+		rtn = run_for_accuracy(sizeof(filtered_args) / sizeof(filtered_args[0]), filtered_args, &filtered);
+	remove(recording);
+	remove(config);
+	ASSERT_SUCCESS(rtn);
+
+	FLT unfiltered_error = unfiltered.cnt ? unfiltered.error_total / unfiltered.cnt : 0;
+	FLT filtered_error = filtered.cnt ? filtered.error_total / filtered.cnt : 0;
+	fprintf(stderr,
+			"Unfiltered: %u angles, %u seed runs, %u failures, %u poses, %.4fm mean error\n"
+			"Filtered:   %u angles (%u rejected), %u seed runs, %u failures, %u poses, %.4fm mean error\n",
+			(unsigned)unfiltered.counters.angles, (unsigned)unfiltered.counters.solver_seed_runs,
+			(unsigned)unfiltered.counters.solver_failures, (unsigned)unfiltered.cnt, unfiltered_error,
+			(unsigned)filtered.counters.angles, (unsigned)filtered.counters.angles_rejected,
+			(unsigned)filtered.counters.solver_seed_runs, (unsigned)filtered.counters.solver_failures,
+			(unsigned)filtered.cnt, filtered_error);
+
+	EXPECT(rtn, unfiltered.counters.angles_rejected == 0);
+	EXPECT(rtn, filtered.counters.angles_rejected > 0);
+	EXPECT(rtn, filtered.counters.angles + filtered.counters.angles_rejected == unfiltered.counters.angles);
+	EXPECT(rtn, filtered.counters.solver_seed_runs <= unfiltered.counters.solver_seed_runs);
+	EXPECT(rtn, unfiltered.cnt > 0 && filtered.cnt > 0);
+	EXPECT(rtn, filtered_error <= unfiltered_error);
+	return rtn;
+}
+
+// Replays a simulation with reflections through EPNP on its own, as it is used for seeding, with and without RANSAC.
+// Leaving the reflected measurements out should at least halve the share of poses that are far off.
+TEST(Playback, EPNPRansac) {
+	const char *recording = "epnp_ransac_test.rec";
+	const char *config = "epnp_ransac_test.json";
+	remove(config);
+
+	ASSERT_SUCCESS(record_reflection_simulator(recording, config));
+
+	char *plain_args[] = {"survive_tests", "--playback",		 (char *)recording,		"--deterministic",
+						  "--configfile",  (char *)config,	 "--disable-calibrate", "--defaultposer",
+						  "EPNP"};
+	char *ransac_args[] = {"survive_tests", "--playback",			(char *)recording,	   "--deterministic",
+						   "--configfile",  (char *)config,		"--disable-calibrate", "--defaultposer",
+						   "EPNP",			"--epnp-ransac",		"1"};
+	AccuracyLog plain = {0}, ransac = {0};
+	int rtn = run_for_accuracy(sizeof(plain_args) / sizeof(plain_args[0]), plain_args, &plain);
+	if (rtn == 0)
+		rtn = run_for_accuracy(sizeof(ransac_args) / sizeof(ransac_args[0]), ransac_args, &ransac);
+	remove(recording);
+	remove(config);
+	ASSERT_SUCCESS(rtn);
+
+	fprintf(stderr,
+			"Plain:  %u/%u poses within %.2fm, %.3fs\n"
+			"RANSAC: %u/%u poses within %.2fm, %.3fs; %u inliers, %u outliers\n",
+			(unsigned)plain.close, (unsigned)plain.cnt, ACCURACY_CLOSE_ENOUGH, plain.seconds, (unsigned)ransac.close,
+			(unsigned)ransac.cnt, ACCURACY_CLOSE_ENOUGH, ransac.seconds, (unsigned)ransac.counters.epnp_inliers,
+			(unsigned)ransac.counters.epnp_outliers);
+
+	EXPECT(rtn, plain.counters.epnp_outliers == 0);
+	EXPECT(rtn, ransac.counters.epnp_outliers > 0);
+	EXPECT(rtn, plain.cnt > 0 && ransac.cnt > 0);
+	EXPECT(rtn, 2 * (ransac.cnt - ransac.close) * plain.cnt < (plain.cnt - plain.close) * ransac.cnt);
+	return rtn;
+}
+
+// Replays a simulation with reflections through MPFIT with each robust loss. Solves are still checked against
+// max-error with the plain sum of squares, so the reflections get about as many of them rejected; the poses that come
+// out should be closer to the truth than with plain least squares, and never cost extra reseeds. Tukey's loss is only
+// run to be reported; it ignores everything once a solve starts far enough off, so it isn't held to the others'
+// accuracy.
+static const char *robust_losses[] = {"none", "huber", "cauchy", "tukey"};
+#define ROBUST_LOSS_CNT (sizeof(robust_losses) / sizeof(robust_losses[0]))
+
+TEST(Playback, RobustLoss) {
+	const char *recording = "robust_loss_test.rec";
+	const char *config = "robust_loss_test.json";
+	remove(config);
+
+	ASSERT_SUCCESS(record_reflection_simulator(recording, config));
+
+	AccuracyLog logs[ROBUST_LOSS_CNT] = {0};
+	int rtn = 0;
+	for (size_t i = 0; rtn == 0 && i < ROBUST_LOSS_CNT; i++) {
+		char *args[] = {"survive_tests", "--playback",		   (char *)recording,		  "--deterministic",
+						"--configfile",  (char *)config,	   "--disable-calibrate",	  "--optimizer-loss",
+						(char *)robust_losses[i]};
+		rtn = run_for_accuracy(sizeof(args) / sizeof(args[0]), args, &logs[i]);
+	}
+	remove(recording);
+	remove(config);
+	ASSERT_SUCCESS(rtn);
+
+	for (size_t i = 0; i < ROBUST_LOSS_CNT; i++) {
+		const AccuracyLog *log = &logs[i];
+		fprintf(stderr,
+				"%-6s: %u solves, %u iterations, %u failures, %u seed runs, %u poses, %.4fm mean error, %.3fs\n",
+				robust_losses[i], (unsigned)log->counters.solver_runs, (unsigned)log->counters.solver_iterations,
+				(unsigned)log->counters.solver_failures, (unsigned)log->counters.solver_seed_runs, (unsigned)log->cnt,
+				log->cnt ? log->error_total / log->cnt : 0, log->seconds);
+	}
+
+	const AccuracyLog *none = &logs[0], *huber = &logs[1], *cauchy = &logs[2];
+	EXPECT(rtn, none->cnt > 0 && huber->cnt > 0 && cauchy->cnt > 0);
+	EXPECT(rtn, huber->counters.solver_seed_runs <= none->counters.solver_seed_runs);
+	EXPECT(rtn, cauchy->counters.solver_seed_runs <= none->counters.solver_seed_runs);
+	EXPECT(rtn, 2 * huber->error_total / huber->cnt < none->error_total / none->cnt);
+	EXPECT(rtn, cauchy->error_total / cauchy->cnt < none->error_total / none->cnt);
+	return rtn;
+}
@@ -5,6 +5,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 typedef struct {
 	LinmathPoint3d pt;
@@ -58,3 +59,107 @@ TEST(Reproject, Extents) {
 
 	return 0;
 }
+
+TEST(Reproject, JacLhPoseMatchesFiniteDifference) {
+	BaseStationCal cal[2] = {{.phase = .01, .tilt = .02, .curve = .03, .gibpha = .4, .gibmag = .005},
+							 {.phase = -.02, .tilt = -.01, .curve = .02, .gibpha = 1.1, .gibmag = -.004}};
+
+	// The last pose has a quaternion that is not unit length; SBA does not normalize its parameters between steps
+	SurvivePose lh2worlds[] = {
+		{.Pos = {1, 1, 1}, .Rot = {0, 0, 1, 0}},
+		{.Pos = {-1.2, 2.1, .4}, .Rot = {.9, .2, -.3, .1}},
+		{.Pos = {2, -1, 2.5}, .Rot = {.3, -.8, .4, .25}},
+	};
+	const LinmathPoint3d pts[] = {{0, 0, -1}, {.3, .2, .1}, {-.5, .1, .4}};
+
+	for (int p = 0; p < sizeof(lh2worlds) / sizeof(lh2worlds[0]); p++) {
+		if (p < 2)
+			quatnormalize(lh2worlds[p].Rot, lh2worlds[p].Rot);
+
+		for (int s = 0; s < sizeof(pts) / sizeof(pts[0]); s++) {
+			// Keep the point in front of the lighthouse (-Z in its frame)
+			LinmathPoint3d ptInWorld, front = {0, 0, -2};
+			quatrotatevector(front, lh2worlds[p].Rot, front);
+			add3d(ptInWorld, lh2worlds[p].Pos, front);
+			add3d(ptInWorld, ptInWorld, pts[s]);
+
+			FLT jac[14];
+			survive_reproject_full_jac_lh_pose(jac, &lh2worlds[p], ptInWorld, cal);
+
+			for (int k = 0; k < 7; k++) {
+				const FLT h = 1e-6;
+				SurvivePose plus = lh2worlds[p], minus = lh2worlds[p];
+				((FLT *)&plus)[k] += h;
+				((FLT *)&minus)[k] -= h;
+
+				SurvivePose world2lh;
+				SurviveAngleReading a, b;
+				InvertPose(&world2lh, &plus);
+				survive_reproject_from_pose_with_bcal(cal, &world2lh, ptInWorld, a);
+				InvertPose(&world2lh, &minus);
+				survive_reproject_from_pose_with_bcal(cal, &world2lh, ptInWorld, b);
+
+				ASSERT_DOUBLE_EQ(jac[k], (a[0] - b[0]) / (2 * h));
+				ASSERT_DOUBLE_EQ(jac[7 + k], (a[1] - b[1]) / (2 * h));
+			}
+		}
+	}
+
+	return 0;
+}
+
+TEST(Reproject, CalibrationTableMatchesExactInverse) {
+	BaseStationCal cal[2] = {{.phase = .05, .tilt = -.047, .curve = .02, .gibpha = 2.1, .gibmag = .006},
+							 {.phase = -.03, .tilt = .012, .curve = -.015, .gibpha = .7, .gibmag = -.004}};
+	const BaseStationCal ideal_cal[2] = {0};
+
+	SurviveCalibrationTable *table = malloc(sizeof(SurviveCalibrationTable));
+	survive_calibration_table_build(table, cal);
+
+	// Sweep points across the field of view; the inverse must recover what an ideal lighthouse would have measured
+	FLT max_exact_error = 0, max_table_error = 0;
+	for (int i = -40; i <= 40; i++) {
+		for (int j = -40; j <= 40; j++) {
+			LinmathPoint3d ptInLh = {tan(i * M_PI / 3. / 41.), tan(j * M_PI / 3. / 41.), -1};
+			SurviveAngleReading measured, expected, exact, tabled;
+			survive_reproject_xy(cal, ptInLh, measured);
+			survive_reproject_xy(ideal_cal, ptInLh, expected);
+
+			survive_reproject_invert_calibration(cal, measured, exact);
+			if (!survive_calibration_table_apply(table, measured, tabled))
+				continue;
+
+			for (int axis = 0; axis < 2; axis++) {
+				max_exact_error = fmax(max_exact_error, fabs(exact[axis] - expected[axis]));
+				max_table_error = fmax(max_table_error, fabs(tabled[axis] - exact[axis]));
+			}
+		}
+	}
+	fprintf(stderr, "Inverse error %g rad, table error %g rad\n", max_exact_error, max_table_error);
+	ASSERT_GT(1e-10, max_exact_error);
+	ASSERT_GT(5e-6, max_table_error);
+
+	SurviveAngleReading outside = {1.2, 0}, untouched = {7, 7};
+	if (survive_calibration_table_apply(table, outside, untouched) || untouched[0] != 7)
+		return survive_test_assert();
+
+	// Through the context, a table that no longer matches the calibration must not be used
+	SurviveContext *ctx = calloc(1, sizeof(SurviveContext));
+	memcpy(ctx->bsd[0].fcal, cal, sizeof(cal));
+	ctx->calibration_tables[0] = table;
+
+	SurviveAngleReading measured = {.3, -.2}, via_ctx, exact;
+	survive_apply_bsd_calibration(ctx, 0, measured, via_ctx);
+	survive_calibration_table_apply(table, measured, exact);
+	ASSERT_DOUBLE_ARRAY_EQ(2, via_ctx, exact);
+
+	ctx->bsd[0].fcal[1].tilt = .03;
+	survive_apply_bsd_calibration(ctx, 0, measured, via_ctx);
+	survive_reproject_invert_calibration(ctx->bsd[0].fcal, measured, exact);
+	if (via_ctx[0] != exact[0] || via_ctx[1] != exact[1])
+		return survive_test_assert();
+
+	free(ctx);
+	free(table);
+	return 0;
+}
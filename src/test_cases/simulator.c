@@ -0,0 +1,156 @@
+#include "test_case.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_OBJECTS 3
+
+typedef struct {
+	size_t cnt[SIM_OBJECTS];
+	uint64_t hash[SIM_OBJECTS];
+} SimLog;
+
+static void log_pose_fn(SurviveObject *so, survive_timecode timecode, SurvivePose *pose) {
+	SimLog *log = so->ctx->user_ptr;
+	for (int i = 0; i < SIM_OBJECTS && i < so->ctx->objs_ct; i++) {
+		if (so->ctx->objs[i] != so)
+			continue;
+
+		// FNV-1a over the pose bits; any difference in any pose changes it
+		const uint8_t *bytes = (const uint8_t *)pose;
+		uint64_t h = log->hash[i] ? log->hash[i] : 0xcbf29ce484222325ull;
+		for (size_t j = 0; j < sizeof(SurvivePose); j++)
+			h = (h ^ bytes[j]) * 0x100000001b3ull;
+		log->hash[i] = h;
+		log->cnt[i]++;
+	}
+
+	survive_default_raw_pose_process(so, timecode, pose);
+}
+
+static int run_simulator(SimLog *log) {
+	const char *config = "simulator_test.json";
+	remove(config);
+
+	char *args[] = {"survive_tests",
+					"--simulator",
+					"--simulator-objects",
+					"3",
+					"--simulator-occlusion",
+					".2",
+					"--simulator-time",
+					"3",
+					"--time-factor",
+					"0",
+					"--deterministic",
+					"--configfile",
+					(char *)config,
+					"--disable-calibrate"};
+	SurviveContext *ctx = survive_init(sizeof(args) / sizeof(args[0]), args);
+	if (ctx == 0)
+		return -1;
+
+	ctx->user_ptr = log;
+	survive_install_pose_fn(ctx, log_pose_fn);
+	survive_startup(ctx);
+
+	int rtn = 0;
+	if (ctx->objs_ct != SIM_OBJECTS || survive_get_so_by_name(ctx, "SM2") == 0) {
+		fprintf(stderr, "Expected %d simulated objects, got %d\n", SIM_OBJECTS, ctx->objs_ct);
+		rtn = survive_test_assert();
+	}
+
+	while (rtn == 0 && survive_poll(ctx) == 0) {
+	}
+	survive_close(ctx);
+	remove(config);
+	return rtn;
+}
+
+TEST(Simulator, MultiObjectDeterministic) {
+	SimLog first = {0}, second = {0};
+	ASSERT_SUCCESS(run_simulator(&first));
+	ASSERT_SUCCESS(run_simulator(&second));
+
+	for (int i = 0; i < SIM_OBJECTS; i++) {
+		if (first.cnt[i] == 0) {
+			fprintf(stderr, "Simulated object %d never got a pose\n", i);
+			return survive_test_assert();
+		}
+		if (first.cnt[i] != second.cnt[i] || first.hash[i] != second.hash[i]) {
+			fprintf(stderr, "Simulated object %d gave different poses between runs\n", i);
+			return survive_test_assert();
+		}
+	}
+	return 0;
+}
+
+#define SWAP_AFTER_POSES 100
+
+// Poses per object from a real solve; the dummy poser only ever reports the identity pose
+static void swap_pose_fn(SurviveObject *so, survive_timecode timecode, SurvivePose *pose) {
+	size_t *solved = so->ctx->user_ptr;
+	SurvivePose identity = LinmathPose_Identity;
+	if (memcmp(pose, &identity, sizeof(identity)) != 0)
+		solved[so->codename[2] - '0']++;
+	survive_default_raw_pose_process(so, timecode, pose);
+}
+
+// SM1 starts out on the dummy poser by way of 'poser-assignments'. Once SM0 has some poses the two trade posers
+// between polls; from then on only SM1 may get solved poses.
+TEST(Simulator, PoserHotSwap) {
+	const char *config = "simulator_swap_test.json";
+	remove(config);
+
+	char *args[] = {"survive_tests",
+					"--simulator",
+					"--simulator-objects",
+					"2",
+					"--simulator-time",
+					"3",
+					"--time-factor",
+					"0",
+					"--deterministic",
+					"--poser-assignments",
+					"XX?=SBA,SM1=Dummy",
+					"--configfile",
+					(char *)config,
+					"--disable-calibrate"};
+	SurviveContext *ctx = survive_init(sizeof(args) / sizeof(args[0]), args);
+	if (ctx == 0)
+		return -1;
+
+	size_t solved[2] = {0};
+	ctx->user_ptr = solved;
+	survive_install_pose_fn(ctx, swap_pose_fn);
+	survive_startup(ctx);
+
+	SurviveObject *sm0 = survive_get_so_by_name(ctx, "SM0"), *sm1 = survive_get_so_by_name(ctx, "SM1");
+	int rtn = 0;
+	if (sm0 == 0 || sm1 == 0 || sm0->PoserFn == sm1->PoserFn) {
+		fprintf(stderr, "SM1 should have its own poser\n");
+		rtn = survive_test_assert();
+	}
+
+	size_t swapped_at[2] = {0};
+	bool swapped = false;
+	while (rtn == 0 && survive_poll(ctx) == 0) {
+		if (!swapped && solved[0] >= SWAP_AFTER_POSES) {
+			if (survive_object_set_poser(sm0, "Dummy") != 0 || survive_object_set_poser(sm1, "MPFIT") != 0 ||
+				survive_object_set_poser(sm1, "NoSuchPoser") != -1) {
+				rtn = survive_test_assert();
+			}
+			memcpy(swapped_at, solved, sizeof(solved));
+			swapped = true;
+		}
+	}
+
+	if (rtn == 0 && (!swapped || swapped_at[1] != 0 || solved[0] != swapped_at[0] || solved[1] == 0)) {
+		fprintf(stderr, "Swapped at %d/%d solved poses; ended with %d/%d\n", (int)swapped_at[0], (int)swapped_at[1],
+				(int)solved[0], (int)solved[1]);
+		rtn = survive_test_assert();
+	}
+
+	survive_close(ctx);
+	remove(config);
+	return rtn;
+}
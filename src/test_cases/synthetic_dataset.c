@@ -0,0 +1,123 @@
+#include "../../tools/synthetic_dataset/synthetic_dataset.h"
+#include "test_case.h"
+#include <string.h>
+
+typedef struct {
+	int rejected;
+	int syncs, angles;
+
+	// Distance of each pose from the latest ground truth, written next to every IMU sample
+	SurvivePose gt;
+	bool has_gt;
+	int poses;
+	FLT error_total, error_max;
+
+	light_process_func light;
+	angle_process_func angle;
+	text_feedback_func warn;
+} ReplayLog;
+
+static void count_rejected_fn(SurviveContext *ctx, const char *fault) {
+	ReplayLog *log = ctx->user_ptr;
+	if (strstr(fault, "doesn't understand") || strstr(fault, "could not parse")) {
+		fprintf(stderr, "%s\n", fault);
+		log->rejected++;
+	}
+	log->warn(ctx, fault);
+}
+
+static void count_light_fn(SurviveObject *so, int sensor_id, int acode, int timeinsweep, survive_timecode timecode,
+						   survive_timecode length, uint32_t lh) {
+	ReplayLog *log = so->ctx->user_ptr;
+	log->syncs += sensor_id == -1;
+	log->light(so, sensor_id, acode, timeinsweep, timecode, length, lh);
+}
+
+static void count_angle_fn(SurviveObject *so, int sensor_id, int acode, survive_timecode timecode, FLT length,
+						   FLT angle, uint32_t lh) {
+	ReplayLog *log = so->ctx->user_ptr;
+	log->angles++;
+	log->angle(so, sensor_id, acode, timecode, length, angle, lh);
+}
+
+static void compare_pose_fn(SurviveObject *so, survive_timecode timecode, SurvivePose *pose) {
+	ReplayLog *log = so->ctx->user_ptr;
+	if (log->has_gt && strcmp(so->codename, "SY0") == 0) {
+		FLT error = dist3d(pose->Pos, log->gt.Pos);
+		log->error_total += error;
+		log->error_max = linmath_max(log->error_max, error);
+		log->poses++;
+	}
+	survive_default_raw_pose_process(so, timecode, pose);
+}
+
+static void record_gt_fn(SurviveContext *ctx, const char *name, const SurvivePose *pose) {
+	ReplayLog *log = ctx->user_ptr;
+	if (strcmp(name, "SY0_GT") == 0) {
+		log->gt = *pose;
+		log->has_gt = true;
+	}
+	survive_default_external_pose_process(ctx, name, pose);
+}
+
+// Poses replayed from a generated trajectory have to average within this of the ground truth, and all be within
+// SYNTHETIC_MAX_ERROR. A solve combines sweeps from up to 1/30s apart and is compared with ground truth up to an IMU
+// sample old, so the trajectory moves at a tenth of the usual speed to keep the motion in between out of the error.
+#define SYNTHETIC_MEAN_ERROR .005
+#define SYNTHETIC_MAX_ERROR .03
+
+// Every record the generator writes has to be one playback understands, with syncs arriving as syncs, and the poses
+// solved from it have to land on the ground truth written alongside.
+TEST(SyntheticDataset, PlaysBackToGroundTruth) {
+	const char *out = "synthetic_dataset_test";
+	char *generate_args[] = {"synthetic_dataset",	 "--synth-out",					(char *)out,
+							 "--synth-trajectories", "1",							"--synth-duration",
+							 "1",					 "--synth-speed",				".1",
+							 "--configfile",		 "synthetic_dataset_test.json"};
+	remove("synthetic_dataset_test.json");
+	SurviveContext *generator = survive_init(sizeof(generate_args) / sizeof(generate_args[0]), generate_args);
+	if (generator == 0)
+		return survive_test_assert();
+	int generated = synthetic_dataset_generate(generator);
+	survive_close(generator);
+	ASSERT_SUCCESS(generated);
+
+	char recording[256], config[256];
+	snprintf(recording, sizeof(recording), "%s/trajectory_0000.rec", out);
+	snprintf(config, sizeof(config), "%s/trajectory_0000.json", out);
+	char *playback_args[] = {"survive_tests", "--playback", recording, "--playback-factor", "0", "--configfile", config};
+	SurviveContext *ctx = survive_init(sizeof(playback_args) / sizeof(playback_args[0]), playback_args);
+	if (ctx == 0)
+		return survive_test_assert();
+
+	ReplayLog log = {.warn = ctx->warnfunction};
+	ctx->user_ptr = &log;
+	ctx->warnfunction = count_rejected_fn;
+	survive_install_pose_fn(ctx, compare_pose_fn);
+	survive_install_external_pose_fn(ctx, record_gt_fn);
+	survive_startup(ctx);
+	log.light = ctx->lightproc;
+	log.angle = ctx->angleproc;
+	ctx->lightproc = count_light_fn;
+	ctx->angleproc = count_angle_fn;
+	while (survive_poll(ctx) == 0) {
+	}
+	survive_close(ctx);
+
+	remove(recording);
+	remove(config);
+	remove(out);
+	remove("synthetic_dataset_test.json");
+
+	fprintf(stderr, "%d poses, %.4fm mean and %.4fm largest error\n", log.poses,
+			log.poses ? log.error_total / log.poses : 0, log.error_max);
+
+	int rtn = 0;
+	EXPECT(rtn, log.rejected == 0);
+	EXPECT(rtn, log.syncs > 0);
+	EXPECT(rtn, log.angles > 0);
+	EXPECT(rtn, log.poses > 0);
+	EXPECT(rtn, log.error_total < SYNTHETIC_MEAN_ERROR * log.poses);
+	EXPECT(rtn, log.error_max < SYNTHETIC_MAX_ERROR);
+	return rtn;
+}
@@ -6,10 +6,19 @@ static inline int survive_test_assert() { return -1; }
 #define ASSERT_SUCCESS(x)                                                                                              \
 	{                                                                                                                  \
 		int error = (x);                                                                                               \
-		if (x < 0)                                                                                                     \
-			return x;                                                                                                  \
+		if (error < 0)                                                                                                 \
+			return error;                                                                                              \
 	}
 
+// Non-fatal check: logs the failed condition and sets 'result', which the test returns once it has cleaned up
+#define EXPECT(result, cond)                                                                                           \
+	do {                                                                                                               \
+		if (!(cond)) {                                                                                                 \
+			fprintf(stderr, "Expected " #cond "\n");                                                                   \
+			(result) = survive_test_assert();                                                                          \
+		}                                                                                                              \
+	} while (0)
+
 #define ASSERT_DOUBLE_EQ(val1, val2)                                                                                   \
 	if (fabs((val1) - (val2)) > 0.00001) {                                                                             \
 		fprintf(stderr, "Assert failed: " #val1 " != " #val2 ": %f != %f (%f)\n", val1, val2, fabs((val1) - (val2)));  \
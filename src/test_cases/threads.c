@@ -0,0 +1,139 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "os_generic.h"
+#include "test_case.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+TEST(Threads, ParseCpuList) {
+	bool cpus[8];
+	ASSERT_DOUBLE_EQ((double)survive_parse_cpu_list("0,2-3", cpus, 8), 3.);
+	ASSERT_GT((double)(cpus[0] && !cpus[1] && cpus[2] && cpus[3] && !cpus[4]), 0.);
+	ASSERT_DOUBLE_EQ((double)survive_parse_cpu_list("1-2,2,7", cpus, 8), 3.);
+	ASSERT_DOUBLE_EQ((double)survive_parse_cpu_list("", cpus, 8), 0.);
+
+	const char *malformed[] = {"8", "3-1", "a", "1,,2", "1-", "-1", "2 3"};
+	for (int i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+		if (survive_parse_cpu_list(malformed[i], cpus, 8) != -1) {
+			fprintf(stderr, "'%s' should not parse\n", malformed[i]);
+			return survive_test_assert();
+		}
+	}
+	return 0;
+}
+
+#ifdef __linux__
+static void *wait_for_release(void *sema) {
+	OGLockSema(sema);
+	return 0;
+}
+
+// The tests may be confined to some CPUs already, so they pin to the first one they are allowed on rather than CPU 0
+static int first_allowed_cpu() {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &set))
+			return cpu;
+	}
+	return 0;
+}
+
+static int native_thread_cpu_count(pthread_t thread, int cpu, bool *only_cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	pthread_getaffinity_np(thread, sizeof(set), &set);
+	*only_cpu = CPU_ISSET(cpu, &set) && CPU_COUNT(&set) == 1;
+	return CPU_COUNT(&set);
+}
+
+static int thread_cpu_count(og_thread_t thread, int cpu, bool *only_cpu) {
+	return native_thread_cpu_count(*(pthread_t *)thread, cpu, only_cpu);
+}
+
+// A null thread configures the calling one
+static int configure_poll_thread(const char *cpus, const char *priority, og_thread_t thread) {
+	const char *configfile = "threads_test.json";
+	remove(configfile);
+	char *args[] = {"survive_tests",		  "--configfile", (char *)configfile, "--poll-thread-cpus", (char *)cpus,
+					"--poll-thread-priority", (char *)priority};
+	SurviveContext *ctx = survive_init(sizeof(args) / sizeof(args[0]), args);
+	if (ctx == 0)
+		return -ENOENT;
+	int rtn = thread ? survive_thread_configure(ctx, thread, "poll") : survive_thread_configure_current(ctx, "poll");
+	survive_close(ctx);
+	remove(configfile);
+	return rtn;
+}
+
+// Pins a thread to the first CPU it may run on. Real-time priority is only checked for failing cleanly, since it
+// depends on the privileges the tests run with.
+TEST(Threads, ConfigureAffinityAndPriority) {
+	og_sema_t sema = OGCreateSema();
+	og_thread_t thread = OGCreateThread(wait_for_release, sema);
+
+	int cpu = first_allowed_cpu();
+	char cpus[16];
+	snprintf(cpus, sizeof(cpus), "%d", cpu);
+
+	bool only_cpu;
+	int cpu_ct = thread_cpu_count(thread, cpu, &only_cpu);
+
+	int rtn = 0;
+	int err = configure_poll_thread("not-a-cpu", "0", thread);
+	if (err != -EINVAL || thread_cpu_count(thread, cpu, &only_cpu) != cpu_ct) {
+		fprintf(stderr, "A bad CPU list gave %d and should leave the thread alone\n", err);
+		rtn = survive_test_assert();
+	}
+
+	err = configure_poll_thread(cpus, "0", thread);
+	thread_cpu_count(thread, cpu, &only_cpu);
+	if (rtn == 0 && (err != 0 || !only_cpu)) {
+		fprintf(stderr, "Pinning to CPU %d gave %d\n", cpu, err);
+		rtn = survive_test_assert();
+	}
+
+	err = configure_poll_thread("", "1", thread);
+	if (rtn == 0 && err != 0 && err != -EPERM) {
+		fprintf(stderr, "SCHED_FIFO priority 1 gave %d\n", err);
+		rtn = survive_test_assert();
+	}
+
+	OGUnlockSema(sema);
+	OGJoinThread(thread);
+	OGDeleteSema(sema);
+	return rtn;
+}
+
+typedef struct {
+	int cpu;
+	bool only_cpu;
+} PinSelf;
+
+static void *pin_self(void *_pin) {
+	PinSelf *pin = _pin;
+	char cpus[16];
+	snprintf(cpus, sizeof(cpus), "%d", pin->cpu);
+	if (configure_poll_thread(cpus, "0", 0) == 0)
+		native_thread_cpu_count(pthread_self(), pin->cpu, &pin->only_cpu);
+	return 0;
+}
+
+// Threads that didn't come from OGCreateThread configure themselves
+TEST(Threads, ConfigureCurrentThread) {
+	PinSelf pin = {.cpu = first_allowed_cpu()};
+	og_thread_t thread = OGCreateThread(pin_self, &pin);
+	OGJoinThread(thread);
+	ASSERT_GT((double)pin.only_cpu, 0.);
+	return 0;
+}
+#endif
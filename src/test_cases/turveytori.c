@@ -0,0 +1,76 @@
+#include "poser_turveytori.h"
+#include "test_case.h"
+#include <stdlib.h>
+
+static FLT random_between(uint64_t *state, FLT low, FLT high) {
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return low + (high - low) * (FLT)(*state >> 11) / (FLT)(1ull << 53);
+}
+
+static int compare_flts(const void *a, const void *b) {
+	FLT d = *(const FLT *)a - *(const FLT *)b;
+	return d < 0 ? -1 : d > 0;
+}
+
+static bool close_enough(FLT a, FLT b) { return FLT_FABS(a - b) <= 1e-6 * FLT_FABS(b) + 1e-9; }
+
+// The closed form fitness over the tori arrays has to match the trig version, torus by torus and summed up over the
+// best 70% the way the poser did before, for a lighthouse seen by a tracker's worth of sensors.
+TEST(TurveyTori, SoAFitnessMatchesPerTorusFitness) {
+	uint64_t state = 42;
+	Point lh = {1.2, -.7, 2.5};
+
+	PointsAndAngle pna[MAX_POINT_PAIRS];
+	Point sensors[14];
+	size_t sensor_ct = sizeof(sensors) / sizeof(sensors[0]), pna_ct = 0;
+	for (size_t i = 0; i < sensor_ct; i++) {
+		sensors[i] = (Point){random_between(&state, -.08, .08), random_between(&state, -.08, .08),
+							 random_between(&state, -.03, .03)};
+		for (size_t j = 0; j < i && pna_ct < MAX_POINT_PAIRS; j++, pna_ct++) {
+			PointsAndAngle *p = &pna[pna_ct];
+			p->a = sensors[i];
+			p->b = sensors[j];
+			FLT toA[3] = {p->a.x - lh.x, p->a.y - lh.y, p->a.z - lh.z};
+			FLT toB[3] = {p->b.x - lh.x, p->b.y - lh.y, p->b.z - lh.z};
+			p->angle = anglebetween3d(toA, toB);
+			p->tanAngle = FLT_TAN(p->angle);
+			p->rotation = GetRotationMatrixForTorus(p->a, p->b);
+			p->invRotation = inverseM33(p->rotation);
+		}
+	}
+
+	ToriSoA tori;
+	buildToriSoA(&tori, pna, pna_ct);
+
+	int rtn = 0;
+	for (int trial = 0; trial < 200 && rtn == 0; trial++) {
+		// Start at the lighthouse and then wander out to where the gradient descent starts from
+		FLT spread = trial * .05;
+		Point point = {lh.x + random_between(&state, -spread, spread), lh.y + random_between(&state, -spread, spread),
+					   lh.z + random_between(&state, -spread, spread)};
+
+		FLT squared[MAX_POINT_PAIRS], expected[MAX_POINT_PAIRS];
+		getPointFitnessesSquared(squared, point, &tori);
+		for (size_t i = 0; i < pna_ct; i++) {
+			expected[i] = FLT_FABS(getPointFitnessForPna(point, &pna[i]));
+			if (!close_enough(FLT_SQRT(squared[i]), expected[i])) {
+				fprintf(stderr, "Torus %d at trial %d: %.12f != %.12f\n", (int)i, trial, FLT_SQRT(squared[i]),
+						expected[i]);
+				rtn = survive_test_assert();
+			}
+			expected[i] *= expected[i];
+		}
+
+		qsort(expected, pna_ct, sizeof(FLT), compare_flts);
+		FLT sum = 0;
+		for (int i = 0; i < (int)(pna_ct * .7); i++)
+			sum += expected[i];
+		// The fitness is the reciprocal, which blows up at the lighthouse, so compare the sums it comes from
+		FLT fitness = getPointFitness(point, &tori), fitness_sum = 1 / (fitness * fitness);
+		if (!close_enough(fitness_sum, sum)) {
+			fprintf(stderr, "Fitness sum at trial %d: %.12f != %.12f\n", trial, fitness_sum, sum);
+			rtn = survive_test_assert();
+		}
+	}
+	return rtn;
+}
@@ -0,0 +1,204 @@
+#include "test_case.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "../driver_vive.h"
+
+#define IMU_PACKETS 300
+#define LIGHTCAP_PACKETS 300
+#define BUTTON_PACKETS 100
+
+static const char config[] = "{\"lighthouse_config\":{"
+							 "\"modelPoints\":[[0,0,0],[0.02,0,0],[0,0.02,0],[0,0,0.02]],"
+							 "\"modelNormals\":[[0,0,1],[1,0,0],[0,1,0],[0,0,1]]}}";
+
+static void write_device_record(FILE *f, const char *codename, uint8_t type, int iface, double time, const void *data,
+								size_t length) {
+	SurviveUSBCaptureRecord record = {.time = time, .length = length, .type = type, .iface = iface};
+	strcpy(record.codename, codename);
+	fwrite(&record, sizeof(record), 1, f);
+	if (length)
+		fwrite(data, length, 1, f);
+}
+
+static void write_record(FILE *f, uint8_t type, int iface, double time, const void *data, size_t length) {
+	write_device_record(f, "WW0", type, iface, time, data, length);
+}
+
+// Synthesizes a wired watchman capture, with packets laid out the way survive_data_cb reads them
+static void write_capture(const char *fn) {
+	FILE *f = fopen(fn, "wb");
+	fwrite(SURVIVE_USB_CAPTURE_MAGIC, strlen(SURVIVE_USB_CAPTURE_MAGIC), 1, f);
+	write_record(f, SURVIVE_USB_CAPTURE_CONFIG, 0, 0, config, strlen(config));
+
+	uint8_t imu_code = 0;
+	uint32_t timecode = 1000;
+	for (int p = 0; p < IMU_PACKETS + LIGHTCAP_PACKETS + BUTTON_PACKETS; p++) {
+		uint8_t packet[64] = {0};
+		double time = p * .001;
+
+		if (p < IMU_PACKETS) {
+			packet[0] = 32;
+			for (int s = 0; s < 3; s++) {
+				uint8_t *sample = packet + 1 + s * 17;
+				int16_t agm[6] = {0, 0, 4096, 0, 0, 0};
+				memcpy(sample, agm, sizeof(agm));
+				memcpy(sample + 12, &timecode, sizeof(timecode));
+				sample[16] = ++imu_code;
+				timecode += 16000;
+			}
+			write_record(f, SURVIVE_USB_CAPTURE_PACKET, USB_IF_W_WATCHMAN1_IMU, time, packet, 52);
+		} else if (p < IMU_PACKETS + LIGHTCAP_PACKETS) {
+			packet[0] = 33;
+			for (int i = 0; i < 7; i++) {
+				uint8_t *le = packet + 1 + i * 8;
+				uint16_t sensor = i % 4, length = 1000 + i;
+				memcpy(le, &sensor, 2);
+				memcpy(le + 2, &length, 2);
+				memcpy(le + 4, &timecode, 4);
+				timecode += 2000;
+			}
+			write_record(f, SURVIVE_USB_CAPTURE_PACKET, USB_IF_W_WATCHMAN1_LIGHTCAP, time, packet, 57);
+		} else {
+			// Toggle one button per packet; trigger and touchpad stay put so each packet is exactly one event
+			packet[0] = 1;
+			packet[2] = 1;
+			uint32_t pressed = ((p + 1) & 1) << 2;
+			memcpy(packet + 8, &pressed, sizeof(pressed));
+			write_record(f, SURVIVE_USB_CAPTURE_PACKET, USB_IF_W_WATCHMAN1_BUTTONS, time, packet, 64);
+		}
+	}
+	fclose(f);
+}
+
+TEST(USBReplay, FeedsVivePacketParsers) {
+	const char *capture = "usb_replay_test.usb";
+	const char *configfile = "usb_replay_test.json";
+	write_capture(capture);
+	remove(configfile);
+
+	char *args[] = {"survive_tests", "--usbreplay",			(char *)capture, "--deterministic",
+					"--configfile",  (char *)configfile, "--disable-calibrate"};
+	SurviveContext *ctx = survive_init(sizeof(args) / sizeof(args[0]), args);
+	if (ctx == 0)
+		return -1;
+	survive_startup(ctx);
+
+	int rtn = 0;
+	SurviveObject *so = survive_get_so_by_name(ctx, "WW0");
+	if (so == 0 || so->sensor_ct != 4) {
+		fprintf(stderr, "Expected WW0 with 4 sensors from the capture's config\n");
+		rtn = survive_test_assert();
+	}
+
+	while (rtn == 0 && survive_poll(ctx) == 0) {
+	}
+
+	if (rtn == 0) {
+		SurviveObjectCounters counters;
+		survive_object_counters(so, &counters);
+		if (counters.packets != IMU_PACKETS + LIGHTCAP_PACKETS + BUTTON_PACKETS || counters.imu != 3 * IMU_PACKETS ||
+			counters.lightcaps != 7 * LIGHTCAP_PACKETS || counters.buttons != BUTTON_PACKETS) {
+			fprintf(stderr, "Replay gave %d packets, %d imu, %d lightcaps, %d buttons\n", (int)counters.packets,
+					(int)counters.imu, (int)counters.lightcaps, (int)counters.buttons);
+			rtn = survive_test_assert();
+		}
+	}
+
+	survive_close(ctx);
+	remove(capture);
+	remove(configfile);
+	return rtn;
+}
+
+#define HOTPLUG_PACKETS 50
+
+static void write_lightcap_packets(FILE *f, const char *codename, double start, int count) {
+	uint32_t timecode = 1000;
+	for (int p = 0; p < count; p++) {
+		uint8_t packet[64] = {33};
+		for (int i = 0; i < 7; i++) {
+			uint8_t *le = packet + 1 + i * 8;
+			uint16_t sensor = i % 4, length = 1000 + i;
+			memcpy(le, &sensor, 2);
+			memcpy(le + 2, &length, 2);
+			memcpy(le + 4, &timecode, 4);
+			timecode += 2000;
+		}
+		write_device_record(f, codename, SURVIVE_USB_CAPTURE_PACKET, USB_IF_W_WATCHMAN1_LIGHTCAP, start + p * .001,
+							packet, 57);
+	}
+}
+
+// Synthesizes what --usb-hotplug captures: WW0 is plugged in, pulled out and plugged back in, and WW1 only shows up
+// once everything is running. Packets sent while a device is unplugged must not reach it.
+static void write_hotplug_capture(const char *fn) {
+	FILE *f = fopen(fn, "wb");
+	fwrite(SURVIVE_USB_CAPTURE_MAGIC, strlen(SURVIVE_USB_CAPTURE_MAGIC), 1, f);
+
+	write_device_record(f, "WW0", SURVIVE_USB_CAPTURE_CONFIG, 0, 0, config, strlen(config));
+	write_device_record(f, "WW0", SURVIVE_USB_CAPTURE_ATTACH, 0, 0, 0, 0);
+	write_lightcap_packets(f, "WW0", .001, HOTPLUG_PACKETS);
+	write_device_record(f, "WW0", SURVIVE_USB_CAPTURE_DETACH, 0, .1, 0, 0);
+
+	write_device_record(f, "WW1", SURVIVE_USB_CAPTURE_CONFIG, 0, .2, config, strlen(config));
+	write_lightcap_packets(f, "WW1", .2, HOTPLUG_PACKETS);
+	write_device_record(f, "WW1", SURVIVE_USB_CAPTURE_ATTACH, 0, .3, 0, 0);
+	write_lightcap_packets(f, "WW1", .3, HOTPLUG_PACKETS);
+
+	write_device_record(f, "WW0", SURVIVE_USB_CAPTURE_CONFIG, 0, .4, config, strlen(config));
+	write_device_record(f, "WW0", SURVIVE_USB_CAPTURE_ATTACH, 0, .4, 0, 0);
+	write_lightcap_packets(f, "WW0", .4, HOTPLUG_PACKETS);
+	fclose(f);
+}
+
+static int check_connections(SurviveObject *so, int connections, int disconnections, int packets) {
+	SurviveObjectCounters counters;
+	survive_object_counters(so, &counters);
+	if (counters.connections != connections || counters.disconnections != disconnections ||
+		counters.packets != packets || so->sensor_ct != 4 || so->PoserFn == 0) {
+		fprintf(stderr, "%s: %d connections, %d disconnections, %d packets, %d sensors, poser %p\n", so->codename,
+				(int)counters.connections, (int)counters.disconnections, (int)counters.packets, so->sensor_ct,
+				so->PoserFn);
+		return survive_test_assert();
+	}
+	return 0;
+}
+
+TEST(USBReplay, HotplugArrivalAndRemoval) {
+	const char *capture = "usb_replay_hotplug_test.usb";
+	const char *configfile = "usb_replay_hotplug_test.json";
+	write_hotplug_capture(capture);
+	remove(configfile);
+
+	char *args[] = {"survive_tests", "--usbreplay",			(char *)capture, "--deterministic",
+					"--configfile",  (char *)configfile, "--disable-calibrate"};
+	SurviveContext *ctx = survive_init(sizeof(args) / sizeof(args[0]), args);
+	if (ctx == 0)
+		return -1;
+	survive_startup(ctx);
+
+	int rtn = 0;
+	if (ctx->objs_ct != 0) {
+		fprintf(stderr, "No device should exist before its attach record\n");
+		rtn = survive_test_assert();
+	}
+
+	while (rtn == 0 && survive_poll(ctx) == 0) {
+	}
+
+	SurviveObject *ww0 = survive_get_so_by_name(ctx, "WW0"), *ww1 = survive_get_so_by_name(ctx, "WW1");
+	if (rtn == 0 && (ctx->objs_ct != 2 || ww0 == 0 || ww1 == 0)) {
+		fprintf(stderr, "Expected WW0 and WW1 once the replay is done, got %d objects\n", ctx->objs_ct);
+		rtn = survive_test_assert();
+	}
+	if (rtn == 0)
+		rtn = check_connections(ww0, 2, 1, 2 * HOTPLUG_PACKETS);
+	if (rtn == 0)
+		rtn = check_connections(ww1, 1, 0, HOTPLUG_PACKETS);
+
+	survive_close(ctx);
+	remove(capture);
+	remove(configfile);
+	return rtn;
+}
@@ -0,0 +1,116 @@
+// Measures what the precomputed calibration table saves per measurement, and how far it is from the exact model.
+//
+// Usage: calibration_table [measurements] [repeats]
+//
+// Measurements are spread over the lighthouse's field of view. Each line of the table is the best of 'repeats' passes
+// over all of them:
+//  - invert exact: survive_reproject_invert_calibration, what a poser would need to correct angles exactly
+//  - invert table: survive_calibration_table_apply on a table built from the same calibration
+//  - invert phase: the phase only correction survive_apply_bsd_calibration does without a table
+//  - model full:   survive_reproject_xy with the calibration, as evaluated for every residual by the posers
+//  - model ideal:  the same projection with no calibration terms, which is all a poser needs on corrected angles
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "survive_reproject.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const BaseStationCal cal[2] = {{.phase = .05, .tilt = -.047, .curve = .02, .gibpha = 2.1, .gibmag = .006},
+									  {.phase = -.03, .tilt = .012, .curve = -.015, .gibpha = .7, .gibmag = -.004}};
+
+// Keeps the compiler from dropping the loops being timed
+static volatile FLT sink;
+
+static void ideal_xy(const LinmathPoint3d ptInLh, SurviveAngleReading out) {
+	out[0] = atan2(-ptInLh[2], ptInLh[0]) - LINMATHPI / 2.;
+	out[1] = atan2(-ptInLh[2], -ptInLh[1]) - LINMATHPI / 2.;
+}
+
+typedef enum { INVERT_EXACT, INVERT_TABLE, INVERT_PHASE, MODEL_FULL, MODEL_IDEAL, METHOD_COUNT } Method;
+static const char *method_names[] = {"invert exact", "invert table", "invert phase", "model full", "model ideal"};
+
+static double run(Method method, const SurviveCalibrationTable *table, const SurviveAngleReading *measured,
+				  const LinmathPoint3d *pts, int n) {
+	double start = now();
+	FLT total = 0;
+	for (int i = 0; i < n; i++) {
+		SurviveAngleReading out;
+		switch (method) {
+		case INVERT_EXACT:
+			survive_reproject_invert_calibration(cal, measured[i], out);
+			break;
+		case INVERT_TABLE:
+			survive_calibration_table_apply(table, measured[i], out);
+			break;
+		case INVERT_PHASE:
+			out[0] = measured[i][0] + cal[0].phase;
+			out[1] = measured[i][1] + cal[1].phase;
+			break;
+		case MODEL_FULL:
+			survive_reproject_xy(cal, pts[i], out);
+			break;
+		default:
+			ideal_xy(pts[i], out);
+			break;
+		}
+		total += out[0] + out[1];
+	}
+	sink = total;
+	return now() - start;
+}
+
+int main(int argc, char **argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 200000;
+	int repeats = argc > 2 ? atoi(argv[2]) : 5;
+	if (n < 1 || repeats < 1) {
+		fprintf(stderr, "Usage: %s [measurements] [repeats]\n", argv[0]);
+		return -1;
+	}
+
+	SurviveCalibrationTable *table = malloc(sizeof(SurviveCalibrationTable));
+	double build_start = now();
+	survive_calibration_table_build(table, cal);
+	double build_time = now() - build_start;
+
+	SurviveAngleReading *measured = malloc(sizeof(SurviveAngleReading) * n);
+	LinmathPoint3d *pts = malloc(sizeof(LinmathPoint3d) * n);
+	FLT max_error = 0;
+	srand(42);
+	for (int i = 0; i < n; i++) {
+		FLT ix = (2. * rand() / RAND_MAX - 1.) * LINMATHPI / 3.2, iy = (2. * rand() / RAND_MAX - 1.) * LINMATHPI / 3.2;
+		LinmathPoint3d pt = {-tan(ix), tan(iy), -1};
+		copy3d(pts[i], pt);
+		survive_reproject_xy(cal, pt, measured[i]);
+
+		SurviveAngleReading exact, tabled;
+		survive_reproject_invert_calibration(cal, measured[i], exact);
+		if (survive_calibration_table_apply(table, measured[i], tabled)) {
+			max_error = fmax(max_error, fmax(fabs(exact[0] - tabled[0]), fabs(exact[1] - tabled[1])));
+		}
+	}
+
+	printf("Table built in %.3f ms; largest difference from the exact inverse %.3g rad\n", build_time * 1000.,
+		   max_error);
+	printf("%-14s %10s\n", "method", "ns/meas");
+	for (int m = 0; m < METHOD_COUNT; m++) {
+		double best = 1e100;
+		for (int r = 0; r < repeats; r++) {
+			double t = run(m, table, measured, (const LinmathPoint3d *)pts, n);
+			best = t < best ? t : best;
+		}
+		printf("%-14s %10.1f\n", method_names[m], best * 1e9 / n);
+	}
+
+	free(measured);
+	free(pts);
+	free(table);
+	return 0;
+}
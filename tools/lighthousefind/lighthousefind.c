@@ -1,50 +1,98 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "linmath.h"
+#include "os_generic.h"
 #include <string.h>
 #include <stdint.h>
 #include <math.h>
+#include <unistd.h>
 
 #define PTS 32
 #define MAX_CHECKS 40000
 #define MIN_HITS_FOR_VALID 10
+#define MAX_THREADS 64
 
 FLT hmd_points[PTS*3];
 FLT hmd_norms[PTS*3];
-FLT hmd_point_angles[PTS*2];
-int hmd_point_counts[PTS*2];
-int best_hmd_target = 0;
-int LoadData( char Camera, const char * FileData );
 
-//Values used for RunTest()
-FLT LighthousePos[3] = { 0, 0, 0 };
-FLT LighthouseQuat[4] = { 1, 0, 0, 0 };
+//One lighthouse's view of the HMD, loaded from one processed data file.
+typedef struct
+{
+	const char * datafile;
+	FLT point_angles[PTS*2];
+	int point_counts[PTS*2];
 
-FLT RunOpti( int print );
-FLT RunTest( int print );
-void PrintOpti();
+	//Results
+	FLT pos[3];
+	FLT quat[4];
+	FLT rms;
+	double seconds;
+} Capture;
 
-int main( int argc, char ** argv )
+int LoadPoints();
+int LoadData( char Camera, const char * FileData, Capture * c );
+
+FLT RunOpti( const Capture * c, const FLT * LighthousePos, FLT * LighthouseQuat, int print );
+FLT RunTest( const Capture * c, const FLT * LighthousePos, const FLT * LighthouseQuat, int print );
+
+//Candidate lighthouse positions of one search cycle, split into contiguous runs, one per thread.
+typedef struct
 {
+	const Capture * c;
+	const FLT * candidates;
+	FLT * errors;
+	int start, end;
+} SearchJob;
+
+static void * SearchWorker( void * v )
+{
+	SearchJob * job = v;
 	int i;
+	for( i = job->start; i < job->end; i++ )
+	{
+		FLT quat[4];
+		job->errors[i] = RunOpti( job->c, &job->candidates[i*3], quat, 0 );
+	}
+	return 0;
+}
+
+static void Search( const Capture * c, const FLT * candidates, FLT * errors, int count, int threads )
+{
+	SearchJob jobs[MAX_THREADS];
+	og_thread_t handles[MAX_THREADS];
+	int t;
 
-	if( argc != 3 )
+	if( threads > count ) threads = count;
+	for( t = 0; t < threads; t++ )
 	{
-		fprintf( stderr, "Error: usage: camfind [camera (L or R)] [datafile]\n" );
-		exit( -1 );
+		jobs[t] = (SearchJob){ c, candidates, errors, (int)((long)count * t / threads), (int)((long)count * (t+1) / threads) };
 	}
 
-	//Load either 'L' (LH1) or 'R' (LH2) data.
-	if( LoadData( argv[1][0], argv[2] ) ) return 5;
+	for( t = 1; t < threads; t++ )
+		handles[t] = OGCreateThread( SearchWorker, &jobs[t] );
+	SearchWorker( &jobs[0] );
+	for( t = 1; t < threads; t++ )
+	{
+		if( handles[t] )
+			OGJoinThread( handles[t] );
+		else
+			SearchWorker( &jobs[t] );
+	}
+}
 
-	int opti = 0;
+void Solve( char Camera, Capture * c, int captureIndex, int captureCount, int threads )
+{
 	int cycle = 0;
-	int axis = 0;
+	double start = OGGetAbsoluteTime();
 
 	FLT dx, dy, dz;
 
-	FLT bestxyz[3];
-	memcpy( bestxyz, LighthousePos, sizeof( LighthousePos ) );
+	FLT bestxyz[3] = { 0, 0, 0 };
+
+	//The first cycle, with 32 splits, is the biggest one; leave room for rounding in the loop steps.
+	int maxCandidates = 33 * 66 * 66;
+	FLT * candidates = malloc( sizeof( FLT ) * 3 * maxCandidates );
+	FLT * errors = malloc( sizeof( FLT ) * maxCandidates );
 
 	//STAGE1 1: Detemine vectoral position from lighthouse to target.  Does not determine lighthouse-target distance.
 	//This also is constantly optimizing the lighthouse quaternion for optimal spotting.
@@ -58,12 +106,16 @@ int main( int argc, char ** argv )
 		{
 			FLT bestxyzrunning[3];
 			FLT beste = 1e20;
+			int count = 0, i;
 
-			FILE * f;
+			FILE * f = 0;
 			if( cycle == 0 )
 			{
 				char filename[1024];
-				sprintf( filename, "%c_lighthouse.dat", argv[1][0] );
+				if( captureCount > 1 )
+					sprintf( filename, "%c_lighthouse_%d.dat", Camera, captureIndex );
+				else
+					sprintf( filename, "%c_lighthouse.dat", Camera );
 				f = fopen( filename, "wb" );
 			}
 
@@ -83,16 +135,28 @@ int main( int argc, char ** argv )
 			for( dy = -fullrange; dy < fullrange; dy += fullrange/splits )
 			for( dx = -fullrange; dx < fullrange; dx += fullrange/splits )
 			{
-				//Specificially adjust one axis at a time, searching for the best.
-				memcpy( LighthousePos, bestxyz, sizeof( LighthousePos ) );
-				LighthousePos[0] += dx;  //These are adjustments to the "best" from last frame.
-				LighthousePos[1] += dy;
-				LighthousePos[2] += dz;
-
-				FLT ft;
-				//Try refining the search for the best orientation several times.
-				ft = RunOpti(0);
-				if( cycle == 0 )
+				if( count == maxCandidates ) break;
+
+				//These are adjustments to the "best" from last frame.
+				FLT * LighthousePos = &candidates[count*3];
+				LighthousePos[0] = bestxyz[0] + dx;
+				LighthousePos[1] = bestxyz[1] + dy;
+				LighthousePos[2] = bestxyz[2] + dz;
+				count++;
+			}
+
+			//Every candidate is independent; only picking the best needs to go in order.
+			Search( c, candidates, errors, count, threads );
+
+			i = 0;
+			for( dz = 0; dz < fullrange; dz += fullrange/splits )
+			for( dy = -fullrange; dy < fullrange; dy += fullrange/splits )
+			for( dx = -fullrange; dx < fullrange; dx += fullrange/splits )
+			{
+				if( i == count ) break;
+
+				FLT ft = errors[i];
+				if( f )
 				{
 					float sk = ft*10.;
 					if( sk > 1 ) sk = 1;
@@ -109,10 +173,11 @@ int main( int argc, char ** argv )
 					fprintf( f, "%c", cell );
 				}
 
-				if( ft < beste ) { beste = ft; memcpy( bestxyzrunning, LighthousePos, sizeof( LighthousePos ) ); }
+				if( ft < beste ) { beste = ft; memcpy( bestxyzrunning, &candidates[i*3], sizeof( bestxyzrunning ) ); }
+				i++;
 			}
 
-			if( cycle == 0 )
+			if( f )
 			{
 				fclose( f );
 			}
@@ -127,20 +192,73 @@ int main( int argc, char ** argv )
 		fullrange *= 0.25;
 	}
 
+	free( candidates );
+	free( errors );
+
 	//Use bestxyz
-	memcpy( LighthousePos, bestxyz, sizeof( LighthousePos ) );
+	memcpy( c->pos, bestxyz, sizeof( c->pos ) );
 
 	//Optimize the quaternion for lighthouse rotation
-	RunOpti(1);
+	RunOpti( c, c->pos, c->quat, 1 );
 
-	printf( "Best Quat: %f %f %f %f\n", PFFOUR( LighthouseQuat ) );
+	printf( "Best Quat: %f %f %f %f\n", PFFOUR( c->quat ) );
 
 	//Print out plane accuracies with these settings.
-	FLT ft = RunTest(1);
-	printf( "Final RMS: %f\n", ft );
+	c->rms = RunTest( c, c->pos, c->quat, 1 );
+	c->seconds = OGGetAbsoluteTime() - start;
+	printf( "Final RMS: %f\n", c->rms );
 }
 
-FLT RunOpti( int print )
+int main( int argc, char ** argv )
+{
+	int i;
+	int threads = sysconf( _SC_NPROCESSORS_ONLN );
+	int arg = 1;
+
+	if( argc > 2 && strcmp( argv[1], "-j" ) == 0 )
+	{
+		threads = atoi( argv[2] );
+		arg = 3;
+	}
+	if( threads < 1 ) threads = 1;
+	if( threads > MAX_THREADS ) threads = MAX_THREADS;
+
+	if( argc - arg < 2 )
+	{
+		fprintf( stderr, "Error: usage: camfind [-j threads] [camera (L or R)] [datafile] [datafile...]\n" );
+		exit( -1 );
+	}
+
+	char Camera = argv[arg][0];
+	int captureCount = argc - arg - 1;
+	Capture * captures = calloc( captureCount, sizeof( Capture ) );
+
+	if( LoadPoints() ) return 5;
+
+	//Load either 'L' (LH1) or 'R' (LH2) data.
+	for( i = 0; i < captureCount; i++ )
+	{
+		if( LoadData( Camera, argv[arg + 1 + i], &captures[i] ) ) return 5;
+	}
+
+	for( i = 0; i < captureCount; i++ )
+	{
+		if( captureCount > 1 ) printf( "=== %s ===\n", captures[i].datafile );
+		Solve( Camera, &captures[i], i, captureCount, threads );
+	}
+
+	printf( "\n%-32s %10s %10s %10s %10s %8s\n", "capture", "x", "y", "z", "rms", "seconds" );
+	for( i = 0; i < captureCount; i++ )
+	{
+		Capture * c = &captures[i];
+		printf( "%-32s %10f %10f %10f %10f %8.2f\n", c->datafile, PFTHREE( c->pos ), c->rms, c->seconds );
+	}
+
+	free( captures );
+	return 0;
+}
+
+FLT RunOpti( const Capture * c, const FLT * LighthousePos, FLT * LighthouseQuat, int print )
 {
 	int i, p;
 	FLT UsToTarget[3];
@@ -156,7 +274,7 @@ FLT RunOpti( int print )
 	//lighthouse position.
 	for( p = 0; p < 32; p++ )
 	{
-		if( hmd_point_counts[p*2+0] < MIN_HITS_FOR_VALID || hmd_point_counts[p*2+1] < MIN_HITS_FOR_VALID ) continue;
+		if( c->point_counts[p*2+0] < MIN_HITS_FOR_VALID || c->point_counts[p*2+1] < MIN_HITS_FOR_VALID ) continue;
 		FLT me_to_dot[3];
 		sub3d( me_to_dot, LighthousePos, &hmd_points[p*3] );
 		float dot = dot3d( &hmd_norms[p*3], me_to_dot );
@@ -172,11 +290,11 @@ FLT RunOpti( int print )
 		first = 1;
 		for( p = 0; p < 32; p++ )
 		{
-			if( hmd_point_counts[p*2+0] < MIN_HITS_FOR_VALID || hmd_point_counts[p*2+1] < MIN_HITS_FOR_VALID ) continue;
+			if( c->point_counts[p*2+0] < MIN_HITS_FOR_VALID || c->point_counts[p*2+1] < MIN_HITS_FOR_VALID ) continue;
 
 			//Find out where our ray shoots forth from.
-			FLT ax = hmd_point_angles[p*2+0];
-			FLT ay = hmd_point_angles[p*2+1];
+			FLT ax = c->point_angles[p*2+0];
+			FLT ay = c->point_angles[p*2+1];
 
 			//NOTE: Inputs may never be output with cross product.
 			//Create a fictitious normalized ray.  Imagine the lighthouse is pointed
@@ -247,11 +365,11 @@ FLT RunOpti( int print )
 	int count = 0;
 	for( p = 0; p < 32; p++ )
 	{
-		if( hmd_point_counts[p*2+0] < MIN_HITS_FOR_VALID || hmd_point_counts[p*2+1] < MIN_HITS_FOR_VALID ) continue;
+		if( c->point_counts[p*2+0] < MIN_HITS_FOR_VALID || c->point_counts[p*2+1] < MIN_HITS_FOR_VALID ) continue;
 
 		//Find out where our ray shoots forth from.
-		FLT ax = hmd_point_angles[p*2+0];
-		FLT ay = hmd_point_angles[p*2+1];
+		FLT ax = c->point_angles[p*2+0];
+		FLT ay = c->point_angles[p*2+1];
 		FLT RayShootOut[3] = { sin(ax), sin(ay), 0 };
 		RayShootOut[2] = sqrt( 1 - (RayShootOut[0]*RayShootOut[0] + RayShootOut[1]*RayShootOut[1]) );
 
@@ -267,25 +385,25 @@ FLT RunOpti( int print )
 		cross3d( xproduct, UsToTarget, RayShootOut );
 		FLT dist = magnitude3d( xproduct );
 		errorsq += dist*dist;
-		if( print ) printf( "%f (%d(%d/%d))\n", dist, p, hmd_point_counts[p*2+0], hmd_point_counts[p*2+1] );
+		if( print ) printf( "%f (%d(%d/%d))\n", dist, p, c->point_counts[p*2+0], c->point_counts[p*2+1] );
 	}
 	if( print ) printf( " = %f\n", sqrt( errorsq ) );
 	return sqrt(errorsq);
 }
 
 
-FLT RunTest( int print )
+FLT RunTest( const Capture * c, const FLT * LighthousePos, const FLT * LighthouseQuat, int print )
 {
 	int k;
 	FLT totprob = 0.0;
 	int ict = 0;
 	for( k = 0; k < PTS*2; k++ )
 	{
-		if( hmd_point_counts[k] == 0 ) continue;
+		if( c->point_counts[k] == 0 ) continue;
 		int axis = k%2;
 		int pt = k/2;
 
-		FLT angle = hmd_point_angles[k];
+		FLT angle = c->point_angles[k];
 		if( print ) printf( "%3d %3d : angle: %10f / ", axis, pt, angle );
 
 		//XXX TODO: This is critical.  We need to properly define the planes. 
@@ -322,12 +440,12 @@ FLT RunTest( int print )
 	if( print )
 	{
 		int p;
-		printf( "POS:  %f %f %f %f\n", PFFOUR(LighthousePos ) );
+		printf( "POS:  %f %f %f\n", PFTHREE(LighthousePos ) );
 		printf( "QUAT: %f %f %f %f\n", PFFOUR(LighthouseQuat ) );
 		printf( "Imagespace comparison:\n" );
 		for( p = 0; p < 32; p++ )
 		{
-			if( hmd_point_counts[p*2+0] < MIN_HITS_FOR_VALID || hmd_point_counts[p*2+1] < MIN_HITS_FOR_VALID ) continue;
+			if( c->point_counts[p*2+0] < MIN_HITS_FOR_VALID || c->point_counts[p*2+1] < MIN_HITS_FOR_VALID ) continue;
 
 			FLT us_to_targ[3];
 			sub3d( us_to_targ, &hmd_points[p*3] , LighthousePos );
@@ -341,7 +459,7 @@ FLT RunTest( int print )
 			FLT x = asin( us_to_targ[0] );
 			FLT y = asin( us_to_targ[1] );
 
-			printf( "%f %f %f %f\n", hmd_point_angles[p*2+0], hmd_point_angles[p*2+1], x, y );
+			printf( "%f %f %f %f\n", c->point_angles[p*2+0], c->point_angles[p*2+1], x, y );
 		}
 	}
 
@@ -350,11 +468,8 @@ FLT RunTest( int print )
 }
 
 
-int LoadData( char Camera, const char * datafile  )
+int LoadPoints()
 {
-	int calpts[MAX_CHECKS*4]; //X (0) or Y (1), ID, offset
-	int calptscount;
-
 	//First, read the positions of all the sensors on the HMD.
 	FILE * f = fopen( "HMD_points.csv", "r" );
 	int pt = 0;
@@ -412,14 +527,19 @@ int LoadData( char Camera, const char * datafile  )
 	fclose( f );
 	printf( "Loaded %d norms\n", nrm );
 
+	return 0;
+}
+
+int LoadData( char Camera, const char * datafile, Capture * c )
+{
 	//Actually load the processed data!
-	int xck = 0;
-	f = fopen( datafile, "r" );
+	FILE * f = fopen( datafile, "r" );
 	if( !f )
 	{
 		fprintf( stderr, "Error: cannot open %s\n", datafile );
-		exit -11;
+		return -11;
 	}
+	c->datafile = datafile;
 	int lineno = 0;
 	while( !feof( f ) )
 	{
@@ -446,8 +566,8 @@ int LoadData( char Camera, const char * datafile  )
 
 		int isy = inn[1] == 'Y';
 
-		hmd_point_angles[id*2+isy] = ( avgTime - 200000 ) / 200000 * 3.1415926535/2.0;
-		hmd_point_counts[id*2+isy] = pointct;
+		c->point_angles[id*2+isy] = ( avgTime - 200000 ) / 200000 * 3.1415926535/2.0;
+		c->point_counts[id*2+isy] = pointct;
 	}
 	fclose( f );
 
@@ -457,15 +577,15 @@ int LoadData( char Camera, const char * datafile  )
 
 	for( targpd = 0; targpd < PTS; targpd++ )
 	{
-		int hits = hmd_point_counts[targpd*2+0];
-		if( hits > hmd_point_counts[targpd*2+1] ) hits = hmd_point_counts[targpd*2+1];
+		int hits = c->point_counts[targpd*2+0];
+		if( hits > c->point_counts[targpd*2+1] ) hits = c->point_counts[targpd*2+1];
 		//Need an X and a Y lock.  
 
-		if( hits > maxhits ) { maxhits = hits; best_hmd_target = targpd; }
+		if( hits > maxhits ) { maxhits = hits; }
 	}
 	if( maxhits < MIN_HITS_FOR_VALID )
 	{
-		fprintf( stderr, "Error: Not enough data for a primary fix.\n" );
+		fprintf( stderr, "Error: Not enough data for a primary fix in %s.\n", datafile );
 	}
 
 	return 0;
@@ -1,29 +1,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "linmath.h"
+#include "os_generic.h"
 #include <string.h>
 #include <stdint.h>
 #include <math.h>
+#include <unistd.h>
 
 #define PTS 32
 #define MAX_CHECKS 40000
 #define MIN_HITS_FOR_VALID 10
+#define MAX_THREADS 64
 
 FLT hmd_points[PTS*3];
 FLT hmd_norms[PTS*3];
-FLT hmd_point_angles[PTS*2];
-int hmd_point_counts[PTS*2];
-int best_hmd_target = 0;
-int LoadData( char Camera, const char * FileData );
 
-//Values used for RunTest()
-FLT LighthousePos[3] = { 0, 0, 0 };
-FLT LighthouseQuat[4] = { 1, 0, 0, 0 };
+#define MAX_POINT_PAIRS 100
+#define MAX_RADII 32
 
-FLT RunTest( int print );
-void PrintOpti();
+//One lighthouse's view of the HMD, loaded from one processed data file.
+typedef struct
+{
+	const char * datafile;
+	FLT point_angles[PTS*2];
+	int point_counts[PTS*2];
 
-#define MAX_POINT_PAIRS 100
+	//Results
+	FLT radii[MAX_RADII];
+	size_t numRadii;
+	FLT fitness;
+	double seconds;
+} Capture;
+
+int LoadPoints();
+int LoadData( char Camera, const char * FileData, Capture * c );
 
 typedef struct
 {
@@ -139,8 +149,6 @@ FLT calculateFitness(SensorAngles *angles, FLT *radii, PointPair *pairs, size_t
 	return FLT_SQRT(fitness);
 }
 
-#define MAX_RADII 32
-
 // note gradientOut will be of the same degree as numRadii
 void getGradient(FLT *gradientOut, SensorAngles *angles, FLT *radii, size_t numRadii, PointPair *pairs, size_t numPairs, const FLT precision)
 {
@@ -314,13 +322,14 @@ static RefineEstimateUsingGradientDescent(FLT *estimateOut, SensorAngles *angles
 
 
 	}
+#ifdef RADII_DEBUG
 	printf("\ni=%d\n", i);
+#endif
 }
 
-void SolveForLighthouse(Point *objPosition, FLT *objOrientation, TrackedObject *obj)
+// Returns the fitness of the radii left in estimate
+FLT SolveForLighthouse(FLT *estimate, TrackedObject *obj)
 {
-	FLT estimate[MAX_RADII];
-
 	for (size_t i = 0; i < MAX_RADII; i++)
 	{
 		estimate[i] = 2.4;
@@ -354,20 +363,13 @@ void SolveForLighthouse(Point *objPosition, FLT *objOrientation, TrackedObject *
 	RefineEstimateUsingGradientDescent(estimate, angles, estimate, obj->numSensors, pairs, pairCount, NULL);
 
 	// we should now have an estimate of the radii.
-
-	for (size_t i = 0; i < obj->numSensors; i++)
-	{
-		printf("radius[%d]: %f\n", i, estimate[i]);
-	}
-// (FLT *estimateOut, SensorAngles *angles, FLT *initialEstimate, size_t numRadii, PointPair *pairs, size_t numPairs, FILE *logFile)
-
-	getc(stdin);
-	return;
+	return calculateFitness(angles, estimate, pairs, pairCount);
 }
 
-static void runTheNumbers()
+static void runTheNumbers(Capture *c)
 {
 	TrackedObject *to;
+	double start = OGGetAbsoluteTime();
 
 	to = malloc(sizeof(TrackedObject) + (PTS * sizeof(TrackedSensor)));
 
@@ -376,8 +378,8 @@ static void runTheNumbers()
 	for (int i = 0; i < PTS; i++)
 	{
 		// if there are enough valid counts for both the x and y sweeps for sensor i
-		if ((hmd_point_counts[2 * i] > MIN_HITS_FOR_VALID) &&
-			(hmd_point_counts[2 * i + 1] > MIN_HITS_FOR_VALID))
+		if ((c->point_counts[2 * i] > MIN_HITS_FOR_VALID) &&
+			(c->point_counts[2 * i + 1] > MIN_HITS_FOR_VALID))
 		{
 			to->sensor[sensorCount].point.x = hmd_points[i * 3 + 0];
 			to->sensor[sensorCount].point.y = hmd_points[i * 3 + 1];
@@ -385,58 +387,98 @@ static void runTheNumbers()
 			to->sensor[sensorCount].normal.x = hmd_norms[i * 3 + 0];
 			to->sensor[sensorCount].normal.y = hmd_norms[i * 3 + 1];
 			to->sensor[sensorCount].normal.z = hmd_norms[i * 3 + 2];
-			to->sensor[sensorCount].theta = hmd_point_angles[i * 2 + 0] + LINMATHPI / 2;
-			to->sensor[sensorCount].phi = hmd_point_angles[i * 2 + 1] + LINMATHPI / 2;
+			to->sensor[sensorCount].theta = c->point_angles[i * 2 + 0] + LINMATHPI / 2;
+			to->sensor[sensorCount].phi = c->point_angles[i * 2 + 1] + LINMATHPI / 2;
 			sensorCount++;
 		}
 	}
 
 	to->numSensors = sensorCount;
 
-	printf("Using %d sensors to find lighthouse.\n", sensorCount);
+	c->fitness = SolveForLighthouse(c->radii, to);
+	c->numRadii = to->numSensors;
+	c->seconds = OGGetAbsoluteTime() - start;
 
-	Point lh;
-	for (int i = 0; i < 1; i++)
-	{
-		SolveForLighthouse(&lh, NULL, to);
-		//(0.156754, -2.403268, 2.280167)
-		//assert(fabs((lh.x / 0.1419305302702402) - 1) < 0.00001);
-		//assert(fabs((lh.y / 2.5574949720325431) - 1) < 0.00001);
-		//assert(fabs((lh.z / 2.2451193935772080) - 1) < 0.00001);
-		//assert(lh.x > 0);
-		//assert(lh.y > 0);
-		//assert(lh.z > 0);
-	}
+	free(to);
+}
 
-	printf("(%f, %f, %f)\n", lh.x, lh.y, lh.z);
+// Captures are independent, so each thread takes the next unsolved one until none are left.
+static Capture *captures;
+static int captureCount;
+static int nextCapture;
+static og_mutex_t captureLock;
 
-	//printTrackedObject(to);
-	free(to);
+static void *SolveCaptures(void *unused)
+{
+	for (;;)
+	{
+		OGLockMutex(captureLock);
+		int i = nextCapture++;
+		OGUnlockMutex(captureLock);
+
+		if (i >= captureCount)
+			return 0;
+		runTheNumbers(&captures[i]);
+	}
 }
 
 int main( int argc, char ** argv )
 {
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int arg = 1;
 
-	if( argc != 3 )
+	if (argc > 2 && strcmp(argv[1], "-j") == 0)
 	{
-		fprintf( stderr, "Error: usage: camfind [camera (L or R)] [datafile]\n" );
-		exit( -1 );
+		threads = atoi(argv[2]);
+		arg = 3;
 	}
+	if (threads < 1) threads = 1;
+	if (threads > MAX_THREADS) threads = MAX_THREADS;
 
-	//Load either 'L' (LH1) or 'R' (LH2) data.
-	if( LoadData( argv[1][0], argv[2] ) ) return 5;
-
-	runTheNumbers();
+	if( argc - arg < 2 )
+	{
+		fprintf( stderr, "Error: usage: camfind [-j threads] [camera (L or R)] [datafile] [datafile...]\n" );
+		exit( -1 );
+	}
 
+	captureCount = argc - arg - 1;
+	captures = calloc(captureCount, sizeof(Capture));
 
-	
-}
+	if (LoadPoints()) return 5;
 
+	//Load either 'L' (LH1) or 'R' (LH2) data.
+	for (int i = 0; i < captureCount; i++)
+	{
+		if (LoadData(argv[arg][0], argv[arg + 1 + i], &captures[i])) return 5;
+	}
 
+	og_thread_t handles[MAX_THREADS];
+	captureLock = OGCreateMutex();
+	if (threads > captureCount) threads = captureCount;
+	for (int t = 1; t < threads; t++)
+		handles[t] = OGCreateThread(SolveCaptures, 0);
+	SolveCaptures(0);
+	for (int t = 1; t < threads; t++)
+	{
+		if (handles[t])
+			OGJoinThread(handles[t]);
+	}
 
+	for (int i = 0; i < captureCount; i++)
+	{
+		Capture *c = &captures[i];
+		printf("%s: %d sensors, fitness %f, %.2f seconds\n", c->datafile, (int)c->numRadii, c->fitness, c->seconds);
+		for (size_t r = 0; r < c->numRadii; r++)
+		{
+			printf("radius[%d]: %f\n", (int)r, c->radii[r]);
+		}
+	}
 
+	free(captures);
+	return 0;
+}
 
-int LoadData( char Camera, const char * datafile  )
+int LoadPoints()
 {
 
 	//First, read the positions of all the sensors on the HMD.
@@ -496,14 +538,19 @@ int LoadData( char Camera, const char * datafile  )
 	fclose( f );
 	printf( "Loaded %d norms\n", nrm );
 
+	return 0;
+}
+
+int LoadData( char Camera, const char * datafile, Capture * c )
+{
 	//Actually load the processed data!
-	int xck = 0;
-	f = fopen( datafile, "r" );
+	FILE * f = fopen( datafile, "r" );
 	if( !f )
 	{
 		fprintf( stderr, "Error: cannot open %s\n", datafile );
-		exit (-11);
+		return -11;
 	}
+	c->datafile = datafile;
 	int lineno = 0;
 	while( !feof( f ) )
 	{
@@ -530,8 +577,8 @@ int LoadData( char Camera, const char * datafile  )
 
 		int isy = inn[1] == 'Y';
 
-		hmd_point_angles[id*2+isy] = ( avgTime - 200000 ) / 200000 * 3.1415926535/2.0;
-		hmd_point_counts[id*2+isy] = pointct;
+		c->point_angles[id*2+isy] = ( avgTime - 200000 ) / 200000 * 3.1415926535/2.0;
+		c->point_counts[id*2+isy] = pointct;
 	}
 	fclose( f );
 
@@ -541,15 +588,15 @@ int LoadData( char Camera, const char * datafile  )
 
 	for( targpd = 0; targpd < PTS; targpd++ )
 	{
-		int hits = hmd_point_counts[targpd*2+0];
-		if( hits > hmd_point_counts[targpd*2+1] ) hits = hmd_point_counts[targpd*2+1];
+		int hits = c->point_counts[targpd*2+0];
+		if( hits > c->point_counts[targpd*2+1] ) hits = c->point_counts[targpd*2+1];
 		//Need an X and a Y lock.  
 
-		if( hits > maxhits ) { maxhits = hits; best_hmd_target = targpd; }
+		if( hits > maxhits ) { maxhits = hits; }
 	}
 	if( maxhits < MIN_HITS_FOR_VALID )
 	{
-		fprintf( stderr, "Error: Not enough data for a primary fix.\n" );
+		fprintf( stderr, "Error: Not enough data for a primary fix in %s.\n", datafile );
 	}
 
 	return 0;
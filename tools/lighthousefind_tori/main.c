@@ -4,20 +4,34 @@
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "linmath.h"
+#include "os_generic.h"
 #include "torus_localizer.h"
 
 #define PTS 32
 #define MAX_CHECKS 40000
 #define MIN_HITS_FOR_VALID 10
+#define MAX_THREADS 64
 
 FLT hmd_points[PTS * 3];
 FLT hmd_norms[PTS * 3];
 
-// index for a given sensor is (2*sensor + is_sensor_y ? 1 : 0)
-FLT hmd_point_angles[PTS * 2];  
-int hmd_point_counts[PTS * 2];
-int best_hmd_target = 0;
+// One lighthouse's view of the HMD, loaded from one processed data file.
+typedef struct
+{
+	const char *datafile;
+
+	// index for a given sensor is (2*sensor + is_sensor_y ? 1 : 0)
+	FLT point_angles[PTS * 2];
+	int point_counts[PTS * 2];
+
+	// Results
+	Point lh;
+	int sensorCount;
+	FLT error;
+	double seconds;
+} Capture;
 
 static void printTrackedObject(TrackedObject *to)
 {
@@ -34,9 +48,10 @@ static void printTrackedObject(TrackedObject *to)
 	}
 }
 
-static void runTheNumbers()
+static void runTheNumbers(Capture *c)
 {
 	TrackedObject *to;
+	double start = OGGetAbsoluteTime();
 
 	to = malloc(sizeof(TrackedObject)+(PTS * sizeof(TrackedSensor)));
 
@@ -45,8 +60,8 @@ static void runTheNumbers()
 	for (int i = 0; i < PTS; i++)
 	{
 		// if there are enough valid counts for both the x and y sweeps for sensor i
-		if ((hmd_point_counts[2*i] > MIN_HITS_FOR_VALID) &&
-			(hmd_point_counts[2*i + 1] > MIN_HITS_FOR_VALID))
+		if ((c->point_counts[2*i] > MIN_HITS_FOR_VALID) &&
+			(c->point_counts[2*i + 1] > MIN_HITS_FOR_VALID))
 		{
 			to->sensor[sensorCount].point.x = hmd_points[i * 3 + 0];
 			to->sensor[sensorCount].point.y = hmd_points[i * 3 + 1];
@@ -54,41 +69,48 @@ static void runTheNumbers()
 			to->sensor[sensorCount].normal.x = hmd_norms[i * 3 + 0];
 			to->sensor[sensorCount].normal.y = hmd_norms[i * 3 + 1];
 			to->sensor[sensorCount].normal.z = hmd_norms[i * 3 + 2];
-			to->sensor[sensorCount].theta = hmd_point_angles[i * 2 + 0] + LINMATHPI / 2;
-			to->sensor[sensorCount].phi = hmd_point_angles[i * 2 + 1] + LINMATHPI / 2;
+			to->sensor[sensorCount].theta = c->point_angles[i * 2 + 0] + LINMATHPI / 2;
+			to->sensor[sensorCount].phi = c->point_angles[i * 2 + 1] + LINMATHPI / 2;
 			sensorCount++;
 		}
 	}
 
 	to->numSensors = sensorCount;
+	c->sensorCount = sensorCount;
 
-	printf("Using %d sensors to find lighthouse.\n", sensorCount);
-
-	Point lh;
-	//for (int i = 0; i < 200; i++)
-	for (int i = 0; i < 1; i++)
-	{
-		lh = SolveForLighthouse(to, 0);
-		//(0.156754, -2.403268, 2.280167)
-		//assert(fabs((lh.x / 0.1419305302702402) - 1) < 0.00001);
-		//assert(fabs((lh.y / 2.5574949720325431) - 1) < 0.00001);
-		//assert(fabs((lh.z / 2.2451193935772080) - 1) < 0.00001);
-		//assert(lh.x > 0);
-		//assert(lh.y > 0);
-		//assert(lh.z > 0);
-	}
-
-	printf("(%f, %f, %f)\n", lh.x, lh.y, lh.z);
+	// The solver reports a fitness that grows as the fit improves; its inverse is the
+	// root of the summed squared torus distances.
+	FLT fitness = 0;
+	c->lh = SolveForLighthouse(to, 0, &fitness);
+	c->error = fitness > 0 ? 1 / fitness : 0;
+	c->seconds = OGGetAbsoluteTime() - start;
 
 	//printTrackedObject(to);
 	free(to);
 }
 
+// Captures are independent, so each thread takes the next unsolved one until none are left.
+static Capture *captures;
+static int captureCount;
+static int nextCapture;
+static og_mutex_t captureLock;
 
-int LoadData(char Camera, const char * datafile)
+static void *SolveCaptures(void *unused)
 {
+	for (;;)
+	{
+		OGLockMutex(captureLock);
+		int i = nextCapture++;
+		OGUnlockMutex(captureLock);
 
+		if (i >= captureCount)
+			return 0;
+		runTheNumbers(&captures[i]);
+	}
+}
 
+int LoadPoints()
+{
 	//First, read the positions of all the sensors on the HMD.
 	FILE * f = fopen("HMD_points.csv", "r");
 	int pt = 0;
@@ -154,14 +176,19 @@ int LoadData(char Camera, const char * datafile)
 	fclose(f);
 	printf("Loaded %d norms\n", nrm);
 
+	return 0;
+}
+
+int LoadData(char Camera, const char * datafile, Capture *c)
+{
 	//Actually load the processed data!
-	int xck = 0;
-	f = fopen(datafile, "r");
+	FILE *f = fopen(datafile, "r");
 	if (!f)
 	{
 		fprintf(stderr, "Error: cannot open %s\n", datafile);
-		exit(-11);
+		return -11;
 	}
+	c->datafile = datafile;
 	int lineno = 0;
 	while (!feof(f))
 	{
@@ -188,9 +215,9 @@ int LoadData(char Camera, const char * datafile)
 
 		int isy = inn[1] == 'Y';
 
-		hmd_point_angles[id * 2 + isy] = ((FLT)avgTime - 200000) * LINMATHPI / 200000 / 2;
+		c->point_angles[id * 2 + isy] = ((FLT)avgTime - 200000) * LINMATHPI / 200000 / 2;
 		
-		hmd_point_counts[id * 2 + isy] = pointct;
+		c->point_counts[id * 2 + isy] = pointct;
 	}
 	fclose(f);
 
@@ -200,15 +227,15 @@ int LoadData(char Camera, const char * datafile)
 
 	for (targpd = 0; targpd < PTS; targpd++)
 	{
-		int hits = hmd_point_counts[targpd * 2 + 0];
-		if (hits > hmd_point_counts[targpd * 2 + 1]) hits = hmd_point_counts[targpd * 2 + 1];
+		int hits = c->point_counts[targpd * 2 + 0];
+		if (hits > c->point_counts[targpd * 2 + 1]) hits = c->point_counts[targpd * 2 + 1];
 		//Need an X and a Y lock.  
 
-		if (hits > maxhits) { maxhits = hits; best_hmd_target = targpd; }
+		if (hits > maxhits) { maxhits = hits; }
 	}
 	if (maxhits < MIN_HITS_FOR_VALID)
 	{
-		fprintf(stderr, "Error: Not enough data for a primary fix.\n");
+		fprintf(stderr, "Error: Not enough data for a primary fix in %s.\n", datafile);
 	}
 
 	return 0;
@@ -217,16 +244,54 @@ int LoadData(char Camera, const char * datafile)
 
 int main(int argc, char ** argv)
 {
-	if (argc != 3)
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int arg = 1;
+
+	if (argc > 2 && strcmp(argv[1], "-j") == 0)
+	{
+		threads = atoi(argv[2]);
+		arg = 3;
+	}
+	if (threads < 1) threads = 1;
+	if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+	if (argc - arg < 2)
 	{
-		fprintf(stderr, "Error: usage: lighthousefind-torus [camera (L or R)] [datafile]\n");
+		fprintf(stderr, "Error: usage: lighthousefind-torus [-j threads] [camera (L or R)] [datafile] [datafile...]\n");
 		exit(-1);
 	}
 
+	captureCount = argc - arg - 1;
+	captures = calloc(captureCount, sizeof(Capture));
+
+	if (LoadPoints()) return 5;
+
 	//Load either 'L' (LH1) or 'R' (LH2) data.
-	if (LoadData(argv[1][0], argv[2])) return 5;
+	for (int i = 0; i < captureCount; i++)
+	{
+		if (LoadData(argv[arg][0], argv[arg + 1 + i], &captures[i])) return 5;
+	}
 
-	runTheNumbers();
+	og_thread_t handles[MAX_THREADS];
+	captureLock = OGCreateMutex();
+	if (threads > captureCount) threads = captureCount;
+	for (int t = 1; t < threads; t++)
+		handles[t] = OGCreateThread(SolveCaptures, 0);
+	SolveCaptures(0);
+	for (int t = 1; t < threads; t++)
+	{
+		if (handles[t])
+			OGJoinThread(handles[t]);
+	}
+
+	printf("%-32s %7s %10s %10s %10s %10s %8s\n", "capture", "sensors", "x", "y", "z", "error", "seconds");
+	for (int i = 0; i < captureCount; i++)
+	{
+		Capture *c = &captures[i];
+		printf("%-32s %7d %10f %10f %10f %10f %8.2f\n", c->datafile, c->sensorCount, c->lh.x, c->lh.y, c->lh.z,
+			c->error, c->seconds);
+	}
 
+	free(captures);
 	return 0;
 }
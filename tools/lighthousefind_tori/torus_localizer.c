@@ -451,7 +451,9 @@ static Point RefineEstimateUsingModifiedGradientDescent1(Point initialEstimate,
 
 
 	}
+#ifdef TORI_DEBUG
 	printf("\ni=%d\n", i);
+#endif
 
 	return lastPoint;
 }
@@ -566,7 +568,9 @@ static Point RefineRotationEstimate(Point initialEstimate, PointsAndAngle *pna,
 
 
 	}
+#ifdef TORI_DEBUG
 	printf("\ni=%d\n", i);
+#endif
 
 	return lastPoint;
 }
@@ -588,7 +592,7 @@ void SolveForRotation(FLT rotOut[4], TrackedObject *obj, Point lh)
 }
 
 
-Point SolveForLighthouse(TrackedObject *obj, char doLogOutput)
+Point SolveForLighthouse(TrackedObject *obj, char doLogOutput, FLT *fitness)
 {
 	PointsAndAngle pna[MAX_POINT_PAIRS];
 
@@ -667,8 +671,12 @@ Point SolveForLighthouse(TrackedObject *obj, char doLogOutput)
 	}
 
 	FLT fitGd = getPointFitness(refinedEstimateGd, pna, pnaCount);
+	if (fitness)
+		*fitness = fitGd;
 
+#ifdef TORI_DEBUG
 	printf("Fitness is %f\n", fitGd);
+#endif
 
 	if (logFile)
 	{
@@ -4,7 +4,8 @@
 
 #include "tori_includes.h"
 
-Point SolveForLighthouse(TrackedObject *obj, char doLogOutput);
+// fitness, if not null, receives the fitness of the returned position; higher is better.
+Point SolveForLighthouse(TrackedObject *obj, char doLogOutput, FLT *fitness);
 
 
 
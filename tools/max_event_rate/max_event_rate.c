@@ -0,0 +1,343 @@
+// Finds the fastest rate at which this machine can process tracking data in real time with a given configuration.
+//
+// The input -- a recording given with '--playback', or the simulator with '--simulator' -- is replayed once as fast as
+// possible to estimate throughput, then at increasing multiples of real time until processing falls behind the
+// timing of the data. All other arguments are passed through to libsurvive, so the poser and disambiguator under test
+// are chosen the usual way, and '--playback-multiplex N' replays every recorded device N times to model more objects
+// per host.
+//
+// Options, all of which are also regular libsurvive config values:
+//   --bench-rate-start   First rate tried, as a multiple of real time (1)
+//   --bench-rate-max     Stop the sweep at this rate (256)
+//   --bench-max-lag      Seconds processing may trail the data before the rate counts as unsustainable (.1)
+//   --bench-refine       Number of bisection steps between the last good and first bad rate (4)
+//   --bench-duration     Seconds of data processed per trial; 0 means the whole recording (0, or 5 for the simulator)
+
+#include <libsurvive/survive.h>
+#include <os_generic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum stage { STAGE_LIGHTCAP, STAGE_LIGHT, STAGE_ANGLE, STAGE_IMU, STAGE_POSE, STAGE_COUNT };
+static const char *stage_names[STAGE_COUNT] = {"disambiguator", "light", "angle/poser", "imu/poser", "pose"};
+
+struct trial {
+	double rate; // 0 is as fast as possible
+	double wall_time;
+	double data_time; // Seconds of data covered, from the device timecodes
+	double max_lag;
+	double final_lag;
+	uint64_t events;
+	uint64_t poses;
+
+	double cpu_time[STAGE_COUNT]; // Exclusive of nested stages
+	uint64_t calls[STAGE_COUNT];
+};
+
+// Per object timing, kept in so->user_ptr
+struct object_clock {
+	bool started;
+	survive_timecode last_timecode;
+	double ticks;
+	double wall_start;
+};
+
+static struct trial *current;
+static double trial_start;
+
+static handle_lightcap_func orig_lightcap;
+static light_process_func orig_light;
+static angle_process_func orig_angle;
+static imu_process_func orig_imu;
+static pose_func orig_pose;
+
+// Stages nest -- the disambiguator calls the light handler, which calls the angle handler, which runs the poser -- so
+// each level tracks how much of its time went to the levels it called.
+#define MAX_DEPTH 16
+static int depth;
+static double stage_start[MAX_DEPTH];
+static double stage_child[MAX_DEPTH];
+
+static double thread_cpu_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void stage_begin() {
+	if (depth < MAX_DEPTH) {
+		stage_start[depth] = thread_cpu_time();
+		stage_child[depth] = 0;
+	}
+	depth++;
+}
+
+static void stage_end(enum stage stage) {
+	depth--;
+	if (depth >= MAX_DEPTH)
+		return;
+
+	double total = thread_cpu_time() - stage_start[depth];
+	current->cpu_time[stage] += total - stage_child[depth];
+	current->calls[stage]++;
+	if (depth > 0)
+		stage_child[depth - 1] += total;
+}
+
+static void track_time(SurviveObject *so, survive_timecode timecode) {
+	struct object_clock *clock = so->user_ptr;
+	if (clock == 0 || so->timebase_hz == 0)
+		return;
+
+	double now = OGGetAbsoluteTime();
+	if (!clock->started) {
+		clock->started = true;
+		clock->last_timecode = timecode;
+		clock->wall_start = now;
+		return;
+	}
+
+	// Timecodes wrap; only forward steps under half the range count as progress.
+	survive_timecode step = timecode - clock->last_timecode;
+	if (step < 0x80000000u) {
+		clock->ticks += step;
+		clock->last_timecode = timecode;
+	}
+
+	double data_time = clock->ticks / so->timebase_hz;
+	if (data_time > current->data_time)
+		current->data_time = data_time;
+
+	if (current->rate > 0) {
+		double lag = (now - clock->wall_start) - data_time / current->rate;
+		if (lag > current->max_lag)
+			current->max_lag = lag;
+		current->final_lag = lag;
+	}
+}
+
+static void attach_clock(SurviveObject *so) {
+	if (so->user_ptr == 0)
+		so->user_ptr = calloc(1, sizeof(struct object_clock));
+}
+
+static void lightcap_fn(SurviveObject *so, LightcapElement *le) {
+	stage_begin();
+	orig_lightcap(so, le);
+	stage_end(STAGE_LIGHTCAP);
+}
+
+static void light_fn(SurviveObject *so, int sensor_id, int acode, int timeinsweep, survive_timecode timecode,
+					 survive_timecode length, uint32_t lh) {
+	attach_clock(so);
+	current->events++;
+	track_time(so, timecode);
+
+	stage_begin();
+	orig_light(so, sensor_id, acode, timeinsweep, timecode, length, lh);
+	stage_end(STAGE_LIGHT);
+}
+
+static void angle_fn(SurviveObject *so, int sensor_id, int acode, survive_timecode timecode, FLT length, FLT angle,
+					 uint32_t lh) {
+	// Angles replayed directly, as from the simulator, never went through the light handler.
+	if (depth == 0) {
+		attach_clock(so);
+		current->events++;
+		track_time(so, timecode);
+	}
+
+	stage_begin();
+	orig_angle(so, sensor_id, acode, timecode, length, angle, lh);
+	stage_end(STAGE_ANGLE);
+}
+
+static void imu_fn(SurviveObject *so, int mask, FLT *accelgyro, survive_timecode timecode, int id) {
+	attach_clock(so);
+	current->events++;
+	track_time(so, timecode);
+
+	stage_begin();
+	orig_imu(so, mask, accelgyro, timecode, id);
+	stage_end(STAGE_IMU);
+}
+
+static void pose_fn(SurviveObject *so, survive_timecode timecode, SurvivePose *pose) {
+	current->poses++;
+
+	stage_begin();
+	orig_pose(so, timecode, pose);
+	stage_end(STAGE_POSE);
+}
+
+static void quiet_info_fn(SurviveContext *ctx, const char *fault) {}
+
+static int run_trial(int argc, char **argv, bool simulator, double duration, struct trial *trial) {
+	SurviveContext *ctx = survive_init(argc, argv);
+	if (ctx == 0)
+		return -1;
+
+	// Keep the per-event log noise out of the measurement.
+	survive_install_info_fn(ctx, quiet_info_fn);
+
+	if (trial->rate > 0) {
+		survive_configf(ctx, "playback-factor", SC_OVERRIDE | SC_SET, 1. / trial->rate);
+		survive_configf(ctx, "time-factor", SC_OVERRIDE | SC_SET, 1. / trial->rate);
+	} else {
+		survive_configf(ctx, "playback-factor", SC_OVERRIDE | SC_SET, 0);
+		survive_configf(ctx, "time-factor", SC_OVERRIDE | SC_SET, 0);
+	}
+
+	int r = survive_startup(ctx);
+	if (r) {
+		survive_close(ctx);
+		return r;
+	}
+
+	current = trial;
+	depth = 0;
+
+	orig_lightcap = ctx->lightcapfunction;
+	orig_light = ctx->lightproc;
+	orig_angle = ctx->angleproc;
+	orig_imu = ctx->imuproc;
+	orig_pose = ctx->poseproc;
+	ctx->lightcapfunction = lightcap_fn;
+	ctx->lightproc = light_fn;
+	ctx->angleproc = angle_fn;
+	ctx->imuproc = imu_fn;
+	ctx->poseproc = pose_fn;
+
+	trial_start = OGGetAbsoluteTime();
+	while (survive_poll(ctx) == 0) {
+		if (duration > 0 && trial->data_time >= duration)
+			break;
+	}
+	trial->wall_time = OGGetAbsoluteTime() - trial_start;
+
+	for (int i = 0; i < ctx->objs_ct; i++) {
+		free(ctx->objs[i]->user_ptr);
+		ctx->objs[i]->user_ptr = 0;
+	}
+	survive_close(ctx);
+
+	if (trial->events == 0) {
+		fprintf(stderr, "No events were processed%s\n", simulator ? "" : "; is the recording empty?");
+		return -1;
+	}
+	return 0;
+}
+
+static bool sustainable(const struct trial *trial, double max_lag) { return trial->final_lag <= max_lag; }
+
+static void print_trial(const struct trial *trial, double max_lag) {
+	if (trial->rate > 0) {
+		printf("rate %8.3fx: %10.0f events/s, %8.1f poses/s, lag max %7.3fs final %7.3fs -- %s\n", trial->rate,
+			   trial->events / trial->wall_time, trial->poses / trial->wall_time, trial->max_lag, trial->final_lag,
+			   sustainable(trial, max_lag) ? "keeps up" : "falls behind");
+	} else {
+		printf("unthrottled:   %10.0f events/s, %8.1f poses/s, %.2fs of data in %.2fs (%.2fx real time)\n",
+			   trial->events / trial->wall_time, trial->poses / trial->wall_time, trial->data_time, trial->wall_time,
+			   trial->data_time / trial->wall_time);
+	}
+	fflush(stdout);
+}
+
+static void print_stages(const struct trial *trial) {
+	double total = 0;
+	for (int i = 0; i < STAGE_COUNT; i++)
+		total += trial->cpu_time[i];
+
+	printf("\nPer-stage CPU time on the polling thread (exclusive of nested stages):\n");
+	printf("  %-14s %12s %12s %10s %8s\n", "stage", "calls", "cpu (s)", "us/call", "share");
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		if (trial->calls[i] == 0)
+			continue;
+		printf("  %-14s %12llu %12.3f %10.2f %7.1f%%\n", stage_names[i], (unsigned long long)trial->calls[i],
+			   trial->cpu_time[i], trial->cpu_time[i] / trial->calls[i] * 1e6,
+			   total > 0 ? 100. * trial->cpu_time[i] / total : 0);
+	}
+	printf("  %-14s %12s %12.3f   over %.3fs of wall time\n", "total", "", total, trial->wall_time);
+}
+
+int main(int argc, char **argv) {
+	SurviveContext *ctx = survive_init(argc, argv);
+	if (ctx == 0)
+		return -1;
+
+	bool simulator = survive_config_is_set(ctx, "simulator");
+	if (!simulator && !survive_config_is_set(ctx, "playback")) {
+		fprintf(stderr, "Usage: %s --playback <file> | --simulator [--bench-* options] [libsurvive options]\n", argv[0]);
+		survive_close(ctx);
+		return -1;
+	}
+
+	double rate = survive_configf(ctx, "bench-rate-start", SC_GET, 1);
+	double rate_max = survive_configf(ctx, "bench-rate-max", SC_GET, 256);
+	double max_lag = survive_configf(ctx, "bench-max-lag", SC_GET, .1);
+	int refine = survive_configi(ctx, "bench-refine", SC_GET, 4);
+	double duration = survive_configf(ctx, "bench-duration", SC_GET, simulator ? 5 : 0);
+	int multiplex = survive_configi(ctx, "playback-multiplex", SC_GET, 1);
+	survive_close(ctx);
+
+	if (simulator && duration <= 0) {
+		fprintf(stderr, "The simulator never ends; set --bench-duration\n");
+		return -1;
+	}
+	if (rate <= 0)
+		rate = 1;
+
+	if (!simulator && multiplex > 1)
+		printf("Replaying each recorded device %d times\n", multiplex);
+
+	struct trial unthrottled = {0};
+	if (run_trial(argc, argv, simulator, duration, &unthrottled))
+		return -1;
+	print_trial(&unthrottled, max_lag);
+
+	// Double the rate until it can't keep up, then bisect between the last good and the first bad rate.
+	struct trial best = {0};
+	double good = 0, bad = 0;
+	for (; rate <= rate_max; rate *= 2) {
+		struct trial trial = {.rate = rate};
+		if (run_trial(argc, argv, simulator, duration, &trial))
+			return -1;
+		print_trial(&trial, max_lag);
+
+		if (!sustainable(&trial, max_lag)) {
+			bad = rate;
+			break;
+		}
+		good = rate;
+		best = trial;
+	}
+
+	for (int i = 0; i < refine && bad > 0 && good > 0; i++) {
+		struct trial trial = {.rate = (good + bad) / 2.};
+		if (run_trial(argc, argv, simulator, duration, &trial))
+			return -1;
+		print_trial(&trial, max_lag);
+
+		if (sustainable(&trial, max_lag)) {
+			good = trial.rate;
+			best = trial;
+		} else {
+			bad = trial.rate;
+		}
+	}
+
+	printf("\n");
+	if (good == 0) {
+		printf("Processing falls behind even at %.3fx real time\n", bad);
+	} else if (bad == 0) {
+		printf("Processing keeps up at every rate tried, up to %.3fx real time\n", good);
+	} else {
+		printf("Maximum sustainable rate: %.3fx real time (%.0f events/s); falls behind at %.3fx\n", good,
+			   best.events / best.wall_time, bad);
+	}
+
+	print_stages(good > 0 ? &best : &unthrottled);
+	return 0;
+}
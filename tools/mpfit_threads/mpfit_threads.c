@@ -0,0 +1,107 @@
+// Measures how much mpfit gains from computing finite-difference Jacobian columns on several threads, as a function of
+// the number of parameters.
+//
+// Usage: mpfit_threads [threads] [max parameters] [repeats]
+//
+// For each problem size the same fit is run serially and with 'threads' threads; the table lists the wall time of
+// each, the speedup, and whether the two fits agree bit for bit (they always should). The model is a sum of radial
+// basis functions with four residuals per parameter, so one residual evaluation costs O(n^2) and a Jacobian O(n^3);
+// at small n the thread start up cost dominates.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mpfit/mpfit.h"
+
+#define RESIDUALS_PER_PARAM 4
+
+typedef struct {
+	int n;
+	double *t, *y;
+} Problem;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double model(const Problem *problem, const double *p, double t) {
+	double r = 0;
+	for (int k = 0; k < problem->n; k++) {
+		double d = t - k;
+		r += p[k] * exp(-.5 * d * d);
+	}
+	return r;
+}
+
+static int residuals(int m, int n, double *p, double *deviates, double **derivs, void *private) {
+	const Problem *problem = private;
+	for (int i = 0; i < m; i++)
+		deviates[i] = problem->y[i] - model(problem, p, problem->t[i]) * (1 + .01 * p[i % n] * p[i % n]);
+	return 0;
+}
+
+static double fit(Problem *problem, int nthreads, double *p, mp_result *result) {
+	int m = problem->n * RESIDUALS_PER_PARAM;
+	for (int k = 0; k < problem->n; k++)
+		p[k] = 1;
+
+	mp_config config = {0};
+	config.nthreads = nthreads;
+	memset(result, 0, sizeof(*result));
+
+	double start = now();
+	mpfit(residuals, m, problem->n, p, 0, &config, problem, result);
+	return now() - start;
+}
+
+int main(int argc, char **argv) {
+	int nthreads = argc > 1 ? atoi(argv[1]) : 4;
+	int max_params = argc > 2 ? atoi(argv[2]) : 256;
+	int repeats = argc > 3 ? atoi(argv[3]) : 3;
+	if (nthreads < 2 || max_params < 1 || repeats < 1) {
+		fprintf(stderr, "Usage: %s [threads >= 2] [max parameters] [repeats]\n", argv[0]);
+		return -1;
+	}
+
+	printf("%6s %6s %12s %12s %8s %s\n", "params", "nfev", "serial ms", "threaded ms", "speedup", "identical");
+	for (int n = 4; n <= max_params; n *= 2) {
+		int m = n * RESIDUALS_PER_PARAM;
+		Problem problem = {.n = n, .t = malloc(sizeof(double) * m), .y = malloc(sizeof(double) * m)};
+		double *truth = malloc(sizeof(double) * n);
+		for (int k = 0; k < n; k++)
+			truth[k] = 1 + .5 * sin(k * 1.7);
+		for (int i = 0; i < m; i++) {
+			problem.t[i] = (i + .5) * n / (double)m;
+			problem.y[i] = model(&problem, truth, problem.t[i]);
+		}
+
+		double *serial = malloc(sizeof(double) * n), *threaded = malloc(sizeof(double) * n);
+		mp_result serial_result, threaded_result;
+		double serial_time = 1e100, threaded_time = 1e100;
+		for (int r = 0; r < repeats; r++) {
+			double t = fit(&problem, 1, serial, &serial_result);
+			serial_time = t < serial_time ? t : serial_time;
+			t = fit(&problem, nthreads, threaded, &threaded_result);
+			threaded_time = t < threaded_time ? t : threaded_time;
+		}
+
+		int identical = serial_result.status == threaded_result.status &&
+						serial_result.nfev == threaded_result.nfev &&
+						serial_result.bestnorm == threaded_result.bestnorm &&
+						memcmp(serial, threaded, sizeof(double) * n) == 0;
+		printf("%6d %6d %12.3f %12.3f %8.2f %s\n", n, serial_result.nfev, serial_time * 1000., threaded_time * 1000.,
+			   serial_time / threaded_time, identical ? "yes" : "NO");
+
+		free(problem.t);
+		free(problem.y);
+		free(truth);
+		free(serial);
+		free(threaded);
+	}
+	return 0;
+}
@@ -2,223 +2,513 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include "os_generic.h"
 #define NUM_DEVICES 3
 #define MAX_SENSORS 32
 #define MAX_SWEEP_INFO 4
+#define NUM_SHARDS (NUM_DEVICES*MAX_SENSORS*MAX_SWEEP_INFO)
 
 #define MAX_DATAPOINTS_PER_SECTION 16384
 
-//Takes 300MB of ram to boot.
+//Input is read as a stream, in batches of this many lines which are parsed on the worker threads. At most two
+//batches per thread are in flight, so memory is bounded by the shards (MAX_DATAPOINTS_PER_SECTION points each, only
+//allocated for shards that show up in the data) no matter how large the capture is.
+#define LINES_PER_BATCH 4096
 
 const char * Devices[] = { "HMD", "WM0", "WM1" };
 const char * DevMap[] = { "LX", "LY", "RX", "RY" };
 
-uint32_t    DATASWEEP[NUM_DEVICES][MAX_SENSORS][MAX_SWEEP_INFO][MAX_DATAPOINTS_PER_SECTION];
-uint16_t    DATALENGTH[NUM_DEVICES][MAX_SENSORS][MAX_SWEEP_INFO][MAX_DATAPOINTS_PER_SECTION];
-int    DPNUM[NUM_DEVICES][MAX_SENSORS][MAX_SWEEP_INFO];
+//All of the points for one device/sensor/sweep, in input order.
+typedef struct
+{
+	int dpnum;
+	int capacity;
+	uint32_t * sweep;
+	uint16_t * length;
+} Shard;
 
+Shard Shards[NUM_DEVICES][MAX_SENSORS][MAX_SWEEP_INFO];
 
-int main( int argc, char ** argv )
+enum { RECORD_OK, RECORD_SHORT, RECORD_DEVICE, RECORD_SENSOR, RECORD_TYPE };
+
+//One parsed input line. Messages about bad lines are printed when the batch is committed so they come out in order.
+typedef struct
 {
-	if( argc < 2 )
+	int status;
+	int valuesread;
+	char text[10];
+	int dev, sensor, swe;
+	int timeinsweep;
+	int pulselength;
+} Record;
+
+typedef struct
+{
+	char * text;
+	size_t textlen, textcap;
+	size_t offsets[LINES_PER_BATCH];
+	int lines;
+	int firstline;
+	Record records[LINES_PER_BATCH];
+	og_sema_t parsed;
+} Batch;
+
+typedef struct
+{
+	Batch * batches;
+	int nbatches;
+	og_mutex_t mutex;
+	og_sema_t work;
+	int nextbatch;
+	int done;
+} ParseQueue;
+
+#define HISTOGRAMSIZE 31
+
+typedef struct
+{
+	int count;
+	int cullcount;
+	double avgsweep, avglen;
+	double stddevtim, stddevlen;
+	int histo[HISTOGRAMSIZE];
+} ShardResult;
+
+typedef struct
+{
+	og_mutex_t mutex;
+	int nextshard;
+	ShardResult * results;
+} ShardQueue;
+
+static void ParseLine( const char * line, Record * rec )
+{
+	//Expecting; L X WM0 632359048 2 2 190890 319
+	//Pulsecode is ignored, L/R X/Y is what is used.
+	int i;
+	char lhn[10];
+	char axn[10];
+	char dev[10];
+	int unusedtime = 0;
+	int sensor = 0;
+	int unusedcode = 0;
+	int timeinsweep = 0;
+	int pulselength = 0;
+
+	int rr = sscanf(line,"%8s %8s %8s %d %d %d %d %d\n", lhn, axn, dev, &unusedtime, &sensor, &unusedcode, &timeinsweep, &pulselength );
+	if( rr != 8 )
 	{
-		fprintf( stderr, "Error: usage process_to_points [raw data.csv]\n" );
-		exit( -5 );
+		rec->status = RECORD_SHORT;
+		rec->valuesread = rr;
+		return;
 	}
 
-	FILE * f = fopen( argv[1], "r" );
+	for( i = 0; i < NUM_DEVICES; i++ )
+	{
+		if( strcmp( dev, Devices[i] ) == 0 ) break;
+	}
+	if( i == NUM_DEVICES )
+	{
+		rec->status = RECORD_DEVICE;
+		strcpy( rec->text, dev );
+		return;
+	}
+	rec->dev = i;
+	if( sensor < 0 || sensor >= MAX_SENSORS )
+	{
+		rec->status = RECORD_SENSOR;
+		return;
+	}
+	char lcom[3];
+	lcom[0] = lhn[0];
+	lcom[1] = axn[0];
+	lcom[2] = 0;
 
-	int lineno = 0;
-	while(!feof(f) && !ferror(f) )
+	for( i = 0; i < 4; i++ )
+	{
+		if( strcmp( lcom, DevMap[i] ) == 0 ) break;
+	}
+	if( i == 4 )
 	{
-		int i;
-		lineno++;
+		rec->status = RECORD_TYPE;
+		strcpy( rec->text, lcom );
+		return;
+	}
 
-		//Expecting; L X WM0 632359048 2 2 190890 319
-		//Pulsecode is ignored, L/R X/Y is what is used.
+	rec->status = RECORD_OK;
+	rec->sensor = sensor;
+	rec->swe = i;
+	rec->timeinsweep = timeinsweep;
+	rec->pulselength = pulselength;
+}
 
-		char  * line;
-		size_t n = 0;
-		ssize_t r = getline( &line, &n, f );
-		if( r <= 0 ) break;
+static void ParseBatch( Batch * b )
+{
+	int i;
+	for( i = 0; i < b->lines; i++ )
+	{
+		ParseLine( b->text + b->offsets[i], &b->records[i] );
+	}
+}
 
-		char lhn[10];
-		char axn[10];
-		char dev[10];
-		int unusedtime = 0;
-		int sensor = 0;
-		int unusedcode = 0;
-		int timeinsweep = 0;
-		int pulselength = 0;
+//Reads up to LINES_PER_BATCH lines into the batch; leaves it empty at the end of the input.
+static void FillBatch( Batch * b, FILE * f, int * lineno, char ** line, size_t * n )
+{
+	b->lines = 0;
+	b->textlen = 0;
+	b->firstline = *lineno + 1;
+	while( b->lines < LINES_PER_BATCH && !feof(f) && !ferror(f) )
+	{
+		ssize_t r = getline( line, n, f );
+		if( r <= 0 ) break;
+		(*lineno)++;
 
-		int rr = sscanf(line,"%8s %8s %8s %d %d %d %d %d\n", lhn, axn, dev, &unusedtime, &sensor, &unusedcode, &timeinsweep, &pulselength );
-		free( line );
-		if( rr != 8 )
+		if( b->textlen + r + 1 > b->textcap )
 		{
-			fprintf( stderr, "Warning:  On line %d, only %d values read\n", lineno, rr );
-			continue;
+			b->textcap = ( b->textlen + r + 1 ) * 2;
+			b->text = realloc( b->text, b->textcap );
 		}
+		memcpy( b->text + b->textlen, *line, r + 1 );
+		b->offsets[b->lines++] = b->textlen;
+		b->textlen += r + 1;
+	}
+}
 
+static void AddPoint( Shard * s, int timeinsweep, int pulselength, int lineno )
+{
+	int num = s->dpnum++;
+	if( num >= MAX_DATAPOINTS_PER_SECTION )
+	{
+		fprintf( stderr, "Error: Too many datapoints on line %d - %d found, %d max\n", lineno, num, MAX_DATAPOINTS_PER_SECTION );
+		return;
+	}
+	if( num >= s->capacity )
+	{
+		s->capacity = s->capacity ? s->capacity * 2 : 256;
+		if( s->capacity > MAX_DATAPOINTS_PER_SECTION ) s->capacity = MAX_DATAPOINTS_PER_SECTION;
+		s->sweep = realloc( s->sweep, s->capacity * sizeof( uint32_t ) );
+		s->length = realloc( s->length, s->capacity * sizeof( uint16_t ) );
+	}
+	s->sweep[num] = timeinsweep;
+	s->length[num] = pulselength;
+}
 
-		int devnum = -1;
-		for( i = 0; i < NUM_DEVICES; i++ )
-		{
-			if( strcmp( dev, Devices[i] ) == 0 ) break;
-		}
-		if( i == NUM_DEVICES )
-		{
-			fprintf( stderr, "Error: unrecognized device %s on line %d\n",dev, lineno );
-			continue;
-		}
-		devnum = i;
-		if( sensor < 0 || sensor > MAX_SENSORS )
+//Done on the reading thread, in input order, so shards and messages come out exactly as a serial pass would have them.
+static void CommitBatch( const Batch * b )
+{
+	int i;
+	for( i = 0; i < b->lines; i++ )
+	{
+		const Record * rec = &b->records[i];
+		int lineno = b->firstline + i;
+		switch( rec->status )
 		{
+		case RECORD_SHORT:
+			fprintf( stderr, "Warning:  On line %d, only %d values read\n", lineno, rec->valuesread );
+			break;
+		case RECORD_DEVICE:
+			fprintf( stderr, "Error: unrecognized device %s on line %d\n", rec->text, lineno );
+			break;
+		case RECORD_SENSOR:
 			fprintf( stderr, "Error: sensor # too high on dev at line %d\n",lineno );
-			continue;
+			break;
+		case RECORD_TYPE:
+			fprintf( stderr, "Error: entry type %s confusing on line %d\n", rec->text, lineno );
+			break;
+		default:
+			AddPoint( &Shards[rec->dev][rec->sensor][rec->swe], rec->timeinsweep, rec->pulselength, lineno );
 		}
-		char lcom[3];
-		lcom[0] = lhn[0];
-		lcom[1] = axn[0];
-		lcom[2] = 0;
+	}
+}
 
-		for( i = 0; i < 4; i++ )
+static void * ParseWorker( void * v )
+{
+	ParseQueue * q = v;
+	while( 1 )
+	{
+		OGLockSema( q->work );
+		OGLockMutex( q->mutex );
+		if( q->done )
 		{
-			if( strcmp( lcom, DevMap[i] ) == 0 ) break;
+			OGUnlockMutex( q->mutex );
+			OGUnlockSema( q->work );
+			return 0;
 		}
-		if( i == 4 )
+		Batch * b = &q->batches[q->nextbatch++ % q->nbatches];
+		OGUnlockMutex( q->mutex );
+
+		ParseBatch( b );
+		OGUnlockSema( b->parsed );
+	}
+}
+
+//Returns the number of lines read.
+static int ReadCapture( FILE * f, int threads )
+{
+	int lineno = 0;
+	char * line = 0;
+	size_t n = 0;
+
+	if( threads < 2 )
+	{
+		Batch * b = calloc( 1, sizeof( Batch ) );
+		do
 		{
-			fprintf( stderr, "Error: entry type %s confusing on line %d\n", lcom, lineno );
-			continue;
-		}
-		int swe = i;
+			FillBatch( b, f, &lineno, &line, &n );
+			ParseBatch( b );
+			CommitBatch( b );
+		} while( b->lines );
+		free( b->text );
+		free( b );
+		free( line );
+		return lineno;
+	}
 
-		int num = DPNUM[devnum][sensor][swe]++;
-		if( num >= MAX_DATAPOINTS_PER_SECTION )
+	ParseQueue q = { 0 };
+	q.nbatches = threads * 2;
+	q.batches = calloc( q.nbatches, sizeof( Batch ) );
+	q.mutex = OGCreateMutex();
+	q.work = OGCreateSema();
+	int i;
+	for( i = 0; i < q.nbatches; i++ )
+		q.batches[i].parsed = OGCreateSema();
+
+	og_thread_t * workers = malloc( threads * sizeof( og_thread_t ) );
+	for( i = 0; i < threads; i++ )
+		workers[i] = OGCreateThread( ParseWorker, &q );
+
+	int filled = 0, committed = 0;
+	while( 1 )
+	{
+		Batch * b = &q.batches[filled % q.nbatches];
+		if( filled - committed == q.nbatches )
 		{
-			fprintf( stderr, "Error: Too many datapoints on line %d - %d found, %d max\n", lineno, num, MAX_DATAPOINTS_PER_SECTION );
-			continue;
+			OGLockSema( b->parsed );
+			CommitBatch( b );
+			committed++;
 		}
-		DATASWEEP[devnum][sensor][swe][num] = timeinsweep;
-		DATALENGTH[devnum][sensor][swe][num] = pulselength;
+		FillBatch( b, f, &lineno, &line, &n );
+		if( b->lines == 0 ) break;
+		filled++;
+		OGUnlockSema( q.work );
 	}
-	fprintf( stderr, "Read %d lines of data.\n", lineno );
-
-	//Now, process the data.
-
-	FILE * hists = fopen( "histograms.csv", "w" );
-	int dev, sen, swe;
-	for( dev = 0; dev < NUM_DEVICES; dev++ )
-	for( sen = 0; sen < MAX_SENSORS; sen++ )
-	for( swe = 0; swe < 4; swe++ )
+	for( ; committed < filled; committed++ )
 	{
-		int dpmax = DPNUM[dev][sen][swe];
-		if( !dpmax ) continue;
-		int i;
+		Batch * b = &q.batches[committed % q.nbatches];
+		OGLockSema( b->parsed );
+		CommitBatch( b );
+	}
 
-		double sumsweeptime = 0;
-		double sumlentime = 0;
-		int count = 0;
+	OGLockMutex( q.mutex );
+	q.done = 1;
+	OGUnlockMutex( q.mutex );
+	OGUnlockSema( q.work );
+	for( i = 0; i < threads; i++ )
+		OGJoinThread( workers[i] );
 
+	for( i = 0; i < q.nbatches; i++ )
+	{
+		OGDeleteSema( q.batches[i].parsed );
+		free( q.batches[i].text );
+	}
+	OGDeleteSema( q.work );
+	OGDeleteMutex( q.mutex );
+	free( q.batches );
+	free( workers );
+	free( line );
+	return lineno;
+}
 
-		//First make a rough histogram to find the peak, discard points not anywhere close to peak.
+//First make a rough histogram to find the peak, discard points not anywhere close to peak.
 #define MAX_LENTIME 200000 //800000/4
 #define MAX_PERMISSABLE_TO_PEAK 40
 
-		int cullcount = 0;
-		int biggesttime = 0;
-		int biggesttimeplace = -1;
+//Returns 0 if the shard has too few points near its peak to say anything about.
+static int AnalyzeShard( Shard * s, int * bincounts, ShardResult * out )
+{
+	int dpmax = s->dpnum < MAX_DATAPOINTS_PER_SECTION ? s->dpnum : MAX_DATAPOINTS_PER_SECTION;
+	int i;
+
+	double sumsweeptime = 0;
+	double sumlentime = 0;
+	int count = 0;
 
+	int cullcount = 0;
+	int biggesttime = 0;
+	int biggesttimeplace = -1;
+
+	memset( bincounts, 0, ( MAX_LENTIME + 1 ) * sizeof( int ) );
+	for( i = 0; i < dpmax; i++ )
+	{
+		int sweeptime = s->sweep[i]/4;
+		if( sweeptime < 0 || sweeptime > MAX_LENTIME )
+		{
+			s->sweep[i] = -1;
+			continue;
+		}
+		int rc = bincounts[sweeptime]++;
+		if( rc > biggesttime )
 		{
-			int bincounts[MAX_LENTIME];
-			for( i = 0; i < dpmax; i++ )
-			{
-				int sweeptime = DATASWEEP[dev][sen][swe][i]/4;
-				if( sweeptime < 0 || sweeptime > MAX_LENTIME ) 
-				{
-					DATASWEEP[dev][sen][swe][i] = -1;
-					continue;
-				}
-				int rc = bincounts[sweeptime]++;
-				if( rc > biggesttime )
-				{
-					biggesttime = rc;
-					biggesttimeplace = sweeptime;
-				}
-			}
+			biggesttime = rc;
+			biggesttimeplace = sweeptime;
 		}
+	}
 
-		for( i = 0; i < dpmax; i++ )
+	for( i = 0; i < dpmax; i++ )
+	{
+		int sweeptime = s->sweep[i];
+		int datalen = s->length[i];
+		int dist_to_peak = sweeptime/4 - biggesttimeplace ;
+
+		if( sweeptime < 0 ) continue;
+		if( dist_to_peak > MAX_PERMISSABLE_TO_PEAK || dist_to_peak < -MAX_PERMISSABLE_TO_PEAK )
 		{
-			int sweeptime = DATASWEEP[dev][sen][swe][i];
-			int datalen = DATALENGTH[dev][sen][swe][i];
-			int dist_to_peak = sweeptime/4 - biggesttimeplace ;
-
-			if( sweeptime < 0 ) continue;
-			if( dist_to_peak > MAX_PERMISSABLE_TO_PEAK || dist_to_peak < -MAX_PERMISSABLE_TO_PEAK )
-			{
-				DATASWEEP[dev][sen][swe][i] = -1;
-				cullcount++;
-				continue;
-			}
-
-			sumsweeptime += sweeptime;
-			sumlentime += datalen;
-			count++;
+			s->sweep[i] = -1;
+			cullcount++;
+			continue;
 		}
 
-		if( count < 50 ) continue;
+		sumsweeptime += sweeptime;
+		sumlentime += datalen;
+		count++;
+	}
 
-		double avgsweep = sumsweeptime / count;
-		double avglen = sumlentime / count;
+	if( count < 50 ) return 0;
 
-		double stddevtim = 0;
-		double stddevlen = 0;
+	double avgsweep = sumsweeptime / count;
+	double avglen = sumlentime / count;
 
-		#define HISTOGRAMSIZE 31
+	double stddevtim = 0;
+	double stddevlen = 0;
 
-		int histo[HISTOGRAMSIZE];
-		memset( histo, 0, sizeof( histo ) );
+	memset( out->histo, 0, sizeof( out->histo ) );
 
-		for( i = 0; i < dpmax; i++ )
-		{
-			int sweeptime = DATASWEEP[dev][sen][swe][i];
-			int datalen = DATALENGTH[dev][sen][swe][i];
+	for( i = 0; i < dpmax; i++ )
+	{
+		int sweeptime = s->sweep[i];
+		int datalen = s->length[i];
 
-			if( sweeptime < 0 ) continue;
+		if( sweeptime < 0 ) continue;
 
-			double Sdiff = sweeptime - avgsweep;
-			double Ldiff = datalen - avglen;
+		double Sdiff = sweeptime - avgsweep;
+		double Ldiff = datalen - avglen;
 
-			stddevtim += Sdiff * Sdiff;
-			stddevlen += Ldiff * Ldiff;
+		stddevtim += Sdiff * Sdiff;
+		stddevlen += Ldiff * Ldiff;
 
-			//Cast a wider net for the histogram.
-			//Sdiff/=4;
+		//Cast a wider net for the histogram.
+		//Sdiff/=4;
 
-			int llm = Sdiff + (HISTOGRAMSIZE/2.0);
-			if( llm < 0 ) llm = 0;
-			if( llm >= HISTOGRAMSIZE ) llm = HISTOGRAMSIZE-1;
+		int llm = Sdiff + (HISTOGRAMSIZE/2.0);
+		if( llm < 0 ) llm = 0;
+		if( llm >= HISTOGRAMSIZE ) llm = HISTOGRAMSIZE-1;
 
-			histo[llm]++;
-		}
+		out->histo[llm]++;
+	}
+
+	out->count = count;
+	out->cullcount = cullcount;
+	out->avgsweep = avgsweep;
+	out->avglen = avglen;
+	out->stddevtim = stddevtim / count;
+	out->stddevlen = stddevlen / count;
+	return 1;
+}
+
+static void * ShardWorker( void * v )
+{
+	ShardQueue * q = v;
+	int * bincounts = malloc( ( MAX_LENTIME + 1 ) * sizeof( int ) );
+	Shard * shards = &Shards[0][0][0];
+	while( 1 )
+	{
+		OGLockMutex( q->mutex );
+		int i = q->nextshard++;
+		OGUnlockMutex( q->mutex );
+		if( i >= NUM_SHARDS ) break;
+
+		ShardResult * r = &q->results[i];
+		r->count = 0;
+		if( shards[i].dpnum == 0 || !AnalyzeShard( &shards[i], bincounts, r ) )
+			r->count = -1;
+	}
+	free( bincounts );
+	return 0;
+}
 
-		if( cullcount > 100 )
+int main( int argc, char ** argv )
+{
+	int threads = sysconf( _SC_NPROCESSORS_ONLN );
+	if( argc > 3 && strcmp( argv[1], "-j" ) == 0 )
+	{
+		threads = atoi( argv[2] );
+		argc -= 2;
+		argv += 2;
+	}
+	if( threads < 1 ) threads = 1;
+
+	if( argc < 2 )
+	{
+		fprintf( stderr, "Error: usage process_to_points [-j threads] [raw data.csv]\n" );
+		exit( -5 );
+	}
+
+	FILE * f = fopen( argv[1], "r" );
+	if( !f )
+	{
+		fprintf( stderr, "Error: could not open %s\n", argv[1] );
+		exit( -5 );
+	}
+
+	int lineno = ReadCapture( f, threads );
+	fclose( f );
+	//Counts the read that hit the end of the file, as this always has.
+	fprintf( stderr, "Read %d lines of data.\n", lineno + 1 );
+
+	//Now, process the data. Shards are independent, so they are spread over the threads; results are printed in
+	//shard order afterwards.
+	ShardQueue q = { 0 };
+	q.mutex = OGCreateMutex();
+	q.results = calloc( NUM_SHARDS, sizeof( ShardResult ) );
+	int i;
+	if( threads < 2 )
+	{
+		ShardWorker( &q );
+	}
+	else
+	{
+		og_thread_t * workers = malloc( threads * sizeof( og_thread_t ) );
+		for( i = 0; i < threads; i++ )
+			workers[i] = OGCreateThread( ShardWorker, &q );
+		for( i = 0; i < threads; i++ )
+			OGJoinThread( workers[i] );
+		free( workers );
+	}
+
+	FILE * hists = fopen( "histograms.csv", "w" );
+	int dev, sen, swe;
+	for( dev = 0; dev < NUM_DEVICES; dev++ )
+	for( sen = 0; sen < MAX_SENSORS; sen++ )
+	for( swe = 0; swe < 4; swe++ )
+	{
+		const ShardResult * r = &q.results[( dev * MAX_SENSORS + sen ) * MAX_SWEEP_INFO + swe];
+		if( r->count < 0 ) continue;
+
+		if( r->cullcount > 100 )
 		{
-			fprintf( stderr, "WARNING: %s%s%02d has %d out-of-window hits. Broken disambiguator?\n", Devices[dev], DevMap[swe], sen, cullcount );
+			fprintf( stderr, "WARNING: %s%s%02d has %d out-of-window hits. Broken disambiguator?\n", Devices[dev], DevMap[swe], sen, r->cullcount );
 		}
 
-		stddevtim /= count;
-		stddevlen /= count;
-
-		if( stddevtim > 55 )
+		if( r->stddevtim > 55 )
 		{
-			fprintf( stderr, "DROPPED: %s%s%02d dropped because stddev (%f) was too high.\n", Devices[dev], DevMap[swe], sen, stddevtim );
+			fprintf( stderr, "DROPPED: %s%s%02d dropped because stddev (%f) was too high.\n", Devices[dev], DevMap[swe], sen, r->stddevtim );
 			continue;
 		}
 
-		if( count < 1000 )
+		if( r->count < 1000 )
 		{
-			fprintf( stderr, "DROPPED: %s%s%02d dropped because of insufficient (%d) points.\n", Devices[dev], DevMap[swe], sen, count );
+			fprintf( stderr, "DROPPED: %s%s%02d dropped because of insufficient (%d) points.\n", Devices[dev], DevMap[swe], sen, r->count );
 			continue;
 		}
 
@@ -226,12 +516,22 @@ int main( int argc, char ** argv )
 
 		for( i = 0; i < HISTOGRAMSIZE; i++ )
 		{
-			fprintf( hists, "%d, ", histo[i] );
+			fprintf( hists, "%d, ", r->histo[i] );
 		}
 		fprintf( hists, "\n" );
 
-		printf( "%s %s %d %d %f %f %f %f\n", Devices[dev], DevMap[swe], sen, count, avgsweep, avglen, stddevtim, stddevlen );
+		printf( "%s %s %d %d %f %f %f %f\n", Devices[dev], DevMap[swe], sen, r->count, r->avgsweep, r->avglen, r->stddevtim, r->stddevlen );
 	}
+	fclose( hists );
 
-
+	for( dev = 0; dev < NUM_DEVICES; dev++ )
+	for( sen = 0; sen < MAX_SENSORS; sen++ )
+	for( swe = 0; swe < 4; swe++ )
+	{
+		free( Shards[dev][sen][swe].sweep );
+		free( Shards[dev][sen][swe].length );
+	}
+	free( q.results );
+	OGDeleteMutex( q.mutex );
+	return 0;
 }
@@ -0,0 +1,326 @@
+// Converts a recording into columnar binary files that analysis tools can memory-map directly.
+//
+// Usage: recording_to_columns <recording> <output directory>
+//
+// The output directory gets one subdirectory per event type (lightcap, light, angle, imu, pose, velocity,
+// external_pose) holding one file per column, plus 'objects.txt' listing one device name per line; the 'object' column
+// of every table indexes into it. Each column file is a 32 byte header followed by 'rows' fixed-width values:
+//
+//   char     magic[8];  "SVCOL1\0\0"
+//   char     dtype[8];  numpy style type string, ie "<f8", "<u4", "|u1"
+//   uint64_t rows;
+//   uint64_t reserved;
+//
+// so in numpy a column loads with np.memmap(path, dtype=dtype, mode='r', offset=32, shape=(rows,)). Lines are parsed
+// with survive_parse_recording_line, the same code playback uses.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <survive.h>
+#include <survive_playback.h>
+
+#define COLUMN_HEADER_SIZE 32
+#define MAX_COLUMNS 16
+#define MAX_OBJECTS 65535
+
+struct column {
+	const char *name;
+	const char *dtype; // Without the byte order prefix
+	size_t size;
+	FILE *f;
+};
+
+struct table {
+	const char *name;
+	struct column columns[MAX_COLUMNS];
+	uint64_t rows;
+	bool opened;
+};
+
+#define F8 "f8", 8
+#define I4 "i4", 4
+#define U4 "u4", 4
+#define U2 "u2", 2
+#define U1 "u1", 1
+
+enum { TABLE_LIGHTCAP, TABLE_LIGHT, TABLE_ANGLE, TABLE_IMU, TABLE_POSE, TABLE_VELOCITY, TABLE_EXTERNAL_POSE, TABLE_COUNT };
+
+static struct table tables[TABLE_COUNT] = {
+	[TABLE_LIGHTCAP] = {"lightcap", {{"time", F8}, {"object", U2}, {"sensor_id", U1}, {"timecode", U4}, {"length", U2}}},
+	[TABLE_LIGHT] = {"light",
+					 {{"time", F8},
+					  {"object", U2},
+					  {"sensor_id", I4},
+					  {"acode", I4},
+					  {"timeinsweep", I4},
+					  {"timecode", U4},
+					  {"length", U4},
+					  {"lh", U4}}},
+	[TABLE_ANGLE] = {"angle",
+					 {{"time", F8},
+					  {"object", U2},
+					  {"sensor_id", I4},
+					  {"acode", I4},
+					  {"timecode", U4},
+					  {"length", F8},
+					  {"angle", F8},
+					  {"lh", U4}}},
+	[TABLE_IMU] = {"imu",
+				   {{"time", F8},
+					{"object", U2},
+					{"mask", I4},
+					{"timecode", U4},
+					{"accel_x", F8},
+					{"accel_y", F8},
+					{"accel_z", F8},
+					{"gyro_x", F8},
+					{"gyro_y", F8},
+					{"gyro_z", F8},
+					{"mag_x", F8},
+					{"mag_y", F8},
+					{"mag_z", F8},
+					{"id", I4}}},
+	[TABLE_POSE] = {"pose",
+					{{"time", F8},
+					 {"object", U2},
+					 {"pos_x", F8},
+					 {"pos_y", F8},
+					 {"pos_z", F8},
+					 {"rot_w", F8},
+					 {"rot_x", F8},
+					 {"rot_y", F8},
+					 {"rot_z", F8}}},
+	[TABLE_VELOCITY] = {"velocity",
+						{{"time", F8},
+						 {"object", U2},
+						 {"vel_x", F8},
+						 {"vel_y", F8},
+						 {"vel_z", F8},
+						 {"ang_x", F8},
+						 {"ang_y", F8},
+						 {"ang_z", F8}}},
+	[TABLE_EXTERNAL_POSE] = {"external_pose",
+							 {{"time", F8},
+							  {"object", U2},
+							  {"pos_x", F8},
+							  {"pos_y", F8},
+							  {"pos_z", F8},
+							  {"rot_w", F8},
+							  {"rot_x", F8},
+							  {"rot_y", F8},
+							  {"rot_z", F8}}},
+};
+
+static const char *output_dir;
+
+static char *objects[MAX_OBJECTS];
+static int object_count;
+
+static void fail(const char *what, const char *path) {
+	fprintf(stderr, "Could not %s '%s': %s\n", what, path, strerror(errno));
+	exit(-1);
+}
+
+static char byte_order() {
+	uint16_t one = 1;
+	return *(uint8_t *)&one ? '<' : '>';
+}
+
+static void write_header(struct column *column, uint64_t rows) {
+	char header[COLUMN_HEADER_SIZE] = "SVCOL1";
+	snprintf(header + 8, 8, "%c%s", column->size == 1 ? '|' : byte_order(), column->dtype);
+	memcpy(header + 16, &rows, sizeof(rows));
+	fwrite(header, sizeof(header), 1, column->f);
+}
+
+static void open_table(struct table *table) {
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/%s", output_dir, table->name);
+	if (mkdir(path, 0777) != 0 && errno != EEXIST)
+		fail("create", path);
+
+	for (struct column *column = table->columns; column->name; column++) {
+		snprintf(path, sizeof(path), "%s/%s/%s.col", output_dir, table->name, column->name);
+		column->f = fopen(path, "wb");
+		if (column->f == 0)
+			fail("open", path);
+
+		// Columns are written one value at a time; a large buffer keeps that at disk speed.
+		setvbuf(column->f, 0, _IOFBF, 1 << 20);
+		write_header(column, 0);
+	}
+	table->opened = true;
+}
+
+static void close_table(struct table *table) {
+	if (!table->opened)
+		return;
+
+	for (struct column *column = table->columns; column->name; column++) {
+		fseek(column->f, 0, SEEK_SET);
+		write_header(column, table->rows);
+		if (fclose(column->f) != 0)
+			fail("write", column->name);
+	}
+	printf("%-14s %12llu rows\n", table->name, (unsigned long long)table->rows);
+}
+
+static uint16_t object_index(const char *name) {
+	for (int i = 0; i < object_count; i++) {
+		if (strcmp(objects[i], name) == 0)
+			return i;
+	}
+	if (object_count == MAX_OBJECTS) {
+		fprintf(stderr, "More than %d distinct object names\n", MAX_OBJECTS);
+		exit(-1);
+	}
+	objects[object_count] = strdup(name);
+	return object_count++;
+}
+
+// Appends the next value of a row; values must come in column order.
+#define PUT(column, type, value)                                                                                       \
+	do {                                                                                                               \
+		type v = (type)(value);                                                                                        \
+		fwrite(&v, sizeof(v), 1, (column)->f);                                                                         \
+	} while (0)
+
+static void write_row(struct table *table, double time, const SurviveRecordingEvent *event) {
+	if (!table->opened)
+		open_table(table);
+
+	struct column *c = table->columns;
+	PUT(c++, double, time);
+	PUT(c++, uint16_t, object_index(event->dev));
+
+	switch (event->type) {
+	case SURVIVE_RECORDING_LIGHTCAP:
+		PUT(c++, uint8_t, event->data.lightcap.sensor_id);
+		PUT(c++, uint32_t, event->data.lightcap.timestamp);
+		PUT(c++, uint16_t, event->data.lightcap.length);
+		break;
+	case SURVIVE_RECORDING_LIGHT:
+		PUT(c++, int32_t, event->data.light.sensor_id);
+		PUT(c++, int32_t, event->data.light.acode);
+		PUT(c++, int32_t, event->data.light.timeinsweep);
+		PUT(c++, uint32_t, event->data.light.timecode);
+		PUT(c++, uint32_t, event->data.light.length);
+		PUT(c++, uint32_t, event->data.light.lh);
+		break;
+	case SURVIVE_RECORDING_ANGLE:
+		PUT(c++, int32_t, event->data.angle.sensor_id);
+		PUT(c++, int32_t, event->data.angle.acode);
+		PUT(c++, uint32_t, event->data.angle.timecode);
+		PUT(c++, double, event->data.angle.length);
+		PUT(c++, double, event->data.angle.angle);
+		PUT(c++, uint32_t, event->data.angle.lh);
+		break;
+	case SURVIVE_RECORDING_IMU:
+		PUT(c++, int32_t, event->data.imu.mask);
+		PUT(c++, uint32_t, event->data.imu.timecode);
+		for (int i = 0; i < 9; i++)
+			PUT(c++, double, event->data.imu.accelgyro[i]);
+		PUT(c++, int32_t, event->data.imu.id);
+		break;
+	case SURVIVE_RECORDING_POSE:
+	case SURVIVE_RECORDING_EXTERNAL_POSE:
+		for (int i = 0; i < 3; i++)
+			PUT(c++, double, event->data.pose.Pos[i]);
+		for (int i = 0; i < 4; i++)
+			PUT(c++, double, event->data.pose.Rot[i]);
+		break;
+	case SURVIVE_RECORDING_VELOCITY:
+		for (int i = 0; i < 3; i++)
+			PUT(c++, double, event->data.velocity.Pos[i]);
+		for (int i = 0; i < 3; i++)
+			PUT(c++, double, event->data.velocity.EulerRot[i]);
+		break;
+	default:
+		break;
+	}
+	table->rows++;
+}
+
+static struct table *table_for(SurviveRecordingEventType type) {
+	switch (type) {
+	case SURVIVE_RECORDING_LIGHTCAP:
+		return &tables[TABLE_LIGHTCAP];
+	case SURVIVE_RECORDING_LIGHT:
+		return &tables[TABLE_LIGHT];
+	case SURVIVE_RECORDING_ANGLE:
+		return &tables[TABLE_ANGLE];
+	case SURVIVE_RECORDING_IMU:
+		return &tables[TABLE_IMU];
+	case SURVIVE_RECORDING_POSE:
+		return &tables[TABLE_POSE];
+	case SURVIVE_RECORDING_VELOCITY:
+		return &tables[TABLE_VELOCITY];
+	case SURVIVE_RECORDING_EXTERNAL_POSE:
+		return &tables[TABLE_EXTERNAL_POSE];
+	default:
+		return 0;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <recording> <output directory>\n", argv[0]);
+		return -1;
+	}
+
+	FILE *f = fopen(argv[1], "r");
+	if (f == 0)
+		fail("open", argv[1]);
+	setvbuf(f, 0, _IOFBF, 1 << 20);
+
+	output_dir = argv[2];
+	if (mkdir(output_dir, 0777) != 0 && errno != EEXIST)
+		fail("create", output_dir);
+
+	char *line = 0;
+	size_t n = 0;
+	ssize_t r;
+	int lineno = 0, malformed = 0;
+	while ((r = getline(&line, &n, f)) > 0) {
+		lineno++;
+		while (r && (line[r - 1] == '\n' || line[r - 1] == '\r'))
+			line[--r] = 0;
+
+		char *rest = 0;
+		double time = strtod(line, &rest);
+		if (rest == line)
+			continue;
+
+		SurviveRecordingEvent event;
+		if (survive_parse_recording_line(rest, &event) != 0) {
+			if (malformed++ < 10)
+				fprintf(stderr, "Skipping malformed line %d: '%s'\n", lineno, line);
+			continue;
+		}
+
+		struct table *table = table_for(event.type);
+		if (table)
+			write_row(table, time, &event);
+	}
+	free(line);
+	fclose(f);
+
+	for (int i = 0; i < TABLE_COUNT; i++)
+		close_table(&tables[i]);
+
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/objects.txt", output_dir);
+	FILE *objects_file = fopen(path, "w");
+	if (objects_file == 0)
+		fail("open", path);
+	for (int i = 0; i < object_count; i++)
+		fprintf(objects_file, "%s\n", objects[i]);
+	fclose(objects_file);
+
+	printf("%d lines, %d malformed, %d objects\n", lineno, malformed, object_count);
+	return 0;
+}
@@ -2,13 +2,44 @@
 #include <os_generic.h>
 #include <stdio.h>
 #include <string.h>
+#include <thread>
 
 #include "ros/ros.h"
 #include <geometry_msgs/PoseStamped.h>
 
+// Maps an object's 32 bit device timecodes onto ros time. The timecode is unwrapped into a running tick count, and the
+// offset between host and device clocks is the smallest one seen so far -- the sample with the least transport and
+// processing delay. It is allowed to creep up slowly so drift between the two clocks doesn't pin it to an old minimum.
+struct DeviceClock {
+	bool valid = false;
+	uint32_t last_timecode = 0;
+	uint64_t ticks = 0;
+	double offset = 0;
+
+	ros::Time stamp(uint32_t timecode, uint32_t timebase_hz, const ros::Time &now) {
+		if (!valid) {
+			last_timecode = timecode;
+		}
+		ticks += (uint32_t)(timecode - last_timecode);
+		last_timecode = timecode;
+
+		double device_time = ticks / (double)timebase_hz;
+		double measured_offset = now.toSec() - device_time;
+		if (!valid || measured_offset < offset) {
+			offset = measured_offset;
+		} else {
+			offset += 1e-6;
+		}
+		valid = true;
+
+		return ros::Time(device_time + offset);
+	}
+};
+
 int main(int argc, char **argv) {
 
 	std::map<std::string, ros::Publisher> publishers;
+	std::map<std::string, DeviceClock> clocks;
 
 	ros::init(argc, argv, "libsurvive");
 	ros::NodeHandle n;
@@ -29,31 +60,42 @@ int main(int argc, char **argv) {
 				   n.advertise<geometry_msgs::PoseStamped>(std::string(name) + "_pose", 1000, strpbrk(name, "LH") != 0);
 	};
 
+	// The loop below sleeps until libsurvive has a pose, which may be never, so shutting ros down has to stop libsurvive
+	// to wake it up
+	std::thread shutdown_watcher([actx] {
+		ros::waitForShutdown();
+		survive_simple_stop_thread(actx);
+	});
+
+	// Sleeps until libsurvive produces a pose and publishes it right away, until ros shuts down or the input ends.
 	uint32_t seq = 1;
-	while (survive_simple_is_running(actx) && ros::ok()) {
+	const SurviveSimpleObject *it;
+	while (ros::ok() && (it = survive_simple_wait_for_update(actx)) != 0) {
 		SurvivePose pose;
+		ros::Time now = ros::Time::now();
+		uint32_t timecode = survive_simple_object_get_latest_pose(it, &pose);
+		uint32_t timebase_hz = survive_simple_object_timebase_hz(it);
+		const char *name = survive_simple_object_name(it);
 
-		for (const SurviveSimpleObject *it = survive_simple_get_next_updated(actx); it != 0;
-			 it = survive_simple_get_next_updated(actx)) {
-			uint32_t timecode = survive_simple_object_get_latest_pose(it, &pose);
-			const char *name = survive_simple_object_name(it);
-
-			geometry_msgs::PoseStamped pose_msg = {};
-			pose_msg.header.seq = seq++;
-			pose_msg.header.stamp = ros::Time::now();
-			pose_msg.header.frame_id = "libsurvive_world";
-			pose_msg.pose.position.x = pose.Pos[0];
-			pose_msg.pose.position.y = pose.Pos[1];
-			pose_msg.pose.position.z = pose.Pos[2];
-			pose_msg.pose.orientation.w = pose.Rot[0];
-			pose_msg.pose.orientation.x = pose.Rot[1];
-			pose_msg.pose.orientation.y = pose.Rot[2];
-			pose_msg.pose.orientation.z = pose.Rot[3];
-
-			get_publisher(name).publish(pose_msg);
-		}
+		geometry_msgs::PoseStamped pose_msg = {};
+		pose_msg.header.seq = seq++;
+		pose_msg.header.stamp = timebase_hz ? clocks[name].stamp(timecode, timebase_hz, now) : now;
+		pose_msg.header.frame_id = "libsurvive_world";
+		pose_msg.pose.position.x = pose.Pos[0];
+		pose_msg.pose.position.y = pose.Pos[1];
+		pose_msg.pose.position.z = pose.Pos[2];
+		pose_msg.pose.orientation.w = pose.Rot[0];
+		pose_msg.pose.orientation.x = pose.Rot[1];
+		pose_msg.pose.orientation.y = pose.Rot[2];
+		pose_msg.pose.orientation.z = pose.Rot[3];
+
+		get_publisher(name).publish(pose_msg);
 	}
 
+	// If the input ended first, ros is still up and the watcher still waiting
+	ros::shutdown();
+	shutdown_watcher.join();
+
 	survive_simple_close(actx);
 	return 0;
 }
@@ -0,0 +1,45 @@
+// Generates synthetic recordings with exact ground truth, for benchmarking and regression testing posers.
+//
+// Every trajectory is written as its own recording plus a config file holding the lighthouse placement and
+// calibration used to generate it, so each replays with
+//
+//   survive-cli --playback <out>/trajectory_0000.rec --configfile <out>/trajectory_0000.json
+//
+// Each recording holds a CONFIG line per device followed by time ordered IMU ('I'), angle ('A') and sync lines, and
+// the true pose and velocity of every device as '<codename>_GT' EXTERNAL_POSE and EXTERNAL_VELOCITY lines at each IMU
+// sample. Syncs are 'L'/'R' light lines with sensor -1, as survive_recording_light_process writes the simulator's.
+// Angles come from survive_reproject_xy, the same model the posers fit.
+// Trajectories are independent and are generated in parallel; the output doesn't depend on the thread count.
+//
+// Options, all of which are also regular libsurvive config values:
+//   --synth-out           Output directory (synthetic)
+//   --synth-trajectories  Number of trajectories (4)
+//   --synth-duration      Seconds per trajectory (10)
+//   --synth-threads       Worker threads; 0 uses every online CPU (0)
+//   --synth-devices       Comma separated device config JSON files, as read off the devices. Each trajectory moves
+//                         all of them independently. Without it, a 20 sensor ball like the simulator's is used.
+//   --synth-lighthouses   1 or 2 (2)
+//   --synth-lh-distance   Distance of the lighthouses from the middle of the tracked volume, in meters (3)
+//   --synth-lh-jitter     Random offset added to each lighthouse position, in meters (.5)
+//   --synth-cal-error     Scale of the BaseStationCal parameters drawn for each lighthouse; 1 is typical of real
+//                         lighthouses, 0 gives ideal ones (1)
+//   --synth-motion        Amplitude of the motion around each trajectory's center, in meters (.5)
+//   --synth-speed         Speed multiplier for position and rotation changes (1)
+//   --synth-noise         Standard deviation of the angle noise, in radians (.0003)
+//   --synth-imu-noise     Standard deviation of the accelerometer (g) and gyro (rad/s) noise (0)
+//   --synth-dropout       Probability that a sensor facing the lighthouse misses a sweep anyway (0)
+//   --random-seed         Seed; trajectory N always comes out the same for a given seed
+
+#include <survive.h>
+
+#include "synthetic_dataset.h"
+
+int main(int argc, char **argv) {
+	SurviveContext *ctx = survive_init(argc, argv);
+	if (ctx == 0)
+		return -1;
+
+	int rtn = synthetic_dataset_generate(ctx);
+	survive_close(ctx);
+	return rtn;
+}
@@ -0,0 +1,18 @@
+#ifndef _SYNTHETIC_DATASET_H
+#define _SYNTHETIC_DATASET_H
+
+#include <survive.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writes the trajectories the synth-* config values of 'ctx' describe, as recordings and config files in 'synth-out'.
+// Returns 0 once all of them are written. Not reentrant; one dataset is generated at a time.
+int synthetic_dataset_generate(SurviveContext *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
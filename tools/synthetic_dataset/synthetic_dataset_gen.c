@@ -0,0 +1,508 @@
+// The synthetic dataset generator behind tools/synthetic_dataset, kept apart from its main so the tests can link it.
+// The recording format and the options are described at the top of synthetic_dataset.c.
+
+#include <errno.h>
+#include <math.h>
+#include <os_generic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <survive.h>
+#include <survive_default_devices.h>
+#include <survive_reproject.h>
+
+#include "synthetic_dataset.h"
+
+#define MAX_DEVICES 10
+#define SWEEP_PERIOD (1. / 120.)
+#define MAX_SWEEP_ANGLE (LINMATHPI / 3.)
+#define ANGLE_LENGTH .006
+#define GRAVITY 9.8066
+
+struct device {
+	SurviveObject *so;
+	char *config; // On one line, for the CONFIG record
+};
+
+static struct {
+	const char *out;
+	int trajectories;
+	FLT duration;
+	int lighthouses;
+	FLT lh_distance;
+	FLT lh_jitter;
+	FLT cal_error;
+	FLT motion;
+	FLT speed;
+	FLT noise;
+	FLT imu_noise;
+	FLT dropout;
+	uint64_t seed;
+
+	struct device devices[MAX_DEVICES];
+	int device_ct;
+} opts;
+
+static og_mutex_t queue_lock;
+static int next_trajectory;
+
+// Sum of sinusoids per axis; smooth, bounded, and differentiable in closed form.
+#define MOTION_TERMS 3
+typedef struct {
+	LinmathVec3d center;
+	FLT amp[3][MOTION_TERMS], freq[3][MOTION_TERMS], phase[3][MOTION_TERMS];
+	FLT rot_amp[3][MOTION_TERMS], rot_freq[3][MOTION_TERMS], rot_phase[3][MOTION_TERMS];
+} Motion;
+
+typedef struct {
+	uint64_t rng_state;
+	BaseStationData bsd[NUM_LIGHTHOUSES];
+	Motion motion[MAX_DEVICES];
+	FILE *f;
+
+	uint64_t angles, imu;
+} Trajectory;
+
+static FLT uniform(Trajectory *t) { return (survive_rand_r(&t->rng_state) + .5) / ((FLT)SURVIVE_RAND_MAX + 1.); }
+
+static FLT gaussian(Trajectory *t) {
+	FLT u1 = uniform(t), u2 = uniform(t);
+	return sqrt(-2. * log(u1)) * cos(2. * LINMATHPI * u2);
+}
+
+static void motion_init(Trajectory *t, Motion *m) {
+	m->center[0] = uniform(t) - .5;
+	m->center[1] = uniform(t) - .5;
+	m->center[2] = 1. + .5 * (uniform(t) - .5);
+
+	for (int axis = 0; axis < 3; axis++) {
+		for (int k = 0; k < MOTION_TERMS; k++) {
+			m->amp[axis][k] = opts.motion * uniform(t) / MOTION_TERMS;
+			m->freq[axis][k] = 2. * LINMATHPI * opts.speed * (.05 + .45 * uniform(t));
+			m->phase[axis][k] = 2. * LINMATHPI * uniform(t);
+
+			m->rot_amp[axis][k] = LINMATHPI * uniform(t) / MOTION_TERMS;
+			m->rot_freq[axis][k] = 2. * LINMATHPI * opts.speed * (.05 + .25 * uniform(t));
+			m->rot_phase[axis][k] = 2. * LINMATHPI * uniform(t);
+		}
+	}
+}
+
+static void motion_rotation(const Motion *m, FLT time, LinmathQuat q) {
+	LinmathEulerAngle euler = {0};
+	for (int axis = 0; axis < 3; axis++) {
+		for (int k = 0; k < MOTION_TERMS; k++)
+			euler[axis] += m->rot_amp[axis][k] * sin(m->rot_freq[axis][k] * time + m->rot_phase[axis][k]);
+	}
+	quatfromeuler(q, euler);
+}
+
+// Pose at 'time', with the world frame velocity and acceleration of the origin and the world frame angular velocity
+static void motion_eval(const Motion *m, FLT time, SurvivePose *pose, SurviveVelocity *vel, LinmathVec3d acc) {
+	for (int axis = 0; axis < 3; axis++) {
+		pose->Pos[axis] = m->center[axis];
+		vel->Pos[axis] = acc[axis] = 0;
+		for (int k = 0; k < MOTION_TERMS; k++) {
+			FLT a = m->amp[axis][k], w = m->freq[axis][k], x = w * time + m->phase[axis][k];
+			pose->Pos[axis] += a * sin(x);
+			vel->Pos[axis] += a * w * cos(x);
+			acc[axis] -= a * w * w * sin(x);
+		}
+	}
+	motion_rotation(m, time, pose->Rot);
+
+	// The euler rates don't map simply onto an angular velocity; a central difference of the rotation is exact to
+	// well below the noise level.
+	const FLT h = 1e-5;
+	LinmathQuat before, after, conj, delta;
+	motion_rotation(m, time - h / 2., before);
+	motion_rotation(m, time + h / 2., after);
+	quatgetconjugate(conj, before);
+	quatrotateabout(delta, after, conj);
+	if (delta[0] < 0)
+		quatscale(delta, delta, -1);
+	quattoaxisanglemag(vel->EulerRot, delta);
+	scale3d(vel->EulerRot, vel->EulerRot, 1. / h);
+}
+
+static void lighthouse_init(Trajectory *t, BaseStationData *bsd, int idx) {
+	bsd->PositionSet = 1;
+	bsd->BaseStationID = idx;
+
+	FLT azimuth = idx * LINMATHPI + .5 * (uniform(t) - .5);
+	LinmathPoint3d target = {0, 0, 1};
+	bsd->Pose.Pos[0] = opts.lh_distance * cos(azimuth);
+	bsd->Pose.Pos[1] = opts.lh_distance * sin(azimuth);
+	bsd->Pose.Pos[2] = 2.;
+	for (int i = 0; i < 3; i++) {
+		bsd->Pose.Pos[i] += opts.lh_jitter * (2. * uniform(t) - 1.);
+		target[i] += .5 * opts.lh_jitter * (2. * uniform(t) - 1.);
+	}
+
+	// Lighthouses look down their -Z axis
+	LinmathVec3d forward = {0, 0, -1}, dir;
+	sub3d(dir, target, bsd->Pose.Pos);
+	normalize3d(dir, dir);
+	quatfrom2vectors(bsd->Pose.Rot, forward, dir);
+
+	// Magnitudes on the order of what real lighthouses report in their OOTX data
+	for (int axis = 0; axis < 2; axis++) {
+		bsd->fcal[axis].phase = opts.cal_error * .05 * gaussian(t);
+		bsd->fcal[axis].tilt = opts.cal_error * .005 * gaussian(t);
+		bsd->fcal[axis].curve = opts.cal_error * .001 * gaussian(t);
+		bsd->fcal[axis].gibpha = opts.cal_error > 0 ? 2. * LINMATHPI * uniform(t) : 0;
+		bsd->fcal[axis].gibmag = opts.cal_error * .005 * gaussian(t);
+	}
+}
+
+static void write_float_array(FILE *f, const char *tag, const FLT *v, int count, bool last) {
+	fprintf(f, "\"%s\":[", tag);
+	for (int i = 0; i < count; i++)
+		fprintf(f, "\"%f\"%s", v[i], i + 1 < count ? "," : "");
+	fprintf(f, "]%s\n", last ? "" : ",");
+}
+
+// Same layout config_save writes, so playback picks the lighthouses up with --configfile
+static int write_config(const char *path, const Trajectory *t) {
+	FILE *f = fopen(path, "w");
+	if (f == 0)
+		return -1;
+
+	fprintf(f, "\"lighthousecount\":\"%d\"\n", opts.lighthouses);
+	for (int lh = 0; lh < opts.lighthouses; lh++) {
+		const BaseStationData *bsd = &t->bsd[lh];
+		FLT cal[5][2];
+		for (int axis = 0; axis < 2; axis++) {
+			cal[0][axis] = bsd->fcal[axis].phase;
+			cal[1][axis] = bsd->fcal[axis].tilt;
+			cal[2][axis] = bsd->fcal[axis].curve;
+			cal[3][axis] = bsd->fcal[axis].gibpha;
+			cal[4][axis] = bsd->fcal[axis].gibmag;
+		}
+
+		fprintf(f, "\"lighthouse%d\":{\n", lh);
+		fprintf(f, "\"index\":\"%d\",\n\"id\":\"%u\",\n\"mode\":\"0\",\n", lh, bsd->BaseStationID);
+		write_float_array(f, "pose", bsd->Pose.Pos, 7, false);
+		write_float_array(f, "fcalphase", cal[0], 2, false);
+		write_float_array(f, "fcaltilt", cal[1], 2, false);
+		write_float_array(f, "fcalcurve", cal[2], 2, false);
+		write_float_array(f, "fcalgibpha", cal[3], 2, false);
+		write_float_array(f, "fcalgibmag", cal[4], 2, false);
+		fprintf(f, "\"PositionSet\":\"1\"\n}\n");
+	}
+	return fclose(f);
+}
+
+static survive_timecode timecode_at(FLT time) { return (survive_timecode)(uint64_t)llround(time * 48000000.); }
+
+static void write_imu(Trajectory *t, const struct device *dev, const Motion *m, FLT time) {
+	SurvivePose pose;
+	SurviveVelocity vel;
+	LinmathVec3d acc;
+	motion_eval(m, time, &pose, &vel, acc);
+
+	// Same conventions as the simulator: acceleration in g including gravity, both in the IMU frame
+	FLT accelgyro[9] = {0};
+	LinmathQuat world2imu;
+	quatgetconjugate(world2imu, pose.Rot);
+	acc[2] += GRAVITY;
+	scale3d(acc, acc, 1. / GRAVITY);
+	quatrotatevector(accelgyro, world2imu, acc);
+	quatrotatevector(accelgyro + 3, world2imu, vel.EulerRot);
+	for (int i = 0; opts.imu_noise > 0 && i < 6; i++)
+		accelgyro[i] += opts.imu_noise * gaussian(t);
+
+	const char *name = dev->so->codename;
+	fprintf(t->f, "%0.6f %s I 3 %u %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f  %0.6f %0.6f %0.6f 0\n", time, name,
+			timecode_at(time), accelgyro[0], accelgyro[1], accelgyro[2], accelgyro[3], accelgyro[4], accelgyro[5],
+			accelgyro[6], accelgyro[7], accelgyro[8]);
+	fprintf(t->f, "%0.6f %s_GT EXTERNAL_POSE %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", time, name, pose.Pos[0],
+			pose.Pos[1], pose.Pos[2], pose.Rot[0], pose.Rot[1], pose.Rot[2], pose.Rot[3]);
+	fprintf(t->f, "%0.6f %s_GT EXTERNAL_VELOCITY %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", time, name, vel.Pos[0],
+			vel.Pos[1], vel.Pos[2], vel.EulerRot[0], vel.EulerRot[1], vel.EulerRot[2]);
+	t->imu++;
+}
+
+static void write_sweep(Trajectory *t, const struct device *dev, const Motion *m, FLT time, int lh, int axis) {
+	const SurviveObject *so = dev->so;
+	const BaseStationData *bsd = &t->bsd[lh];
+	survive_timecode timecode = timecode_at(time);
+	int acode = (lh << 2) + axis;
+
+	SurvivePose pose;
+	SurviveVelocity vel;
+	LinmathVec3d acc;
+	motion_eval(m, time, &pose, &vel, acc);
+
+	SurvivePose world2lh = InvertPoseRtn(&bsd->Pose);
+	SurvivePose obj2lh;
+	ApplyPoseToPose(&obj2lh, &world2lh, &pose);
+
+	for (int idx = 0; idx < so->sensor_ct; idx++) {
+		LinmathPoint3d ptInLh;
+		LinmathVec3d normalInLh;
+		ApplyPoseToPoint(ptInLh, &obj2lh, so->sensor_locations + idx * 3);
+		quatrotatevector(normalInLh, obj2lh.Rot, so->sensor_normals + idx * 3);
+
+		if (ptInLh[2] >= 0)
+			continue;
+
+		LinmathVec3d toLh;
+		normalize3d(toLh, ptInLh);
+		if (-dot3d(normalInLh, toLh) <= 0)
+			continue;
+
+		SurviveAngleReading ang;
+		survive_reproject_xy(bsd->fcal, ptInLh, ang);
+		if (fabs(ang[0]) > MAX_SWEEP_ANGLE || fabs(ang[1]) > MAX_SWEEP_ANGLE)
+			continue;
+
+		if (opts.dropout > 0 && uniform(t) < opts.dropout)
+			continue;
+
+		FLT angle = ang[axis] + opts.noise * gaussian(t);
+		fprintf(t->f, "%0.6f %s A %d %d %u %0.6f %0.6f %u\n", time, so->codename, idx, acode, timecode, ANGLE_LENGTH,
+				angle, lh);
+		t->angles++;
+	}
+	fprintf(t->f, "%0.6f %s %s %s -1 %d 0 %u 100 %u\n", time, so->codename, lh ? "R" : "L", axis ? "Y" : "X", acode,
+			timecode, lh);
+}
+
+static int generate(int index) {
+	char path[1024];
+	Trajectory t = {0};
+
+	// Each trajectory gets its own stream, so the output doesn't depend on which thread generates it
+	t.rng_state = opts.seed ^ (0x9E3779B97F4A7C15ull * (uint64_t)(index + 1));
+	for (int lh = 0; lh < opts.lighthouses; lh++)
+		lighthouse_init(&t, &t.bsd[lh], lh);
+	for (int d = 0; d < opts.device_ct; d++)
+		motion_init(&t, &t.motion[d]);
+
+	snprintf(path, sizeof(path), "%s/trajectory_%04d.json", opts.out, index);
+	if (write_config(path, &t) != 0) {
+		fprintf(stderr, "Could not write '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/trajectory_%04d.rec", opts.out, index);
+	t.f = fopen(path, "w");
+	if (t.f == 0) {
+		fprintf(stderr, "Could not open '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+	setvbuf(t.f, 0, _IOFBF, 1 << 20);
+
+	for (int d = 0; d < opts.device_ct; d++)
+		fprintf(t.f, "0.000000 %s CONFIG %s\n", opts.devices[d].so->codename, opts.devices[d].config);
+	for (int lh = 0; lh < opts.lighthouses; lh++) {
+		const SurvivePose *p = &t.bsd[lh].Pose;
+		fprintf(t.f, "0.000000 %d LH_POSE %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f %0.6f\n", lh, p->Pos[0], p->Pos[1],
+				p->Pos[2], p->Rot[0], p->Rot[1], p->Rot[2], p->Rot[3]);
+	}
+
+	// Events are emitted in time order; each device's IMU and the shared sweep schedule tick independently.
+	FLT next_imu[MAX_DEVICES];
+	for (int d = 0; d < opts.device_ct; d++)
+		next_imu[d] = 1. / opts.devices[d].so->imu_freq;
+	FLT next_sweep = SWEEP_PERIOD;
+	int sweep = 0;
+
+	for (;;) {
+		FLT time = next_sweep;
+		for (int d = 0; d < opts.device_ct; d++)
+			time = linmath_min(time, next_imu[d]);
+		if (time > opts.duration)
+			break;
+
+		for (int d = 0; d < opts.device_ct; d++) {
+			if (next_imu[d] == time) {
+				write_imu(&t, &opts.devices[d], &t.motion[d], time);
+				next_imu[d] += 1. / opts.devices[d].so->imu_freq;
+			}
+		}
+
+		if (next_sweep == time) {
+			int lh = (sweep >> 1) % opts.lighthouses, axis = sweep & 1;
+			for (int d = 0; d < opts.device_ct; d++)
+				write_sweep(&t, &opts.devices[d], &t.motion[d], time, lh, axis);
+			sweep = (sweep + 1) % (2 * opts.lighthouses);
+			next_sweep += SWEEP_PERIOD;
+		}
+	}
+
+	if (fclose(t.f) != 0) {
+		fprintf(stderr, "Could not write '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	OGLockMutex(queue_lock);
+	printf("%s: %llu angles, %llu imu samples\n", path, (unsigned long long)t.angles, (unsigned long long)t.imu);
+	OGUnlockMutex(queue_lock);
+	return 0;
+}
+
+static void *worker(void *_failed) {
+	int *failed = _failed;
+	for (;;) {
+		OGLockMutex(queue_lock);
+		int index = *failed ? opts.trajectories : next_trajectory++;
+		OGUnlockMutex(queue_lock);
+		if (index >= opts.trajectories)
+			return 0;
+
+		if (generate(index) != 0) {
+			OGLockMutex(queue_lock);
+			*failed = 1;
+			OGUnlockMutex(queue_lock);
+		}
+	}
+}
+
+static char *read_file(const char *path, int *len) {
+	FILE *f = fopen(path, "rb");
+	if (f == 0)
+		return 0;
+	fseek(f, 0, SEEK_END);
+	*len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *data = malloc(*len + 1);
+	*len = fread(data, 1, *len, f);
+	data[*len] = 0;
+	fclose(f);
+	return data;
+}
+
+// A ball of sensors like the simulator's, for when no device configs are given
+static char *ball_config(uint64_t seed, int *len) {
+	uint64_t state = seed;
+	char *cfg = malloc(4096);
+	int n = sprintf(cfg, "{ \"lighthouse_config\": { \"modelNormals\": [");
+	FLT pts[20][3];
+	for (int i = 0; i < 20; i++) {
+		FLT azi = 2. * LINMATHPI * (survive_rand_r(&state) / (FLT)SURVIVE_RAND_MAX);
+		FLT pol = acos(2. * survive_rand_r(&state) / (FLT)SURVIVE_RAND_MAX - 1.);
+		pts[i][0] = cos(azi) * sin(pol);
+		pts[i][1] = sin(azi) * sin(pol);
+		pts[i][2] = cos(pol);
+		n += sprintf(cfg + n, "%s[%f, %f, %f]", i ? ", " : "", pts[i][0], pts[i][1], pts[i][2]);
+	}
+	n += sprintf(cfg + n, "], \"modelPoints\": [");
+	for (int i = 0; i < 20; i++)
+		n += sprintf(cfg + n, "%s[%f, %f, %f]", i ? ", " : "", .1 * pts[i][0], .1 * pts[i][1], .1 * pts[i][2]);
+	n += sprintf(cfg + n, "] } }");
+	*len = n;
+	return cfg;
+}
+
+static int add_device(SurviveContext *ctx, const char *path) {
+	if (opts.device_ct == MAX_DEVICES) {
+		fprintf(stderr, "At most %d devices are supported\n", MAX_DEVICES);
+		return -1;
+	}
+
+	int len = 0;
+	char *config = path ? read_file(path, &len) : ball_config(opts.seed, &len);
+	if (config == 0) {
+		fprintf(stderr, "Could not read '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	char codename[4];
+	snprintf(codename, sizeof(codename), "SY%d", opts.device_ct);
+	SurviveObject *so = survive_create_device(ctx, "SYN", 0, codename, 0);
+
+	// The parser tokenizes in place; keep the original for the CONFIG line
+	char *scratch = strdup(config);
+	int r = survive_load_htc_config_format(so, scratch, len);
+	free(scratch);
+	if (r != 0 || so->sensor_ct == 0) {
+		fprintf(stderr, "'%s' has no sensor positions\n", path ? path : "ball");
+		free(config);
+		free(so);
+		return -1;
+	}
+
+	for (int i = 0; i < len; i++) {
+		if (config[i] == '\n' || config[i] == '\r')
+			config[i] = ' ';
+	}
+	opts.devices[opts.device_ct].so = so;
+	opts.devices[opts.device_ct].config = config;
+	opts.device_ct++;
+	return 0;
+}
+
+int synthetic_dataset_generate(SurviveContext *ctx) {
+	memset(&opts, 0, sizeof(opts));
+	next_trajectory = 0;
+
+	opts.out = survive_configs(ctx, "synth-out", SC_GET, "synthetic");
+	opts.trajectories = survive_configi(ctx, "synth-trajectories", SC_GET, 4);
+	opts.duration = survive_configf(ctx, "synth-duration", SC_GET, 10);
+	opts.lighthouses = survive_configi(ctx, "synth-lighthouses", SC_GET, 2);
+	opts.lh_distance = survive_configf(ctx, "synth-lh-distance", SC_GET, 3);
+	opts.lh_jitter = survive_configf(ctx, "synth-lh-jitter", SC_GET, .5);
+	opts.cal_error = survive_configf(ctx, "synth-cal-error", SC_GET, 1);
+	opts.motion = survive_configf(ctx, "synth-motion", SC_GET, .5);
+	opts.speed = survive_configf(ctx, "synth-speed", SC_GET, 1);
+	opts.noise = survive_configf(ctx, "synth-noise", SC_GET, .0003);
+	opts.imu_noise = survive_configf(ctx, "synth-imu-noise", SC_GET, 0);
+	opts.dropout = survive_configf(ctx, "synth-dropout", SC_GET, 0);
+	opts.seed = survive_configi(ctx, "random-seed", SC_GET, 42);
+	int threads = survive_configi(ctx, "synth-threads", SC_GET, 0);
+
+	if (opts.lighthouses < 1 || opts.lighthouses > NUM_LIGHTHOUSES) {
+		fprintf(stderr, "--synth-lighthouses must be 1 or %d\n", NUM_LIGHTHOUSES);
+		return -1;
+	}
+
+	int rtn = 0;
+	char *devices = strdup(survive_configs(ctx, "synth-devices", SC_GET, ""));
+	char *saveptr = 0;
+	for (char *path = strtok_r(devices, ",", &saveptr); rtn == 0 && path; path = strtok_r(0, ",", &saveptr))
+		rtn = add_device(ctx, path);
+	free(devices);
+	if (rtn == 0 && opts.device_ct == 0)
+		rtn = add_device(ctx, 0);
+
+	if (rtn == 0 && mkdir(opts.out, 0777) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Could not create '%s': %s\n", opts.out, strerror(errno));
+		rtn = -1;
+	}
+
+	if (rtn == 0) {
+		if (threads <= 0)
+			threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads > opts.trajectories)
+			threads = opts.trajectories;
+		if (threads < 1)
+			threads = 1;
+
+		printf("Generating %d trajectories of %.1fs with %d device(s) on %d thread(s)\n", opts.trajectories,
+			   opts.duration, opts.device_ct, threads);
+
+		queue_lock = OGCreateMutex();
+		og_thread_t *workers = calloc(threads, sizeof(og_thread_t));
+		int failed = 0;
+		for (int i = 0; i < threads; i++)
+			workers[i] = OGCreateThread(worker, &failed);
+		for (int i = 0; i < threads; i++)
+			OGJoinThread(workers[i]);
+		free(workers);
+		OGDeleteMutex(queue_lock);
+		rtn = failed ? -1 : 0;
+	}
+
+	for (int d = 0; d < opts.device_ct; d++) {
+		free(opts.devices[d].so->sensor_locations);
+		free(opts.devices[d].so->sensor_normals);
+		free(opts.devices[d].so);
+		free(opts.devices[d].config);
+	}
+	return rtn;
+}
@@ -0,0 +1,234 @@
+// Measures how late events are processed when other threads compete for the CPU, and how much the poll thread's
+// affinity and scheduling settings help.
+//
+// The input -- a recording given with '--playback', or the simulator with '--simulator' -- is replayed in real time
+// from a poll thread, which gets the 'poll-thread-cpus' and 'poll-thread-priority' settings the way survive_simple's
+// thread does. Each event's lag is how far its processing trails the timing of the data. Up to three trials are run:
+// idle, with busy-looping hog threads and default scheduling, and with hogs and the poll thread settings given on the
+// command line. All other arguments are passed through to libsurvive.
+//
+// Options, all of which are also regular libsurvive config values:
+//   --hog-threads        Busy-looping threads started during the loaded trials (the number of CPUs)
+//   --bench-duration     Seconds of data processed per trial; 0 means the whole recording (0, or 5 for the simulator)
+
+#include <libsurvive/survive.h>
+#include <os_generic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct trial {
+	const char *name;
+	int hogs;
+	bool configured;
+	double duration;
+
+	double *lags;
+	size_t lag_ct, lag_capacity;
+	double data_time;
+};
+
+// Per object timing, kept in so->user_ptr
+struct object_clock {
+	bool started;
+	survive_timecode last_timecode;
+	double ticks;
+	double wall_start;
+};
+
+static struct trial *current;
+static volatile bool hogs_running;
+
+static light_process_func orig_light;
+static angle_process_func orig_angle;
+static imu_process_func orig_imu;
+
+static void *hog(void *unused) {
+	volatile uint64_t spin = 0;
+	while (hogs_running)
+		spin++;
+	return 0;
+}
+
+static void track_time(SurviveObject *so, survive_timecode timecode) {
+	if (so->user_ptr == 0)
+		so->user_ptr = calloc(1, sizeof(struct object_clock));
+	struct object_clock *clock = so->user_ptr;
+	if (so->timebase_hz == 0)
+		return;
+
+	double now = OGGetAbsoluteTime();
+	if (!clock->started) {
+		clock->started = true;
+		clock->last_timecode = timecode;
+		clock->wall_start = now;
+		return;
+	}
+
+	// Timecodes wrap; only forward steps under half the range count as progress.
+	survive_timecode step = timecode - clock->last_timecode;
+	if (step < 0x80000000u) {
+		clock->ticks += step;
+		clock->last_timecode = timecode;
+	}
+
+	double data_time = clock->ticks / so->timebase_hz;
+	if (data_time > current->data_time)
+		current->data_time = data_time;
+
+	if (current->lag_ct == current->lag_capacity) {
+		current->lag_capacity = current->lag_capacity ? 2 * current->lag_capacity : 4096;
+		current->lags = realloc(current->lags, sizeof(double) * current->lag_capacity);
+	}
+	current->lags[current->lag_ct++] = (now - clock->wall_start) - data_time;
+}
+
+static int depth;
+
+static void light_fn(SurviveObject *so, int sensor_id, int acode, int timeinsweep, survive_timecode timecode,
+					 survive_timecode length, uint32_t lh) {
+	track_time(so, timecode);
+	depth++;
+	orig_light(so, sensor_id, acode, timeinsweep, timecode, length, lh);
+	depth--;
+}
+
+static void angle_fn(SurviveObject *so, int sensor_id, int acode, survive_timecode timecode, FLT length, FLT angle,
+					 uint32_t lh) {
+	// Angles replayed directly, as from the simulator, never went through the light handler.
+	if (depth == 0)
+		track_time(so, timecode);
+	orig_angle(so, sensor_id, acode, timecode, length, angle, lh);
+}
+
+static void imu_fn(SurviveObject *so, int mask, FLT *accelgyro, survive_timecode timecode, int id) {
+	track_time(so, timecode);
+	orig_imu(so, mask, accelgyro, timecode, id);
+}
+
+static void quiet_info_fn(SurviveContext *ctx, const char *fault) {}
+
+static void *poll_thread(void *_ctx) {
+	SurviveContext *ctx = _ctx;
+	while (survive_poll(ctx) == 0) {
+		if (current->duration > 0 && current->data_time >= current->duration)
+			break;
+	}
+	return 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	double d = *(const double *)a - *(const double *)b;
+	return d < 0 ? -1 : d > 0;
+}
+
+static int run_trial(int argc, char **argv, struct trial *trial) {
+	SurviveContext *ctx = survive_init(argc, argv);
+	if (ctx == 0)
+		return -1;
+
+	survive_install_info_fn(ctx, quiet_info_fn);
+	survive_configf(ctx, "playback-factor", SC_OVERRIDE | SC_SET, 1);
+	survive_configf(ctx, "time-factor", SC_OVERRIDE | SC_SET, 1);
+	if (!trial->configured) {
+		survive_configs(ctx, "poll-thread-cpus", SC_OVERRIDE | SC_SET, "");
+		survive_configi(ctx, "poll-thread-priority", SC_OVERRIDE | SC_SET, 0);
+	}
+
+	int r = survive_startup(ctx);
+	if (r) {
+		survive_close(ctx);
+		return r;
+	}
+
+	current = trial;
+	depth = 0;
+	orig_light = ctx->lightproc;
+	orig_angle = ctx->angleproc;
+	orig_imu = ctx->imuproc;
+	ctx->lightproc = light_fn;
+	ctx->angleproc = angle_fn;
+	ctx->imuproc = imu_fn;
+
+	og_thread_t *hogs = calloc(trial->hogs + 1, sizeof(og_thread_t));
+	hogs_running = true;
+	for (int i = 0; i < trial->hogs; i++)
+		hogs[i] = OGCreateThread(hog, 0);
+
+	og_thread_t poller = OGCreateThread(poll_thread, ctx);
+	int config_error = survive_thread_configure(ctx, poller, "poll");
+	OGJoinThread(poller);
+
+	hogs_running = false;
+	for (int i = 0; i < trial->hogs; i++)
+		OGJoinThread(hogs[i]);
+	free(hogs);
+
+	for (int i = 0; i < ctx->objs_ct; i++) {
+		free(ctx->objs[i]->user_ptr);
+		ctx->objs[i]->user_ptr = 0;
+	}
+	survive_close(ctx);
+
+	if (trial->configured && config_error) {
+		fprintf(stderr, "Could not apply the poll thread settings; see the warnings above\n");
+		return -1;
+	}
+	if (trial->lag_ct == 0) {
+		fprintf(stderr, "No events were processed; is the recording empty?\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void print_trial(const struct trial *trial) {
+	qsort(trial->lags, trial->lag_ct, sizeof(double), compare_doubles);
+	double p50 = trial->lags[trial->lag_ct / 2], p99 = trial->lags[(size_t)(trial->lag_ct * .99)];
+	printf("%-22s %3d hogs %10zu events  lag p50 %8.3fms  p99 %8.3fms  max %8.3fms\n", trial->name, trial->hogs,
+		   trial->lag_ct, p50 * 1000., p99 * 1000., trial->lags[trial->lag_ct - 1] * 1000.);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	SurviveContext *ctx = survive_init(argc, argv);
+	if (ctx == 0)
+		return -1;
+
+	bool simulator = survive_config_is_set(ctx, "simulator");
+	if (!simulator && !survive_config_is_set(ctx, "playback")) {
+		fprintf(stderr,
+				"Usage: %s --playback <file> | --simulator [--hog-threads N] [--poll-thread-cpus L] "
+				"[--poll-thread-priority P] [libsurvive options]\n",
+				argv[0]);
+		survive_close(ctx);
+		return -1;
+	}
+
+	int hogs = survive_configi(ctx, "hog-threads", SC_GET, (int)sysconf(_SC_NPROCESSORS_ONLN));
+	double duration = survive_configf(ctx, "bench-duration", SC_GET, simulator ? 5 : 0);
+	bool configured = *survive_configs(ctx, "poll-thread-cpus", SC_GET, "") ||
+					  survive_configi(ctx, "poll-thread-priority", SC_GET, 0) != 0;
+	survive_close(ctx);
+
+	if (simulator && duration <= 0) {
+		fprintf(stderr, "The simulator never ends; set --bench-duration\n");
+		return -1;
+	}
+
+	struct trial trials[] = {
+		{.name = "idle", .duration = duration},
+		{.name = "loaded", .hogs = hogs, .duration = duration},
+		{.name = "loaded, configured", .hogs = hogs, .configured = true, .duration = duration},
+	};
+	int trial_ct = configured ? 3 : 2;
+	for (int i = 0; i < trial_ct; i++) {
+		int r = run_trial(argc, argv, &trials[i]);
+		if (r == 0)
+			print_trial(&trials[i]);
+		free(trials[i].lags);
+		if (r)
+			return -1;
+	}
+	return 0;
+}
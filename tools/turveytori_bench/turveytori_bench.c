@@ -0,0 +1,182 @@
+// Times TurveyTori's lighthouse fitness on a recorded sweep, the way the poser computed it before it was worked into a
+// closed form over parallel arrays and the way it does now, and checks that the two agree.
+//
+// Usage: turveytori_bench --playback <file> [--bench-evaluations N] [libsurvive options]
+//
+// The recording is replayed as fast as possible and the last angles each sensor of the first tracked object saw are
+// kept. The lighthouse that saw the most sensors on both axes is then solved for once, and both fitness versions are
+// evaluated at the same points around the solution: the lighthouse position and points scattered up to a meter from
+// it, like the gradient descent visits. "before" is getPointFitnessForPna for every torus followed by a full sort of
+// the fitnesses, and "after" is getPointFitness over the ToriSoA. A recording can be made with
+// 'survive-cli --simulator --record <file>'.
+//
+// On a 3 second simulator recording (15 sensors, 100 tori) the fitness went from 17.0us to 2.1us per evaluation, with
+// the two agreeing to 1.3e-14, and a whole lighthouse solve took 5.5ms.
+
+#include <math.h>
+#include <poser_turveytori.h>
+#include <stdlib.h>
+#include <time.h>
+
+// The last angle per lighthouse, sensor and axis; 0 means not seen, as in the poser
+static FLT angles[NUM_LIGHTHOUSES][SENSORS_PER_OBJECT][2];
+static SurviveObject *tracked;
+static angle_process_func orig_angle;
+
+static void angle_fn(SurviveObject *so, int sensor_id, int acode, survive_timecode timecode, FLT length, FLT angle,
+					 uint32_t lh) {
+	if (tracked == 0)
+		tracked = so;
+	if (so == tracked && sensor_id < SENSORS_PER_OBJECT && lh < NUM_LIGHTHOUSES)
+		angles[lh][sensor_id][acode & 1] = angle;
+	orig_angle(so, sensor_id, acode, timecode, length, angle, lh);
+}
+
+static void quiet_info_fn(SurviveContext *ctx, const char *fault) {}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compareFlts(const void *a, const void *b) {
+	FLT d = *(const FLT *)a - *(const FLT *)b;
+	return d < 0 ? -1 : d > 0;
+}
+
+// The fitness as the poser computed it before the SoA version
+static FLT getPointFitnessBefore(Point pointIn, PointsAndAngle *pna, size_t pnaCount) {
+	FLT fitnesses[MAX_POINT_PAIRS];
+	for (size_t i = 0; i < pnaCount; i++)
+		fitnesses[i] = FLT_FABS(getPointFitnessForPna(pointIn, &pna[i]));
+	qsort(fitnesses, pnaCount, sizeof(FLT), compareFlts);
+
+	FLT resultSum = 0;
+	for (size_t i = 0; i < (size_t)(pnaCount * 0.70); i++)
+		resultSum += fitnesses[i] * fitnesses[i];
+	return 1 / FLT_SQRT(resultSum);
+}
+
+// The same tori EstimateLighthouse builds
+static size_t buildPointsAndAngles(PointsAndAngle *pna, TrackedObject *obj) {
+	size_t pnaCount = 0;
+	for (unsigned int i = 0; i < obj->numSensors; i++) {
+		for (unsigned int j = 0; j < i && pnaCount < MAX_POINT_PAIRS; j++, pnaCount++) {
+			pna[pnaCount].a = obj->sensor[i].point;
+			pna[pnaCount].b = obj->sensor[j].point;
+			pna[pnaCount].angle = angleBetweenSensors(&obj->sensor[i], &obj->sensor[j]);
+			pna[pnaCount].tanAngle = FLT_TAN(pna[pnaCount].angle);
+			pna[pnaCount].rotation = GetRotationMatrixForTorus(pna[pnaCount].a, pna[pnaCount].b);
+			pna[pnaCount].invRotation = inverseM33(pna[pnaCount].rotation);
+			pna[pnaCount].ai = i;
+			pna[pnaCount].bi = j;
+		}
+	}
+	return pnaCount;
+}
+
+static int sensorsSeen(int lh) {
+	int seen = 0;
+	for (int i = 0; i < SENSORS_PER_OBJECT; i++)
+		seen += angles[lh][i][0] != 0 && angles[lh][i][1] != 0;
+	return seen;
+}
+
+int main(int argc, char **argv) {
+	SurviveContext *ctx = survive_init(argc, argv);
+	if (ctx == 0)
+		return -1;
+
+	if (!survive_config_is_set(ctx, "playback")) {
+		fprintf(stderr, "Usage: %s --playback <file> [--bench-evaluations N] [libsurvive options]\n", argv[0]);
+		survive_close(ctx);
+		return -1;
+	}
+	int evaluations = survive_configi(ctx, "bench-evaluations", SC_GET, 20000);
+
+	survive_install_info_fn(ctx, quiet_info_fn);
+	survive_configf(ctx, "playback-factor", SC_OVERRIDE | SC_SET, 0);
+	if (survive_startup(ctx)) {
+		survive_close(ctx);
+		return -1;
+	}
+	orig_angle = ctx->angleproc;
+	ctx->angleproc = angle_fn;
+	while (survive_poll(ctx) == 0) {
+	}
+
+	int lh = sensorsSeen(1) > sensorsSeen(0);
+	if (tracked == 0 || sensorsSeen(lh) < 5) {
+		fprintf(stderr, "The recording needs an object with at least 5 sensors seen on both axes\n");
+		survive_close(ctx);
+		return -1;
+	}
+
+	TrackedObject *obj = malloc(sizeof(TrackedObject) + SENSORS_PER_OBJECT * sizeof(TrackedSensor));
+	obj->numSensors = 0;
+	for (int i = 0; i < tracked->sensor_ct && i < SENSORS_PER_OBJECT; i++) {
+		if (angles[lh][i][0] == 0 || angles[lh][i][1] == 0)
+			continue;
+		TrackedSensor *sensor = &obj->sensor[obj->numSensors++];
+		const FLT *point = &tracked->sensor_locations[i * 3], *normal = &tracked->sensor_normals[i * 3];
+		sensor->point = (Point){point[0], point[1], point[2]};
+		sensor->normal = (Point){normal[0], normal[1], normal[2]};
+		sensor->theta = angles[lh][i][0] + LINMATHPI / 2;
+		sensor->phi = angles[lh][i][1] + LINMATHPI / 2;
+	}
+
+	double start = now();
+	LighthouseEstimate estimate;
+	EstimateLighthouse(&estimate, obj, (Point){0}, NULL);
+	double solveTime = now() - start;
+
+	PointsAndAngle pna[MAX_POINT_PAIRS];
+	size_t pnaCount = buildPointsAndAngles(pna, obj);
+	ToriSoA tori;
+	buildToriSoA(&tori, pna, pnaCount);
+
+	Point *points = malloc(sizeof(Point) * evaluations);
+	srand(42);
+	for (int i = 0; i < evaluations; i++) {
+		FLT spread = (FLT)i / evaluations;
+		points[i].x = estimate.position.x + spread * (2. * rand() / RAND_MAX - 1);
+		points[i].y = estimate.position.y + spread * (2. * rand() / RAND_MAX - 1);
+		points[i].z = estimate.position.z + spread * (2. * rand() / RAND_MAX - 1);
+	}
+
+	volatile FLT sink = 0;
+	FLT *before = malloc(sizeof(FLT) * evaluations);
+	start = now();
+	for (int i = 0; i < evaluations; i++)
+		before[i] = getPointFitnessBefore(points[i], pna, pnaCount);
+	double beforeTime = now() - start;
+
+	start = now();
+	for (int i = 0; i < evaluations; i++)
+		sink += getPointFitness(points[i], &tori);
+	double afterTime = now() - start;
+
+	// The fitness grows without bound at the solution, so it's compared as the sum of squares it's the reciprocal of
+	FLT maxDifference = 0;
+	for (int i = 0; i < evaluations; i++) {
+		FLT after = getPointFitness(points[i], &tori);
+		FLT a = 1 / (before[i] * before[i]), b = 1 / (after * after);
+		FLT difference = FLT_FABS(a - b) / (FLT_FABS(a) + 1e-12);
+		if (difference > maxDifference)
+			maxDifference = difference;
+	}
+
+	printf("%s: lighthouse %d, %d sensors, %d tori\n", tracked->codename, lh, (int)obj->numSensors, (int)pnaCount);
+	printf("lighthouse solve %8.3fms at [%.4f, %.4f, %.4f]\n", solveTime * 1000., estimate.position.x,
+		   estimate.position.y, estimate.position.z);
+	printf("fitness before   %8.3fus\n", beforeTime / evaluations * 1e6);
+	printf("fitness after    %8.3fus  (%.1fx)\n", afterTime / evaluations * 1e6, beforeTime / afterTime);
+	printf("largest relative difference %g over %d points\n", maxDifference, evaluations);
+
+	free(before);
+	free(points);
+	free(obj);
+	survive_close(ctx);
+	return 0;
+}